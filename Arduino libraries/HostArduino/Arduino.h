@@ -0,0 +1,378 @@
+/*
+Arduino.h - Emulation of the Arduino core on a Linux host.
+Released into the public domain.
+
+Sketches and the Satellites libraries compile unmodified against this header and run on
+a virtual clock driven by HostArduino (see HostArduino.h). Only the parts of the core used
+by these libraries and common sketches are provided. IntervalTimer follows the Teensy API,
+so libraries can be built with -DTEENSYDUINO to drive their engines from virtual timer
+interrupts. As on Teensy 3.x and 4.x, at most four run at once and begin fails for a fifth.
+
+Types follow the host, e.g. int and unsigned long are 32 and 64 bits on x86-64 Linux.
+*/
+
+#ifndef Arduino_h
+#define Arduino_h
+
+// Lets sketches swap hardware for host stand-ins, e.g. HostBlockDevice for an SD card
+#define HOST_ARDUINO
+
+#include <ctype.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Standard headers that break once min and max are macros
+#include <algorithm>
+#include <queue>
+#include <string>
+#include <vector>
+
+typedef uint8_t byte;
+typedef bool boolean;
+typedef unsigned int word;
+
+// Pins
+#define HIGH			1
+#define LOW				0
+#define INPUT			0
+#define OUTPUT			1
+#define INPUT_PULLUP	2
+#define INPUT_PULLDOWN	3
+
+#define CHANGE			4
+#define FALLING			2
+#define RISING			3
+
+#define NUM_DIGITAL_PINS	64
+#define LED_BUILTIN		13
+#define A0	14
+#define A1	15
+#define A2	16
+#define A3	17
+#define A4	18
+#define A5	19
+#define A6	20
+#define A7	21
+#define A8	22
+#define A9	23
+
+#define digitalPinToInterrupt(p)	((p) < NUM_DIGITAL_PINS ? (p) : -1)
+
+// Printing bases
+#define DEC		10
+#define HEX		16
+#define OCT		8
+#define BIN		2
+
+// Math
+#define PI			3.1415926535897932384626433832795
+#define HALF_PI		1.5707963267948966192313216916398
+#define TWO_PI		6.283185307179586476925286766559
+#define DEG_TO_RAD	0.017453292519943295769236907684886
+#define RAD_TO_DEG	57.295779513082320876798154814105
+
+#ifndef min
+#define min(a, b)	((a) < (b) ? (a) : (b))
+#endif
+#ifndef max
+#define max(a, b)	((a) > (b) ? (a) : (b))
+#endif
+#define constrain(amt, low, high)	((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+#define radians(deg)	((deg) * DEG_TO_RAD)
+#define degrees(rad)	((rad) * RAD_TO_DEG)
+#define sq(x)			((x) * (x))
+
+#define lowByte(w)		((uint8_t)((w) & 0xFF))
+#define highByte(w)		((uint8_t)((w) >> 8))
+#define bit(b)			(1UL << (b))
+#define bitRead(value, b)		(((value) >> (b)) & 0x01)
+#define bitSet(value, b)		((value) |= (1UL << (b)))
+#define bitClear(value, b)		((value) &= ~(1UL << (b)))
+#define bitWrite(value, b, v)	((v) ? bitSet(value, b) : bitClear(value, b))
+
+// Program memory is ordinary memory on the host
+#define PROGMEM
+#define PSTR(s)				(s)
+#define pgm_read_byte(p)	(*(const uint8_t*)(p))
+#define pgm_read_word(p)	(*(const uint16_t*)(p))
+#define pgm_read_dword(p)	(*(const uint32_t*)(p))
+#define pgm_read_float(p)	(*(const float*)(p))
+#define pgm_read_ptr(p)		(*(void* const*)(p))
+
+class __FlashStringHelper;
+#define F(s)	(reinterpret_cast<const __FlashStringHelper*>(s))
+
+inline bool isDigit(int c) { return isdigit(c) != 0; }
+inline bool isAlpha(int c) { return isalpha(c) != 0; }
+inline bool isAlphaNumeric(int c) { return isalnum(c) != 0; }
+inline bool isSpace(int c) { return isspace(c) != 0; }
+inline bool isWhitespace(int c) { return c == ' ' || c == '\t'; }
+inline bool isControl(int c) { return iscntrl(c) != 0; }
+inline bool isPrintable(int c) { return isprint(c) != 0; }
+inline bool isUpperCase(int c) { return isupper(c) != 0; }
+inline bool isLowerCase(int c) { return islower(c) != 0; }
+inline bool isHexadecimalDigit(int c) { return isxdigit(c) != 0; }
+
+
+
+// Time (virtual, see HostArduino)
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+// Cycle counter as on Teensy, read from the host (time stamp counter on x86)
+uint32_t hostCycles();
+#define ARM_DWT_CYCCNT	hostCycles()
+
+// Pins and interrupts
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+void analogWrite(uint8_t pin, int val);
+void analogReadResolution(unsigned int bits);
+uint32_t analogWriteResolution(uint32_t bits);	// returns the previous one, as on Teensy
+void analogWriteFrequency(uint8_t pin, float frequency);
+void attachInterrupt(int interrupt, void (*isr)(void), int mode);
+void detachInterrupt(int interrupt);
+void noInterrupts();
+void interrupts();
+#define cli()	noInterrupts()
+#define sei()	interrupts()
+
+// Random numbers
+void randomSeed(unsigned long seed);
+long random(long howBig);
+long random(long howSmall, long howBig);
+long map(long x, long inMin, long inMax, long outMin, long outMax);
+
+// Sketch entry points
+void setup();
+void loop();
+
+
+
+class String
+{
+public:
+	String(const char* s = "");
+	String(const String& s);
+	String(const __FlashStringHelper* s);
+	explicit String(char c);
+	explicit String(unsigned char value, unsigned char base = DEC);
+	explicit String(int value, unsigned char base = DEC);
+	explicit String(unsigned int value, unsigned char base = DEC);
+	explicit String(long value, unsigned char base = DEC);
+	explicit String(unsigned long value, unsigned char base = DEC);
+	explicit String(float value, unsigned char decimals = 2);
+	explicit String(double value, unsigned char decimals = 2);
+
+	String& operator=(const String& s);
+	String& operator=(const char* s);
+
+	// Concatenation, as on the Arduino core (numbers in decimal, floats with 2 decimals)
+	bool concat(const String& s);
+	bool concat(const char* s);
+	bool concat(const __FlashStringHelper* s);
+	bool concat(char c);
+	bool concat(unsigned char n);
+	bool concat(int n);
+	bool concat(unsigned int n);
+	bool concat(long n);
+	bool concat(unsigned long n);
+	bool concat(float n);
+	bool concat(double n);
+
+	template<typename T> String& operator+=(const T& x) { concat(x); return *this; }
+
+	// Access
+	unsigned int length() const { return (unsigned int)_s.size(); }
+	const char* c_str() const { return _s.c_str(); }
+	char charAt(unsigned int i) const { return i < _s.size() ? _s[i] : 0; }
+	char operator[](unsigned int i) const { return charAt(i); }
+	char& operator[](unsigned int i);
+	void setCharAt(unsigned int i, char c) { if (i < _s.size()) _s[i] = c; }
+	void toCharArray(char* buf, unsigned int size, unsigned int index = 0) const;
+	bool reserve(unsigned int size) { _s.reserve(size); return true; }
+
+	// Comparison
+	bool equals(const String& s) const { return _s == s._s; }
+	bool equals(const char* s) const { return _s == (s ? s : ""); }
+	bool equalsIgnoreCase(const String& s) const;
+	int compareTo(const String& s) const { return _s.compare(s._s); }
+	bool startsWith(const String& s) const { return _s.compare(0, s._s.size(), s._s) == 0; }
+	bool endsWith(const String& s) const;
+	bool operator==(const String& s) const { return equals(s); }
+	bool operator==(const char* s) const { return equals(s); }
+	bool operator!=(const String& s) const { return !equals(s); }
+	bool operator!=(const char* s) const { return !equals(s); }
+	bool operator<(const String& s) const { return _s < s._s; }
+
+	// Search and modification
+	int indexOf(char c, unsigned int from = 0) const;
+	int indexOf(const String& s, unsigned int from = 0) const;
+	int lastIndexOf(char c) const;
+	String substring(unsigned int from) const;
+	String substring(unsigned int from, unsigned int to) const;
+	void replace(const String& find, const String& with);
+	void remove(unsigned int index, unsigned int count = (unsigned int)-1);
+	void toLowerCase();
+	void toUpperCase();
+	void trim();
+
+	// Conversion
+	long toInt() const { return atol(_s.c_str()); }
+	float toFloat() const { return (float)atof(_s.c_str()); }
+	double toDouble() const { return atof(_s.c_str()); }
+
+private:
+	std::string _s;
+};
+
+String operator+(const String& a, const String& b);
+String operator+(const String& a, const char* b);
+String operator+(const char* a, const String& b);
+
+
+
+class Print
+{
+public:
+	virtual ~Print() {}
+	virtual size_t write(uint8_t b) = 0;
+	virtual size_t write(const uint8_t* buf, size_t size);
+	size_t write(const char* s) { return s ? write((const uint8_t*)s, strlen(s)) : 0; }
+	size_t write(const char* buf, size_t size) { return write((const uint8_t*)buf, size); }
+	virtual int availableForWrite() { return 0; }
+	virtual void flush() {}
+
+	size_t print(const __FlashStringHelper* s);
+	size_t print(const String& s);
+	size_t print(const char* s);
+	size_t print(char c);
+	size_t print(unsigned char n, int base = DEC);
+	size_t print(int n, int base = DEC);
+	size_t print(unsigned int n, int base = DEC);
+	size_t print(long n, int base = DEC);
+	size_t print(unsigned long n, int base = DEC);
+	size_t print(double n, int digits = 2);
+
+	size_t println();
+	template<typename T> size_t println(const T& x) { size_t n = print(x); return n + println(); }
+	template<typename T> size_t println(const T& x, int format) { size_t n = print(x, format); return n + println(); }
+
+	size_t printf(const char* format, ...);
+
+private:
+	size_t printNumber(unsigned long n, int base);
+	size_t printFloat(double n, int digits);
+};
+
+
+
+class Stream : public Print
+{
+public:
+	virtual int available() = 0;
+	virtual int read() = 0;
+	virtual int peek() = 0;
+
+	// Reading with a timeout on the (virtual) clock
+	void setTimeout(unsigned long timeout) { _timeout = timeout; }
+	unsigned long getTimeout() { return _timeout; }
+	size_t readBytes(char* buf, size_t length);
+	size_t readBytes(uint8_t* buf, size_t length) { return readBytes((char*)buf, length); }
+	size_t readBytesUntil(char terminator, char* buf, size_t length);
+	String readString();
+	String readStringUntil(char terminator);
+	long parseInt();
+
+protected:
+	unsigned long _timeout = 1000;
+	int timedRead();
+	int timedPeek();
+};
+
+
+
+class HardwareSerial : public Stream
+{
+public:
+	explicit HardwareSerial(const char* name);
+
+	void begin(unsigned long baud) { _baud = baud; }
+	void begin(unsigned long baud, uint16_t) { _baud = baud; }
+	void end() {}
+	operator bool() { return true; }
+
+	int available();
+	int read();
+	int peek();
+	size_t write(uint8_t b);
+	size_t write(const uint8_t* buf, size_t size);
+	using Print::write;
+	int availableForWrite();
+	void flush() {}
+
+	const char* name() const { return _name; }
+
+private:
+	friend class HostArduino;
+
+	const char* _name;
+	unsigned long _baud = 0;
+
+	// Transmit speed in bytes per second (0 for unlimited) and buffer
+	unsigned long _txRate = 0;
+	int _txBufferSize = 0;
+	double _txDoneAt = 0;
+
+	// Input from scripts or a pseudo-terminal, and output split into lines for tracing
+	std::string _rx;
+	size_t _rxPos = 0;
+	std::string _txLine;
+	int _ptyFd = -1;
+	std::string _ptyName;
+
+	void receive(const char* buf, size_t size);
+	void pollPty();
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+extern HardwareSerial Serial2;
+extern HardwareSerial Serial3;
+
+
+
+// Periodic timer interrupts, as on Teensy
+class IntervalTimer
+{
+public:
+	IntervalTimer() {}
+	~IntervalTimer() { end(); }
+	bool begin(void (*f)(), unsigned long microseconds);
+	bool begin(void (*f)(), int microseconds) { return begin(f, (unsigned long)microseconds); }
+	bool begin(void (*f)(), unsigned int microseconds) { return begin(f, (unsigned long)microseconds); }
+	bool begin(void (*f)(), double microseconds) { return begin(f, (unsigned long)(microseconds + 0.5)); }
+	void update(unsigned long microseconds) { _period = microseconds; }
+	void end();
+	void priority(uint8_t) {}
+
+	// Timers that can run at once, as the PIT channels of Teensy 3.x and 4.x
+	static const int maxRunning = 4;
+
+private:
+	friend class HostArduino;
+	static int _numRunning;
+	void (*_func)() = NULL;
+	unsigned long _period = 0;
+	unsigned long _generation = 0;
+};
+
+#endif
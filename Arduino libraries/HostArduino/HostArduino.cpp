@@ -0,0 +1,1425 @@
+/*
+HostArduino.cpp - Emulation of the Arduino core on a Linux host.
+Released into the public domain.
+*/
+
+// System headers go first since Arduino.h defines min and max as macros
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <chrono>
+#include <thread>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "HostArduino.h"
+
+HardwareSerial Serial("Serial");
+HardwareSerial Serial1("Serial1");
+HardwareSerial Serial2("Serial2");
+HardwareSerial Serial3("Serial3");
+
+static HardwareSerial* const serialPorts[] = { &Serial, &Serial1, &Serial2, &Serial3 };
+
+
+
+// Pins
+struct PinState
+{
+	int mode = INPUT;
+	int out = LOW;
+	int in = 0;
+	bool hasInput = false;
+	int pwm = -1;
+	void (*isr)() = NULL;
+	int irqMode = 0;
+};
+
+static PinState pins[NUM_DIGITAL_PINS];
+
+// Scheduled inputs and timers
+enum EventKind
+{
+	pinEvent,
+	serialEvent,
+	pulseOnEvent,
+	pulseOffEvent,
+	timerEvent
+};
+
+struct PulseTrain
+{
+	uint8_t pin;
+	uint64_t period;
+	uint64_t width;
+	unsigned long remaining;	// 0 for endless
+	double rate;				// Poisson rate in Hz, 0 for fixed period
+	uint32_t rng;
+};
+
+struct Event
+{
+	uint64_t t;
+	uint64_t seq;
+	EventKind kind;
+	int pin;
+	int value;
+	HardwareSerial* port;
+	std::string text;
+	size_t train;
+	IntervalTimer* timer;
+	unsigned long generation;
+};
+
+struct EventLater
+{
+	bool operator()(const Event& a, const Event& b) const
+	{
+		return a.t != b.t ? a.t > b.t : a.seq > b.seq;
+	}
+};
+
+static std::priority_queue<Event, std::vector<Event>, EventLater> events;
+static std::vector<PulseTrain> trains;
+static uint64_t eventSeq = 0;
+
+// Clock
+static const unsigned long idlePollsPerDoubling = 16;
+static const uint64_t maxIdleStep = 1000;
+
+static uint64_t clockUs = 0;
+static unsigned long pollCost = 1;
+static unsigned long idlePolls = 0;
+static bool isRealTime = false;
+static std::chrono::steady_clock::time_point wallStart;
+static bool isWallStarted = false;
+
+// Interrupts
+static bool isInterruptsOn = true;
+static bool isInIsr = false;
+static std::vector<void (*)()> pendingIsrs;
+
+// Outputs and stopping
+static FILE* traceFile = NULL;
+static void (*lineCallback)(HardwareSerial&, const char*) = NULL;
+static std::string stopTag;
+static unsigned long stopCount = 0;
+static unsigned long tagCount = 0;
+static uint64_t stopTime = UINT64_MAX;
+
+static unsigned long pollCount = 0;
+static unsigned long eventCount = 0;
+static unsigned long lineCount = 0;
+
+static uint32_t randomState = 1;
+
+
+
+static uint32_t xorshift(uint32_t* s)
+{
+	*s ^= *s << 13;
+	*s ^= *s >> 17;
+	*s ^= *s << 5;
+	return *s;
+}
+
+static void pushEvent(Event e)
+{
+	e.seq = eventSeq++;
+	events.push(e);
+}
+
+static Event makeEvent(uint64_t t, EventKind kind)
+{
+	Event e;
+	e.t = t;
+	e.seq = 0;
+	e.kind = kind;
+	e.pin = 0;
+	e.value = 0;
+	e.port = NULL;
+	e.train = 0;
+	e.timer = NULL;
+	e.generation = 0;
+	return e;
+}
+
+// Escapes control characters so that traces stay one line per event
+static std::string escape(const std::string& s)
+{
+	std::string out;
+	char buf[8];
+	for (size_t i = 0; i < s.size(); i++)
+	{
+		unsigned char c = s[i];
+		if (c == '\\')
+			out += "\\\\";
+		else if (c == '\t')
+			out += "\\t";
+		else if (c == '\r')
+			out += "\\r";
+		else if (c == '\n')
+			out += "\\n";
+		else if (c < 32 || c == 127)
+		{
+			snprintf(buf, sizeof(buf), "\\x%02X", c);
+			out += buf;
+		}
+		else
+			out += (char)c;
+	}
+	return out;
+}
+
+static void runIsr(void (*isr)())
+{
+	if (!isInterruptsOn || isInIsr)
+	{
+		if (std::find(pendingIsrs.begin(), pendingIsrs.end(), isr) == pendingIsrs.end())
+			pendingIsrs.push_back(isr);
+		return;
+	}
+
+	// Interrupts do not nest, and the flag is cleared even if the handler stops the run
+	struct IsrScope
+	{
+		IsrScope() { isInIsr = true; }
+		~IsrScope() { isInIsr = false; }
+	} scope;
+
+	isr();
+}
+
+static void runPendingIsrs()
+{
+	while (!pendingIsrs.empty() && isInterruptsOn && !isInIsr)
+	{
+		void (*isr)() = pendingIsrs.front();
+		pendingIsrs.erase(pendingIsrs.begin());
+		runIsr(isr);
+	}
+}
+
+static bool readLevel(const PinState& p)
+{
+	if (p.hasInput)
+		return p.in != 0;
+	return p.mode == INPUT_PULLUP;
+}
+
+static void applyInput(uint8_t pin, int value)
+{
+	if (pin >= NUM_DIGITAL_PINS)
+		return;
+
+	PinState& p = pins[pin];
+	bool wasHigh = readLevel(p);
+	p.in = value;
+	p.hasInput = true;
+	bool isHigh = readLevel(p);
+
+	HostArduino::traceLine("in", "%u\t%d", pin, value);
+	HostArduino::activity();
+
+	if (p.isr && p.mode != OUTPUT && wasHigh != isHigh)
+	{
+		bool isFired = p.irqMode == CHANGE || (p.irqMode == RISING && isHigh) || (p.irqMode == FALLING && !isHigh);
+		if (isFired)
+		{
+			HostArduino::traceLine("irq", "%u", pin);
+			runIsr(p.isr);
+		}
+	}
+}
+
+static void applyEvent(const Event& e)
+{
+	eventCount++;
+
+	switch (e.kind)
+	{
+		case pinEvent:
+			applyInput(e.pin, e.value);
+			break;
+
+		case serialEvent:
+			HostArduino::receive(*e.port, e.text.data(), e.text.size());
+			break;
+
+		case pulseOnEvent:
+		{
+			PulseTrain& p = trains[e.train];
+			applyInput(p.pin, HIGH);
+
+			Event off = makeEvent(e.t + p.width, pulseOffEvent);
+			off.pin = p.pin;
+			pushEvent(off);
+
+			if (p.remaining == 1)
+				break;
+			if (p.remaining > 1)
+				p.remaining--;
+
+			// Poisson pulses are separated by exponential gaps after each pulse
+			uint64_t next = p.period;
+			if (p.rate > 0)
+			{
+				double u = (xorshift(&p.rng) + 1.0) / 4294967297.0;
+				next = p.width + (uint64_t)(-log(u) / p.rate * 1e6);
+			}
+			Event on = makeEvent(e.t + (next > p.width ? next : p.width + 1), pulseOnEvent);
+			on.train = e.train;
+			pushEvent(on);
+			break;
+		}
+
+		case pulseOffEvent:
+			applyInput(e.pin, LOW);
+			break;
+
+		case timerEvent:
+			HostArduino::timerFired(e.timer, e.generation, e.t);
+			break;
+	}
+}
+
+// Wall time since the first use of the clock
+static uint64_t wallMicros()
+{
+	auto t = std::chrono::steady_clock::now();
+	if (!isWallStarted)
+	{
+		wallStart = t;
+		isWallStarted = true;
+	}
+	return std::chrono::duration_cast<std::chrono::microseconds>(t - wallStart).count();
+}
+
+// Moves the clock to t, applying scheduled events on the way
+static void advanceTo(uint64_t t)
+{
+	wallMicros();
+
+	// Time passes inside an interrupt handler but events wait until it returns
+	if (!isInIsr)
+	{
+		while (!events.empty() && events.top().t <= t)
+		{
+			Event e = events.top();
+			events.pop();
+			if (e.t > clockUs)
+				clockUs = e.t;
+			applyEvent(e);
+		}
+	}
+	if (t > clockUs)
+		clockUs = t;
+
+	if (clockUs >= stopTime)
+	{
+		HostStop stop = { "time limit" };
+		throw stop;
+	}
+
+	// Delays wait for the wall clock to catch up
+	if (isRealTime)
+	{
+		auto due = wallStart + std::chrono::microseconds(clockUs);
+		if (due > std::chrono::steady_clock::now() + std::chrono::milliseconds(1))
+			std::this_thread::sleep_until(due);
+	}
+}
+
+
+
+uint64_t HostArduino::now()
+{
+	return clockUs;
+}
+
+void HostArduino::setPollCost(unsigned long us)
+{
+	pollCost = us;
+}
+
+void HostArduino::setRealTime(bool b)
+{
+	isRealTime = b;
+}
+
+void HostArduino::advance(uint64_t us)
+{
+	advanceTo(clockUs + us);
+}
+
+void HostArduino::poll()
+{
+	pollCount++;
+
+	// In real time, polls do not cost anything and the clock follows the wall clock
+	if (isRealTime)
+	{
+		uint64_t wall = wallMicros();
+		advanceTo(wall > clockUs ? wall : clockUs);
+		return;
+	}
+
+	// Handlers run at full cost, or a timer sampling inputs would race ahead of events
+	if (isInIsr)
+	{
+		advanceTo(clockUs + pollCost);
+		return;
+	}
+
+	idlePolls++;
+
+	// Polling without anything happening speeds time up
+	uint64_t step = pollCost;
+	if (idlePolls > idlePollsPerDoubling)
+	{
+		unsigned long shift = idlePolls / idlePollsPerDoubling;
+		step = (uint64_t)(pollCost > 0 ? pollCost : 1) << (shift < 20 ? shift : 20);
+		if (step > maxIdleStep)
+			step = maxIdleStep;
+	}
+
+	// Land on the next event rather than past it
+	if (!events.empty() && events.top().t > clockUs && events.top().t < clockUs + step)
+		step = events.top().t - clockUs;
+
+	advanceTo(clockUs + step);
+}
+
+void HostArduino::activity()
+{
+	idlePolls = 0;
+}
+
+void HostArduino::setPin(uint8_t pin, int value)
+{
+	applyInput(pin, value);
+}
+
+void HostArduino::schedulePin(uint64_t t, uint8_t pin, int value)
+{
+	Event e = makeEvent(t, pinEvent);
+	e.pin = pin;
+	e.value = value;
+	pushEvent(e);
+}
+
+void HostArduino::schedulePulses(uint8_t pin, uint64_t start, uint64_t period, uint64_t width, unsigned long count)
+{
+	PulseTrain p = { pin, period, width, count, 0, 1 };
+	trains.push_back(p);
+
+	Event e = makeEvent(start, pulseOnEvent);
+	e.train = trains.size() - 1;
+	pushEvent(e);
+}
+
+void HostArduino::schedulePoisson(uint8_t pin, uint64_t start, double rate, uint64_t width, unsigned long count, unsigned long seed)
+{
+	PulseTrain p = { pin, 0, width, count, rate, (uint32_t)(seed ? seed : 1) };
+	trains.push_back(p);
+
+	Event e = makeEvent(start, pulseOnEvent);
+	e.train = trains.size() - 1;
+	pushEvent(e);
+}
+
+void HostArduino::scheduleSerial(uint64_t t, HardwareSerial& port, const std::string& text)
+{
+	Event e = makeEvent(t, serialEvent);
+	e.port = &port;
+	e.text = text;
+	pushEvent(e);
+}
+
+int HostArduino::getPin(uint8_t pin)
+{
+	return pin < NUM_DIGITAL_PINS ? pins[pin].out : LOW;
+}
+
+int HostArduino::getPinMode(uint8_t pin)
+{
+	return pin < NUM_DIGITAL_PINS ? pins[pin].mode : INPUT;
+}
+
+void HostArduino::setTrace(FILE* f)
+{
+	traceFile = f;
+}
+
+void HostArduino::setLineCallback(void (*f)(HardwareSerial&, const char*))
+{
+	lineCallback = f;
+}
+
+void HostArduino::stopAfter(const char* tag, unsigned long count)
+{
+	stopTag = tag;
+	stopCount = count;
+	tagCount = 0;
+}
+
+void HostArduino::stopAt(uint64_t t)
+{
+	stopTime = t;
+}
+
+const char* HostArduino::run()
+{
+	try
+	{
+		setup();
+		while (true)
+		{
+			loop();
+			poll();
+		}
+	}
+	catch (const HostStop& stop)
+	{
+		return stop.reason;
+	}
+}
+
+unsigned long HostArduino::numPolls()
+{
+	return pollCount;
+}
+
+unsigned long HostArduino::numEvents()
+{
+	return eventCount;
+}
+
+unsigned long HostArduino::numLinesSent()
+{
+	return lineCount;
+}
+
+void HostArduino::traceLine(const char* kind, const char* format, ...)
+{
+	if (!traceFile)
+		return;
+
+	fprintf(traceFile, "%llu.%03u\t%s\t", (unsigned long long)(clockUs / 1000), (unsigned)(clockUs % 1000), kind);
+	va_list args;
+	va_start(args, format);
+	vfprintf(traceFile, format, args);
+	va_end(args);
+	fputc('\n', traceFile);
+}
+
+void HostArduino::lineSent(HardwareSerial& port, const std::string& line)
+{
+	lineCount++;
+	traceLine("tx", "%s\t%s", port.name(), escape(line).c_str());
+
+	if (lineCallback)
+		lineCallback(port, line.c_str());
+
+	// Satellites messages start with the tag followed by a delimiter
+	size_t n = stopTag.size();
+	bool isTag = n > 0 && line.compare(0, n, stopTag) == 0 && (line.size() == n || !isalnum((unsigned char)line[n]));
+	if (isTag && ++tagCount >= stopCount)
+	{
+		HostStop stop = { "stop tag" };
+		throw stop;
+	}
+}
+
+void HostArduino::setTxRate(HardwareSerial& port, unsigned long bytesPerSecond, int bufferSize)
+{
+	port._txRate = bytesPerSecond;
+	port._txBufferSize = bufferSize > 0 ? bufferSize : 1;
+	port._txDoneAt = clockUs;
+}
+
+HardwareSerial* HostArduino::findSerial(const char* name)
+{
+	for (size_t i = 0; i < sizeof(serialPorts) / sizeof(serialPorts[0]); i++)
+		if (strcmp(serialPorts[i]->name(), name) == 0)
+			return serialPorts[i];
+	return NULL;
+}
+
+void HostArduino::startTimer(IntervalTimer* timer)
+{
+	Event e = makeEvent(clockUs + timer->_period, timerEvent);
+	e.timer = timer;
+	e.generation = timer->_generation;
+	pushEvent(e);
+}
+
+void HostArduino::receive(HardwareSerial& port, const char* buf, size_t size)
+{
+	port.receive(buf, size);
+}
+
+void HostArduino::timerFired(IntervalTimer* timer, unsigned long generation, uint64_t t)
+{
+	if (!timer->_func || timer->_generation != generation)
+		return;
+
+	// The next period counts from this one, not from when the handler returns
+	Event next = makeEvent(t + timer->_period, timerEvent);
+	next.timer = timer;
+	next.generation = generation;
+	pushEvent(next);
+
+	runIsr(timer->_func);
+}
+
+const char* HostArduino::attachPty(HardwareSerial& port)
+{
+	int fd = posix_openpt(O_RDWR | O_NOCTTY);
+	if (fd < 0 || grantpt(fd) != 0 || unlockpt(fd) != 0)
+		return NULL;
+
+	// Raw mode on the terminal side, which is kept open so that the port survives reconnects
+	const char* name = ptsname(fd);
+	int slave = name ? open(name, O_RDWR | O_NOCTTY) : -1;
+	if (slave < 0)
+	{
+		close(fd);
+		return NULL;
+	}
+	struct termios tio;
+	tcgetattr(slave, &tio);
+	cfmakeraw(&tio);
+	tcsetattr(slave, TCSANOW, &tio);
+
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	port._ptyFd = fd;
+	port._ptyName = name;
+	return port._ptyName.c_str();
+}
+
+
+
+// Script parsing
+static bool parseEscapes(const char* s, std::string& out)
+{
+	out.clear();
+	for (; *s; s++)
+	{
+		if (*s != '\\')
+		{
+			out += *s;
+			continue;
+		}
+		s++;
+		switch (*s)
+		{
+			case 'r': out += '\r'; break;
+			case 'n': out += '\n'; break;
+			case 't': out += '\t'; break;
+			case '\\': out += '\\'; break;
+			case 'x':
+				if (isxdigit((unsigned char)s[1]) && isxdigit((unsigned char)s[2]))
+				{
+					char hex[3] = { s[1], s[2], 0 };
+					out += (char)strtol(hex, NULL, 16);
+					s += 2;
+					break;
+				}
+				return false;
+			default:
+				return false;
+		}
+	}
+	return true;
+}
+
+static uint64_t msToUs(double ms)
+{
+	return ms > 0 ? (uint64_t)(ms * 1000 + 0.5) : 0;
+}
+
+bool HostArduino::loadScript(const char* path)
+{
+	FILE* f = fopen(path, "r");
+	if (!f)
+	{
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return false;
+	}
+
+	char line[4096];
+	int lineNum = 0;
+	bool isOk = true;
+	while (isOk && fgets(line, sizeof(line), f))
+	{
+		lineNum++;
+		line[strcspn(line, "\r\n")] = '\0';
+		char* p = line + strspn(line, " \t");
+		if (*p == '\0' || *p == '#')
+			continue;
+
+		char cmd[32], a[64], b[64];
+		double t, x, y, z;
+		int n = 0;
+		unsigned long count = 0, seed = 1;
+
+		if (sscanf(p, "%31s", cmd) != 1)
+			continue;
+
+		if (strcmp(cmd, "at") == 0 && sscanf(p, "at %lf %63s %63s %n", &t, a, b, &n) == 3)
+		{
+			if (strcmp(a, "pin") == 0)
+				schedulePin(msToUs(t), (uint8_t)atoi(b), atoi(p + n));
+			else if (strcmp(a, "serial") == 0 && findSerial(b))
+			{
+				// The rest of the line is the text
+				std::string text;
+				isOk = parseEscapes(p + n, text);
+				scheduleSerial(msToUs(t), *findSerial(b), text + "\n");
+			}
+			else
+				isOk = false;
+		}
+		else if (strcmp(cmd, "pulse") == 0 && sscanf(p, "pulse %63s %lf %lf %lf %lu", a, &x, &y, &z, &count) >= 4)
+			schedulePulses((uint8_t)atoi(a), msToUs(x), msToUs(y), msToUs(z), count);
+		else if (strcmp(cmd, "poisson") == 0 && sscanf(p, "poisson %63s %lf %lf %lf %lu %lu", a, &x, &y, &z, &count, &seed) >= 4)
+			schedulePoisson((uint8_t)atoi(a), msToUs(x), y, msToUs(z), count, seed);
+		else if (strcmp(cmd, "stopafter") == 0 && sscanf(p, "stopafter %63s %lu", a, &count) == 2)
+			stopAfter(a, count);
+		else if (strcmp(cmd, "until") == 0 && sscanf(p, "until %lf", &t) == 1)
+			stopAt(msToUs(t));
+		else
+			isOk = false;
+
+		if (!isOk)
+			fprintf(stderr, "%s:%d: cannot parse '%s'\n", path, lineNum, p);
+	}
+
+	fclose(f);
+	return isOk;
+}
+
+
+
+// Time
+unsigned long millis()
+{
+	HostArduino::poll();
+	return (unsigned long)(clockUs / 1000);
+}
+
+unsigned long micros()
+{
+	HostArduino::poll();
+	return (unsigned long)clockUs;
+}
+
+void delay(unsigned long ms)
+{
+	advanceTo(clockUs + (uint64_t)ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+	advanceTo(clockUs + us);
+}
+
+void yield()
+{
+	HostArduino::poll();
+}
+
+uint32_t hostCycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return (uint32_t)__rdtsc();
+#else
+	using namespace std::chrono;
+	return (uint32_t)duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+
+
+// Pins and interrupts
+void pinMode(uint8_t pin, uint8_t mode)
+{
+	if (pin >= NUM_DIGITAL_PINS)
+		return;
+
+	static const char* names[] = { "INPUT", "OUTPUT", "INPUT_PULLUP", "INPUT_PULLDOWN" };
+	pins[pin].mode = mode;
+	HostArduino::traceLine("mode", "%u\t%s", pin, mode < 4 ? names[mode] : "?");
+}
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+	if (pin >= NUM_DIGITAL_PINS)
+		return;
+
+	int v = val ? HIGH : LOW;
+	if (pins[pin].out != v || pins[pin].pwm >= 0)
+		HostArduino::traceLine("out", "%u\t%d", pin, v);
+	pins[pin].out = v;
+	pins[pin].pwm = -1;
+	HostArduino::activity();
+}
+
+int digitalRead(uint8_t pin)
+{
+	HostArduino::poll();
+	if (pin >= NUM_DIGITAL_PINS)
+		return LOW;
+
+	const PinState& p = pins[pin];
+	if (p.mode == OUTPUT)
+		return p.out;
+	return readLevel(p) ? HIGH : LOW;
+}
+
+int analogRead(uint8_t pin)
+{
+	HostArduino::poll();
+	return pin < NUM_DIGITAL_PINS && pins[pin].hasInput ? pins[pin].in : 0;
+}
+
+void analogWrite(uint8_t pin, int val)
+{
+	if (pin >= NUM_DIGITAL_PINS)
+		return;
+
+	if (pins[pin].pwm != val)
+		HostArduino::traceLine("pwm", "%u\t%d", pin, val);
+	pins[pin].pwm = val;
+	HostArduino::activity();
+}
+
+void analogReadResolution(unsigned int) {}
+
+uint32_t analogWriteResolution(uint32_t bits)
+{
+	static uint32_t writeBits = 8;
+	uint32_t previous = writeBits;
+	writeBits = bits;
+	return previous;
+}
+
+void analogWriteFrequency(uint8_t, float) {}
+
+void attachInterrupt(int interrupt, void (*isr)(void), int mode)
+{
+	if (interrupt < 0 || interrupt >= NUM_DIGITAL_PINS)
+		return;
+	pins[interrupt].isr = isr;
+	pins[interrupt].irqMode = mode;
+}
+
+void detachInterrupt(int interrupt)
+{
+	if (interrupt < 0 || interrupt >= NUM_DIGITAL_PINS)
+		return;
+	pins[interrupt].isr = NULL;
+}
+
+void noInterrupts()
+{
+	isInterruptsOn = false;
+}
+
+void interrupts()
+{
+	isInterruptsOn = true;
+	runPendingIsrs();
+}
+
+
+
+// Random numbers
+void randomSeed(unsigned long seed)
+{
+	if (seed != 0)
+		randomState = (uint32_t)seed;
+}
+
+long random(long howBig)
+{
+	if (howBig <= 0)
+		return 0;
+	return (long)(xorshift(&randomState) % (unsigned long)howBig);
+}
+
+long random(long howSmall, long howBig)
+{
+	if (howSmall >= howBig)
+		return howSmall;
+	return random(howBig - howSmall) + howSmall;
+}
+
+long map(long x, long inMin, long inMax, long outMin, long outMax)
+{
+	return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+
+
+// String
+static std::string formatNumber(unsigned long n, unsigned char base, bool isNegative)
+{
+	if (base < 2)
+		base = 10;
+	char buf[72];
+	char* p = buf + sizeof(buf) - 1;
+	*p = '\0';
+	do
+	{
+		int d = n % base;
+		*--p = (char)(d < 10 ? '0' + d : 'A' + d - 10);
+		n /= base;
+	} while (n);
+	if (isNegative)
+		*--p = '-';
+	return p;
+}
+
+static std::string formatFloat(double x, unsigned char decimals)
+{
+	char buf[352];
+	snprintf(buf, sizeof(buf), "%.*f", decimals, x);
+	return buf;
+}
+
+String::String(const char* s) : _s(s ? s : "") {}
+String::String(const String& s) : _s(s._s) {}
+String::String(const __FlashStringHelper* s) : _s(s ? (const char*)s : "") {}
+String::String(char c) : _s(1, c) {}
+String::String(unsigned char value, unsigned char base) : _s(formatNumber(value, base, false)) {}
+String::String(int value, unsigned char base) : _s(base == 10 && value < 0 ? formatNumber(-(long)value, 10, true) : formatNumber((unsigned int)value, base, false)) {}
+String::String(unsigned int value, unsigned char base) : _s(formatNumber(value, base, false)) {}
+String::String(long value, unsigned char base) : _s(base == 10 && value < 0 ? formatNumber(0UL - (unsigned long)value, 10, true) : formatNumber((unsigned long)value, base, false)) {}
+String::String(unsigned long value, unsigned char base) : _s(formatNumber(value, base, false)) {}
+String::String(float value, unsigned char decimals) : _s(formatFloat(value, decimals)) {}
+String::String(double value, unsigned char decimals) : _s(formatFloat(value, decimals)) {}
+
+String& String::operator=(const String& s)
+{
+	_s = s._s;
+	return *this;
+}
+
+String& String::operator=(const char* s)
+{
+	_s = s ? s : "";
+	return *this;
+}
+
+bool String::concat(const String& s) { _s += s._s; return true; }
+bool String::concat(const char* s) { if (!s) return false; _s += s; return true; }
+bool String::concat(const __FlashStringHelper* s) { return concat((const char*)s); }
+bool String::concat(char c) { _s += c; return true; }
+bool String::concat(unsigned char n) { return concat(String(n)); }
+bool String::concat(int n) { return concat(String(n)); }
+bool String::concat(unsigned int n) { return concat(String(n)); }
+bool String::concat(long n) { return concat(String(n)); }
+bool String::concat(unsigned long n) { return concat(String(n)); }
+bool String::concat(float n) { return concat(String(n)); }
+bool String::concat(double n) { return concat(String(n)); }
+
+char& String::operator[](unsigned int i)
+{
+	static char dummy;
+	if (i >= _s.size())
+	{
+		dummy = 0;
+		return dummy;
+	}
+	return _s[i];
+}
+
+void String::toCharArray(char* buf, unsigned int size, unsigned int index) const
+{
+	if (size == 0)
+		return;
+	size_t n = index < _s.size() ? _s.size() - index : 0;
+	if (n > size - 1)
+		n = size - 1;
+	memcpy(buf, _s.data() + index, n);
+	buf[n] = '\0';
+}
+
+bool String::equalsIgnoreCase(const String& s) const
+{
+	if (_s.size() != s._s.size())
+		return false;
+	for (size_t i = 0; i < _s.size(); i++)
+		if (tolower((unsigned char)_s[i]) != tolower((unsigned char)s._s[i]))
+			return false;
+	return true;
+}
+
+bool String::endsWith(const String& s) const
+{
+	return _s.size() >= s._s.size() && _s.compare(_s.size() - s._s.size(), s._s.size(), s._s) == 0;
+}
+
+int String::indexOf(char c, unsigned int from) const
+{
+	size_t i = _s.find(c, from);
+	return i == std::string::npos ? -1 : (int)i;
+}
+
+int String::indexOf(const String& s, unsigned int from) const
+{
+	size_t i = _s.find(s._s, from);
+	return i == std::string::npos ? -1 : (int)i;
+}
+
+int String::lastIndexOf(char c) const
+{
+	size_t i = _s.rfind(c);
+	return i == std::string::npos ? -1 : (int)i;
+}
+
+String String::substring(unsigned int from) const
+{
+	return substring(from, length());
+}
+
+String String::substring(unsigned int from, unsigned int to) const
+{
+	if (from > to)
+	{
+		unsigned int tmp = from;
+		from = to;
+		to = tmp;
+	}
+	if (from >= _s.size())
+		return String();
+	if (to > _s.size())
+		to = (unsigned int)_s.size();
+	String r;
+	r._s = _s.substr(from, to - from);
+	return r;
+}
+
+void String::replace(const String& find, const String& with)
+{
+	if (find._s.empty())
+		return;
+	for (size_t i = _s.find(find._s); i != std::string::npos; i = _s.find(find._s, i + with._s.size()))
+		_s.replace(i, find._s.size(), with._s);
+}
+
+void String::remove(unsigned int index, unsigned int count)
+{
+	if (index < _s.size())
+		_s.erase(index, count);
+}
+
+void String::toLowerCase()
+{
+	for (size_t i = 0; i < _s.size(); i++)
+		_s[i] = (char)tolower((unsigned char)_s[i]);
+}
+
+void String::toUpperCase()
+{
+	for (size_t i = 0; i < _s.size(); i++)
+		_s[i] = (char)toupper((unsigned char)_s[i]);
+}
+
+void String::trim()
+{
+	size_t b = _s.find_first_not_of(" \t\r\n\f\v");
+	if (b == std::string::npos)
+	{
+		_s.clear();
+		return;
+	}
+	size_t e = _s.find_last_not_of(" \t\r\n\f\v");
+	_s = _s.substr(b, e - b + 1);
+}
+
+String operator+(const String& a, const String& b)
+{
+	String r(a);
+	r.concat(b);
+	return r;
+}
+
+String operator+(const String& a, const char* b)
+{
+	String r(a);
+	r.concat(b);
+	return r;
+}
+
+String operator+(const char* a, const String& b)
+{
+	String r(a);
+	r.concat(b);
+	return r;
+}
+
+
+
+// Print
+size_t Print::write(const uint8_t* buf, size_t size)
+{
+	size_t n = 0;
+	while (size--)
+		n += write(*buf++);
+	return n;
+}
+
+size_t Print::print(const __FlashStringHelper* s)
+{
+	return write((const char*)s);
+}
+
+size_t Print::print(const String& s)
+{
+	return write((const uint8_t*)s.c_str(), s.length());
+}
+
+size_t Print::print(const char* s)
+{
+	return write(s);
+}
+
+size_t Print::print(char c)
+{
+	return write((uint8_t)c);
+}
+
+size_t Print::print(unsigned char n, int base)
+{
+	return print((unsigned long)n, base);
+}
+
+size_t Print::print(int n, int base)
+{
+	return print((long)n, base);
+}
+
+size_t Print::print(unsigned int n, int base)
+{
+	return print((unsigned long)n, base);
+}
+
+size_t Print::print(long n, int base)
+{
+	if (base == 0)
+		return write((uint8_t)n);
+	if (base == 10 && n < 0)
+		return print('-') + printNumber(0UL - (unsigned long)n, 10);
+	return printNumber((unsigned long)n, base);
+}
+
+size_t Print::print(unsigned long n, int base)
+{
+	if (base == 0)
+		return write((uint8_t)n);
+	return printNumber(n, base);
+}
+
+size_t Print::print(double n, int digits)
+{
+	return printFloat(n, digits);
+}
+
+size_t Print::println()
+{
+	return write((const uint8_t*)"\r\n", 2);
+}
+
+size_t Print::printf(const char* format, ...)
+{
+	char buf[512];
+	va_list args;
+	va_start(args, format);
+	int n = vsnprintf(buf, sizeof(buf), format, args);
+	va_end(args);
+	if (n < 0)
+		return 0;
+	return write((const uint8_t*)buf, (size_t)n < sizeof(buf) ? n : sizeof(buf) - 1);
+}
+
+size_t Print::printNumber(unsigned long n, int base)
+{
+	std::string s = formatNumber(n, (unsigned char)base, false);
+	return write((const uint8_t*)s.data(), s.size());
+}
+
+size_t Print::printFloat(double number, int digits)
+{
+	// Same rounding and limits as the Arduino core
+	if (isnan(number))
+		return print("nan");
+	if (isinf(number))
+		return print("inf");
+	if (number > 4294967040.0 || number < -4294967040.0)
+		return print("ovf");
+
+	size_t n = 0;
+	if (number < 0.0)
+	{
+		n += print('-');
+		number = -number;
+	}
+
+	double rounding = 0.5;
+	for (int i = 0; i < digits; i++)
+		rounding /= 10.0;
+	number += rounding;
+
+	unsigned long intPart = (unsigned long)number;
+	double remainder = number - (double)intPart;
+	n += print(intPart);
+
+	if (digits > 0)
+		n += print('.');
+	while (digits-- > 0)
+	{
+		remainder *= 10.0;
+		unsigned int d = (unsigned int)remainder;
+		n += print(d);
+		remainder -= d;
+	}
+	return n;
+}
+
+
+
+// Stream
+int Stream::timedRead()
+{
+	unsigned long t0 = millis();
+	do
+	{
+		int c = read();
+		if (c >= 0)
+			return c;
+	} while (millis() - t0 < _timeout);
+	return -1;
+}
+
+int Stream::timedPeek()
+{
+	unsigned long t0 = millis();
+	do
+	{
+		int c = peek();
+		if (c >= 0)
+			return c;
+	} while (millis() - t0 < _timeout);
+	return -1;
+}
+
+size_t Stream::readBytes(char* buf, size_t length)
+{
+	size_t n = 0;
+	while (n < length)
+	{
+		int c = timedRead();
+		if (c < 0)
+			break;
+		buf[n++] = (char)c;
+	}
+	return n;
+}
+
+size_t Stream::readBytesUntil(char terminator, char* buf, size_t length)
+{
+	size_t n = 0;
+	while (n < length)
+	{
+		int c = timedRead();
+		if (c < 0 || c == terminator)
+			break;
+		buf[n++] = (char)c;
+	}
+	return n;
+}
+
+String Stream::readString()
+{
+	String s;
+	for (int c = timedRead(); c >= 0; c = timedRead())
+		s += (char)c;
+	return s;
+}
+
+String Stream::readStringUntil(char terminator)
+{
+	String s;
+	for (int c = timedRead(); c >= 0 && c != terminator; c = timedRead())
+		s += (char)c;
+	return s;
+}
+
+long Stream::parseInt()
+{
+	// Skip to the first digit or minus sign
+	int c = timedPeek();
+	while (c >= 0 && c != '-' && !isdigit(c))
+	{
+		read();
+		c = timedPeek();
+	}
+	if (c < 0)
+		return 0;
+
+	bool isNegative = false;
+	long value = 0;
+	if (c == '-')
+	{
+		isNegative = true;
+		read();
+		c = timedPeek();
+	}
+	while (c >= 0 && isdigit(c))
+	{
+		value = value * 10 + c - '0';
+		read();
+		c = timedPeek();
+	}
+	return isNegative ? -value : value;
+}
+
+
+
+// HardwareSerial
+HardwareSerial::HardwareSerial(const char* name) : _name(name) {}
+
+void HardwareSerial::receive(const char* buf, size_t size)
+{
+	if (_rxPos > 0 && _rxPos == _rx.size())
+	{
+		_rx.clear();
+		_rxPos = 0;
+	}
+	_rx.append(buf, size);
+
+	std::string text(buf, size);
+	if (!text.empty() && text[text.size() - 1] == '\n')
+		text.erase(text.size() - 1);
+	HostArduino::traceLine("rx", "%s\t%s", _name, escape(text).c_str());
+	HostArduino::activity();
+}
+
+void HardwareSerial::pollPty()
+{
+	if (_ptyFd < 0)
+		return;
+
+	char buf[4096];
+	ssize_t n = ::read(_ptyFd, buf, sizeof(buf));
+	if (n > 0)
+		receive(buf, n);
+}
+
+int HardwareSerial::available()
+{
+	HostArduino::poll();
+	pollPty();
+	return (int)(_rx.size() - _rxPos);
+}
+
+int HardwareSerial::read()
+{
+	if (_rxPos >= _rx.size())
+		return -1;
+	HostArduino::activity();
+	return (unsigned char)_rx[_rxPos++];
+}
+
+int HardwareSerial::peek()
+{
+	return _rxPos < _rx.size() ? (unsigned char)_rx[_rxPos] : -1;
+}
+
+int HardwareSerial::availableForWrite()
+{
+	if (_txRate == 0)
+		return 4096;
+
+	// Polled like available, so that waiting for room lets time pass
+	HostArduino::poll();
+	double queued = (_txDoneAt - HostArduino::now()) * _txRate / 1e6;
+	int n = queued > 0 ? (int)ceil(queued) : 0;
+	return n < _txBufferSize ? _txBufferSize - n : 0;
+}
+
+size_t HardwareSerial::write(uint8_t b)
+{
+	HostArduino::activity();
+
+	if (_txRate > 0)
+	{
+		// Wait for room in the transmit buffer, then queue the byte behind the others
+		double perByte = 1e6 / _txRate;
+		double roomAt = _txDoneAt - (_txBufferSize - 1) * perByte;
+		if (roomAt > HostArduino::now())
+			HostArduino::advance((uint64_t)ceil(roomAt - HostArduino::now()));
+		double now = HostArduino::now();
+		_txDoneAt = (_txDoneAt > now ? _txDoneAt : now) + perByte;
+	}
+
+	if (_ptyFd >= 0)
+	{
+		// Ignore a full buffer when nothing is reading the terminal, like a closed USB port
+		ssize_t n = ::write(_ptyFd, &b, 1);
+		(void)n;
+	}
+
+	if (b == '\n')
+	{
+		std::string line;
+		line.swap(_txLine);
+		if (!line.empty() && line[line.size() - 1] == '\r')
+			line.erase(line.size() - 1);
+		HostArduino::lineSent(*this, line);
+	}
+	else
+		_txLine += (char)b;
+	return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t* buf, size_t size)
+{
+	for (size_t i = 0; i < size; i++)
+		write(buf[i]);
+	return size;
+}
+
+
+
+// IntervalTimer
+int IntervalTimer::_numRunning = 0;
+
+bool IntervalTimer::begin(void (*f)(), unsigned long microseconds)
+{
+	// A running timer restarts on its own channel, another one needs a free channel
+	if (!f || microseconds == 0 || (_func == NULL && _numRunning >= maxRunning))
+		return false;
+
+	end();
+	_func = f;
+	_period = microseconds;
+	_numRunning++;
+	HostArduino::startTimer(this);
+	return true;
+}
+
+void IntervalTimer::end()
+{
+	if (_func != NULL)
+		_numRunning--;
+	_func = NULL;
+	_generation++;
+}
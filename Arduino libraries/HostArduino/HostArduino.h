@@ -0,0 +1,97 @@
+/*
+HostArduino.h - Virtual clock, scripted inputs and tracing for sketches run on Linux.
+Released into the public domain.
+
+Time only moves when the sketch asks for it. Each call to millis, micros, digitalRead,
+analogRead or Serial.available costs pollCost microseconds (1 by default) and delay jumps
+ahead directly. When the sketch keeps polling without any input, output or interrupt, the
+cost doubles every 16 polls up to 1 ms, so waits like Satellites::delay take a few thousand
+iterations however long they are, overshooting by a few percent at most. Polls inside
+interrupt handlers always cost pollCost, so a timer that samples inputs keeps its pace.
+Scheduled inputs are applied at their exact times: pin levels change, interrupts attached
+to the pin run (deferred while interrupts are off) and serial bytes arrive. In real time
+(setRealTime, used with a pseudo-terminal), the clock follows the wall clock instead and
+delays sleep. Serial output is instant unless setTxRate gives a port a speed, after
+which it has a transmit buffer that drains at that rate and writes wait for room in it.
+
+Inputs are scheduled in code or by a script, one command per line (times in ms, # comments)
+	at <t> pin <pin> <value>					set a digital (0/1) or analog value
+	at <t> serial <port> <text>					send text and a newline, \r \n \t \\ \xHH escapes
+	pulse <pin> <start> <period> <width> [count]		high pulses at a fixed period
+	poisson <pin> <start> <rateHz> <width> [count] [seed]	high pulses at random times
+	stopafter <tag> <count>						stop when the count-th line starting with tag is sent
+	until <t>									stop at time t
+
+The trace has one tab-separated line per event: time in ms, kind and details. Kinds are
+mode, out (digitalWrite), pwm (analogWrite), in (scripted input), irq (interrupt or timer),
+rx and tx (serial lines).
+
+Build a sketch (see HostIno.cpp for the .ino preprocessor)
+	g++ -O2 -std=c++11 HostIno.cpp -o hostino
+	./hostino ../Satellites/Examples/SatellitesLick > SatellitesLick.cpp
+	g++ -O2 -std=c++11 -I. -I../Satellites SatellitesLick.cpp ../Satellites/Satellites.cpp HostArduino.cpp HostMain.cpp -o SatellitesLick
+Sketches can test for HOST_ARDUINO to swap hardware for stand-ins, such as HostBlockDevice
+for an SD card under SatelliteLog.
+Run it (see HostMain.cpp for options)
+	./SatellitesLick --script lick.txt --trace trace.tsv
+Tests of the libraries are programs in the Tests folder (see Tests/HostTest.h).
+*/
+
+#ifndef HostArduino_h
+#define HostArduino_h
+
+#include "Arduino.h"
+
+// Thrown from inside the sketch to end a run
+struct HostStop
+{
+	const char* reason;
+};
+
+class HostArduino
+{
+public:
+	// Clock in microseconds
+	static uint64_t now();
+	static void setPollCost(unsigned long us);
+	static void setRealTime(bool isRealTime);
+	static void advance(uint64_t us);
+
+	// Inputs
+	static void setPin(uint8_t pin, int value);
+	static void schedulePin(uint64_t t, uint8_t pin, int value);
+	static void schedulePulses(uint8_t pin, uint64_t start, uint64_t period, uint64_t width, unsigned long count);
+	static void schedulePoisson(uint8_t pin, uint64_t start, double rate, uint64_t width, unsigned long count, unsigned long seed);
+	static void scheduleSerial(uint64_t t, HardwareSerial& port, const std::string& text);
+	static bool loadScript(const char* path);
+	static const char* attachPty(HardwareSerial& port);
+	static void setTxRate(HardwareSerial& port, unsigned long bytesPerSecond, int bufferSize = 64);
+
+	// Outputs
+	static int getPin(uint8_t pin);
+	static int getPinMode(uint8_t pin);
+	static void setTrace(FILE* f);
+	static void setLineCallback(void (*f)(HardwareSerial& port, const char* line));
+
+	// Running
+	static void stopAfter(const char* tag, unsigned long count);
+	static void stopAt(uint64_t t);
+	static const char* run();
+
+	// Statistics
+	static unsigned long numPolls();
+	static unsigned long numEvents();
+	static unsigned long numLinesSent();
+
+	// Used by the core emulation
+	static void poll();
+	static void activity();
+	static void traceLine(const char* kind, const char* format, ...);
+	static void lineSent(HardwareSerial& port, const std::string& line);
+	static HardwareSerial* findSerial(const char* name);
+	static void startTimer(IntervalTimer* timer);
+	static void receive(HardwareSerial& port, const char* buf, size_t size);
+	static void timerFired(IntervalTimer* timer, unsigned long generation, uint64_t t);
+};
+
+#endif
@@ -0,0 +1,61 @@
+/*
+HostBlockDevice.h - SatelliteBlockDevice kept in a file, for SatelliteLog on the host.
+Released into the public domain.
+
+The file is created when missing and grows as blocks are written. Each write advances the
+virtual clock by writeUs microseconds, so that the stalls of a slow card show up in
+SatelliteLog statistics (a few ms is typical of SD cards, with rare writes of 100 ms).
+*/
+
+#ifndef HostBlockDevice_h
+#define HostBlockDevice_h
+
+#include "HostArduino.h"
+#include "Satellites.h"
+
+class HostBlockDevice : public SatelliteBlockDevice
+{
+public:
+	HostBlockDevice(const char* path, unsigned long numBlocks, unsigned long writeUs = 0)
+		: _numBlocks(numBlocks), _writeUs(writeUs)
+	{
+		_file = fopen(path, "r+b");
+		if (!_file)
+			_file = fopen(path, "w+b");
+	}
+
+	~HostBlockDevice()
+	{
+		if (_file)
+			fclose(_file);
+	}
+
+	unsigned long numBlocks() { return _file ? _numBlocks : 0; }
+	unsigned long numWrites() { return _numWrites; }
+
+	bool readBlock(unsigned long index, byte* data)
+	{
+		if (!_file || index >= _numBlocks || fseek(_file, (long)(index * blockSize), SEEK_SET) != 0)
+			return false;
+		return fread(data, 1, blockSize, _file) == blockSize;
+	}
+
+	bool writeBlock(unsigned long index, const byte* data)
+	{
+		if (!_file || index >= _numBlocks || fseek(_file, (long)(index * blockSize), SEEK_SET) != 0)
+			return false;
+		HostArduino::advance(_writeUs);
+		_numWrites++;
+		bool isDone = fwrite(data, 1, blockSize, _file) == blockSize;
+		fflush(_file);
+		return isDone;
+	}
+
+private:
+	FILE* _file;
+	unsigned long _numBlocks;
+	unsigned long _writeUs;
+	unsigned long _numWrites = 0;
+};
+
+#endif
@@ -0,0 +1,316 @@
+/*
+HostIno.cpp - Turns an Arduino sketch folder into one C++ file for HostArduino.
+Released into the public domain.
+
+Does what the Arduino builder does before compiling: the main .ino (named after the folder)
+comes first and the other .ino files follow in alphabetical order, Arduino.h is included,
+and prototypes are inserted before the first function definition so that functions can be
+used before they are defined. #line directives keep compiler errors pointing at the .ino
+files.
+
+Usage
+	./hostino <sketch folder or .ino file> > sketch.cpp
+Build
+	g++ -O2 -std=c++11 HostIno.cpp -o hostino
+*/
+
+#include <dirent.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+struct Part
+{
+	size_t offset;		// where the file starts in the combined text
+	std::string path;
+};
+
+static bool readFile(const std::string& path, std::string& text)
+{
+	FILE* f = fopen(path.c_str(), "rb");
+	if (!f)
+		return false;
+	char buf[65536];
+	size_t n;
+	while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+		text.append(buf, n);
+	fclose(f);
+	return true;
+}
+
+static bool endsWith(const std::string& s, const char* suffix)
+{
+	size_t n = strlen(suffix);
+	return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+static std::string baseName(std::string path)
+{
+	while (path.size() > 1 && path[path.size() - 1] == '/')
+		path.erase(path.size() - 1);
+	size_t i = path.rfind('/');
+	return i == std::string::npos ? path : path.substr(i + 1);
+}
+
+// Main file first, then the rest alphabetically
+static std::vector<std::string> sketchFiles(std::string path)
+{
+	std::vector<std::string> files;
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0)
+		return files;
+
+	if (!S_ISDIR(st.st_mode))
+	{
+		files.push_back(path);
+		return files;
+	}
+
+	while (path.size() > 1 && path[path.size() - 1] == '/')
+		path.erase(path.size() - 1);
+	std::string main = baseName(path) + ".ino";
+
+	DIR* dir = opendir(path.c_str());
+	if (!dir)
+		return files;
+	std::vector<std::string> others;
+	bool hasMain = false;
+	for (dirent* e = readdir(dir); e; e = readdir(dir))
+	{
+		std::string name = e->d_name;
+		if (!endsWith(name, ".ino"))
+			continue;
+		if (name == main)
+			hasMain = true;
+		else
+			others.push_back(name);
+	}
+	closedir(dir);
+
+	std::sort(others.begin(), others.end());
+	if (hasMain)
+		files.push_back(path + "/" + main);
+	for (size_t i = 0; i < others.size(); i++)
+		files.push_back(path + "/" + others[i]);
+	return files;
+}
+
+// Copy of the text with comments, literals and preprocessor lines blanked, keeping newlines
+static std::string codeOnly(const std::string& s)
+{
+	std::string c = s;
+	size_t n = s.size();
+	bool isLineStart = true;
+	for (size_t i = 0; i < n; i++)
+	{
+		char ch = s[i];
+		if (ch == '/' && i + 1 < n && s[i + 1] == '/')
+		{
+			for (; i < n && s[i] != '\n'; i++)
+				c[i] = ' ';
+			i--;
+			continue;
+		}
+		if (ch == '/' && i + 1 < n && s[i + 1] == '*')
+		{
+			size_t e = s.find("*/", i + 2);
+			e = e == std::string::npos ? n : e + 2;
+			for (; i < e; i++)
+				if (s[i] != '\n')
+					c[i] = ' ';
+			i--;
+			continue;
+		}
+		if (ch == '"' || ch == '\'')
+		{
+			c[i] = ' ';
+			for (i++; i < n && s[i] != ch && s[i] != '\n'; i++)
+			{
+				if (s[i] == '\\' && i + 1 < n)
+					c[i++] = ' ';
+				c[i] = ' ';
+			}
+			if (i < n && s[i] != '\n')
+				c[i] = ' ';
+			continue;
+		}
+		if (ch == '#' && isLineStart)
+		{
+			// Up to the end of the line, following continuations; marked as a statement end
+			for (; i < n && s[i] != '\n'; i++)
+			{
+				if (s[i] == '\\' && i + 1 < n && s[i + 1] == '\n')
+					i++;
+				else
+					c[i] = ' ';
+			}
+			c[i - 1] = ';';
+			isLineStart = true;
+			continue;
+		}
+
+		if (ch == '\n')
+			isLineStart = true;
+		else if (ch != ' ' && ch != '\t' && ch != '\r')
+			isLineStart = false;
+	}
+	return c;
+}
+
+static std::string collapse(const std::string& s)
+{
+	std::string out;
+	for (size_t i = 0; i < s.size(); i++)
+	{
+		char ch = s[i];
+		if (ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n')
+		{
+			if (!out.empty() && out[out.size() - 1] != ' ')
+				out += ' ';
+		}
+		else
+			out += ch;
+	}
+	while (!out.empty() && out[out.size() - 1] == ' ')
+		out.erase(out.size() - 1);
+	return out;
+}
+
+static bool startsWithWord(const std::string& s, const char* word)
+{
+	size_t n = strlen(word);
+	return s.compare(0, n, word) == 0 && (s.size() == n || !(isalnum((unsigned char)s[n]) || s[n] == '_'));
+}
+
+// Function declaration if the text before a top-level { is a function head, empty otherwise
+static std::string prototype(const std::string& head)
+{
+	static const char* skipped[] = { "class", "struct", "union", "enum", "namespace", "typedef",
+		"template", "extern", "static_assert" };
+
+	std::string h = collapse(head);
+	if (h.empty() || h[h.size() - 1] != ')')
+		return "";
+	for (size_t i = 0; i < sizeof(skipped) / sizeof(skipped[0]); i++)
+		if (startsWithWord(h, skipped[i]))
+			return "";
+
+	// Member definitions and default arguments cannot be declared again
+	size_t paren = h.find('(');
+	if (paren == std::string::npos || paren == 0 || h.find("::") != std::string::npos || h.find('=') != std::string::npos)
+		return "";
+
+	// The name before ( must follow a return type
+	size_t e = paren;
+	while (e > 0 && h[e - 1] == ' ')
+		e--;
+	size_t b = e;
+	while (b > 0 && (isalnum((unsigned char)h[b - 1]) || h[b - 1] == '_'))
+		b--;
+	std::string name = h.substr(b, e - b);
+	if (name.empty() || b == 0 || name == "main")
+		return "";
+	return h + ";";
+}
+
+int main(int argc, char** argv)
+{
+	if (argc != 2)
+	{
+		fprintf(stderr, "Usage: %s <sketch folder or .ino file>\n", argv[0]);
+		return 2;
+	}
+
+	std::vector<std::string> files = sketchFiles(argv[1]);
+	if (files.empty())
+	{
+		fprintf(stderr, "No .ino files in %s\n", argv[1]);
+		return 1;
+	}
+
+	std::string text;
+	std::vector<Part> parts;
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		Part p = { text.size(), files[i] };
+		parts.push_back(p);
+		if (!readFile(files[i], text))
+		{
+			perror(files[i].c_str());
+			return 1;
+		}
+		if (!text.empty() && text[text.size() - 1] != '\n')
+			text += '\n';
+	}
+
+	// Collect function heads at file scope
+	std::string code = codeOnly(text);
+	std::vector<std::string> prototypes;
+	size_t firstDef = std::string::npos;
+	size_t stmtStart = 0;
+	int depth = 0;
+	for (size_t i = 0; i < code.size(); i++)
+	{
+		char ch = code[i];
+		if (ch == '{')
+		{
+			if (depth == 0)
+			{
+				std::string p = prototype(code.substr(stmtStart, i - stmtStart));
+				if (!p.empty())
+				{
+					prototypes.push_back(p);
+					if (firstDef == std::string::npos)
+						firstDef = stmtStart;
+				}
+			}
+			depth++;
+		}
+		else if (ch == '}')
+		{
+			if (depth > 0)
+				depth--;
+			if (depth == 0)
+				stmtStart = i + 1;
+		}
+		else if (ch == ';' && depth == 0)
+			stmtStart = i + 1;
+
+		// Files are compiled as one, but a head never spans two of them
+		for (size_t k = 1; k < parts.size(); k++)
+			if (parts[k].offset == i + 1 && depth == 0)
+				stmtStart = i + 1;
+	}
+
+	// Insert at the start of the line holding the first definition
+	size_t insertAt = text.size();
+	if (firstDef != std::string::npos)
+	{
+		insertAt = code.find_first_not_of(" \t\r\n", firstDef);
+		while (insertAt > 0 && text[insertAt - 1] != '\n')
+			insertAt--;
+	}
+
+	printf("#include \"Arduino.h\"\n");
+	for (size_t k = 0; k < parts.size(); k++)
+	{
+		size_t b = parts[k].offset;
+		size_t e = k + 1 < parts.size() ? parts[k + 1].offset : text.size();
+		printf("#line 1 \"%s\"\n", parts[k].path.c_str());
+
+		if (insertAt >= b && insertAt < e)
+		{
+			fwrite(text.data() + b, 1, insertAt - b, stdout);
+			for (size_t i = 0; i < prototypes.size(); i++)
+				printf("%s\n", prototypes[i].c_str());
+			int line = 1 + (int)std::count(text.begin() + b, text.begin() + insertAt, '\n');
+			printf("#line %d \"%s\"\n", line, parts[k].path.c_str());
+			b = insertAt;
+		}
+		fwrite(text.data() + b, 1, e - b, stdout);
+	}
+	return 0;
+}
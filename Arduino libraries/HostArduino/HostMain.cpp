@@ -0,0 +1,125 @@
+/*
+HostMain.cpp - Runs a sketch built against HostArduino.
+Released into the public domain.
+
+Usage
+	./sketch [options]
+Options
+	--script <file>			load inputs and stop conditions (repeatable, see HostArduino.h)
+	--trace <file>			write the event trace to file, - for stdout
+	--echo					print lines sent on Serial to stdout
+	--until <ms>			stop at this virtual time
+	--stop-after <tag> <n>	stop when the n-th line starting with tag is sent
+	--pty [port]			connect port (Serial by default) to a pseudo-terminal, which
+							implies --realtime so that SatellitesViewer can open it
+	--realtime				run on the wall clock: polls cost nothing and delays sleep
+	--baud <rate>			send on Serial at rate / 10 bytes per second through a 64 byte
+							buffer, like a UART, instead of instantly
+	--poll-us <us>			virtual cost of each poll (default 1)
+	--seed <n>				seed for random()
+*/
+
+#include <chrono>
+#include <string>
+
+#include "HostArduino.h"
+
+static double now()
+{
+	using namespace std::chrono;
+	return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+static void echoLine(HardwareSerial& port, const char* line)
+{
+	if (&port == &Serial)
+		printf("%s\n", line);
+}
+
+static int usage(const char* program)
+{
+	fprintf(stderr, "Usage: %s [--script file] [--trace file|-] [--echo] [--until ms] [--stop-after tag n]\n"
+		"\t[--pty [port]] [--realtime] [--baud rate] [--poll-us us] [--seed n]\n", program);
+	return 2;
+}
+
+int main(int argc, char** argv)
+{
+	FILE* trace = NULL;
+	bool isEcho = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (arg == "--script" && hasValue)
+		{
+			if (!HostArduino::loadScript(argv[++i]))
+				return 1;
+		}
+		else if (arg == "--trace" && hasValue)
+		{
+			const char* path = argv[++i];
+			trace = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+			if (!trace)
+			{
+				perror(path);
+				return 1;
+			}
+			HostArduino::setTrace(trace);
+		}
+		else if (arg == "--echo")
+			isEcho = true;
+		else if (arg == "--until" && hasValue)
+			HostArduino::stopAt((uint64_t)(atof(argv[++i]) * 1000));
+		else if (arg == "--stop-after" && i + 2 < argc)
+		{
+			HostArduino::stopAfter(argv[i + 1], strtoul(argv[i + 2], NULL, 10));
+			i += 2;
+		}
+		else if (arg == "--pty")
+		{
+			HardwareSerial* port = &Serial;
+			if (hasValue && argv[i + 1][0] != '-')
+				port = HostArduino::findSerial(argv[++i]);
+			const char* name = port ? HostArduino::attachPty(*port) : NULL;
+			if (!name)
+			{
+				fprintf(stderr, "Cannot open a pseudo-terminal.\n");
+				return 1;
+			}
+			fprintf(stderr, "%s is on %s\n", port->name(), name);
+			HostArduino::setRealTime(true);
+		}
+		else if (arg == "--realtime")
+			HostArduino::setRealTime(true);
+		else if (arg == "--baud" && hasValue)
+			HostArduino::setTxRate(Serial, strtoul(argv[++i], NULL, 10) / 10);
+		else if (arg == "--poll-us" && hasValue)
+			HostArduino::setPollCost(strtoul(argv[++i], NULL, 10));
+		else if (arg == "--seed" && hasValue)
+			randomSeed(strtoul(argv[++i], NULL, 10));
+		else
+			return usage(argv[0]);
+	}
+
+	if (isEcho)
+		HostArduino::setLineCallback(echoLine);
+
+	double t0 = now();
+	const char* reason = HostArduino::run();
+	double wall = now() - t0;
+	double virt = HostArduino::now() / 1e6;
+
+	if (trace && trace != stdout)
+		fclose(trace);
+	else
+		fflush(stdout);
+
+	fprintf(stderr, "Stopped on %s at %.3f s virtual after %.3f s wall (%.0fx real time)\n",
+		reason, virt, wall, wall > 0 ? virt / wall : 0);
+	fprintf(stderr, "%lu lines sent, %lu events, %lu polls\n",
+		HostArduino::numLinesSent(), HostArduino::numEvents(), HostArduino::numPolls());
+	return 0;
+}
@@ -0,0 +1,112 @@
+/*
+EngineTimerTest.cpp - Timer budget of the ManyRig engines and the events they log.
+Released into the public domain.
+
+Built with -DTEENSYDUINO, so that the engines run from IntervalTimer, of which the host
+has four like a Teensy 3.x or 4.x. With three engines and another timer running, a
+SequencePlayer finds no timer free: its begin returns false and the sequence plays from
+tick instead. Once a timer is free again, it plays from the timer.
+
+Build and run from this folder
+	g++ -O2 -std=c++11 -Wall -DTEENSYDUINO -I.. -I../../ManyTimer -I../../ManyRig EngineTimerTest.cpp ../../ManyRig/ManyRig.cpp TestMain.cpp ../HostArduino.cpp -o EngineTimerTest
+	./EngineTimerTest
+*/
+
+#include "HostTest.h"
+#include "ManyRig.h"
+
+static const byte outPin = 5;
+
+static void idle() {}
+
+static bool playSequence(SequencePlayer& player, bool isTicked, unsigned long& numRises)
+{
+	// Play three 1 ms pulses 5 ms apart, counting rising edges of the output. Returns
+	// whether the sequence ended with doneEvent.
+
+	numRises = 0;
+	if (!check(player.start(), "start refused"))
+		return false;
+
+	int level = LOW;
+	unsigned long t0 = millis();
+	while (player.isPlaying() && millis() - t0 < 100)
+	{
+		if (isTicked)
+			player.tick();
+		int now = HostArduino::getPin(outPin);
+		if (now == HIGH && level == LOW)
+			numRises++;
+		level = now;
+	}
+
+	byte kind = 0;
+	unsigned long value = 0, t = 0;
+	bool isStarted = player.popEvent(kind, value, t) && kind == SequencePlayer::startEvent;
+	return isStarted && player.popEvent(kind, value, t) && kind == SequencePlayer::doneEvent && value == 1;
+}
+
+
+
+void setup()
+{
+	// The host refuses a fifth timer, while a running one restarts on its own channel
+	{
+		IntervalTimer timers[IntervalTimer::maxRunning + 1];
+		for (int i = 0; i < IntervalTimer::maxRunning; i++)
+			check(timers[i].begin(idle, 1000), "timer %d refused", i);
+		check(!timers[IntervalTimer::maxRunning].begin(idle, 1000), "fifth timer should be refused");
+		check(timers[0].begin(idle, 500), "running timer should restart");
+		timers[0].end();
+		check(timers[IntervalTimer::maxRunning].begin(idle, 1000), "freed timer should be given out");
+	}
+
+	// Three engines and one more timer take all four
+	StateMachine machine;
+	SyncGenerator sync;
+	ToneSynth synth;
+	IntervalTimer other;
+	check(machine.begin() && sync.begin() && synth.begin() && other.begin(idle, 1000), "engines refused");
+
+	SequencePlayer player;
+	player.setOutput(0, outPin);
+	for (int i = 0; i < 3; i++)
+	{
+		player.addStep(i == 0 ? 1000 : 4000, 1);
+		player.addStep(1000, 0);
+	}
+
+	unsigned long numRises = 0;
+	check(!player.begin(), "player should find no timer free");
+	check(playSequence(player, true, numRises), "ticked sequence should end with doneEvent");
+	check(numRises == 3, "%lu pulses from tick", numRises);
+
+	// With a timer free, the player claims it and no longer needs tick
+	other.end();
+	check(player.begin(), "player should claim the free timer");
+	check(playSequence(player, false, numRises), "timed sequence should end with doneEvent");
+	check(numRises == 3, "%lu pulses from the timer", numRises);
+	check(player.getDropped() == 0, "%lu events dropped", player.getDropped());
+
+	// The timer is held between sequences, so another engine cannot take it
+	check(!other.begin(idle, 1000), "player should keep its timer between sequences");
+	player.end();
+	check(other.begin(idle, 1000), "end should free the timer");
+	other.end();
+	machine.end();
+	sync.end();
+	synth.end();
+
+	// Events beyond the ring are dropped and counted, and the rest come out in order
+	EventRing<unsigned long, 4> ring;
+	for (byte i = 0; i < 6; i++)
+		ring.push(i, 10 * i, 100 * i);
+	check(ring.available() == 4 && ring.getDropped() == 2, "%d events, %lu dropped", ring.available(),
+		ring.getDropped());
+
+	byte kind = 0;
+	unsigned long value = 0, t = 0;
+	for (byte i = 0; i < 4; i++)
+		check(ring.pop(kind, value, t) && kind == i && value == 10UL * i && t == 100UL * i, "event %d", i);
+	check(!ring.pop(kind, value, t), "ring should be empty");
+}
@@ -0,0 +1,28 @@
+/*
+HostTest.h - Checks for library tests run on Linux with HostArduino.
+Released into the public domain.
+
+A test is a program whose setup does the checks, so that it runs on the virtual clock like
+a sketch. TestMain.cpp provides main, which runs setup once, prints a summary and exits
+with 1 when a check failed. Each test lists its build command at the top; build and run
+from this folder, e.g.
+	g++ -O2 -std=c++11 -Wall -I.. -I../../ZaberMotor ZaberPtyTest.cpp ../../ZaberMotor/ZaberMotor.cpp TestMain.cpp ../HostArduino.cpp -pthread -o ZaberPtyTest
+	./ZaberPtyTest
+*/
+
+#ifndef HostTest_h
+#define HostTest_h
+
+#include "HostArduino.h"
+
+// Counts a check and prints the message (printf format) when it fails. Returns isOk.
+bool check(bool isOk, const char* format, ...);
+
+// Prints a line of results that are measured rather than checked
+void report(const char* format, ...);
+
+// Arguments of the test program, e.g. to regenerate reference data
+extern int testArgc;
+extern char** testArgv;
+
+#endif
@@ -0,0 +1,148 @@
+/*
+PositionTest.cpp - Accuracy of the fixed-point Position of ZaberMotor against double precision.
+Released into the public domain.
+
+Sweeps cartesian points over a grid and a range of radii, and polar points over all angles,
+and compares the CORDIC conversions with atan2, hypot, sin and cos in double precision.
+Angle errors are checked as the distance they move a point on the circle, since the
+angle of a point near the origin is only as good as its coordinates. Errors are kept
+separately within 200 mm, the travel of the stages, and beyond up to 1.4 m, where the float
+interface and the last CORDIC step add a fraction of a um.
+
+Build and run from this folder
+	g++ -O2 -std=c++11 -Wall -I.. -I../../ZaberMotor PositionTest.cpp ../../ZaberMotor/ZaberMotor.cpp TestMain.cpp ../HostArduino.cpp -o PositionTest
+	./PositionTest
+*/
+
+#include "HostTest.h"
+#include "ZaberMotor.h"
+
+// Largest errors in um, within 200 mm and beyond
+struct Errors
+{
+	double r = 0;
+	double arc = 0;
+	double xy = 0;
+};
+
+static Errors nearErrors, farErrors;
+
+static Errors& errorsAt(double r)
+{
+	return r <= 200000 ? nearErrors : farErrors;
+}
+
+static double wrapDegrees(double a)
+{
+	// Into [-180, 180)
+	return a - 360 * floor((a + 180) / 360);
+}
+
+static void checkCartesian(long x, long y)
+{
+	// Polar form of a cartesian point
+	Position p(x, y);
+	double a = atan2((double)x, (double)y) * 180 / M_PI;
+	double r = hypot((double)x, (double)y);
+	double dr = fabs(p.getR() - r);
+	double da = fabs(wrapDegrees(p.getA() - a));
+	double arc = r * da * M_PI / 180;
+
+	Errors& e = errorsAt(r);
+	e.r = max(e.r, dr);
+	if (r > 0)
+		e.arc = max(e.arc, arc);
+
+	// The cartesian form is kept as given
+	check(p.getX() == x && p.getY() == y, "(%ld, %ld) became (%ld, %ld)", x, y, p.getX(), p.getY());
+}
+
+static void checkPolar(float a, float r)
+{
+	// Cartesian form of a polar point, which rounds to whole um
+	Position p(a, r);
+	double x = r * sin(a * M_PI / 180);
+	double y = r * cos(a * M_PI / 180);
+	Errors& e = errorsAt(r);
+	e.xy = max(e.xy, hypot(p.getX() - x, p.getY() - y));
+
+	// The polar form is kept as given, to the resolution of its fields
+	double da = fabs(wrapDegrees(p.getA() - wrapDegrees(a)));
+	check(da < 1e-4 && fabs(p.getR() - r) < 1.0 / 256, "(%.4f deg, %.3f um) became (%.4f, %.3f)",
+		a, r, p.getA(), p.getR());
+}
+
+
+
+void setup()
+{
+	// Coordinates up to 1 m, radii up to 1.4 m; beyond about 2 m the 1/256 um fixed point
+	// overflows
+	const long range = 1000000;
+
+	// Grid over the whole range, and the neighbourhood of the origin and the axes
+	for (long x = -range; x <= range; x += range / 200)
+		for (long y = -range; y <= range; y += range / 200)
+			checkCartesian(x, y);
+	for (long x = -50; x <= 50; x++)
+		for (long y = -50; y <= 50; y++)
+			checkCartesian(x, y);
+
+	// Every angle at radii from 1 um up, and odd angles on top
+	for (double r = 1; r <= range; r *= 1.5)
+		for (int i = 0; i < 3600; i++)
+		{
+			double a = i * 0.1 + 0.0137;
+			checkCartesian(lround(r * sin(a * M_PI / 180)), lround(r * cos(a * M_PI / 180)));
+			checkPolar(a - 180, r);
+			checkPolar(a * 7 - 1260, r + 0.3);
+		}
+
+	// Rounding to whole um alone gives a cartesian error up to 0.71 um
+	const char* names[2] = { "within 200 mm", "beyond" };
+	Errors* es[2] = { &nearErrors, &farErrors };
+	const double bounds[2] = { 0.1, 0.5 };
+	for (int i = 0; i < 2; i++)
+	{
+		Errors& e = *es[i];
+		report("%s: radius error %.4f um, angle error %.4f um along the circle, cartesian error %.4f um",
+			names[i], e.r, e.arc, e.xy);
+		check(e.r < bounds[i], "radius error %.4f um %s", e.r, names[i]);
+		check(e.arc < bounds[i], "angle error %.4f um along the circle %s", e.arc, names[i]);
+		check(e.xy < sqrt(0.5) + bounds[i], "cartesian error %.4f um %s", e.xy, names[i]);
+	}
+
+	// Batch conversions agree with single ones
+	const unsigned int n = 64;
+	float as[n], rs[n];
+	long xs[n], ys[n];
+	Position ps[n];
+	for (unsigned int i = 0; i < n; i++)
+	{
+		as[i] = i * 17.3 - 500;
+		rs[i] = i * 1234.5;
+		ps[i] = Position(as[i], rs[i]);
+	}
+
+	Position::polarToCartesian(as, rs, xs, ys, n);
+	for (unsigned int i = 0; i < n; i++)
+	{
+		Position p(as[i], rs[i]);
+		check(xs[i] == p.getX() && ys[i] == p.getY(), "polarToCartesian %u", i);
+	}
+
+	Position::toCartesian(ps, xs, ys, n);
+	for (unsigned int i = 0; i < n; i++)
+	{
+		Position p(as[i], rs[i]);
+		check(xs[i] == p.getX() && ys[i] == p.getY(), "toCartesian %u", i);
+	}
+
+	// Arithmetic on mixed forms
+	Position sum = Position(90.0f, 1000.0f) + Position(100L, -200L);
+	Position diff = Position(3000L, 4000L) - Position(0.0f, 4000.0f);
+	check(sum.getX() == 1100 && sum.getY() == -200, "sum (%ld, %ld)", sum.getX(), sum.getY());
+	check(diff.getX() == 3000 && diff.getY() == 0, "difference (%ld, %ld)", diff.getX(), diff.getY());
+	check(fabs(diff.getA() - 90) < 1e-3 && fabs(diff.getR() - 3000) < 0.02, "difference (%.4f deg, %.3f um)",
+		diff.getA(), diff.getR());
+}
@@ -0,0 +1,220 @@
+/*
+SatelliteCaptureTest.cpp - Windows of SatelliteCapture around triggers.
+Released into the public domain.
+
+Frames hold their own index (and its negative on a second channel), so that every window
+sent can be checked frame by frame. Windows must include the frames kept before the trigger,
+or as many as there are at the start; triggers whose windows overlap must merge into one
+window without sending a frame twice; and windows lost to a full queue, to the ring wrapping
+around or to an overrun while being sent must be counted as dropped.
+
+Build and run from this folder
+	g++ -O2 -std=c++11 -Wall -I.. -I../../Satellites SatelliteCaptureTest.cpp ../../Satellites/Satellites.cpp TestMain.cpp ../HostArduino.cpp -o SatelliteCaptureTest
+	./SatelliteCaptureTest
+*/
+
+#include "HostTest.h"
+#include "Satellites.h"
+
+static const unsigned int numFrames = 400;
+static int16_t buffer[2 * numFrames];
+
+struct Window
+{
+	long cause, count, pre, frames, channels;
+	long first;
+	std::vector<int> samples;
+	int numParts;
+	bool isWellFormed;
+};
+
+static void addFrames(SatelliteCapture& capture, int from, int to)
+{
+	// Frames from to to, end excluded
+	for (int i = from; i < to; i++)
+	{
+		int vals[2] = {i, -i};
+		capture.add(vals);
+	}
+}
+
+static bool sendWindow(SatelliteCapture& capture, Window& w)
+{
+	// Send the oldest complete window to the end, or the rest of the one being sent, checking
+	// that each part has the header of the window and continues where the last one ended.
+	// Returns false when none is complete.
+
+	String msg;
+	if (!capture.send(msg, "cap", ','))
+		return false;
+
+	w.samples.clear();
+	w.numParts = 0;
+	w.isWellFormed = true;
+	do
+	{
+		long h[5], first = 0;
+		int n = 0;
+		bool isOk = sscanf(msg.c_str(), "cap,%*d,%ld,%ld,%ld,%ld,%ld,%ld%n", h, h + 1, h + 2, h + 3, h + 4, &first,
+			&n) == 6;
+		if (w.numParts == 0)
+		{
+			w.cause = h[0];
+			w.count = h[1];
+			w.pre = h[2];
+			w.frames = h[3];
+			w.channels = h[4];
+			w.first = first;
+		}
+		isOk = isOk && h[0] == w.cause && h[1] == w.count && h[2] == w.pre && h[3] == w.frames && h[4] == 2
+			&& first == w.first + (long)w.samples.size() / 2;
+
+		char* p = (char*)msg.c_str() + n;
+		while (isOk && *p == ',')
+			w.samples.push_back(strtol(p + 1, &p, 10));
+
+		w.isWellFormed = w.isWellFormed && isOk && *p == '\0';
+		w.numParts++;
+	} while (capture.isSending() && capture.send(msg, "cap", ','));
+
+	return true;
+}
+
+static bool holdsFrames(const Window& w, int from, int to)
+{
+	// Whether the window holds frames from to to, end excluded
+	if (!w.isWellFormed || w.samples.size() != 2 * (size_t)(to - from))
+		return false;
+	for (int i = from; i < to; i++)
+		if (w.samples[2 * (i - from)] != i || w.samples[2 * (i - from) + 1] != -i)
+			return false;
+	return true;
+}
+
+
+
+void setup()
+{
+	Window w;
+
+	// Frames before the trigger, waiting for the last frame after it
+	{
+		SatelliteCapture capture;
+		capture.begin(buffer, 2 * numFrames, 2);
+		capture.setWindow(50, 100);
+		addFrames(capture, 0, 100);
+		capture.trigger();
+		addFrames(capture, 100, 199);
+		check(!sendWindow(capture, w), "window sent before its last frame");
+		addFrames(capture, 199, 200);
+		check(sendWindow(capture, w) && w.cause == SatelliteCapture::callCause && w.count == 1 && w.pre == 50
+			&& w.frames == 150 && holdsFrames(w, 50, 200), "window of 50 + 100 frames");
+		check(w.numParts == (150 + SatelliteCapture::framesPerSend - 1) / SatelliteCapture::framesPerSend,
+			"%d parts", w.numParts);
+		check(!sendWindow(capture, w) && capture.getDropped() == 0, "no window should be left or dropped");
+	}
+
+	// A trigger soon after begin keeps the frames there are
+	{
+		SatelliteCapture capture;
+		capture.begin(buffer, 2 * numFrames, 2);
+		capture.setWindow(50, 100);
+		addFrames(capture, 0, 10);
+		capture.trigger(SatelliteCapture::edgeCause);
+		addFrames(capture, 10, 110);
+		check(sendWindow(capture, w) && w.cause == SatelliteCapture::edgeCause && w.pre == 10 && w.frames == 110
+			&& holdsFrames(w, 0, 110), "early window of %ld + %ld frames", w.pre, w.frames - w.pre);
+	}
+
+	// Overlapping windows merge up to half the ring, and the next one starts where the last ends
+	{
+		SatelliteCapture capture;
+		capture.begin(buffer, 2 * numFrames, 2);
+		capture.setWindow(20, 50);
+		addFrames(capture, 0, 100);
+		capture.trigger();
+		addFrames(capture, 100, 130);
+		capture.trigger();
+		addFrames(capture, 130, 200);
+		capture.trigger();
+		addFrames(capture, 200, 260);
+		capture.trigger();
+		check(capture.numPending() == 2, "%d windows pending instead of 2", capture.numPending());
+		addFrames(capture, 260, 320);
+
+		check(sendWindow(capture, w) && w.count == 3 && w.pre == 20 && holdsFrames(w, 80, 250),
+			"merged window: %ld triggers, %ld + %ld frames", w.count, w.pre, w.frames - w.pre);
+		check(sendWindow(capture, w) && w.count == 1 && w.pre == 10 && holdsFrames(w, 250, 310),
+			"window after a merged one: %ld + %ld frames", w.pre, w.frames - w.pre);
+	}
+
+	// A window being sent takes no more triggers
+	{
+		SatelliteCapture capture;
+		capture.begin(buffer, 2 * numFrames, 2);
+		capture.setWindow(20, 50);
+		addFrames(capture, 0, 100);
+		capture.trigger();
+		addFrames(capture, 100, 160);
+		String msg;
+		check(capture.send(msg, "cap", ',') && capture.isSending(), "first part of a window");
+		capture.trigger();
+		addFrames(capture, 160, 220);
+
+		check(sendWindow(capture, w) && w.count == 1 && w.first == 16 && holdsFrames(w, 96, 150),
+			"rest of the window being sent: %d frames from %ld", (int)w.samples.size() / 2, w.first);
+		check(sendWindow(capture, w) && w.count == 1 && w.pre == 10 && holdsFrames(w, 150, 210),
+			"window after the one being sent: %ld + %ld frames", w.pre, w.frames - w.pre);
+	}
+
+	// Windows beyond the queue are dropped, as are pending ones that the ring overwrites
+	{
+		SatelliteCapture capture;
+		capture.begin(buffer, 2 * numFrames, 2);
+		capture.setWindow(5, 5);
+		addFrames(capture, 0, 100);
+		for (int i = 0; i <= SatelliteCapture::maxWindows; i++)
+		{
+			capture.trigger();
+			addFrames(capture, 100 + 20 * i, 120 + 20 * i);
+		}
+		check(capture.numPending() == SatelliteCapture::maxWindows && capture.getDropped() == 1,
+			"%d pending and %lu dropped with a full queue", capture.numPending(), capture.getDropped());
+
+		// The first window starts at frame 95, which frame 495 overwrites
+		addFrames(capture, 200, numFrames + 95);
+		check(capture.getDropped() == 1, "window dropped before the ring reached it");
+		addFrames(capture, numFrames + 95, numFrames + 100);
+		check(capture.numPending() == SatelliteCapture::maxWindows - 1 && capture.getDropped() == 2,
+			"%d pending and %lu dropped once the ring wrapped", capture.numPending(), capture.getDropped());
+		check(sendWindow(capture, w) && holdsFrames(w, 115, 125), "oldest window left after the wrap");
+	}
+
+	// A window overrun while being sent ends early and counts as dropped
+	{
+		SatelliteCapture capture;
+		capture.begin(buffer, 2 * numFrames, 2);
+		capture.setWindow(0, 200);
+		addFrames(capture, 0, 10);
+		capture.trigger();
+		addFrames(capture, 10, 220);
+		String msg;
+		check(capture.send(msg, "cap", ','), "first part of the window");
+
+		// The next frame to send is 26, overwritten by frame 426
+		addFrames(capture, 220, numFrames + 27);
+		check(capture.getDropped() == 1, "%lu dropped after an overrun", capture.getDropped());
+		check(capture.send(msg, "cap", ',') && !capture.isSending() && capture.numPending() == 0,
+			"overrun window should end");
+		long first = 0;
+		int n = 0;
+		check(sscanf(msg.c_str(), "cap,%*d,0,1,0,200,2,%ld%n", &first, &n) == 1 && first == 16 && msg.c_str()[n] == '\0',
+			"last part of an overrun window should have no samples: %s", msg.c_str());
+
+		// And capture goes on
+		capture.trigger();
+		addFrames(capture, numFrames + 27, numFrames + 227);
+		check(sendWindow(capture, w) && holdsFrames(w, numFrames + 27, numFrames + 227), "window after an overrun");
+		check(capture.getDropped() == 1, "%lu dropped in all", capture.getDropped());
+	}
+}
@@ -0,0 +1,244 @@
+/*
+SatelliteFilterTest.cpp - SatelliteFilter against reference vectors and a direct model.
+Released into the public domain.
+
+Every mode and decimation from 1 to 32, with and without offset tracking, filters the same
+signal: a slow sine on a 12-bit offset with noise, a step, and a burst at the limits of 16
+bits. Each block gives a line of SatelliteFilterVectors.txt
+	<mode> <decimation> <offset shift> <block> <value> <min> <max> <rms> <offset>
+and the results of process, getValue, getMin, getMax, getRms and getOffset must match it
+exactly. The same results are also checked against a direct model here, which convolves
+the whole history instead of running polyphase or integrator-comb states, so that the
+vectors themselves are known to be right.
+
+Build and run from this folder
+	g++ -O2 -std=c++11 -Wall -I.. -I../../Satellites SatelliteFilterTest.cpp ../../Satellites/Satellites.cpp TestMain.cpp ../HostArduino.cpp -o SatelliteFilterTest
+	./SatelliteFilterTest
+After an intended change of the filter, rewrite the vectors with
+	./SatelliteFilterTest --write
+*/
+
+#include <fstream>
+#include <sstream>
+
+#include "HostTest.h"
+#include "Satellites.h"
+
+static const char* const vectorsPath = "SatelliteFilterVectors.txt";
+static const int numSamples = 128;
+static const byte offsetShift = 5;
+static const char* const modeNames[3] = { "average", "cic", "fir" };
+
+static int signal(int i)
+{
+	// Deterministic noise from a linear congruential generator
+	static uint32_t seed = 12345;
+	seed = seed * 1103515245 + 12345;
+	int noise = (int)((seed >> 16) % 201) - 100;
+
+	if (i >= 80 && i < 88)
+		return i % 2 ? 32767 : -32768;
+	int step = i >= 48 ? 900 : 0;
+	return 2048 + step + (int)lround(1500 * sin(2 * PI * i / 50.0)) + noise;
+}
+
+static std::vector<double> firTaps(int r)
+{
+	// Taps in Q14 designed as SatelliteFilter does: Hamming windowed sinc, gain of exactly 1
+	int k = r == 1 ? 1 : min(4, SatelliteFilter::maxTaps / r);
+	int n = k * r;
+
+	float h[SatelliteFilter::maxTaps];
+	float sum = 0;
+	for (int i = 0; i < n; i++)
+	{
+		float m = i - (n - 1) / 2.0;
+		h[i] = m == 0 ? 1.0 / r : sin(PI * m / r) / (PI * m);
+		if (n > 1)
+			h[i] *= 0.54 - 0.46 * cos(2 * PI * i / (n - 1));
+		sum += h[i];
+	}
+
+	std::vector<double> taps(n);
+	long total = 0;
+	for (int i = 0; i < n; i++)
+	{
+		taps[i] = round(h[i] / sum * 16384);
+		total += (long)taps[i];
+	}
+	taps[n / 2] += 16384 - total;
+	return taps;
+}
+
+static std::vector<double> cicWeights(int r)
+{
+	// Impulse response of three boxcars of length r
+	std::vector<double> w(1, 1);
+	for (int stage = 0; stage < 3; stage++)
+	{
+		std::vector<double> next(w.size() + r - 1, 0);
+		for (size_t i = 0; i < w.size(); i++)
+			for (int j = 0; j < r; j++)
+				next[i + j] += w[i];
+		w = next;
+	}
+	return w;
+}
+
+static long roundHalfAway(double x)
+{
+	return x >= 0 ? (long)floor(x + 0.5) : -(long)floor(-x + 0.5);
+}
+
+static std::string modelBlocks(int mode, int r, int shift, const std::vector<int>& xs)
+{
+	// Lines for one configuration, computed from the whole history of offset-free samples
+
+	std::vector<long> vs, offsets;
+	long offset = 0;
+	for (size_t i = 0; i < xs.size(); i++)
+	{
+		long v = xs[i];
+		if (shift)
+		{
+			if (i == 0)
+				offset = v * 256;
+			offset += (v * 256 - offset) >> shift;
+			v -= (offset + 128) >> 8;
+		}
+		vs.push_back(v);
+		offsets.push_back(shift ? (offset + 128) >> 8 : 0);
+	}
+
+	std::vector<double> weights;
+	double gain = 1;
+	if (mode == SatelliteFilter::averageMode)
+	{
+		weights.assign(r, 1);
+		gain = r;
+	}
+	else if (mode == SatelliteFilter::cicMode)
+	{
+		weights = cicWeights(r);
+		gain = (double)r * r * r;
+	}
+	else
+	{
+		weights = firTaps(r);
+		gain = 16384;
+	}
+
+	std::ostringstream out;
+	for (size_t i = 0; i < vs.size(); i++)
+	{
+		if ((i + 1) % r != 0)
+			continue;
+
+		// Output at the end of each block, from the samples before it (zero before the start)
+		double acc = 0;
+		for (size_t j = 0; j < weights.size() && j <= i; j++)
+			acc += weights[j] * vs[i - j];
+		long value = mode == SatelliteFilter::firMode ? (long)floor((acc + 8192) / 16384) : roundHalfAway(acc / gain);
+
+		long lo = vs[i], hi = vs[i];
+		uint64_t sumSquares = 0;
+		for (size_t j = i + 1 - r; j <= i; j++)
+		{
+			lo = min(lo, vs[j]);
+			hi = max(hi, vs[j]);
+			sumSquares += (uint64_t)((int64_t)vs[j] * vs[j]);
+		}
+		unsigned int rms = (unsigned int)floor(sqrt((double)(sumSquares / r)));
+
+		out << modeNames[mode] << ' ' << r << ' ' << shift << ' ' << i / r << ' ' << value << ' ' << lo << ' '
+			<< hi << ' ' << rms << ' ' << offsets[i] << '\n';
+	}
+	return out.str();
+}
+
+static std::string filterBlocks(SatelliteFilter& filter, int mode, int r, int shift, const std::vector<int>& xs)
+{
+	// Lines for one configuration from SatelliteFilter on channel 2
+
+	const byte ch = 2;
+	check(filter.setChannel(ch, mode, r) && filter.setOffsetTracking(ch, shift), "%s %d rejected", modeNames[mode], r);
+	check(filter.getMode(ch) == mode && filter.getDecimation(ch) == r, "%s %d configuration", modeNames[mode], r);
+
+	std::ostringstream out;
+	for (size_t i = 0; i < xs.size(); i++)
+	{
+		bool isBlock = filter.process(ch, xs[i]);
+		check(isBlock == ((i + 1) % r == 0), "%s %d: block end at sample %d", modeNames[mode], r, (int)i);
+		if (!isBlock)
+			continue;
+
+		out << modeNames[mode] << ' ' << r << ' ' << shift << ' ' << i / r << ' ' << filter.getValue(ch) << ' '
+			<< filter.getMin(ch) << ' ' << filter.getMax(ch) << ' ' << filter.getRms(ch) << ' '
+			<< filter.getOffset(ch) << '\n';
+	}
+	return out.str();
+}
+
+static void compareLines(const std::string& actual, const std::string& expected, const char* what)
+{
+	// First difference, line by line
+	std::istringstream a(actual), e(expected);
+	std::string la, le;
+	for (int line = 1; ; line++)
+	{
+		bool hasA = (bool)std::getline(a, la);
+		bool hasE = (bool)std::getline(e, le);
+		if (!hasA && !hasE)
+			return;
+		if (!check(hasA && hasE && la == le, "%s line %d: \"%s\" instead of \"%s\"", what, line, la.c_str(), le.c_str()))
+			return;
+	}
+}
+
+
+
+void setup()
+{
+	bool isWrite = testArgc > 1 && strcmp(testArgv[1], "--write") == 0;
+
+	std::vector<int> xs;
+	for (int i = 0; i < numSamples; i++)
+		xs.push_back(signal(i));
+
+	// One filter for all configurations, since setChannel restarts a channel
+	SatelliteFilter filter;
+	std::string actual = "# mode decimation shift block value min max rms offset\n";
+	for (int shift = 0; shift <= offsetShift; shift += offsetShift)
+	{
+		for (int mode = 0; mode < 3; mode++)
+		{
+			for (int r = 1; r <= SatelliteFilter::maxDecimation; r++)
+			{
+				std::string blocks = filterBlocks(filter, mode, r, shift, xs);
+				compareLines(blocks, modelBlocks(mode, r, shift, xs), "model");
+				actual += blocks;
+			}
+		}
+	}
+
+	// Out of range settings are refused
+	check(!filter.setChannel(SatelliteFilter::maxChannels, 0, 1) && !filter.setChannel(0, 3, 1) &&
+		!filter.setChannel(0, 0, 0) && !filter.setChannel(0, 0, SatelliteFilter::maxDecimation + 1) &&
+		!filter.setOffsetTracking(0, 17), "bad settings should be refused");
+
+	if (isWrite)
+	{
+		std::ofstream file(vectorsPath);
+		file << actual;
+		check((bool)file, "cannot write %s", vectorsPath);
+		report("wrote %s", vectorsPath);
+		return;
+	}
+
+	std::ifstream file(vectorsPath);
+	if (!check((bool)file, "cannot read %s (run from the Tests folder)", vectorsPath))
+		return;
+	std::stringstream expected;
+	expected << file.rdbuf();
+	compareLines(actual, expected.str(), vectorsPath);
+}
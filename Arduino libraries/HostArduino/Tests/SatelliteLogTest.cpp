@@ -0,0 +1,227 @@
+/*
+SatelliteLogTest.cpp - Blocks, recovery and stalls of SatelliteLog.
+Released into the public domain.
+
+The log is kept on a block device in memory, whose blocks the test can damage. Messages of
+many lengths, some over 254 bytes so that they take a long record, must replay as they were
+logged. A block with any byte changed must fail its checksum. When the last block of a
+session is torn, a new session must continue after the valid blocks before it, which still
+replay whole. Appending while both buffers are full must write a block on the spot and
+count a stall, which polling in between avoids.
+
+Build and run from this folder
+	g++ -O2 -std=c++11 -Wall -I.. -I../../Satellites SatelliteLogTest.cpp ../../Satellites/Satellites.cpp TestMain.cpp ../HostArduino.cpp -o SatelliteLogTest
+	./SatelliteLogTest
+*/
+
+#include "HostTest.h"
+#include "Satellites.h"
+
+class MemoryDevice : public SatelliteBlockDevice
+{
+public:
+	MemoryDevice(unsigned long numBlocks, unsigned long writeUs = 0)
+		: data(numBlocks * blockSize, 0), writeUs(writeUs) {}
+
+	unsigned long numBlocks() { return data.size() / blockSize; }
+
+	bool readBlock(unsigned long index, byte* block)
+	{
+		if (index >= numBlocks())
+			return false;
+		memcpy(block, data.data() + index * blockSize, blockSize);
+		return true;
+	}
+
+	bool writeBlock(unsigned long index, const byte* block)
+	{
+		if (index >= numBlocks())
+			return false;
+		HostArduino::advance(writeUs);
+		memcpy(data.data() + index * blockSize, block, blockSize);
+		numWrites++;
+		return true;
+	}
+
+	std::vector<byte> data;
+	unsigned long writeUs;
+	unsigned long numWrites = 0;
+};
+
+// Lines written by replay, without logBlock and logSync lines unless asked for
+class Lines : public Print
+{
+public:
+	std::vector<std::string> all;
+
+	size_t write(uint8_t b)
+	{
+		if (b == '\n')
+			all.push_back(std::string());
+		else if (b != '\r')
+			_line += (char)b;
+		if (b == '\n')
+			all.back().swap(_line);
+		return 1;
+	}
+
+	std::vector<std::string> messages()
+	{
+		std::vector<std::string> m;
+		for (size_t i = 0; i < all.size(); i++)
+			if (all[i].compare(0, 8, "logBlock") != 0 && all[i].compare(0, 7, "logSync") != 0)
+				m.push_back(all[i]);
+		return m;
+	}
+
+private:
+	std::string _line;
+};
+
+static std::string messageOf(int i)
+{
+	// From 1 to 400 characters
+	std::string s = "m," + std::to_string(i) + ",";
+	return s + std::string((i * 53) % 400, 'a' + i % 26);
+}
+
+static std::vector<std::string> logMessages(SatelliteLog& log, int from, int to, bool isPolled)
+{
+	std::vector<std::string> sent;
+	for (int i = from; i < to; i++)
+	{
+		sent.push_back(messageOf(i));
+		log.append(sent.back().c_str(), sent.back().length());
+		if (isPolled)
+			log.poll();
+	}
+	return sent;
+}
+
+static Lines replayAll(SatelliteLog& log)
+{
+	Lines lines;
+	for (unsigned long b = 0; b < log.size(); b++)
+		check(log.replay(b, lines, ','), "block %lu should replay", b);
+	return lines;
+}
+
+
+
+void setup()
+{
+	// Messages replay as logged, with sync markers counting the records before them
+	{
+		MemoryDevice device(128);
+		SatelliteLog log;
+		bool isBegun = log.begin(device);
+		check(isBegun && log.getSession() == 1, "new log");
+		std::vector<std::string> sent = logMessages(log, 0, 200, true);
+		log.addSync();
+		log.flush();
+
+		Lines lines = replayAll(log);
+		check(lines.messages() == sent, "%d of %d messages replayed", (int)lines.messages().size(), (int)sent.size());
+		check(log.numRecords() == 200 && log.numDropped() == 0 && log.numStalls() == 0,
+			"%lu records, %lu dropped, %lu stalls", log.numRecords(), log.numDropped(), log.numStalls());
+
+		unsigned long ms = 0, numBefore = 0;
+		check(sscanf(lines.all.back().c_str(), "logSync,%lu,%lu", &ms, &numBefore) == 2 && numBefore == 200,
+			"last line should be a sync marker after 200 records: %s", lines.all.back().c_str());
+		check(lines.all[0] == "logBlock,0,1", "first line %s", lines.all[0].c_str());
+	}
+
+	// Any change to a block fails its checksum
+	{
+		MemoryDevice device(16);
+		SatelliteLog log;
+		log.begin(device);
+		logMessages(log, 0, 10, true);
+		log.flush();
+
+		Lines lines;
+		bool isCaught = true;
+		for (unsigned int k = 0; k < SatelliteBlockDevice::blockSize; k += 7)
+		{
+			device.data[k] ^= 0x10;
+			isCaught = isCaught && !log.replay(0, lines, ',');
+			device.data[k] ^= 0x10;
+		}
+		check(isCaught, "a changed byte should fail the checksum");
+		check(log.replay(0, lines, ','), "restored block should replay");
+	}
+
+	// A torn block ends the log, and the next session continues after the valid prefix
+	{
+		MemoryDevice device(64);
+		SatelliteLog log;
+		log.begin(device);
+		std::vector<std::string> first = logMessages(log, 0, 30, true);
+		log.flush();
+		unsigned long numBlocks = log.size();
+
+		// The second half of the last block is lost
+		unsigned long torn = numBlocks - 1;
+		memset(device.data.data() + torn * SatelliteBlockDevice::blockSize + SatelliteBlockDevice::blockSize / 2, 0,
+			SatelliteBlockDevice::blockSize / 2);
+
+		SatelliteLog next;
+		bool isBegun = next.begin(device);
+		check(isBegun && next.getSession() == 2 && next.size() == torn + 1,
+			"session %d of %lu blocks after a torn block %lu", next.getSession(), next.size(), torn);
+		std::vector<std::string> second = logMessages(next, 100, 120, true);
+		next.flush();
+
+		// What replays of the first session is a prefix of it
+		Lines lines = replayAll(next);
+		std::vector<std::string> m = lines.messages();
+		size_t numKept = m.size() - second.size();
+		bool isPrefix = m.size() > second.size() && numKept < first.size()
+			&& std::equal(m.begin(), m.begin() + numKept, first.begin())
+			&& std::equal(m.begin() + numKept, m.end(), second.begin());
+		report("torn block %lu of %lu: %d of %d messages of the first session kept", torn, numBlocks, (int)numKept,
+			(int)first.size());
+		check(isPrefix, "replay should be a prefix of the first session, then the second");
+		check(std::find(lines.all.begin(), lines.all.end(), "logBlock," + std::to_string(torn) + ",2") != lines.all.end(),
+			"torn block should be written again by session 2");
+
+		// A new log ignores the blocks of the old one, and its next session follows its one block
+		SatelliteLog fresh;
+		fresh.begin(device, false);
+		logMessages(fresh, 200, 201, true);
+		fresh.flush();
+		SatelliteLog again;
+		isBegun = again.begin(device);
+		check(isBegun && again.getSession() == 2 && again.size() == 2,
+			"new log continued at session %d with %lu blocks", again.getSession(), again.size());
+	}
+
+	// Both buffers full: a block is written on the spot and the append stalls
+	{
+		MemoryDevice device(64, 5000);
+		SatelliteLog log;
+		log.begin(device);
+		log.setIntervals(1000000, 1000000);
+		logMessages(log, 0, 100, false);
+		unsigned long numFull = log.size() - 1;
+		report("%lu blocks filled without polls: %lu stalls, longest %lu us", numFull, log.numStalls(),
+			log.getMaxStall());
+		check(log.numStalls() == numFull - 1 && log.getMaxStall() >= 5000, "%lu stalls for %lu full blocks",
+			log.numStalls(), numFull);
+
+		MemoryDevice idle(64, 5000);
+		SatelliteLog polled;
+		polled.begin(idle);
+		polled.setIntervals(1000000, 1000000);
+		logMessages(polled, 0, 100, true);
+		check(polled.numStalls() == 0 && polled.getMaxStall() < 5000, "%lu stalls with polls", polled.numStalls());
+
+		// A full device drops records rather than stall
+		MemoryDevice small(2);
+		SatelliteLog full;
+		full.begin(small);
+		logMessages(full, 0, 50, true);
+		check(full.numDropped() > 0 && full.numRecords() + full.numDropped() == 50, "%lu records and %lu dropped",
+			full.numRecords(), full.numDropped());
+	}
+}
@@ -0,0 +1,215 @@
+/*
+SatellitesQueueTest.cpp - Queueing of Satellites messages by priority on a slow link.
+Released into the public domain.
+
+Serial1 sends at the speed of a 115200 baud UART with a 64-byte transmit buffer, so that
+messages queue up. Messages of many lengths go through the byte ring of each class, and
+every line that comes out must be one of them, whole and in order. Each case starts with
+the link idle, since Satellites learns the size of the transmit buffer while it is empty.
+Parts of a capture window share the link with the queued messages.
+
+Build and run from this folder
+	g++ -O2 -std=c++11 -Wall -I.. -I../../Satellites SatellitesQueueTest.cpp ../../Satellites/Satellites.cpp TestMain.cpp ../HostArduino.cpp -o SatellitesQueueTest
+	./SatellitesQueueTest
+*/
+
+#include <algorithm>
+
+#include "HostTest.h"
+#include "Satellites.h"
+
+static std::vector<std::string> lines;
+
+static void onLine(HardwareSerial& port, const char* line)
+{
+	if (&port == &Serial1)
+		lines.push_back(line);
+}
+
+static std::string tagOf(int i)
+{
+	// Tags from 1 to 150 characters, so that messages wrap around the rings at odd places
+	return std::string(1 + (i * 37) % 150, 'a' + i % 26);
+}
+
+static std::string messageOf(const std::string& tag, int i)
+{
+	return tag + "," + std::to_string(i) + "," + std::to_string(i * 7);
+}
+
+static bool isInOrder(const std::vector<std::string>& sent, size_t from, size_t& numFound)
+{
+	// Whether lines from index from are a subsequence of sent, counting them
+	size_t j = 0;
+	numFound = 0;
+	for (size_t i = from; i < lines.size(); i++)
+	{
+		while (j < sent.size() && sent[j] != lines[i])
+			j++;
+		if (j == sent.size())
+			return check(false, "line %d \"%.40s\" was not sent or is out of order", (int)i, lines[i].c_str());
+		j++;
+		numFound++;
+	}
+	return true;
+}
+
+
+
+void setup()
+{
+	HostArduino::setLineCallback(onLine);
+	HostArduino::setTxRate(Serial1, 11520, 64);
+
+	// Blocking class: every message arrives, whole and in order
+	{
+		delay(10);
+		Satellites sat(Serial1);
+		SatelliteQueue queue;
+		sat.attachQueue(queue);
+		sat.setClassPolicy(Satellites::eventClass, Satellites::blockPolicy, 1000);
+
+		lines.clear();
+		std::vector<std::string> sent;
+		for (int i = 0; i < 300; i++)
+		{
+			std::string tag = tagOf(i);
+			sent.push_back(messageOf(tag, i));
+			sat.sendData(tag.c_str(), i, (long)(i * 7));
+		}
+		sat.detachQueue();
+		check(lines == sent, "%d of %d messages arrived as sent", (int)lines.size(), (int)sent.size());
+
+		// Several messages at a time in the ring, so that they wrapped around
+		lines.clear();
+		sat.sendQueueStats();
+		long numSent = 0, numDropped = 0, depth = 0;
+		check(lines.size() == 1 && sscanf(lines[0].c_str(), "queue,%*d,%*d,%*d,%*d,%*d,%ld,%ld,%*d,%ld", &numSent, &numDropped,
+			&depth) == 3, "queue statistics");
+		check(numSent == 300 && numDropped == 0 && depth > 3, "event: %ld sent, %ld dropped, deepest queue %ld",
+			numSent, numDropped, depth);
+	}
+
+	// Dropping class: what arrives is a subsequence ending with the newest, and the statistics
+	// account for every message
+	{
+		delay(10);
+		Satellites sat(Serial1);
+		SatelliteQueue queue;
+		sat.attachQueue(queue);
+		sat.setDefaultClass(Satellites::streamClass);
+		sat.setTagClass("crit", Satellites::criticalClass);
+		sat.setTagClass("queue", Satellites::criticalClass);
+
+		lines.clear();
+		std::vector<std::string> sent;
+		for (int i = 0; i < 200; i++)
+		{
+			std::string tag = tagOf(i);
+			sent.push_back(messageOf(tag, i));
+			sat.sendData(tag.c_str(), i, (long)(i * 7));
+		}
+
+		// A critical message overtakes the stream still queued
+		size_t numBefore = lines.size();
+		sat.sendData("crit", 1, 2L);
+		sat.detachQueue();
+
+		size_t critAt = std::find(lines.begin(), lines.end(), "crit,1,2") - lines.begin();
+		check(critAt < lines.size() - 1 && critAt <= numBefore + 1, "critical message at %d of %d lines, %d before it",
+			(int)critAt, (int)lines.size(), (int)numBefore);
+		if (critAt < lines.size())
+			lines.erase(lines.begin() + critAt);
+
+		size_t numFound = 0;
+		check(isInOrder(sent, 0, numFound), "stream should arrive in order");
+		check(!lines.empty() && lines.back() == sent.back(), "the newest message should arrive");
+
+		lines.clear();
+		sat.sendQueueStats();
+		long stats[12] = { 0 };
+		check(lines.size() == 1 && sscanf(lines[0].c_str(), "queue,%*d,%ld,%ld,%ld,%ld,%ld,%ld,%ld,%ld,%ld,%ld,%ld,%ld",
+			stats, stats + 1, stats + 2, stats + 3, stats + 4, stats + 5, stats + 6, stats + 7, stats + 8, stats + 9,
+			stats + 10, stats + 11) == 12, "queue statistics");
+		report("stream: %ld sent, %ld dropped, deepest queue %ld", stats[8], stats[9], stats[11]);
+		check(stats[8] == (long)numFound && stats[8] + stats[9] == 200, "%ld sent and %ld dropped of 200 with %d arrived",
+			stats[8], stats[9], (int)numFound);
+		check(stats[0] == 1 && stats[1] == 0, "critical: %ld sent, %ld dropped", stats[0], stats[1]);
+		check(stats[9] > 0 && stats[11] <= SatelliteQueue::queueSize, "stream queue should fill and drop");
+	}
+
+	// Messages longer than a ring go out right away
+	{
+		delay(10);
+		Satellites sat(Serial1);
+		SatelliteQueue queue;
+		sat.attachQueue(queue);
+
+		lines.clear();
+		sat.sendData(tagOf(1).c_str(), 1, 7L);
+		sat.sendData(tagOf(2).c_str(), 2, 14L);
+		std::string tag(SatelliteQueue::queueBytes + 10, 'z');
+		sat.sendData(tag.c_str(), 3, 21L);
+		sat.detachQueue();
+
+		check(lines.size() == 3 && std::find(lines.begin(), lines.end(), messageOf(tag, 3)) != lines.end(),
+			"long message should arrive whole");
+	}
+
+	// A capture window goes out in parts as the link frees up, and a critical message sent
+	// meanwhile neither waits for the window nor lands inside a part
+	{
+		delay(10);
+		Satellites sat(Serial1);
+		SatelliteQueue queue;
+		SatelliteCapture capture;
+		static int16_t buffer[2 * 400];
+		capture.begin(buffer, 2 * 400, 2);
+		capture.setWindow(50, 150);
+		sat.attachQueue(queue);
+		sat.attachCapture(capture);
+		sat.setTagClass("crit", Satellites::criticalClass);
+
+		for (int i = 0; i < 300; i++)
+		{
+			if (i == 100)
+				capture.trigger();
+			int vals[2] = {i, -i};
+			capture.add(vals);
+		}
+
+		lines.clear();
+		check(sat.sendCapture(), "first part should go out");
+		unsigned long t0 = micros();
+		sat.sendData("crit", 1, 2L);
+		unsigned long dt = micros() - t0;
+		while ((capture.isSending() || capture.numPending() > 0) && micros() - t0 < 1000000)
+			sat.delay(1);
+		sat.detachQueue();
+
+		// Parts hold frames 50 to 249 in order, each with the window header and its first frame
+		size_t critAt = std::find(lines.begin(), lines.end(), "crit,1,2") - lines.begin();
+		std::vector<int> samples;
+		int numParts = 0;
+		bool isHeaderOk = true;
+		for (size_t i = 0; i < lines.size(); i++)
+		{
+			if (i == critAt)
+				continue;
+			int n = 0, numFrames = 0, first = 0;
+			isHeaderOk = isHeaderOk && sscanf(lines[i].c_str(), "capture,%*d,0,1,50,%d,2,%d%n", &numFrames, &first,
+				&n) == 2 && numFrames == 200 && first == (int)samples.size() / 2;
+			char* p = (char*)lines[i].c_str() + n;
+			while (isHeaderOk && *p == ',')
+				samples.push_back(strtol(p + 1, &p, 10));
+			numParts++;
+		}
+		bool isDataOk = samples.size() == 400;
+		for (size_t i = 0; isDataOk && i < 200; i++)
+			isDataOk = samples[2 * i] == (int)(50 + i) && samples[2 * i + 1] == -(int)(50 + i);
+
+		report("capture: %d parts, critical message after %d of them, sent in %lu us", numParts, (int)critAt, dt);
+		check(isHeaderOk && isDataOk, "capture parts should hold the window in order");
+		check(critAt <= 2 && dt < 1000, "critical message at line %d after %lu us", (int)critAt, dt);
+	}
+}
@@ -0,0 +1,98 @@
+/*
+StepperRampTest.cpp - Step intervals of ManyStepper moves with acceleration.
+Released into the public domain.
+
+Runs moves by calling run at every microsecond and records the time between steps. Each
+move must speed up then slow down: the intervals fall to their shortest and rise again,
+never change by more than the ramp allows from one step to the next, and are never shorter
+than the step interval, which only long moves reach. Short moves that do not reach full speed are run with odd and
+even numbers of steps, since an odd one has a middle step between its ramps.
+
+Build and run from this folder
+	g++ -O2 -std=c++11 -Wall -I.. -I../../ManyTimer -I../../ManyStepper StepperRampTest.cpp ../../ManyStepper/ManyStepper.cpp TestMain.cpp ../HostArduino.cpp -o StepperRampTest
+	./StepperRampTest
+*/
+
+#include "HostTest.h"
+#include "ManyStepper.h"
+
+static const unsigned long stepInterval = 200;
+static const unsigned long acceleration = 2000;
+
+static std::vector<long> runMove(ManyStepper& stepper, long numSteps)
+{
+	// Intervals between the steps of one move, in us
+
+	std::vector<long> intervals;
+	long pos = stepper.getPosition();
+	unsigned long tLast = 0;
+	stepper.moveBy(numSteps);
+
+	for (unsigned long t = 0; stepper.isBusy() && t < 60000000UL; t++)
+	{
+		stepper.run(t);
+		if (stepper.getPosition() == pos)
+			continue;
+		if (pos != stepper.getPosition() && t > 0)
+			intervals.push_back(t - tLast);
+		pos = stepper.getPosition();
+		tLast = t;
+	}
+	return intervals;
+}
+
+static void checkRamp(const std::vector<long>& c, long numSteps)
+{
+	if (!check((long)c.size() == numSteps - 1, "%ld steps: %d intervals", numSteps, (int)c.size()))
+		return;
+
+	size_t shortest = 0;
+	for (size_t i = 0; i < c.size(); i++)
+		if (c[i] < c[shortest])
+			shortest = i;
+
+	// Whole microseconds with the fraction carried over may differ by 1 at full speed
+	bool isMonotonic = true, isSmooth = true;
+	for (size_t i = 1; i < c.size(); i++)
+	{
+		isMonotonic = isMonotonic && (i <= shortest ? c[i] <= c[i - 1] + 1 : c[i] >= c[i - 1] - 1);
+
+		// Neighbouring intervals differ by 5/3 at most, at the end of a ramp down
+		isSmooth = isSmooth && c[i] * 2 > c[i - 1] && c[i - 1] * 2 > c[i];
+	}
+
+	check(isMonotonic, "%ld steps: intervals do not fall then rise", numSteps);
+	check(isSmooth, "%ld steps: interval jumps by more than 2x", numSteps);
+	check(c[shortest] >= (long)stepInterval, "%ld steps: interval of %ld us", numSteps, c[shortest]);
+
+	// Full speed is reached after v^2 / 2a = 5000^2 / 4000 = 6250 steps of each ramp
+	bool isFullSpeed = numSteps > 2 * 6250;
+	check(isFullSpeed == (c[shortest] <= (long)stepInterval + 1), "%ld steps: shortest interval %ld us", numSteps,
+		c[shortest]);
+}
+
+
+
+void setup()
+{
+	ManyStepper stepper(2, 3, 4, 5);
+	stepper.setStepInterval(stepInterval);
+	stepper.setAcceleration(acceleration);
+
+	long moves[] = {2, 3, 4, 5, 8, 9, 10, 11, 100, 101, 1001, 12000, 12501, 20000};
+	for (size_t k = 0; k < sizeof(moves) / sizeof(moves[0]); k++)
+	{
+		std::vector<long> c = runMove(stepper, moves[k]);
+		if (moves[k] == 9)
+		{
+			std::string s;
+			for (size_t i = 0; i < c.size(); i++)
+				s += " " + std::to_string(c[i]);
+			report("9 steps:%s us", s.c_str());
+		}
+		checkRamp(c, moves[k]);
+	}
+
+	// Backwards too
+	checkRamp(runMove(stepper, -9), 9);
+}
@@ -0,0 +1,59 @@
+/*
+TestMain.cpp - Runs a host test (see HostTest.h).
+Released into the public domain.
+*/
+
+#include <stdarg.h>
+
+#include "HostTest.h"
+
+int testArgc = 0;
+char** testArgv = NULL;
+
+static unsigned long numChecks = 0;
+static unsigned long numFailed = 0;
+
+bool check(bool isOk, const char* format, ...)
+{
+	numChecks++;
+	if (isOk)
+		return true;
+
+	numFailed++;
+	printf("FAIL ");
+	va_list args;
+	va_start(args, format);
+	vprintf(format, args);
+	va_end(args);
+	printf("\n");
+	return false;
+}
+
+void report(const char* format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	vprintf(format, args);
+	va_end(args);
+	printf("\n");
+}
+
+// The checks are all in setup
+void loop()
+{
+	HostStop stop = { "end of test" };
+	throw stop;
+}
+
+int main(int argc, char** argv)
+{
+	testArgc = argc;
+	testArgv = argv;
+
+	const char* reason = HostArduino::run();
+	if (strcmp(reason, "end of test") != 0)
+		check(false, "stopped on %s", reason);
+
+	printf("%lu checks, %lu failed\n", numChecks, numFailed);
+	return numFailed > 0 ? 1 : 0;
+}
@@ -0,0 +1,131 @@
+/*
+TrialScheduleTest.cpp - Choices of TrialSchedule over long sessions.
+Released into the public domain.
+
+Draws many trials from each configuration and checks the share of each choice against
+its probability, that no run of the same choice is longer than the limit, and that every
+block holds exactly its counts. Probability vectors that add up to more than 100 must give
+the same shares as ManyRig::choose.
+
+Build and run from this folder
+	g++ -O2 -std=c++11 -Wall -I.. -I../../ManyTimer -I../../ManyRig TrialScheduleTest.cpp ../../ManyRig/ManyRig.cpp TestMain.cpp ../HostArduino.cpp -o TrialScheduleTest
+	./TrialScheduleTest
+*/
+
+#include "HostTest.h"
+#include "ManyRig.h"
+
+static const long numTrials = 60000;
+
+static std::vector<byte> draw(TrialSchedule& schedule, long n)
+{
+	std::vector<byte> choices;
+	while ((long)choices.size() < n)
+	{
+		schedule.fill();
+		while (schedule.pop())
+			choices.push_back(schedule.getChoice());
+	}
+	choices.resize(n);
+	return choices;
+}
+
+static int longestRun(const std::vector<byte>& choices)
+{
+	int longest = 0, run = 0;
+	for (size_t i = 0; i < choices.size(); i++)
+	{
+		run = i > 0 && choices[i] == choices[i - 1] ? run + 1 : 1;
+		longest = max(longest, run);
+	}
+	return longest;
+}
+
+static void checkShares(const std::vector<byte>& choices, const double* expected, byte numChoices, const char* what)
+{
+	// Within 1 percentage point, about 5 standard deviations at 60000 trials
+	std::vector<long> counts(numChoices, 0);
+	for (size_t i = 0; i < choices.size(); i++)
+		if (check(choices[i] < numChoices, "%s: choice %d out of range", what, choices[i]))
+			counts[choices[i]]++;
+
+	for (byte c = 0; c < numChoices; c++)
+	{
+		double share = 100.0 * counts[c] / choices.size();
+		check(fabs(share - expected[c]) < 1, "%s: choice %d in %.2f%% of trials instead of %.0f%%", what, c, share,
+			expected[c]);
+	}
+}
+
+
+
+void setup()
+{
+	// Probabilities without a run limit
+	{
+		TrialSchedule schedule;
+		schedule.setSeed(7);
+		byte probs[3] = {20, 30, 50};
+		schedule.setProbabilities(probs, 3);
+		double expected[3] = {20, 30, 50};
+		checkShares(draw(schedule, numTrials), expected, 3, "20/30/50");
+	}
+
+	// Vectors past 100 are cut off as in ManyRig::choose
+	{
+		byte probs[3] = {60, 60, 10};
+		double expected[3] = {60, 40, 0};
+
+		TrialSchedule schedule;
+		schedule.setSeed(11);
+		schedule.setProbabilities(probs, 3);
+		checkShares(draw(schedule, numTrials), expected, 3, "schedule 60/60/10");
+
+		ManyRig rig;
+		std::vector<byte> choices;
+		for (long i = 0; i < numTrials; i++)
+			choices.push_back(rig.choose(probs, 3));
+		checkShares(choices, expected, 3, "choose 60/60/10");
+	}
+
+	// Run limit with unequal probabilities
+	for (byte maxRun = 1; maxRun <= 3; maxRun++)
+	{
+		TrialSchedule schedule;
+		schedule.setSeed(3);
+		byte probs[2] = {80, 20};
+		schedule.setProbabilities(probs, 2);
+		schedule.setMaxRun(maxRun);
+		std::vector<byte> choices = draw(schedule, numTrials);
+		int longest = longestRun(choices);
+		report("80/20 with runs of at most %d: longest run %d", maxRun, longest);
+		check(longest <= maxRun, "run of %d with a limit of %d", longest, maxRun);
+	}
+
+	// Blocks, with and without a run limit
+	for (byte maxRun = 0; maxRun <= 2; maxRun++)
+	{
+		TrialSchedule schedule;
+		schedule.setSeed(5);
+		byte counts[3] = {3, 2, 1};
+		schedule.setBlock(counts, 3);
+		schedule.setMaxRun(maxRun);
+		std::vector<byte> choices = draw(schedule, 6 * 5000);
+
+		long numBad = 0;
+		for (size_t b = 0; b < choices.size(); b += 6)
+		{
+			int n[3] = {0, 0, 0};
+			for (size_t i = b; i < b + 6; i++)
+				n[choices[i]]++;
+			if (n[0] != 3 || n[1] != 2 || n[2] != 1)
+				numBad++;
+		}
+		check(numBad == 0, "%ld of 5000 blocks unbalanced with runs of at most %d", numBad, maxRun);
+
+		double expected[3] = {50, 100 / 3.0, 50 / 3.0};
+		checkShares(choices, expected, 3, "block 3/2/1");
+		if (maxRun > 0)
+			check(longestRun(choices) <= maxRun, "block run of %d with a limit of %d", longestRun(choices), maxRun);
+	}
+}
@@ -0,0 +1,307 @@
+/*
+XBeeFrameTest.cpp - Round trip and resynchronization of the SatellitesViewer XBee codec.
+Released into the public domain.
+
+Encodes frames with random payloads that are mostly bytes needing an escape, in API modes 1
+and 2, and decodes them from reads of random size. Every frame must come back unchanged, and
+an escaped frame must hold no special byte after its start. Streams are then damaged by
+truncating frames, flipping bits and inserting garbage: each intact frame must still be
+decoded, in order, and the damage counted.
+
+Build and run from this folder
+	g++ -O2 -std=c++11 -Wall -I.. -I../../../SatellitesViewer/native XBeeFrameTest.cpp ../../../SatellitesViewer/native/svxbee.cpp TestMain.cpp ../HostArduino.cpp -o XBeeFrameTest
+	./XBeeFrameTest
+*/
+
+#include "HostTest.h"
+#include "svxbee.h"
+
+static const int numFrames = 3000;
+
+struct Frame
+{
+	uint8_t type;
+	std::vector<uint8_t> data;
+};
+
+struct Decoded
+{
+	std::vector<Frame> frames;
+	svxbee_decoder d;
+};
+
+static uint32_t seed = 1;
+
+static uint32_t rnd()
+{
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	return seed;
+}
+
+static void onFrame(const svxbee_frame* f, void* user)
+{
+	Frame frame;
+	frame.type = f->type;
+	frame.data.assign(f->data, f->data + f->length);
+	((Decoded*)user)->frames.push_back(frame);
+}
+
+static void copyFrame(const svxbee_frame* f, void* user)
+{
+	*(svxbee_frame*)user = *f;
+}
+
+static Frame randomFrame()
+{
+	// Receive Packets of up to 300 bytes, half of them bytes that are escaped in API mode 2
+	static const uint8_t special[] = {SVXBEE_START, SVXBEE_ESCAPE, SVXBEE_XON, SVXBEE_XOFF};
+	Frame f;
+	f.type = SVXBEE_RX_PACKET;
+	f.data.resize(11 + rnd() % 300);
+	for (size_t i = 0; i < f.data.size(); i++)
+		f.data[i] = rnd() % 2 ? special[rnd() % 4] : (uint8_t)rnd();
+	return f;
+}
+
+static std::vector<uint8_t> encode(const Frame& f, bool isEscaped)
+{
+	std::vector<uint8_t> data(1, f.type);
+	data.insert(data.end(), f.data.begin(), f.data.end());
+	std::vector<uint8_t> out(2 * (data.size() + 18) + 1);
+	out.resize(svxbee_encode(data[0], data.data() + 1, data.size() - 1, isEscaped, out.data(), out.size()));
+	return out;
+}
+
+static void decode(Decoded& rx, const std::vector<uint8_t>& bytes, bool isEscaped)
+{
+	// Reads of 1 to 64 bytes, so that frames are split at every position
+	svxbee_decoder_init(&rx.d, isEscaped);
+	for (size_t i = 0; i < bytes.size(); )
+	{
+		size_t n = 1 + rnd() % 64;
+		n = min(n, bytes.size() - i);
+		svxbee_decode(&rx.d, bytes.data() + i, n, onFrame, &rx);
+		i += n;
+	}
+}
+
+static bool isSame(const Frame& a, const Frame& b)
+{
+	return a.type == b.type && a.data == b.data;
+}
+
+// Number of frames in want that were decoded, in order
+static size_t countInOrder(const std::vector<Frame>& want, const std::vector<Frame>& got)
+{
+	size_t numFound = 0, pos = 0;
+	for (size_t k = 0; k < want.size(); k++)
+		for (size_t i = pos; i < got.size(); i++)
+			if (isSame(got[i], want[k]))
+			{
+				numFound++;
+				pos = i + 1;
+				break;
+			}
+	return numFound;
+}
+
+
+
+static void checkRoundTrip(bool isEscaped)
+{
+	const char* mode = isEscaped ? "API 2" : "API 1";
+	std::vector<Frame> sent;
+	std::vector<uint8_t> bytes;
+	bool isClean = true;
+
+	for (int i = 0; i < numFrames; i++)
+	{
+		sent.push_back(randomFrame());
+		std::vector<uint8_t> out = encode(sent.back(), isEscaped);
+		if (!check(!out.empty(), "%s: frame %d not encoded", mode, i))
+			return;
+
+		for (size_t k = 1; isEscaped && k < out.size(); k++)
+			isClean = isClean && out[k] != SVXBEE_START && out[k] != SVXBEE_XON && out[k] != SVXBEE_XOFF;
+		bytes.insert(bytes.end(), out.begin(), out.end());
+	}
+	check(isClean, "%s: special byte left unescaped", mode);
+
+	Decoded rx;
+	decode(rx, bytes, isEscaped);
+	check(rx.frames.size() == sent.size() && countInOrder(sent, rx.frames) == sent.size(),
+		"%s: %d of %d frames decoded unchanged", mode, (int)countInOrder(sent, rx.frames), numFrames);
+	check(rx.d.checksumErrors == 0 && rx.d.lengthErrors == 0 && rx.d.discardedBytes == 0,
+		"%s: %lu checksum errors, %lu length errors, %lu bytes discarded in a clean stream", mode,
+		rx.d.checksumErrors, rx.d.lengthErrors, rx.d.discardedBytes);
+
+	// Receive Packet fields
+	uint8_t one[] = {SVXBEE_RX_PACKET, 0x00, 0x13, 0xA2, 0x00, 0x40, 0x7D, 0x7E, 0x11, 0xFF, 0xFE, 0x01, 'o', 'k'};
+	std::vector<uint8_t> out(64);
+	out.resize(svxbee_encode(one[0], one + 1, sizeof(one) - 1, isEscaped, out.data(), out.size()));
+	svxbee_decoder d;
+	svxbee_decoder_init(&d, isEscaped);
+	svxbee_frame f;
+	memset(&f, 0, sizeof(f));
+	svxbee_decode(&d, out.data(), out.size(), copyFrame, &f);
+	check(f.src64 == 0x0013A200407D7E11ULL && f.src16 == 0xFFFE && f.options == 1 && f.payloadLength == 2
+		&& memcmp(f.payload, "ok", 2) == 0, "%s: Receive Packet fields", mode);
+
+	// Transmit Request header
+	Decoded tx;
+	out.assign(64, 0);
+	out.resize(svxbee_encode_tx(0x0013A20040131111ULL, SVXBEE_UNKNOWN16, 0x7E, (const uint8_t*)"go", 2, isEscaped,
+		out.data(), out.size()));
+	decode(tx, out, isEscaped);
+	uint8_t head[] = {0x7E, 0x00, 0x13, 0xA2, 0x00, 0x40, 0x13, 0x11, 0x11, 0xFF, 0xFE, 0, 0, 'g', 'o'};
+	check(tx.frames.size() == 1 && tx.frames[0].type == SVXBEE_TX_REQUEST
+		&& tx.frames[0].data == std::vector<uint8_t>(head, head + sizeof(head)), "%s: Transmit Request", mode);
+
+	// Too small an output buffer gives no frame rather than part of one
+	out.assign(8, 0);
+	check(svxbee_encode(SVXBEE_RX_PACKET, one + 1, sizeof(one) - 1, isEscaped, out.data(), out.size()) == 0,
+		"%s: frame written past the buffer", mode);
+}
+
+static void checkResync(bool isEscaped)
+{
+	// Each frame is sent intact, truncated, with a bit flipped or after garbage
+	const char* mode = isEscaped ? "API 2" : "API 1";
+	std::vector<Frame> intact;
+	std::vector<uint8_t> bytes;
+	int numTruncated = 0, numFlipped = 0, numGarbage = 0;
+
+	for (int i = 0; i < numFrames; i++)
+	{
+		Frame f = randomFrame();
+		std::vector<uint8_t> out = encode(f, isEscaped);
+
+		switch (rnd() % 8)
+		{
+			case 0:
+				// Cut anywhere after the start, even in an escape
+				out.resize(1 + rnd() % (out.size() - 1));
+				numTruncated++;
+				break;
+
+			case 1:
+			{
+				// Any byte but the start, so the frame either fails its checksum or its length
+				size_t k = 1 + rnd() % (out.size() - 1);
+				out[k] ^= (uint8_t)(1 << rnd() % 8);
+				numFlipped++;
+				break;
+			}
+
+			case 2:
+			{
+				// Garbage with start delimiters before an intact frame
+				std::vector<uint8_t> garbage(1 + rnd() % 40);
+				for (size_t k = 0; k < garbage.size(); k++)
+					garbage[k] = rnd() % 4 == 0 ? SVXBEE_START : (uint8_t)rnd();
+				bytes.insert(bytes.end(), garbage.begin(), garbage.end());
+				intact.push_back(f);
+				numGarbage++;
+				break;
+			}
+
+			default:
+				intact.push_back(f);
+		}
+		bytes.insert(bytes.end(), out.begin(), out.end());
+	}
+
+	Decoded rx;
+	decode(rx, bytes, isEscaped);
+	size_t numFound = countInOrder(intact, rx.frames);
+	size_t numSpurious = rx.frames.size() - numFound;
+	report("%s: %d truncated, %d flipped, %d after garbage: %d of %d intact frames, %d spurious, "
+		"%lu checksum and %lu length errors, %lu bytes discarded", mode, numTruncated, numFlipped, numGarbage,
+		(int)numFound, (int)intact.size(), (int)numSpurious, rx.d.checksumErrors, rx.d.lengthErrors,
+		rx.d.discardedBytes);
+
+	// In API mode 1 a start delimiter in the payload or in damaged bytes can begin a frame
+	// whose checksum fits by chance, about 1 in 256, and which then takes in the frames
+	// after it. In API mode 2 a start delimiter always begins a frame, so none is lost.
+	if (isEscaped)
+		check(numFound == intact.size(), "%s: %d of %d intact frames decoded", mode, (int)numFound,
+			(int)intact.size());
+	else
+		check(numFound * 100 > intact.size() * 99, "%s: %d of %d intact frames decoded", mode, (int)numFound,
+			(int)intact.size());
+	check(rx.d.frames == rx.frames.size(), "%s: frame count %lu", mode, rx.d.frames);
+	check(rx.d.checksumErrors + rx.d.lengthErrors > 0 && rx.d.discardedBytes > 0, "%s: damage not counted", mode);
+	check(numSpurious * 50 < (size_t)(numTruncated + numFlipped + numGarbage), "%s: %d spurious frames", mode,
+		(int)numSpurious);
+
+	// A frame cut short by the next start delimiter is a length error in API mode 2
+	if (isEscaped)
+	{
+		Frame second = randomFrame();
+		std::vector<uint8_t> s = encode(randomFrame(), true), b = encode(second, true);
+		s.resize(s.size() - 2);
+		s.insert(s.end(), b.begin(), b.end());
+		Decoded cut;
+		decode(cut, s, true);
+		check(cut.frames.size() == 1 && isSame(cut.frames[0], second) && cut.d.lengthErrors == 1,
+			"%s: cut frame gave %d frames, %lu length errors", mode, (int)cut.frames.size(), cut.d.lengthErrors);
+	}
+}
+
+struct Lines
+{
+	std::vector<std::string> text;
+	std::vector<int> node;
+};
+
+static void onLine(int node, uint64_t src64, const char* line, size_t len, void* user)
+{
+	Lines* lines = (Lines*)user;
+	lines->text.push_back(std::string(line, len));
+	lines->node.push_back(node);
+}
+
+static void checkRouter()
+{
+	// Lines split across packets of two radios arrive whole, each from its own radio
+	svxbee_router* r = svxbee_router_create(2, 16);
+	Lines lines;
+	const char* parts[][2] = {{"spe", "posi"}, {"ed,1\r", "tion,2"}, {"\n", "\n\n"}, {"a-line-too-long-", "x\r\n"},
+		{"to-keep\nok\n", ""}};
+
+	for (size_t i = 0; i < sizeof(parts) / sizeof(parts[0]); i++)
+		for (int k = 0; k < 2; k++)
+		{
+			svxbee_frame f;
+			memset(&f, 0, sizeof(f));
+			f.type = SVXBEE_RX_PACKET;
+			f.src64 = 0x0013A20040000000ULL + k;
+			f.payload = (const uint8_t*)parts[i][k];
+			f.payloadLength = strlen(parts[i][k]);
+			svxbee_router_route(r, &f, onLine, &lines);
+		}
+
+	const char* want[] = {"speed,1", "position,2", "x", "ok"};
+	int wantNode[] = {0, 1, 1, 0};
+	bool isOk = lines.text.size() == 4;
+	for (size_t i = 0; isOk && i < 4; i++)
+		isOk = lines.text[i] == want[i] && lines.node[i] == wantNode[i];
+	check(isOk, "routed %d lines", (int)lines.text.size());
+	check(svxbee_router_num_nodes(r) == 2 && svxbee_router_dropped(r) == 1, "%d nodes, %lu dropped",
+		svxbee_router_num_nodes(r), svxbee_router_dropped(r));
+	svxbee_router_destroy(r);
+}
+
+
+
+void setup()
+{
+	for (int isEscaped = 0; isEscaped <= 1; isEscaped++)
+	{
+		checkRoundTrip(isEscaped);
+		checkResync(isEscaped);
+	}
+	checkRouter();
+}
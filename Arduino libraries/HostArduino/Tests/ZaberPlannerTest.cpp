@@ -0,0 +1,286 @@
+/*
+ZaberPlannerTest.cpp - ZaberPlanner against a simulated controller with a finite FIFO.
+Released into the public domain.
+
+The controller is a Stream on the virtual clock. It takes "stream 1 line abs" segments into
+a FIFO of fifoSize and runs them one after another at a fixed speed. While the FIFO is
+full, it holds back the reply to the next stream command and reads no further, like the
+real one. It records the segments it ran and every time it stopped, and can lose a reply.
+
+Build and run from this folder
+	g++ -O2 -std=c++11 -Wall -I.. -I../../ZaberMotor ZaberPlannerTest.cpp ../../ZaberMotor/ZaberMotor.cpp TestMain.cpp ../HostArduino.cpp -o ZaberPlannerTest
+	./ZaberPlannerTest
+*/
+
+#include <deque>
+
+#include "HostTest.h"
+#include "ZaberMotor.h"
+
+class FakeController : public Stream
+{
+public:
+	static const unsigned int fifoSize = 6;
+
+	// Speed in microsteps per ms
+	FakeController(double speed) : _speed(speed) {}
+
+	// Segments run, as end points in microsteps
+	std::vector<long> xs, ys;
+
+	unsigned long numStops = 0;		// times motion stopped with the FIFO empty
+	unsigned int maxUnanswered = 0;	// stream commands received and not answered at once
+	long lostReply = -1;			// index of a reply that is never sent
+
+	int available()
+	{
+		run();
+		return (int)(_out.size() - _outPos);
+	}
+
+	int read()
+	{
+		// Reading and writing count as activity, as on HardwareSerial, so that polls stay cheap
+		HostArduino::activity();
+		return _outPos < _out.size() ? (unsigned char)_out[_outPos++] : -1;
+	}
+
+	int peek()
+	{
+		return _outPos < _out.size() ? (unsigned char)_out[_outPos] : -1;
+	}
+
+	size_t write(uint8_t b)
+	{
+		HostArduino::activity();
+		if (b == '\n')
+		{
+			_commands.push_back(_line);
+			_line.clear();
+		}
+		else if (b != '\r')
+			_line += (char)b;
+		return 1;
+	}
+
+	using Print::write;
+
+private:
+	double _speed;
+	std::string _line;
+	std::deque<std::string> _commands;
+	std::string _out;
+	size_t _outPos = 0;
+	long _numReplies = 0;
+
+	std::deque<long> _fifoX, _fifoY;
+	bool _isCorked = false;
+	bool _isMoving = false;
+	double _tEnd = 0;
+	long _x = 0, _y = 0;
+
+	void run()
+	{
+		double t = micros() / 1000.0;
+
+		// Motion, one segment after another without a gap while the FIFO has them
+		while (true)
+		{
+			if (_isMoving && t < _tEnd)
+				break;
+			double t0 = _isMoving ? _tEnd : t;
+			if (_fifoX.empty() || _isCorked)
+			{
+				if (_isMoving)
+					numStops++;
+				_isMoving = false;
+				break;
+			}
+			long x = _fifoX.front(), y = _fifoY.front();
+			_fifoX.pop_front();
+			_fifoY.pop_front();
+			_tEnd = t0 + hypot(x - _x, y - _y) / _speed;
+			_x = x;
+			_y = y;
+			xs.push_back(x);
+			ys.push_back(y);
+			_isMoving = true;
+		}
+
+		// Commands in order, stopping at a segment that does not fit
+		unsigned int numStream = 0;
+		for (size_t i = 0; i < _commands.size(); i++)
+			if (_commands[i].find(" stream 1 line") != std::string::npos)
+				numStream++;
+		if (numStream > maxUnanswered)
+			maxUnanswered = numStream;
+
+		while (!_commands.empty())
+		{
+			std::string cmd = _commands.front();
+			long x, y;
+			if (sscanf(cmd.c_str(), "/01 0 stream 1 line abs %ld %ld", &x, &y) == 2)
+			{
+				if (_fifoX.size() >= fifoSize)
+					break;
+				_fifoX.push_back(x);
+				_fifoY.push_back(y);
+			}
+			else if (cmd == "/01 0 stream 1 fifo cork")
+				_isCorked = true;
+			else if (cmd == "/01 0 stream 1 fifo uncork")
+				_isCorked = false;
+			_commands.pop_front();
+
+			bool isBusy = _isMoving || (!_fifoX.empty() && !_isCorked);
+			if (_numReplies++ != lostReply)
+				_out += isBusy ? "@01 0 OK BUSY -- 0\r\n" : "@01 0 OK IDLE -- 0\r\n";
+		}
+	}
+};
+
+static double distanceToSegment(double px, double py, double ax, double ay, double bx, double by)
+{
+	double dx = bx - ax, dy = by - ay;
+	double len2 = dx * dx + dy * dy;
+	double u = len2 > 0 ? ((px - ax) * dx + (py - ay) * dy) / len2 : 0;
+	u = constrain(u, 0.0, 1.0);
+	return hypot(px - ax - u * dx, py - ay - u * dy);
+}
+
+template <class F>
+static bool streamPath(ZaberPlanner& planner, ZaberMotor& z, const std::vector<long>& xs, const std::vector<long>& ys, F wait)
+{
+	// Feed points as the planner takes them, calling wait between points, until the device
+	// has run the whole path. Returns false after a minute of virtual time.
+
+	planner.clear();
+	planner.start();
+
+	size_t i = 0;
+	unsigned long t0 = millis();
+	while (!planner.update())
+	{
+		if (!check(z.getPendingCount() <= ZaberMotor::maxPending, "%d replies pending", z.getPendingCount()))
+			return false;
+		if (millis() - t0 > 60000)
+			return false;
+
+		while (i < xs.size() && wait(i) && planner.addLine(xs[i], ys[i]))
+			i++;
+		if (i == xs.size())
+			planner.endPath();
+	}
+	return true;
+}
+
+
+
+void setup()
+{
+	const double umPerStep = 381 / 2000.0;
+
+	// Half a circle of radius 10 mm through points 1 um apart, merged with a tolerance of 1 um
+	{
+		FakeController device(20000 / 1000.0 / umPerStep);
+		ZaberMotor z(device, 1, 2);
+		ZaberPlanner planner(z);
+		planner.setMergeTolerance(1);
+
+		std::vector<long> xs, ys;
+		const double r = 10000;
+		long n = PI * r;
+		for (long i = 0; i <= n; i++)
+		{
+			xs.push_back(lround(20000 + r * cos(PI * i / n)));
+			ys.push_back(lround(20000 + r * sin(PI * i / n)));
+		}
+
+		check(streamPath(planner, z, xs, ys, [](size_t) { return true; }), "semicircle did not finish");
+
+		// Distance of every point from the path run, starting where the first point was
+		double worst = 0;
+		size_t m = device.xs.size();
+		for (size_t i = 0; i < xs.size(); i++)
+		{
+			double best = 1e9;
+			for (size_t j = 1; j < m; j++)
+				best = min(best, distanceToSegment(xs[i], ys[i], device.xs[j - 1] * umPerStep, device.ys[j - 1] * umPerStep,
+					device.xs[j] * umPerStep, device.ys[j] * umPerStep));
+			worst = max(worst, best);
+		}
+
+		// Chords within 1 um of a circle of 10 mm would be about 280 um long, but rounding the
+		// points to whole um takes up most of the tolerance; merging every point within 1 um
+		// of its chord gives about 500 segments
+		report("semicircle: %lu points in %lu segments, worst deviation %.2f um, %u underruns, %.0f segments/s",
+			(unsigned long)xs.size(), (unsigned long)m, worst, planner.getUnderrunCount(), planner.getSegmentRate());
+		check(worst <= 1 + umPerStep, "point %.2f um away from the path", worst);
+		check(m > 100 && m < 600, "%lu segments", (unsigned long)m);
+		check(planner.getUnderrunCount() == 0 && device.numStops == 1, "%u underruns, %lu stops",
+			planner.getUnderrunCount(), device.numStops);
+		check(planner.getExpiredCount() == 0, "%u expired", planner.getExpiredCount());
+		check(device.maxUnanswered <= ZaberMotor::maxPending, "%u segments sent unanswered", device.maxUnanswered);
+	}
+
+	// Square of 2 mm sides, each side taking 100 ms, added by the caller at once or slowly
+	for (int isSlow = 0; isSlow < 2; isSlow++)
+	{
+		FakeController device(20000 / 1000.0 / umPerStep);
+		ZaberMotor z(device, 1, 2);
+		ZaberPlanner planner(z);
+		planner.setTargetDepth(20);
+
+		std::vector<long> xs, ys;
+		for (int i = 0; i < 12; i++)
+		{
+			xs.push_back(i % 4 == 1 || i % 4 == 2 ? 3000 : 1000);
+			ys.push_back(i % 4 >= 2 ? 3000 : 1000);
+		}
+
+		// Slowly means every 300 ms
+		unsigned long tNext = millis();
+		auto wait = [&](size_t)
+		{
+			if (!isSlow)
+				return true;
+			if ((long)(millis() - tNext) < 0)
+				return false;
+			tNext += 300;
+			return true;
+		};
+		check(streamPath(planner, z, xs, ys, wait), "square did not finish");
+
+		report("square %s: %lu segments, %u underruns, %lu stops", isSlow ? "slowly" : "at once",
+			(unsigned long)device.xs.size(), planner.getUnderrunCount(), device.numStops);
+		check(device.xs.size() == xs.size(), "%lu segments run", (unsigned long)device.xs.size());
+		check(planner.getUnderrunCount() == device.numStops - 1, "%u underruns for %lu stops",
+			planner.getUnderrunCount(), device.numStops);
+		check(isSlow ? device.numStops > 1 : device.numStops == 1, "%lu stops", device.numStops);
+		check(planner.getExpiredCount() == 0, "%u expired", planner.getExpiredCount());
+		check(device.maxUnanswered <= ZaberMotor::maxPending, "%u segments sent unanswered", device.maxUnanswered);
+	}
+
+	// A reply lost in the middle of a path is given up after the reply timeout
+	{
+		FakeController device(20000 / 1000.0 / umPerStep);
+		device.lostReply = 5;
+		ZaberMotor z(device, 1, 2);
+		ZaberPlanner planner(z);
+		planner.setReplyTimeout(500);
+
+		std::vector<long> xs, ys;
+		for (int i = 0; i < 12; i++)
+		{
+			xs.push_back(i % 4 == 1 || i % 4 == 2 ? 3000 : 1000);
+			ys.push_back(i % 4 >= 2 ? 3000 : 1000);
+		}
+
+		unsigned long t0 = millis();
+		check(streamPath(planner, z, xs, ys, [](size_t) { return true; }), "path with a lost reply did not finish");
+		report("lost reply: %lu segments, %u expired, done after %lu ms", (unsigned long)device.xs.size(),
+			planner.getExpiredCount(), millis() - t0);
+		check(device.xs.size() == xs.size(), "%lu segments run", (unsigned long)device.xs.size());
+		check(planner.getExpiredCount() == 1, "%u expired", planner.getExpiredCount());
+	}
+}
@@ -0,0 +1,351 @@
+/*
+ZaberPtyTest.cpp - ZaberMotor commands and replies against a stand-in device on a pty.
+Released into the public domain.
+
+Serial1 is attached to a pseudo-terminal in real time. A thread opens the other end and
+plays the device: it follows a script of the commands it expects, in ASCII lines or binary
+frames, and the replies it sends back. The test checks what ZaberMotor makes of the
+replies, and the device checks every byte of the commands.
+
+Build and run from this folder
+	g++ -O2 -std=c++11 -Wall -I.. -I../../ZaberMotor ZaberPtyTest.cpp ../../ZaberMotor/ZaberMotor.cpp TestMain.cpp ../HostArduino.cpp -pthread -o ZaberPtyTest
+	./ZaberPtyTest
+*/
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <mutex>
+#include <thread>
+
+#include "HostTest.h"
+#include "ZaberMotor.h"
+
+// Script of the device, one step per line:
+//	< text		expect an ASCII command (the device adds \r\n)
+//	> text		send an ASCII reply
+//	<b hex		expect a binary frame of 6 bytes
+//	>b hex		send bytes, which may be less than a frame
+//	pause ms	wait
+static const char* const deviceScript[] = {
+	// Encoding of moves with the default microstep of 0.1905 um
+	"< /01 1 move abs 2000",
+	"> @01 1 OK BUSY -- 0",
+	"pause 100",
+	"> !01 1 IDLE --",
+
+	// Device-level position of both axes
+	"< /01 0 get pos",
+	"> @01 0 OK IDLE -- 2000 4000",
+
+	// Reference offset and another microstep size
+	"< /01 2 move abs 5774",
+	"> @01 2 RJ IDLE -- BADDATA",
+	"< /01 1 move abs 500",
+	"> @01 1 OK BUSY WR 0",
+
+	// Replies matched by message ID in any order
+	"< /01 0 00 set accel 250",
+	"< /01 0 01 stream 1 setup disable",
+	"< /01 1 02 get pos",
+	"> @01 1 02 OK IDLE -- 1234",
+	"> @01 0 01 OK IDLE -- 0",
+	"> @01 0 00 OK IDLE -- 0",
+
+	// Streams
+	"< /01 0 03 stream 1 setup live 1 2",
+	"< /01 0 04 stream 1 line abs 2000 4000",
+	"> @01 0 03 OK IDLE -- 0",
+	"> @01 0 04 OK BUSY -- 0",
+
+	// Broadcasts on a bus carry an ID when a device uses them, and every device replies
+	"< /01 1 00 get pos",
+	"< /00 0 01 home",
+	"> @02 0 01 OK BUSY -- 0",
+	"> @01 0 01 OK BUSY -- 0",
+	"> @01 1 00 OK IDLE -- 1234",
+	"< /00 0 stop",
+	"> @01 0 OK IDLE -- 0",
+	"> @02 0 OK IDLE -- 0",
+
+	// Binary frames address axes as consecutive devices
+	"<b 02 14 d0 07 00 00",
+	"pause 50",
+	">b 02 14 d0 07 00 00",
+	"<b 01 01 00 00 00 00",
+	"<b 02 01 00 00 00 00",
+	">b 01 01 00 00 00 00",
+	">b 02 01 00 00 00 00",
+	"<b 01 36 00 00 00 00",
+	">b 01 36 63 00 00 00",
+	"<b 02 3c 00 00 00 00",
+	">b 02 3c ff ff ff ff",
+	"<b 01 2a 64 00 00 00",
+	"<b 02 2a 64 00 00 00",
+	">b 01 ff 2a 00 00 00",
+	">b 02 2a 64 00 00 00",
+
+	// A broken frame is dropped after a gap in transmission
+	"<b 02 3c 00 00 00 00",
+	">b 02 3c 10",
+	"pause 100",
+	">b 02 3c 34 12 00 00",
+};
+
+static std::mutex deviceMutex;
+static std::string deviceError;
+static bool isDeviceDone = false;
+
+static void deviceFail(const std::string& error)
+{
+	std::lock_guard<std::mutex> lock(deviceMutex);
+	if (deviceError.empty())
+		deviceError = error;
+}
+
+static bool readBytes(int fd, std::string& buf, size_t n, bool isLine)
+{
+	// Read until buf holds n bytes, or a line when isLine, within 2 s
+	for (;;)
+	{
+		if (isLine)
+		{
+			size_t end = buf.find('\n');
+			if (end != std::string::npos)
+				return true;
+		}
+		else if (buf.size() >= n)
+			return true;
+
+		struct pollfd p = { fd, POLLIN, 0 };
+		if (::poll(&p, 1, 2000) <= 0)
+			return false;
+		char chunk[256];
+		ssize_t got = ::read(fd, chunk, sizeof(chunk));
+		if (got <= 0)
+			return false;
+		buf.append(chunk, got);
+	}
+}
+
+static std::string parseHex(const char* s)
+{
+	std::string bytes;
+	char* end;
+	for (long b = strtol(s, &end, 16); end != s; b = strtol(s, &end, 16))
+	{
+		bytes += (char)b;
+		s = end;
+	}
+	return bytes;
+}
+
+static std::string showBytes(const std::string& s)
+{
+	std::string out;
+	char hex[4];
+	for (size_t i = 0; i < s.size(); i++)
+	{
+		snprintf(hex, sizeof(hex), "%s%02x", i > 0 ? " " : "", (unsigned char)s[i]);
+		out += hex;
+	}
+	return out;
+}
+
+static void runDevice(std::string ptyName)
+{
+	int fd = open(ptyName.c_str(), O_RDWR | O_NOCTTY);
+	if (fd < 0)
+	{
+		deviceFail("cannot open " + ptyName);
+		return;
+	}
+
+	std::string rx;
+	for (size_t i = 0; i < sizeof(deviceScript) / sizeof(deviceScript[0]); i++)
+	{
+		std::string step = deviceScript[i];
+
+		if (step.compare(0, 3, "<b ") == 0)
+		{
+			std::string expected = parseHex(step.c_str() + 3);
+			if (!readBytes(fd, rx, 6, false))
+			{
+				deviceFail("no frame for \"" + step + "\"");
+				break;
+			}
+			std::string frame = rx.substr(0, 6);
+			rx.erase(0, 6);
+			if (frame != expected)
+				deviceFail("got frame " + showBytes(frame) + " for \"" + step + "\"");
+		}
+		else if (step.compare(0, 3, ">b ") == 0)
+		{
+			std::string bytes = parseHex(step.c_str() + 3);
+			if (::write(fd, bytes.data(), bytes.size()) != (ssize_t)bytes.size())
+				deviceFail("cannot write");
+		}
+		else if (step.compare(0, 2, "< ") == 0)
+		{
+			if (!readBytes(fd, rx, 0, true))
+			{
+				deviceFail("no command for \"" + step + "\"");
+				break;
+			}
+			size_t end = rx.find('\n');
+			std::string line = rx.substr(0, end + 1);
+			rx.erase(0, end + 1);
+			if (line != step.substr(2) + "\r\n")
+				deviceFail("got \"" + line.substr(0, line.size() - 2) + "\" for \"" + step + "\"");
+		}
+		else if (step.compare(0, 2, "> ") == 0)
+		{
+			std::string line = step.substr(2) + "\r\n";
+			if (::write(fd, line.data(), line.size()) != (ssize_t)line.size())
+				deviceFail("cannot write");
+		}
+		else if (step.compare(0, 6, "pause ") == 0)
+			usleep(atoi(step.c_str() + 6) * 1000);
+	}
+
+	// Nothing more should arrive
+	if (readBytes(fd, rx, rx.size() + 1, false))
+		deviceFail("unexpected bytes " + showBytes(rx));
+
+	close(fd);
+	std::lock_guard<std::mutex> lock(deviceMutex);
+	isDeviceDone = true;
+}
+
+template <class F>
+static bool waitFor(ZaberMotor& z, F isDone)
+{
+	// Parse replies until the condition holds, for up to 1 s
+	unsigned long t0 = millis();
+	while (millis() - t0 < 1000)
+	{
+		z.update();
+		if (isDone())
+			return true;
+	}
+	return false;
+}
+
+
+
+void setup()
+{
+	const char* name = HostArduino::attachPty(Serial1);
+	if (!check(name != NULL, "cannot open a pseudo-terminal"))
+		return;
+	HostArduino::setRealTime(true);
+	std::thread device(runDevice, std::string(name));
+
+	ZaberMotor z(Serial1, 1, 2);
+
+	// ASCII
+	z.move(381, 1);
+	check(waitFor(z, [&] { return z.getPendingCount() == 0; }), "no reply to move");
+	check(z.isBusy(1) && z.isBusy(0) && !z.isBusy(2), "axis 1 should be busy after move");
+	check(z.getLastReply() == ZaberMotor::REPLY_OK, "move should be accepted");
+	check(waitFor(z, [&] { return !z.isBusy(1); }), "alert should end the move");
+
+	z.requestPosition(0);
+	check(waitFor(z, [&] { return z.getPendingCount() == 0; }), "no reply to get pos");
+	check(z.getPositionSteps(1) == 2000 && z.getPositionSteps(2) == 4000, "positions %ld %ld",
+		z.getPositionSteps(1), z.getPositionSteps(2));
+	check(z.getPosition(1) == 381 && z.getPosition(2) == 762, "positions in um %ld %ld",
+		z.getPosition(1), z.getPosition(2));
+
+	z.setRef(100, 2);
+	z.move(1000, 2);
+	check(waitFor(z, [&] { return z.getPendingCount() == 0; }), "no reply to rejected move");
+	check(z.getLastReply() == ZaberMotor::REPLY_RJ && z.getRejectCount() == 1, "move should be rejected");
+	z.setRef(0, 2);
+
+	z.setMicrostepSize(1, 10);
+	z.move(50, 1);
+	check(waitFor(z, [&] { return z.getPendingCount() == 0; }), "no reply to move");
+	check(strcmp(z.getWarning(1), "WR") == 0, "warning %s", z.getWarning(1));
+	z.setMicrostepSize(381, 2000);
+
+	z.enableMessageIds(true);
+	z.setAcceleration(250);
+	z.requestPosition(1);
+	check(z.getPendingCount() == 3, "3 commands should be pending, not %d", z.getPendingCount());
+	check(waitFor(z, [&] { return z.getPendingCount() == 0; }), "no replies with IDs");
+	check(z.getPositionSteps(1) == 1234, "position by ID %ld", z.getPositionSteps(1));
+	check(z.getRejectCount() == 1, "replies with IDs should be accepted");
+
+	z.streamLine(381, 762);
+	check(waitFor(z, [&] { return z.getPendingCount() == 0; }), "no replies to stream");
+	check(z.isBusy(0), "stream should be busy");
+
+	// Bus of two devices, only the first one with IDs
+	{
+		ZaberBus bus(Serial1);
+		ZaberMotor b1(bus, 1), b2(bus, 2);
+		b1.enableMessageIds(true);
+		b1.requestPosition(1);
+		bus.broadcast("home");
+		check(b1.getPendingCount() == 2 && b2.getPendingCount() == 1, "broadcast should be pending on both");
+		check(b1.isBusy(0) && b2.isBusy(0), "broadcast home should set busy");
+		bool isAnswered = waitFor(b1, [&] { return b1.getPendingCount() == 0 && b2.getPendingCount() == 0; });
+		check(isAnswered, "no replies to broadcast");
+		check(b1.getPositionSteps(1) == 1234, "position by ID after broadcast %ld", b1.getPositionSteps(1));
+		check(b2.getLastReply() == ZaberMotor::REPLY_OK && b2.isBusy(0), "reply with an ID to a device without IDs");
+
+		b1.enableMessageIds(false);
+		bus.broadcast("stop");
+		isAnswered = waitFor(b1, [&] { return b1.getPendingCount() == 0 && b2.getPendingCount() == 0; });
+		check(isAnswered, "no replies to broadcast without IDs");
+		check(!b1.isBusy(0) && !b2.isBusy(0), "replies to stop should clear busy");
+
+		// Motors beyond the size of the bus stay off the port
+		ZaberMotor* others[ZaberBus::maxDevices - 1];
+		for (byte i = 0; i < ZaberBus::maxDevices - 1; i++)
+			others[i] = new ZaberMotor(bus, 3 + i);
+		check(b1.isAttached() && others[ZaberBus::maxDevices - 3]->isAttached(), "motors within the bus should be attached");
+		check(!others[ZaberBus::maxDevices - 2]->isAttached(), "a motor beyond the bus should not be attached");
+		others[ZaberBus::maxDevices - 2]->home();
+		for (byte i = 0; i < ZaberBus::maxDevices - 1; i++)
+			delete others[i];
+
+		// Deleted motors leave the bus, freeing their slots
+		ZaberMotor later(bus, 9);
+		check(later.isAttached(), "a motor should take the slot of a deleted one");
+		bus.detach(later);
+		check(!later.isAttached(), "a detached motor should be off the bus");
+	}
+
+	// Binary
+	z.enableMessageIds(false);
+	z.setProtocol(ZaberMotor::BINARY);
+
+	z.move(381, 2);
+	check(z.isBusy(2), "binary move should set busy");
+	check(waitFor(z, [&] { return !z.isBusy(2); }), "binary move should end");
+	check(z.getPositionSteps(2) == 2000, "binary position %ld", z.getPositionSteps(2));
+
+	z.home(0);
+	check(waitFor(z, [&] { return !z.isBusy(0); }), "binary home should end");
+	check(z.getPositionSteps(1) == 0 && z.getPositionSteps(2) == 0, "home positions %ld %ld",
+		z.getPositionSteps(1), z.getPositionSteps(2));
+
+	z.requestStatus(1);
+	check(waitFor(z, [&] { return z.isBusy(1); }), "binary status should report busy");
+
+	z.requestPosition(2);
+	waitFor(z, [&] { return z.getPositionSteps(2) != 0; });
+	check(z.getPositionSteps(2) == -1, "negative binary position %ld", z.getPositionSteps(2));
+
+	z.setMaxSpeed(100);
+	check(waitFor(z, [&] { return z.getRejectCount() == 2; }), "binary error should be counted");
+
+	z.requestPosition(2);
+	waitFor(z, [&] { return z.getPositionSteps(2) != -1; });
+	check(z.getPositionSteps(2) == 0x1234, "resynchronized position %ld", z.getPositionSteps(2));
+
+	device.join();
+	check(isDeviceDone && deviceError.empty(), "device: %s", deviceError.c_str());
+}
@@ -85,3 +85,1433 @@ byte ManyRig::choose(byte *probVector, byte numChoices)
 
 	return 0;
 }
+
+
+
+TrialSchedule::TrialSchedule()
+{
+	_weights[0] = 100;
+	reset();
+}
+
+void TrialSchedule::setSeed(unsigned long seed)
+{
+	// Xorshift cannot leave the all-zero state, so zero is remapped
+	_seed = seed == 0 ? 1 : seed;
+	reset();
+}
+
+void TrialSchedule::setProbabilities(byte *probVector, byte numChoices)
+{
+	// Probabilities in percent. As in ManyRig::choose, the last choice takes the remainder,
+	// and choices past the point where the others add up to 100 get what is left of it.
+
+	_isBlock = false;
+	_numChoices = constrain(numChoices, 1, maxChoices);
+
+	int sumProb = 0;
+	for (byte i = 0; i < _numChoices - 1; i++)
+	{
+		_weights[i] = probVector[i] < 100 - sumProb ? probVector[i] : 100 - sumProb;
+		sumProb += _weights[i];
+	}
+	_weights[_numChoices - 1] = 100 - sumProb;
+
+	reset();
+}
+
+void TrialSchedule::setBlock(byte *blockCounts, byte numChoices)
+{
+	// Each block contains exactly blockCounts[i] trials of choice i in shuffled order
+
+	_isBlock = true;
+	_numChoices = constrain(numChoices, 1, maxChoices);
+
+	for (byte i = 0; i < _numChoices; i++)
+		_weights[i] = blockCounts[i];
+
+	reset();
+}
+
+void TrialSchedule::setMaxRun(byte n)
+{
+	// Maximum number of consecutive trials with the same choice (0 for no limit)
+	_maxRun = n;
+	reset();
+}
+
+void TrialSchedule::reset()
+{
+	_rngState = _seed;
+	_head = 0;
+	_count = 0;
+	_choice = 0;
+	_interval = 0;
+	_trialNum = 0;
+	_runLength = 0;
+
+	for (byte i = 0; i < _numChoices; i++)
+		_blockLeft[i] = _weights[i];
+}
+
+
+
+byte TrialSchedule::fill()
+{
+	return fill(bufferSize);
+}
+
+byte TrialSchedule::fill(byte numTrials)
+{
+	// Generate up to numTrials trials into free slots. Returns the number generated.
+
+	byte n = min(numTrials, bufferSize - _count);
+
+	for (byte k = 0; k < n; k++)
+	{
+		byte idx = (_head + _count) % bufferSize;
+		_choices[idx] = nextChoice();
+		_intervals[idx] = nextInterval();
+		_count++;
+	}
+
+	return n;
+}
+
+byte TrialSchedule::available()
+{
+	return _count;
+}
+
+bool TrialSchedule::pop()
+{
+	// Advance to the next pre-generated trial. Returns false if none is available.
+
+	if (_count == 0)
+		return false;
+
+	_choice = _choices[_head];
+	_interval = _intervals[_head];
+	_head = (_head + 1) % bufferSize;
+	_count--;
+	_trialNum++;
+
+	return true;
+}
+
+byte TrialSchedule::getChoice()
+{
+	return _choice;
+}
+
+unsigned long TrialSchedule::getInterval()
+{
+	return _interval;
+}
+
+unsigned long TrialSchedule::getTrialNumber()
+{
+	return _trialNum;
+}
+
+byte TrialSchedule::copyChoices(byte *dest, byte maxNum)
+{
+	byte n = min(maxNum, _count);
+	for (byte k = 0; k < n; k++)
+		dest[k] = _choices[(_head + k) % bufferSize];
+	return n;
+}
+
+byte TrialSchedule::copyIntervals(unsigned long *dest, byte maxNum)
+{
+	byte n = min(maxNum, _count);
+	for (byte k = 0; k < n; k++)
+		dest[k] = _intervals[(_head + k) % bufferSize];
+	return n;
+}
+
+
+
+uint32_t TrialSchedule::nextRand()
+{
+	// 32-bit xorshift, independent of Arduino's random() so that schedules are reproducible
+	uint32_t x = _rngState;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	_rngState = x;
+	return x;
+}
+
+byte TrialSchedule::nextChoice()
+{
+	// Refill the block when all of its trials are used up
+	if (_isBlock)
+	{
+		bool isEmpty = true;
+		for (byte i = 0; i < _numChoices; i++)
+			isEmpty = isEmpty && _blockLeft[i] == 0;
+
+		if (isEmpty)
+			for (byte i = 0; i < _numChoices; i++)
+				_blockLeft[i] = _weights[i];
+	}
+
+	// Collect weights of the candidates
+	byte w[maxChoices];
+	unsigned int sumW = 0;
+	for (byte i = 0; i < _numChoices; i++)
+	{
+		w[i] = _isBlock ? _blockLeft[i] : _weights[i];
+		sumW += w[i];
+	}
+
+	if (_maxRun > 0)
+	{
+		// Exclude the repeating choice once its run reaches the limit. When it is the only
+		// candidate left in a block, the run is allowed to continue.
+		if (_runLength >= _maxRun && sumW > w[_lastChoice])
+		{
+			sumW -= w[_lastChoice];
+			w[_lastChoice] = 0;
+		}
+
+		// In a block, force a choice that could no longer be interleaved with the rest
+		// within the run limit if it were skipped now
+		if (_isBlock)
+		{
+			unsigned int sumLeft = 0;
+			for (byte i = 0; i < _numChoices; i++)
+				sumLeft += _blockLeft[i];
+
+			for (byte i = 0; i < _numChoices; i++)
+			{
+				if (w[i] > 0 && _blockLeft[i] > _maxRun * (sumLeft - _blockLeft[i]))
+				{
+					for (byte j = 0; j < _numChoices; j++)
+						if (j != i)
+							w[j] = 0;
+					sumW = w[i];
+					break;
+				}
+			}
+		}
+	}
+
+	if (sumW == 0)
+		return 0;
+
+	// Draw a choice in proportion to its weight
+	unsigned int r = nextRand() % sumW;
+	byte c = 0;
+	while (r >= w[c])
+	{
+		r -= w[c];
+		c++;
+	}
+
+	// Update states
+	if (_isBlock)
+		_blockLeft[c]--;
+
+	if (c == _lastChoice && _runLength > 0)
+		_runLength++;
+	else
+		_runLength = 1;
+	_lastChoice = c;
+
+	return c;
+}
+
+unsigned long TrialSchedule::nextInterval()
+{
+	// Same distribution as Interval::nextRandom, added to the fixed duration
+
+	unsigned long randomDur = 0;
+
+	if (iti.meanRandDur > 0 && iti.upperRandLim > iti.lowerRandLim)
+	{
+		do {
+			double u = double(nextRand() >> 8) / 16777216.0;
+			randomDur = -double(iti.meanRandDur) * log(1.0 - u);
+		} while (randomDur > iti.upperRandLim || randomDur < iti.lowerRandLim);
+	}
+
+	return iti.fixedDur + randomDur;
+}
+
+
+
+// Only one machine runs at a time since interrupt handlers take no arguments
+typedef EngineTimer<StateMachine, &StateMachine::tick> MachineTimer;
+
+static void edge0() { MachineTimer::active()->onEdge(0); }
+static void edge1() { MachineTimer::active()->onEdge(1); }
+static void edge2() { MachineTimer::active()->onEdge(2); }
+static void edge3() { MachineTimer::active()->onEdge(3); }
+static void (*const edgeHandlers[StateMachine::maxInputs])() = {edge0, edge1, edge2, edge3};
+
+StateMachine::StateMachine()
+{
+	clear();
+}
+
+void StateMachine::setInput(byte ch, byte pin, byte mode)
+{
+	if (ch >= maxInputs)
+		return;
+
+	pinMode(pin, mode);
+	_inPins[ch] = pin;
+	_inLevels[ch] = digitalRead(pin) == HIGH;
+	if (ch >= _numInputs)
+		_numInputs = ch + 1;
+}
+
+void StateMachine::setOutput(byte ch, byte pin)
+{
+	if (ch >= maxOutputs)
+		return;
+
+	pinMode(pin, OUTPUT);
+	digitalWrite(pin, LOW);
+	_outPins[ch] = pin;
+	_pulseWidths[ch] = 0;
+	if (ch >= _numOutputs)
+		_numOutputs = ch + 1;
+}
+
+void StateMachine::setPulse(byte ch, unsigned long widthInUs)
+{
+	// Width of the pulse started on an output by states with its bit in pulses
+	if (ch < maxOutputs)
+		_pulseWidths[ch] = widthInUs;
+}
+
+void StateMachine::clear()
+{
+	// States do nothing and go nowhere until defined
+
+	if (_isRunning || _pulseMask)
+		stop();
+	for (byte s = 0; s < maxStates; s++)
+	{
+		_outHigh[s] = 0;
+		_outLow[s] = 0;
+		_pulses[s] = 0;
+		_timers[s] = 0;
+		_timerNext[s] = none;
+		for (byte k = 0; k < 2 * maxInputs; k++)
+			_next[s][k] = none;
+	}
+}
+
+bool StateMachine::setState(byte s, byte outHigh, byte outLow, byte pulses, unsigned long timerInUs, byte timerNext)
+{
+	// Outputs and timer of a state. A timer of 0 never expires.
+
+	if (s >= maxStates || (timerNext >= maxStates && timerNext != exitState && timerNext != none))
+		return false;
+
+	noInterrupts();
+	_outHigh[s] = outHigh;
+	_outLow[s] = outLow;
+	_pulses[s] = pulses;
+	_timers[s] = timerInUs;
+	_timerNext[s] = timerNext;
+	interrupts();
+	return true;
+}
+
+bool StateMachine::setTransition(byte s, byte input, bool isRising, byte next)
+{
+	if (s >= maxStates || input >= maxInputs || (next >= maxStates && next != exitState && next != none))
+		return false;
+
+	_next[s][2 * input + (isRising ? 0 : 1)] = next;
+	return true;
+}
+
+bool StateMachine::loadRow(unsigned int idx, long val)
+{
+	// Load a state from a Satellites command "<cmd>,<state>,<outHigh>,<outLow>,<pulses>,
+	// <timerInUs>,<timerNext>,<rise0>,<fall0>,<rise1>,<fall1>,...". Pass getIndex and
+	// getValue of each callback. Fields left out keep their values.
+
+	if (idx == 1)
+	{
+		_loadState = val >= 0 && val < maxStates ? val : none;
+		return _loadState != none;
+	}
+	if (idx < 2 || _loadState == none)
+		return false;
+
+	byte s = _loadState;
+	byte field = idx - 2;
+	byte b = constrain(val, 0, 255);
+	switch (field)
+	{
+		case 0: return setState(s, b, _outLow[s], _pulses[s], _timers[s], _timerNext[s]);
+		case 1: return setState(s, _outHigh[s], b, _pulses[s], _timers[s], _timerNext[s]);
+		case 2: return setState(s, _outHigh[s], _outLow[s], b, _timers[s], _timerNext[s]);
+		case 3: return setState(s, _outHigh[s], _outLow[s], _pulses[s], max(val, 0L), _timerNext[s]);
+		case 4: return setState(s, _outHigh[s], _outLow[s], _pulses[s], _timers[s], b);
+	}
+	byte k = field - 5;
+	return k < 2 * maxInputs && setTransition(s, k / 2, k % 2 == 0, b);
+}
+
+
+
+bool StateMachine::begin(unsigned long tickInUs)
+{
+	// Attach input interrupts and start a hardware timer calling tick, which bounds the
+	// resolution of timers and pulses. Without IntervalTimer this returns false; call tick
+	// from loop or a Satellites::delayUntil condition instead.
+
+	MachineTimer::attach(*this);
+
+	for (byte ch = 0; ch < _numInputs; ch++)
+		attachInterrupt(digitalPinToInterrupt(_inPins[ch]), edgeHandlers[ch], CHANGE);
+
+	return MachineTimer::begin(tickInUs);
+}
+
+void StateMachine::end()
+{
+	stop();
+
+	if (MachineTimer::active() != this)
+		return;
+
+	for (byte ch = 0; ch < _numInputs; ch++)
+		detachInterrupt(digitalPinToInterrupt(_inPins[ch]));
+	MachineTimer::detach(*this);
+}
+
+void StateMachine::start(byte s)
+{
+	noInterrupts();
+	_isRunning = true;
+	enter(s, startCause, micros());
+	interrupts();
+}
+
+void StateMachine::stop()
+{
+	// Stop and end pulses. Other outputs keep their levels.
+
+	noInterrupts();
+	_isRunning = false;
+	_isTimerOn = false;
+	writeOutputs(_pulseMask, LOW);
+	_pulseMask = 0;
+	interrupts();
+}
+
+bool StateMachine::isRunning()
+{
+	return _isRunning;
+}
+
+byte StateMachine::getState()
+{
+	return _state;
+}
+
+void StateMachine::tick()
+{
+	// End pulses and take timer transitions that are due
+
+	noInterrupts();
+	unsigned long t = micros();
+
+	if (_pulseMask)
+	{
+		for (byte ch = 0; ch < _numOutputs; ch++)
+		{
+			byte bit = 1 << ch;
+			if ((_pulseMask & bit) && (long)(t - _pulseEnds[ch]) >= 0)
+			{
+				digitalWrite(_outPins[ch], LOW);
+				_pulseMask &= ~bit;
+			}
+		}
+	}
+
+	if (_isRunning && _isTimerOn && (long)(t - _timerDue) >= 0)
+		enter(_timerNext[_state], timerCause, t);
+
+	interrupts();
+}
+
+void StateMachine::onEdge(byte ch)
+{
+	// Take the transition of an input edge, timing it from interrupt entry
+
+	unsigned long t = micros();
+	bool level = digitalRead(_inPins[ch]) == HIGH;
+	if (level == _inLevels[ch])
+		return;
+	_inLevels[ch] = level;
+
+	if (!_isRunning)
+		return;
+
+	byte cause = 2 * ch + (level ? 0 : 1);
+	byte next = _next[_state][cause];
+	if (next == none)
+		return;
+
+	enter(next, cause, t);
+
+	unsigned long latency = micros() - t;
+	if (latency > _maxLatency)
+		_maxLatency = latency;
+}
+
+void StateMachine::enter(byte s, byte cause, unsigned long t)
+{
+	// Called with interrupts off
+
+	if (s == none)
+	{
+		_isTimerOn = false;
+		return;
+	}
+
+	_events.push(s, cause, t);
+	if (s >= maxStates)
+	{
+		_isRunning = false;
+		_isTimerOn = false;
+		return;
+	}
+
+	_state = s;
+	writeOutputs(_outLow[s], LOW);
+	writeOutputs(_outHigh[s] | _pulses[s], HIGH);
+
+	for (byte ch = 0; ch < _numOutputs; ch++)
+		if (_pulses[s] & (1 << ch))
+			_pulseEnds[ch] = t + _pulseWidths[ch];
+	_pulseMask |= _pulses[s];
+
+	_isTimerOn = _timers[s] > 0;
+	_timerDue = t + _timers[s];
+}
+
+void StateMachine::writeOutputs(byte mask, byte level)
+{
+	for (byte ch = 0; mask && ch < _numOutputs; ch++, mask >>= 1)
+		if (mask & 1)
+			digitalWrite(_outPins[ch], level);
+}
+
+
+
+byte StateMachine::available()
+{
+	return _events.available();
+}
+
+bool StateMachine::popEvent(byte& state, byte& cause, unsigned long& t)
+{
+	// Oldest state entry: the state, the edge (2 * input, + 1 when falling) or timerCause or
+	// startCause that caused it, and the time in microseconds
+	return _events.pop(state, cause, t);
+}
+
+unsigned long StateMachine::getDropped()
+{
+	return _events.getDropped();
+}
+
+unsigned long StateMachine::getMaxLatency()
+{
+	// Longest time from entering an input interrupt to having written the outputs, in us
+	return _maxLatency;
+}
+
+void StateMachine::clearMaxLatency()
+{
+	_maxLatency = 0;
+}
+
+
+
+// As with StateMachine, one generator runs from the timer at a time
+typedef EngineTimer<SyncGenerator, &SyncGenerator::tick> SyncTimer;
+
+SyncGenerator::SyncGenerator()
+{
+}
+
+void SyncGenerator::setBarcodePin(byte pin)
+{
+	pinMode(pin, OUTPUT);
+	digitalWrite(pin, LOW);
+	_barcodePin = pin;
+}
+
+void SyncGenerator::setBarcode(byte numBits, unsigned long bitWidthInUs)
+{
+	// Bits sent of the number and width of a bit cell. A barcode lasts numBits + 3 cells.
+
+	noInterrupts();
+	_numBits = constrain(numBits, 1, maxBits);
+	_halfBit = max(bitWidthInUs / 2, 1UL);
+	interrupts();
+}
+
+void SyncGenerator::setFramePins(byte pin, byte pin2)
+{
+	// Frame pulses go out on both pins, e.g. camPin to trigger the camera and framePin to
+	// record frame times
+
+	_framePins[0] = pin;
+	_framePins[1] = pin2;
+	for (byte i = 0; i < 2; i++)
+		if (_framePins[i] != none)
+			pinMode(_framePins[i], OUTPUT);
+	writeFrame(LOW);
+}
+
+void SyncGenerator::setFrameRate(float hz)
+{
+	// The fraction of a microsecond in the period is carried over, so the rate holds over
+	// long sessions (e.g. 30 Hz is 33333 us and 21845/65536 us)
+
+	if (hz <= 0)
+		return;
+
+	double period = 1e6 / hz;
+	noInterrupts();
+	_framePeriod = (unsigned long)period;
+	_frameFrac = (period - _framePeriod) * 65536;
+	interrupts();
+}
+
+void SyncGenerator::setFrameWidth(unsigned long widthInUs)
+{
+	_frameWidth = widthInUs;
+}
+
+void SyncGenerator::setFrameLogInterval(unsigned long n)
+{
+	// Log every n-th frame. The first and the last frame are always logged, and frames in
+	// between follow from the rate.
+	_logInterval = max(n, 1UL);
+}
+
+bool SyncGenerator::begin(unsigned long tickInUs)
+{
+	// Start a hardware timer calling tick, which bounds the jitter of edges (not the rate,
+	// since edges are scheduled in absolute time). Without IntervalTimer this returns false;
+	// call tick from loop instead.
+
+	SyncTimer::attach(*this);
+	return SyncTimer::begin(tickInUs);
+}
+
+void SyncGenerator::end()
+{
+	stopFrames();
+	SyncTimer::detach(*this);
+
+	noInterrupts();
+	_isBarcode = false;
+	if (_barcodePin != none)
+		digitalWrite(_barcodePin, LOW);
+	writeFrame(LOW);
+	_isFrameHigh = false;
+	interrupts();
+}
+
+bool SyncGenerator::sendBarcode(unsigned long number)
+{
+	// Start a barcode on the next tick, or return false while the last one is being sent
+
+	if (_barcodePin == none || _isBarcode)
+		return false;
+
+	noInterrupts();
+	_code = _numBits < 32 ? number & ((1UL << _numBits) - 1) : number;
+	_halfIdx = 0;
+	_barcodeDue = micros();
+	_isBarcode = true;
+	interrupts();
+	return true;
+}
+
+bool SyncGenerator::isSendingBarcode()
+{
+	return _isBarcode;
+}
+
+void SyncGenerator::startFrames(unsigned long count)
+{
+	// Start frames now and count them from 0, stopping after count frames (never when 0)
+
+	if (_framePins[0] == none)
+		return;
+
+	noInterrupts();
+	if (_isFraming)
+		endFrames();
+	_numFrames = 0;
+	_frameLimit = count;
+	_frameAcc = 0;
+	_frameDue = micros();
+	_isFraming = true;
+	interrupts();
+}
+
+void SyncGenerator::stopFrames()
+{
+	// A pulse being sent is finished
+
+	noInterrupts();
+	if (_isFraming)
+		endFrames();
+	interrupts();
+}
+
+bool SyncGenerator::isFraming()
+{
+	return _isFraming;
+}
+
+unsigned long SyncGenerator::getFrameCount()
+{
+	noInterrupts();
+	unsigned long n = _numFrames;
+	interrupts();
+	return n;
+}
+
+void SyncGenerator::tick()
+{
+	// Write the barcode edge and frame edges that are due
+
+	noInterrupts();
+	unsigned long t = micros();
+
+	if (_isBarcode && (long)(t - _barcodeDue) >= 0)
+	{
+		// Half cells: 4 of mark, 2 of gap, then 2 per bit
+		byte total = 6 + 2 * _numBits;
+		// Edges are timed from the actual start of the mark
+		byte k = _halfIdx;
+		if (k == 0)
+		{
+			_barcodeDue = t;
+			_events.push(barcodeEvent, _code, t);
+		}
+
+		if (k >= total)
+		{
+			digitalWrite(_barcodePin, LOW);
+			_isBarcode = false;
+		}
+		else
+		{
+			bool level = k < 4;
+			if (k >= 6)
+			{
+				bool bit = (_code >> ((k - 6) / 2)) & 1;
+				level = (k % 2 == 0) == bit;
+			}
+			digitalWrite(_barcodePin, level ? HIGH : LOW);
+			_halfIdx = k + 1;
+			_barcodeDue += _halfBit;
+		}
+	}
+
+	if (_isFrameHigh && (long)(t - _frameEnd) >= 0)
+	{
+		writeFrame(LOW);
+		_isFrameHigh = false;
+	}
+
+	if (_isFraming && !_isFrameHigh && (long)(t - _frameDue) >= 0)
+	{
+		writeFrame(HIGH);
+		_isFrameHigh = true;
+		_frameEnd = _frameDue + _frameWidth;
+		_lastFrame = _frameDue;
+		if (_numFrames % _logInterval == 0)
+			_events.push(frameEvent, _numFrames, _frameDue);
+		_numFrames++;
+
+		uint16_t acc = _frameAcc + _frameFrac;
+		_frameDue += _framePeriod + (acc < _frameAcc ? 1 : 0);
+		_frameAcc = acc;
+
+		if (_frameLimit > 0 && _numFrames >= _frameLimit)
+			endFrames();
+	}
+
+	interrupts();
+}
+
+void SyncGenerator::writeFrame(byte level)
+{
+	for (byte i = 0; i < 2; i++)
+		if (_framePins[i] != none)
+			digitalWrite(_framePins[i], level);
+}
+
+void SyncGenerator::endFrames()
+{
+	// Called with interrupts off
+	_isFraming = false;
+	if (_numFrames > 0)
+		_events.push(framesEndEvent, _numFrames, _lastFrame);
+}
+
+
+
+byte SyncGenerator::available()
+{
+	return _events.available();
+}
+
+bool SyncGenerator::popEvent(byte& kind, unsigned long& value, unsigned long& t)
+{
+	// Oldest event: its kind, the number or frame index, and the time of its first rising
+	// edge in microseconds (of the last frame for framesEndEvent)
+	return _events.pop(kind, value, t);
+}
+
+unsigned long SyncGenerator::getDropped()
+{
+	return _events.getDropped();
+}
+
+
+
+// One player runs from the timer at a time, as with StateMachine
+typedef EngineTimer<SequencePlayer, &SequencePlayer::onTimer> PlayerTimer;
+
+// Period of the timer between sequences, which keeps it claimed
+static const unsigned long playerIdlePeriod = 100000;
+
+static void playerTrigger()
+{
+	PlayerTimer::active()->onTrigger();
+}
+
+SequencePlayer::SequencePlayer()
+{
+}
+
+void SequencePlayer::setOutput(byte ch, byte pin)
+{
+	if (ch >= maxOutputs)
+		return;
+
+	pinMode(pin, OUTPUT);
+	digitalWrite(pin, LOW);
+	_outPins[ch] = pin;
+	_outLevels &= ~(1 << ch);
+	if (ch >= _numOutputs)
+		_numOutputs = ch + 1;
+}
+
+void SequencePlayer::setTrigger(byte pin, bool isRising, byte mode)
+{
+	// Input whose edge starts an armed sequence
+	pinMode(pin, mode);
+	_triggerPin = pin;
+	_isRising = isRising;
+}
+
+void SequencePlayer::clear()
+{
+	if (_isArmed || _isPlaying)
+		return;
+
+	_numSteps = 0;
+	_duration = 0;
+	_pendingDelay = 0;
+}
+
+bool SequencePlayer::addStep(unsigned long delayInUs, byte levels)
+{
+	if (_numSteps >= maxSteps || _isArmed || _isPlaying)
+		return false;
+
+	if (delayInUs < minDelay)
+		delayInUs = minDelay;
+	_delays[_numSteps] = delayInUs;
+	_levels[_numSteps] = levels;
+	_numSteps++;
+	_duration += delayInUs;
+	return true;
+}
+
+bool SequencePlayer::loadStep(unsigned int idx, long val)
+{
+	// Add steps from a Satellites command "<cmd>,<delay>,<levels>,<delay>,<levels>,...".
+	// Pass getIndex and getValue of each callback. Steps follow those loaded already, so
+	// clear first for a new sequence. A 20 Hz train of 5 ms pulses on channel 0 for 1 s is
+	// "<cmd>,2,1,5000,0" with setLoops(20, 50000).
+
+	if (idx == 0)
+		return false;
+
+	if (idx % 2 == 1)
+	{
+		_pendingDelay = max(val, 0L);
+		return true;
+	}
+	return addStep(_pendingDelay, constrain(val, 0, 255));
+}
+
+byte SequencePlayer::numSteps()
+{
+	return _numSteps;
+}
+
+unsigned long SequencePlayer::getDuration()
+{
+	// Time from the start to the last step of one loop in us
+	return _duration;
+}
+
+void SequencePlayer::setLoops(unsigned long count, unsigned long periodInUs)
+{
+	// Play count times (0 for ever until stop), with each loop starting periodInUs after the
+	// one before, or right after the last step of it when the period is shorter
+
+	if (_isArmed || _isPlaying)
+		return;
+
+	_numLoops = count;
+	_period = periodInUs;
+}
+
+bool SequencePlayer::begin()
+{
+	// Claim the timer and trigger interrupt. Without IntervalTimer, or when no timer is
+	// free, this returns false; call tick from loop instead, which bounds timing by the loop.
+
+	PlayerTimer::attach(*this);
+	_hasTimer = PlayerTimer::begin(playerIdlePeriod);
+	return _hasTimer;
+}
+
+void SequencePlayer::end()
+{
+	stop();
+	PlayerTimer::detach(*this);
+	_hasTimer = false;
+}
+
+bool SequencePlayer::arm()
+{
+	// Start on the next edge of the trigger input
+
+	if (PlayerTimer::active() != this || _numSteps == 0 || _triggerPin == none || _isPlaying)
+		return false;
+
+	_isArmed = true;
+	attachInterrupt(digitalPinToInterrupt(_triggerPin), playerTrigger, _isRising ? RISING : FALLING);
+	return true;
+}
+
+void SequencePlayer::disarm()
+{
+	_isArmed = false;
+	if (_triggerPin != none)
+		detachInterrupt(digitalPinToInterrupt(_triggerPin));
+}
+
+bool SequencePlayer::start()
+{
+	// Start now, from the protocol
+
+	if (PlayerTimer::active() != this || _numSteps == 0 || _isPlaying)
+		return false;
+
+	noInterrupts();
+	play(0, micros());
+	interrupts();
+	return true;
+}
+
+void SequencePlayer::stop()
+{
+	// Stop playing or waiting for the trigger, and set all outputs low
+
+	disarm();
+	noInterrupts();
+	if (_isPlaying)
+		finish(stopEvent, _numPlayed, micros());
+	writeOutputs(0);
+	interrupts();
+}
+
+bool SequencePlayer::isArmed()
+{
+	return _isArmed;
+}
+
+bool SequencePlayer::isPlaying()
+{
+	return _isPlaying;
+}
+
+void SequencePlayer::tick()
+{
+	// Play the steps that are due, when there is no timer
+
+	if (_hasTimer)
+		return;
+
+	noInterrupts();
+	unsigned long t = micros();
+	while (_isPlaying && (long)(t - _due) >= 0)
+		onTimer();
+	interrupts();
+}
+
+void SequencePlayer::onTrigger()
+{
+	unsigned long t = micros();
+	if (_isArmed && !_isPlaying)
+		play(1, t);
+}
+
+void SequencePlayer::onTimer()
+{
+	// Write the step that is due and set the timer for the step after the next one, since
+	// a new interval takes effect when the current one ends
+
+	if (!_isPlaying)
+		return;
+
+	byte k = _idx;
+	writeOutputs(_levels[k]);
+	_numPlayed++;
+
+	unsigned long next = delayAfter(k, _loop);
+	if (next == 0)
+	{
+		finish(doneEvent, _loop + 1, _due);
+		return;
+	}
+
+	if (k + 1 < _numSteps)
+		_idx = k + 1;
+	else
+	{
+		_idx = 0;
+		_loop++;
+	}
+	_due += next;
+
+	unsigned long after = delayAfter(_idx, _loop);
+	if (_hasTimer && after > 0)
+		PlayerTimer::update(after);
+}
+
+void SequencePlayer::play(byte cause, unsigned long t)
+{
+	// Called with interrupts off
+
+	_isArmed = false;
+	_isPlaying = true;
+	_idx = 0;
+	_loop = 0;
+	_numPlayed = 0;
+	_due = t + _delays[0];
+	_events.push(startEvent, cause, t);
+
+	// Restarting the timer on its channel should not fail, but tick takes over if it does
+	if (_hasTimer && !PlayerTimer::begin(_delays[0]))
+		_hasTimer = false;
+
+	unsigned long after = delayAfter(0, 0);
+	if (_hasTimer && after > 0)
+		PlayerTimer::update(after);
+}
+
+void SequencePlayer::finish(byte kind, unsigned long value, unsigned long t)
+{
+	// Called with interrupts off
+
+	_isPlaying = false;
+
+	// The timer idles, firing once more at the interval it had
+	if (_hasTimer)
+		PlayerTimer::update(playerIdlePeriod);
+
+	_events.push(kind, value, t);
+}
+
+unsigned long SequencePlayer::delayAfter(byte idx, unsigned long loop)
+{
+	// Delay from a step to the next one, 0 after the last step of the last loop
+
+	if (idx + 1 < _numSteps)
+		return _delays[idx + 1];
+	if (_numLoops > 0 && loop + 1 >= _numLoops)
+		return 0;
+
+	unsigned long period = max(_period, _duration);
+	return period - _duration + _delays[0];
+}
+
+void SequencePlayer::writeOutputs(byte levels)
+{
+	// Only outputs that change are written
+	byte changes = (levels ^ _outLevels) & ((1 << _numOutputs) - 1);
+	for (byte ch = 0; changes; ch++, changes >>= 1)
+		if (changes & 1)
+			digitalWrite(_outPins[ch], (levels >> ch) & 1 ? HIGH : LOW);
+	_outLevels = levels;
+}
+
+
+
+byte SequencePlayer::available()
+{
+	return _events.available();
+}
+
+bool SequencePlayer::popEvent(byte& kind, unsigned long& value, unsigned long& t)
+{
+	// Oldest event: its kind, value and time in us (of the last step for doneEvent)
+	return _events.pop(kind, value, t);
+}
+
+unsigned long SequencePlayer::getDropped()
+{
+	// Events lost while the buffer was full, which only happens when nobody reads it
+	return _events.getDropped();
+}
+
+
+
+// One period of a sine in Q15, interpolated between entries
+static const int16_t sineTable[256] PROGMEM = {
+	0, 804, 1608, 2410, 3212, 4011, 4808, 5602, 6393, 7179, 7962, 8739, 9512, 10278, 11039, 11793,
+	12539, 13279, 14010, 14732, 15446, 16151, 16846, 17530, 18204, 18868, 19519, 20159, 20787, 21403, 22005, 22594,
+	23170, 23731, 24279, 24811, 25329, 25832, 26319, 26790, 27245, 27683, 28105, 28510, 28898, 29268, 29621, 29956,
+	30273, 30571, 30852, 31113, 31356, 31580, 31785, 31971, 32137, 32285, 32412, 32521, 32609, 32678, 32728, 32757,
+	32767, 32757, 32728, 32678, 32609, 32521, 32412, 32285, 32137, 31971, 31785, 31580, 31356, 31113, 30852, 30571,
+	30273, 29956, 29621, 29268, 28898, 28510, 28105, 27683, 27245, 26790, 26319, 25832, 25329, 24811, 24279, 23731,
+	23170, 22594, 22005, 21403, 20787, 20159, 19519, 18868, 18204, 17530, 16846, 16151, 15446, 14732, 14010, 13279,
+	12539, 11793, 11039, 10278, 9512, 8739, 7962, 7179, 6393, 5602, 4808, 4011, 3212, 2410, 1608, 804,
+	0, -804, -1608, -2410, -3212, -4011, -4808, -5602, -6393, -7179, -7962, -8739, -9512, -10278, -11039, -11793,
+	-12539, -13279, -14010, -14732, -15446, -16151, -16846, -17530, -18204, -18868, -19519, -20159, -20787, -21403, -22005, -22594,
+	-23170, -23731, -24279, -24811, -25329, -25832, -26319, -26790, -27245, -27683, -28105, -28510, -28898, -29268, -29621, -29956,
+	-30273, -30571, -30852, -31113, -31356, -31580, -31785, -31971, -32137, -32285, -32412, -32521, -32609, -32678, -32728, -32757,
+	-32767, -32757, -32728, -32678, -32609, -32521, -32412, -32285, -32137, -31971, -31785, -31580, -31356, -31113, -30852, -30571,
+	-30273, -29956, -29621, -29268, -28898, -28510, -28105, -27683, -27245, -26790, -26319, -25832, -25329, -24811, -24279, -23731,
+	-23170, -22594, -22005, -21403, -20787, -20159, -19519, -18868, -18204, -17530, -16846, -16151, -15446, -14732, -14010, -13279,
+	-12539, -11793, -11039, -10278, -9512, -8739, -7962, -7179, -6393, -5602, -4808, -4011, -3212, -2410, -1608, -804
+};
+
+static long sine(uint32_t phase)
+{
+	byte idx = phase >> 24;
+	long a = (int16_t)pgm_read_word(sineTable + idx);
+	long b = (int16_t)pgm_read_word(sineTable + (byte)(idx + 1));
+	long frac = (phase >> 8) & 0xFFFF;
+	return a + (((b - a) * frac) >> 16);
+}
+
+// Stages of a tone
+static const byte idleState = 0;
+static const byte attackState = 1;
+static const byte sustainState = 2;
+static const byte releaseState = 3;
+
+// A ramp is a quarter of a cycle of the ramp phase
+static const uint32_t rampEnd = 1UL << 30;
+
+// One synthesizer runs from the timer at a time
+typedef EngineTimer<ToneSynth, &ToneSynth::onTimer> SynthTimer;
+
+ToneSynth::ToneSynth()
+{
+	for (byte i = 0; i < numPresets; i++)
+	{
+		_freqs[i] = 0;
+		_volumes[i] = 0;
+	}
+}
+
+void ToneSynth::setOutput(byte pin, byte bits)
+{
+	// DAC pin (e.g. A14 on Teensy 3.2, A21 on 3.6) or PWM pin, and the resolution of
+	// analogWrite. With PWM, filter the pin and raise its PWM frequency well above the tones.
+	// analogWriteResolution applies to every pin, so on Teensy the synth sets it around each
+	// of its writes and puts back that of the sketch. Other boards cannot read it back, and
+	// begin sets it for the whole sketch there.
+
+	_pin = pin;
+	_bits = constrain(bits, 8, 16);
+}
+
+bool ToneSynth::setSampleRate(unsigned long hz)
+{
+	// Samples per second, which must be over twice the highest tone. The timer period is
+	// 1e6 / hz us, and the host emulator rounds it to whole microseconds. tick carries the
+	// fraction of a microsecond over (e.g. 44.1 kHz is 22 us and 44984/65536 us).
+
+	if (hz == 0 || hz > 1000000 || _state != idleState)
+		return false;
+
+	// Presets must stay below half the new rate
+	for (byte i = 0; i < numPresets; i++)
+		if (_freqs[i] >= hz / 2.0)
+			return false;
+
+	double period = 1e6 / hz;
+	_sampleRate = hz;
+	_samplePeriod = (unsigned long)period;
+	_sampleFrac = (period - _samplePeriod) * 65536;
+
+	// Should the timer not restart, tick takes over as after a failed begin
+	if (_hasTimer && !SynthTimer::begin(1e6 / _sampleRate))
+		_hasTimer = false;
+	return true;
+}
+
+void ToneSynth::setRamp(unsigned long rampInUs)
+{
+	// Duration of the fade in and of the fade out
+	_rampUs = rampInUs;
+}
+
+bool ToneSynth::setPreset(byte idx, float hz, byte volume)
+{
+	// Tones at or above half the sample rate alias, and their phase increment overflows
+	if (idx >= numPresets || hz < 0 || hz >= _sampleRate / 2.0)
+		return false;
+
+	_freqs[idx] = hz;
+	_volumes[idx] = volume;
+	return true;
+}
+
+bool ToneSynth::begin()
+{
+	// Set the output to silence and start the sample timer. Without IntervalTimer this
+	// returns false; call tick from loop instead, which only suits low sample rates.
+
+	SynthTimer::attach(*this);
+	_state = idleState;
+
+#if defined(ARM_DEMCR) && defined(ARM_DWT_CTRL)
+	ARM_DEMCR |= ARM_DEMCR_TRCENA;
+	ARM_DWT_CTRL |= ARM_DWT_CTRL_CYCCNTENA;
+#endif
+
+	if (_pin != none)
+	{
+		pinMode(_pin, OUTPUT);
+#if !defined(__AVR__) && !defined(TEENSYDUINO)
+		analogWriteResolution(_bits);
+#endif
+		writeSample(0);
+	}
+
+	_due = micros();
+	_dueAcc = 0;
+	clearLoad();
+
+	_hasTimer = SynthTimer::begin(1e6 / _sampleRate);
+	return _hasTimer;
+}
+
+void ToneSynth::end()
+{
+	SynthTimer::detach(*this);
+
+	_state = idleState;
+	if (_pin != none)
+		writeSample(0);
+}
+
+bool ToneSynth::play(byte preset, unsigned long durInUs)
+{
+	// Start a tone, fading in, and fade it out so that it ends durInUs later (or play until
+	// stop when 0). A tone cannot start while another is playing or fading out.
+
+	if (preset >= numPresets || _pin == none || _state != idleState)
+		return false;
+
+	unsigned long rampSamples = max((unsigned long)((float)_rampUs * _sampleRate / 1e6), 1UL);
+	unsigned long numSamples = (float)durInUs * _sampleRate / 1e6;
+
+	noInterrupts();
+	_preset = preset;
+	_increment = _freqs[preset] * 4294967296.0 / _sampleRate;
+	_volume = _volumes[preset];
+	_phase = 0;
+	_sampleIdx = 0;
+	_rampPhase = 0;
+	_rampStep = max(rampEnd / rampSamples, 1UL);
+	_releaseAt = durInUs == 0 ? 0 : (numSamples > rampSamples ? numSamples - rampSamples : 1);
+	_state = attackState;
+	interrupts();
+	return true;
+}
+
+void ToneSynth::stop()
+{
+	// Fade out from where the tone is
+
+	noInterrupts();
+	if (_state == attackState || _state == sustainState)
+		_state = releaseState;
+	interrupts();
+}
+
+bool ToneSynth::isPlaying()
+{
+	return _state != idleState;
+}
+
+void ToneSynth::tick()
+{
+	// Write the samples that are due, when there is no timer
+
+	if (_hasTimer)
+		return;
+
+	// Samples missed by far are skipped rather than written in a burst
+	noInterrupts();
+	unsigned long t = micros();
+	if ((long)(t - _due) > (long)(64 * (_samplePeriod + 1)))
+	{
+		_due = t;
+		_dueAcc = 0;
+	}
+	while ((long)(t - _due) >= 0)
+	{
+		onTimer();
+		uint16_t acc = _dueAcc + _sampleFrac;
+		_due += _samplePeriod + (acc < _dueAcc ? 1 : 0);
+		_dueAcc = acc;
+	}
+	interrupts();
+}
+
+void ToneSynth::onTimer()
+{
+	// Compute and write one sample
+
+#if defined(ARM_DWT_CYCCNT)
+	uint32_t t0 = ARM_DWT_CYCCNT;
+#endif
+
+	byte state = _state;
+	if (state != idleState)
+	{
+		if (_sampleIdx == 0)
+			_events.push(onsetEvent, _preset, micros());
+
+		// Stage of the envelope
+		uint32_t ramp = _rampPhase;
+		if (state == attackState)
+		{
+			ramp = ramp + _rampStep < rampEnd ? ramp + _rampStep : rampEnd;
+			if (ramp == rampEnd)
+				state = sustainState;
+		}
+		else if (state == releaseState)
+			ramp = ramp > _rampStep ? ramp - _rampStep : 0;
+
+		_sampleIdx++;
+		if (_releaseAt > 0 && _sampleIdx >= _releaseAt && state != releaseState)
+			state = releaseState;
+
+		// Raised cosine gain in Q15, as the square of a quarter sine
+		long s = sine(ramp);
+		long gain = ramp == rampEnd ? 32767 : (s * s) >> 15;
+		long amp = (gain * _volume) >> 8;
+		writeSample((sine(_phase) * amp) >> 15);
+		_phase += _increment;
+		_rampPhase = ramp;
+
+		if (state == releaseState && ramp == 0)
+		{
+			state = idleState;
+			writeSample(0);
+			_events.push(offsetEvent, _preset, micros());
+		}
+		_state = state;
+	}
+
+#if defined(ARM_DWT_CYCCNT)
+	uint32_t dt = ARM_DWT_CYCCNT - t0;
+	_busyTicks += dt;
+	_numSamples++;
+	if (dt > _maxTicks)
+		_maxTicks = dt;
+#endif
+}
+
+void ToneSynth::writeSample(long value)
+{
+	// Value in Q15 around half scale, at the resolution of the synth (see setOutput)
+	long half = 1L << (_bits - 1);
+#if defined(TEENSYDUINO)
+	uint32_t sketchBits = analogWriteResolution(_bits);
+	analogWrite(_pin, half + (value >> (16 - _bits)));
+	analogWriteResolution(sketchBits);
+#else
+	analogWrite(_pin, half + (value >> (16 - _bits)));
+#endif
+}
+
+unsigned long ToneSynth::getTicksPerSample()
+{
+	// Mean since clearLoad, idle samples included. The share of the CPU taken is this
+	// divided by the ticks per us, times the sample rate / 1e6.
+
+	noInterrupts();
+	unsigned long n = _numSamples;
+	unsigned long ticks = _busyTicks;
+	interrupts();
+	return n > 0 ? ticks / n : 0;
+}
+
+unsigned long ToneSynth::getMaxTicks()
+{
+	return _maxTicks;
+}
+
+void ToneSynth::clearLoad()
+{
+	noInterrupts();
+	_busyTicks = 0;
+	_numSamples = 0;
+	_maxTicks = 0;
+	interrupts();
+}
+
+
+
+byte ToneSynth::available()
+{
+	return _events.available();
+}
+
+bool ToneSynth::popEvent(byte& kind, byte& preset, unsigned long& t)
+{
+	// Oldest event: its kind, the preset played and the time of the sample in us
+	return _events.pop(kind, preset, t);
+}
+
+unsigned long ToneSynth::getDropped()
+{
+	// Events lost while the buffer was full, which only happens when nobody reads it
+	return _events.getDropped();
+}
@@ -8,6 +8,7 @@ Last updated by Duo Xu, March 17, 2019.
 #define ManyRig_h
 
 #include "Arduino.h"
+#include "ManyTimer.h"
 
 class ManyRig
 {
@@ -59,4 +60,401 @@ public:
 	}
 };
 
+class TrialSchedule
+{
+public:
+	TrialSchedule();
+
+	static const byte bufferSize = 32;	// number of trials generated ahead
+	static const byte maxChoices = 8;
+
+	// Inter-trial-interval parameters (same meaning as in Interval)
+	Interval iti;
+
+	// Configuration (clears trials already generated)
+	void setSeed(unsigned long seed);
+	void setProbabilities(byte* probVector, byte numChoices);
+	void setBlock(byte* blockCounts, byte numChoices);
+	void setMaxRun(byte n);
+	void reset();
+
+	// Generation (call in idle time, e.g. during ITI or from a reader)
+	byte fill();
+	byte fill(byte numTrials);
+
+	// Consumption
+	byte available();
+	bool pop();
+	byte getChoice();
+	unsigned long getInterval();
+	unsigned long getTrialNumber();
+
+	// Export of generated trials in order, for logging with Satellites::sendData
+	byte copyChoices(byte* dest, byte maxNum);
+	byte copyIntervals(unsigned long* dest, byte maxNum);
+
+private:
+	// Trial buffer as struct of arrays
+	byte _choices[bufferSize];
+	unsigned long _intervals[bufferSize];
+	byte _head = 0;
+	byte _count = 0;
+
+	// Trial popped most recently
+	byte _choice = 0;
+	unsigned long _interval = 0;
+	unsigned long _trialNum = 0;
+
+	// Choice settings
+	bool _isBlock = false;
+	byte _numChoices = 1;
+	byte _weights[maxChoices];
+	byte _blockLeft[maxChoices];
+	byte _maxRun = 0;
+	byte _lastChoice = 0;
+	byte _runLength = 0;
+
+	// Generator
+	unsigned long _seed = 1;
+	uint32_t _rngState = 1;
+
+	uint32_t nextRand();
+	byte nextChoice();
+	unsigned long nextInterval();
+};
+
+class StateMachine
+{
+public:
+	// A trial as a table of states. Entering a state sets and clears outputs, starts pulses
+	// and an optional timer. The state is left on an input edge or when the timer expires.
+	// Edges are handled in pin-change interrupts and timers in a periodic tick, so outputs
+	// follow inputs without waiting for the main loop.
+
+	static const byte maxStates = 32;
+	static const byte maxInputs = 4;
+	static const byte maxOutputs = 8;
+	static const byte eventBufferSize = 32;
+
+	static const byte none = 255;			// no transition
+	static const byte exitState = 254;		// entering it stops the machine
+	static const byte timerCause = 254;		// cause of timer transitions in events
+	static const byte startCause = 255;		// cause of the first state in events
+
+	StateMachine();
+
+	// Wiring (channels index the bits of output masks and the edges of transitions)
+	void setInput(byte ch, byte pin, byte mode = INPUT);
+	void setOutput(byte ch, byte pin);
+	void setPulse(byte ch, unsigned long widthInUs);
+
+	// Table
+	void clear();
+	bool setState(byte s, byte outHigh, byte outLow, byte pulses, unsigned long timerInUs, byte timerNext);
+	bool setTransition(byte s, byte input, bool isRising, byte next);
+	bool loadRow(unsigned int idx, long val);
+
+	// Running
+	bool begin(unsigned long tickInUs = 10);
+	void end();
+	void start(byte s);
+	void stop();
+	bool isRunning();
+	byte getState();
+	void tick();
+
+	// Log of state entries, written in interrupts and read in the main loop
+	byte available();
+	bool popEvent(byte& state, byte& cause, unsigned long& t);
+	unsigned long getDropped();
+	unsigned long getMaxLatency();
+	void clearMaxLatency();
+
+	// Called by the pin-change interrupt handlers
+	void onEdge(byte ch);
+
+private:
+	// Table as struct of arrays
+	byte _outHigh[maxStates];
+	byte _outLow[maxStates];
+	byte _pulses[maxStates];
+	unsigned long _timers[maxStates];
+	byte _timerNext[maxStates];
+	byte _next[maxStates][2 * maxInputs];	// rising and falling edge of each input
+
+	// Wiring
+	byte _inPins[maxInputs];
+	byte _numInputs = 0;
+	byte _outPins[maxOutputs];
+	byte _numOutputs = 0;
+	unsigned long _pulseWidths[maxOutputs];
+
+	// State, shared with interrupts
+	volatile bool _isRunning = false;
+	volatile byte _state = 0;
+	volatile bool _inLevels[maxInputs];
+	volatile bool _isTimerOn = false;
+	volatile unsigned long _timerDue = 0;
+	volatile byte _pulseMask = 0;
+	volatile unsigned long _pulseEnds[maxOutputs];
+	volatile unsigned long _maxLatency = 0;
+
+	// State entries as the state and its cause
+	EventRing<byte, eventBufferSize> _events;
+
+	// Row being loaded by loadRow
+	byte _loadState = none;
+
+	void enter(byte s, byte cause, unsigned long t);
+	void writeOutputs(byte mask, byte level);
+};
+
+class SyncGenerator
+{
+public:
+	// Trial-number barcodes and camera frame triggers for aligning recordings, generated in a
+	// timer interrupt so that neither blocks the protocol.
+	//
+	// A barcode starts with a high mark of 2 bit cells and a low gap of 1 cell, followed by
+	// the bits of the number, least significant first, in Manchester code: a 1 is high then
+	// low in its cell and a 0 is low then high. The mark is longer than any level in the code,
+	// so a decoder finds it, takes the cell width from it and reads each bit from the edge in
+	// the middle of its cell.
+
+	static const byte maxBits = 32;
+	static const byte eventBufferSize = 32;
+	static const byte none = 255;
+
+	// Kinds of events
+	static const byte barcodeEvent = 0;		// value is the number
+	static const byte frameEvent = 1;		// value is the frame index
+	static const byte framesEndEvent = 2;	// value is the number of frames
+
+	SyncGenerator();
+
+	// Wiring and timing
+	void setBarcodePin(byte pin);
+	void setBarcode(byte numBits, unsigned long bitWidthInUs);
+	void setFramePins(byte pin, byte pin2 = none);
+	void setFrameRate(float hz);
+	void setFrameWidth(unsigned long widthInUs);
+	void setFrameLogInterval(unsigned long n);
+
+	// Running
+	bool begin(unsigned long tickInUs = 10);
+	void end();
+	bool sendBarcode(unsigned long number);
+	bool isSendingBarcode();
+	void startFrames(unsigned long count = 0);
+	void stopFrames();
+	bool isFraming();
+	unsigned long getFrameCount();
+	void tick();
+
+	// Log of barcode starts and every n-th frame, written in interrupts and read in the main loop
+	byte available();
+	bool popEvent(byte& kind, unsigned long& value, unsigned long& t);
+	unsigned long getDropped();
+
+private:
+	// Barcode
+	byte _barcodePin = none;
+	byte _numBits = 16;
+	unsigned long _halfBit = 5000;
+	volatile bool _isBarcode = false;
+	volatile unsigned long _code = 0;
+	volatile byte _halfIdx = 0;
+	volatile unsigned long _barcodeDue = 0;
+
+	// Frames, with the period in us and 1/65536 us
+	byte _framePins[2] = {none, none};
+	unsigned long _framePeriod = 33333;
+	uint16_t _frameFrac = 21845;
+	unsigned long _frameWidth = 1000;
+	unsigned long _logInterval = 1;
+	volatile bool _isFraming = false;
+	volatile bool _isFrameHigh = false;
+	volatile unsigned long _frameDue = 0;
+	volatile unsigned long _frameEnd = 0;
+	volatile uint16_t _frameAcc = 0;
+	volatile unsigned long _numFrames = 0;
+	volatile unsigned long _frameLimit = 0;
+	volatile unsigned long _lastFrame = 0;
+
+	// Events as the kind and its value
+	EventRing<unsigned long, eventBufferSize> _events;
+
+	void writeFrame(byte level);
+	void endFrames();
+};
+
+class SequencePlayer
+{
+public:
+	// A preloaded sequence of output changes, replayed by a hardware timer that is set to the
+	// time of each next change. Each step gives the delay since the previous step (since the
+	// start for the first) and the levels of all outputs as a bit mask. Playback starts from
+	// the protocol or on an edge of a trigger input, and can loop at a fixed period.
+
+	static const byte maxSteps = 128;
+	static const byte maxOutputs = 8;
+	static const byte eventBufferSize = 8;
+	static const byte none = 255;
+	static const unsigned long minDelay = 2;	// us, shorter delays are lengthened to it
+
+	// Kinds of events
+	static const byte startEvent = 0;	// value is 0 when started by start, 1 by the trigger
+	static const byte doneEvent = 1;	// value is the number of loops played
+	static const byte stopEvent = 2;	// value is the number of steps played
+
+	SequencePlayer();
+
+	// Wiring (channels index the bits of levels)
+	void setOutput(byte ch, byte pin);
+	void setTrigger(byte pin, bool isRising = true, byte mode = INPUT);
+
+	// Sequence, which cannot change while armed or playing
+	void clear();
+	bool addStep(unsigned long delayInUs, byte levels);
+	bool loadStep(unsigned int idx, long val);
+	byte numSteps();
+	unsigned long getDuration();
+	void setLoops(unsigned long count, unsigned long periodInUs = 0);
+
+	// Running
+	bool begin();
+	void end();
+	bool arm();
+	void disarm();
+	bool start();
+	void stop();
+	bool isArmed();
+	bool isPlaying();
+	void tick();
+
+	// Log of starts and ends, written in interrupts and read in the main loop
+	byte available();
+	bool popEvent(byte& kind, unsigned long& value, unsigned long& t);
+	unsigned long getDropped();
+
+	// Called by the timer and trigger interrupt handlers
+	void onTimer();
+	void onTrigger();
+
+private:
+	// Sequence as struct of arrays
+	unsigned long _delays[maxSteps];
+	byte _levels[maxSteps];
+	byte _numSteps = 0;
+	unsigned long _duration = 0;
+	unsigned long _pendingDelay = 0;
+	unsigned long _numLoops = 1;
+	unsigned long _period = 0;
+
+	// Wiring
+	byte _outPins[maxOutputs];
+	byte _numOutputs = 0;
+	volatile byte _outLevels = 0;
+	byte _triggerPin = none;
+	bool _isRising = true;
+
+	// Playback, shared with interrupts
+	bool _hasTimer = false;
+	volatile bool _isArmed = false;
+	volatile bool _isPlaying = false;
+	volatile byte _idx = 0;
+	volatile unsigned long _loop = 0;
+	volatile unsigned long _due = 0;
+	volatile unsigned long _numPlayed = 0;
+
+	// Events as the kind and its value
+	EventRing<unsigned long, eventBufferSize> _events;
+
+	void play(byte cause, unsigned long t);
+	void finish(byte kind, unsigned long value, unsigned long t);
+	unsigned long delayAfter(byte idx, unsigned long loop);
+	void writeOutputs(byte levels);
+};
+
+class ToneSynth
+{
+public:
+	// Tones synthesized on the board by direct digital synthesis: a timer interrupt adds the
+	// frequency to a 32-bit phase each sample, looks the phase up in a sine table and writes
+	// the result to a DAC or PWM pin. Tones start at a zero crossing and fade in and out
+	// with raised cosine ramps, so they do not click.
+
+	static const byte numPresets = 8;
+	static const byte eventBufferSize = 16;
+	static const byte none = 255;
+
+	// Kinds of events
+	static const byte onsetEvent = 0;	// first sample of a tone
+	static const byte offsetEvent = 1;	// last sample, at the end of the ramp down
+
+	ToneSynth();
+
+	// Output and sound (the output idles at half scale)
+	void setOutput(byte pin, byte bits = 12);
+	bool setSampleRate(unsigned long hz);
+	void setRamp(unsigned long rampInUs);
+	bool setPreset(byte idx, float hz, byte volume = 255);
+
+	// Running
+	bool begin();
+	void end();
+	bool play(byte preset, unsigned long durInUs = 0);
+	void stop();
+	bool isPlaying();
+	void tick();
+
+	// Log of onsets and offsets, written in the interrupt and read in the main loop
+	byte available();
+	bool popEvent(byte& kind, byte& preset, unsigned long& t);
+	unsigned long getDropped();
+
+	// Time spent in the interrupt in clock ticks (CPU cycles where there is a cycle counter)
+	unsigned long getTicksPerSample();
+	unsigned long getMaxTicks();
+	void clearLoad();
+
+	// Called by the timer interrupt handler
+	void onTimer();
+
+private:
+	// Settings
+	byte _pin = none;
+	byte _bits = 12;
+	unsigned long _sampleRate = 40000;
+	unsigned long _samplePeriod = 25;		// us and 1/65536 us
+	uint16_t _sampleFrac = 0;
+	unsigned long _rampUs = 5000;
+	float _freqs[numPresets];
+	byte _volumes[numPresets];
+	bool _hasTimer = false;
+
+	// Tone, shared with the interrupt
+	volatile byte _state = 0;
+	volatile byte _preset = 0;
+	volatile uint32_t _phase = 0;
+	volatile uint32_t _increment = 0;
+	volatile byte _volume = 0;
+	volatile unsigned long _sampleIdx = 0;
+	volatile unsigned long _releaseAt = 0;
+	volatile uint32_t _rampPhase = 0;
+	volatile uint32_t _rampStep = 0;
+	volatile unsigned long _due = 0;
+	volatile uint16_t _dueAcc = 0;
+
+	// Load
+	volatile uint32_t _busyTicks = 0;
+	volatile unsigned long _numSamples = 0;
+	volatile unsigned long _maxTicks = 0;
+
+	// Events as the kind and the preset
+	EventRing<byte, eventBufferSize> _events;
+
+	void writeSample(long value);
+};
+
 #endif
\ No newline at end of file
@@ -7,6 +7,13 @@ Released into the public domain.
 #include "Arduino.h"
 #include "ManyStepper.h"
 
+// Coil patterns indexed by phase in half-step units. Bit k drives _pins[k].
+static const byte phaseTable[3][8] = {
+	{ 0x8, 0x8, 0x4, 0x4, 0x2, 0x2, 0x1, 0x1 },	// ONE_PHASE
+	{ 0xC, 0xC, 0x6, 0x6, 0x3, 0x3, 0x9, 0x9 },	// TWO_PHASE
+	{ 0x8, 0xC, 0x4, 0x6, 0x2, 0x3, 0x1, 0x9 }	// HALF_STEP
+};
+
 ManyStepper::ManyStepper(byte pin0, byte pin1, byte pin2, byte pin3)
 {
 	_pins[0] = pin0;
@@ -48,16 +55,8 @@ void ManyStepper::enableHolding()
 {
 	_isHolding = true;
 
-	// Set the pin specified by _thisStep
-	int level[] = { LOW, LOW, LOW, LOW };
-	for (byte i = 0; i < 4; i++)
-	{
-		if (i == _thisStep)
-		{
-			level[3 - i] = HIGH;
-		}
-		digitalWrite(_pins[3 - i], level[3 - i]);
-	}
+	// Energize coils of the current phase
+	writeCoils(phaseTable[_stepMode][_phase]);
 }
 
 void ManyStepper::disableHolding()
@@ -65,8 +64,7 @@ void ManyStepper::disableHolding()
 	_isHolding = false;
 
 	// Clear all pins
-	for (byte i = 0; i < 4; i++)
-		digitalWrite(_pins[3 - i], LOW);
+	releaseCoils();
 }
 
 bool ManyStepper::isHolding()
@@ -74,46 +72,47 @@ bool ManyStepper::isHolding()
 	return _isHolding;
 }
 
+void ManyStepper::setStepMode(byte mode)
+{
+	if (mode > HALF_STEP)
+		return;
+
+	_stepMode = mode;
+
+	// Full step modes only use even phases
+	if (_stepMode != HALF_STEP)
+		_phase &= 6;
+}
+
+byte ManyStepper::getStepMode()
+{
+	return _stepMode;
+}
+
 
 
 void ManyStepper::step(int numSteps)
 {
-	if (numSteps > 0)
-		for (int i = numSteps; i > 0; i--)
-		{
-			if (_thisStep < 3)
-				_thisStep++;
-			else
-				_thisStep = 0;
+	// Blocking move at the constant rate set by setPeriod. Do not mix with queued moves.
 
-			unitStep();
-		}
-	else
-		for (int i = numSteps; i < 0; i++)
-		{
-			if (_thisStep > 0)
-				_thisStep--;
-			else
-				_thisStep = 3;
+	int8_t dir = numSteps > 0 ? 1 : -1;
 
-			unitStep();
-		}
+	for (int i = abs(numSteps); i > 0; i--)
+	{
+		advancePhase(dir);
+		unitStep();
+		_position += dir;
+	}
+
+	_queuedTarget = _position;
 }
 
 
 
 void ManyStepper::unitStep()
 {
-	// Set the pin specified by _thisStep
-	int level[] = { LOW, LOW, LOW, LOW };
-	for (byte i = 0; i < 4; i++)
-	{
-		if (i == _thisStep)
-		{
-			level[3-i] = HIGH;
-		}
-		digitalWrite(_pins[3-i], level[3-i]);
-	}
+	// Set the pins specified by the current phase
+	writeCoils(phaseTable[_stepMode][_phase]);
 
 	// keep this output for a while before the next step
 	delay(min(_actionTimeInMs, _periodInMs));
@@ -121,8 +120,7 @@ void ManyStepper::unitStep()
 	// Turn off all pins for reducing heating, if enabled
 	if (!_isHolding)
 	{
-		for (byte i = 0; i < 4; i++)
-			digitalWrite(_pins[3 - i], LOW);
+		releaseCoils();
 	}
 
 	// Wait additional time to ensure the stepping period
@@ -130,4 +128,280 @@ void ManyStepper::unitStep()
 	{
 		delay(_periodInMs - _actionTimeInMs);
 	}
-}
\ No newline at end of file
+}
+
+void ManyStepper::advancePhase(int8_t dir)
+{
+	byte inc = _stepMode == HALF_STEP ? 1 : 2;
+	_phase = (_phase + dir * inc) & 7;
+}
+
+void ManyStepper::writeCoils(byte mask)
+{
+	for (byte i = 0; i < 4; i++)
+		digitalWrite(_pins[3 - i], (mask >> (3 - i)) & 1 ? HIGH : LOW);
+}
+
+void ManyStepper::releaseCoils()
+{
+	for (byte i = 0; i < 4; i++)
+		digitalWrite(_pins[3 - i], LOW);
+}
+
+
+
+void ManyStepper::setStepInterval(unsigned long intervalInUs)
+{
+	// Step interval at full speed, in microseconds
+	noInterrupts();
+	_cMinFx = constrain(intervalInUs, 1UL, 0xFFFFFFUL) << 8;
+	updateRamp();
+	interrupts();
+}
+
+unsigned long ManyStepper::getStepInterval()
+{
+	return _cMinFx >> 8;
+}
+
+void ManyStepper::setAcceleration(unsigned long stepsPerSecSq)
+{
+	// Zero disables ramping so that moves run at a constant rate
+	noInterrupts();
+	_accel = stepsPerSecSq;
+	updateRamp();
+	interrupts();
+}
+
+unsigned long ManyStepper::getAcceleration()
+{
+	return _accel;
+}
+
+void ManyStepper::updateRamp()
+{
+	// Precompute the first interval and the length of ramps (Austin, "Generate stepper-motor
+	// speed profiles in real time", 2005) so that the interrupt only does integer math.
+
+	if (_accel == 0)
+	{
+		_rampSteps = 0;
+		_c0Fx = _cMinFx;
+		return;
+	}
+
+	double c0 = 676000.0 * sqrt(2.0 / _accel);
+	_c0Fx = min(c0, double(0xFFFFFF)) * 256;
+
+	double v = 256.0e6 / _cMinFx;
+	_rampSteps = v * v / (2.0 * _accel);
+}
+
+
+
+bool ManyStepper::moveBy(long numSteps)
+{
+	// Queue a relative move. Returns false if the queue is full or a stop is in progress.
+
+	if (numSteps == 0)
+		return true;
+
+	byte nextTail = (_queueTail + 1) % _queueSize;
+	if (nextTail == _queueHead || _isStopping)
+		return false;
+
+	long base = _isBusy ? _queuedTarget : getPosition();
+
+	_queue[_queueTail] = numSteps;
+	_queueTail = nextTail;
+	_queuedTarget = base + numSteps;
+	_isBusy = true;
+
+	return true;
+}
+
+bool ManyStepper::moveTo(long pos)
+{
+	// Queue an absolute move relative to where previously queued moves will end
+	long base = _isBusy ? _queuedTarget : getPosition();
+	return moveBy(pos - base);
+}
+
+void ManyStepper::stop()
+{
+	// Discard queued moves and decelerate the current move to a stop
+	if (_isBusy)
+		_isStopping = true;
+}
+
+void ManyStepper::attachMoveDone(void(*f)(void))
+{
+	// The function is called from the timer interrupt whenever a move completes
+	_moveDoneFunc = f;
+}
+
+void ManyStepper::detachMoveDone()
+{
+	_moveDoneFunc = NULL;
+}
+
+
+
+long ManyStepper::getPosition()
+{
+	noInterrupts();
+	long pos = _position;
+	interrupts();
+	return pos;
+}
+
+void ManyStepper::setPosition(long pos)
+{
+	// Redefine the current position. Ignored while moving.
+	if (_isBusy)
+		return;
+
+	noInterrupts();
+	_position = pos;
+	_queuedTarget = pos;
+	interrupts();
+}
+
+long ManyStepper::getTarget()
+{
+	// Position at the end of all queued moves
+	return _isBusy ? _queuedTarget : getPosition();
+}
+
+bool ManyStepper::isBusy()
+{
+	return _isBusy;
+}
+
+byte ManyStepper::getQueueLength()
+{
+	return (_queueTail + _queueSize - _queueHead) % _queueSize;
+}
+
+unsigned long ManyStepper::getMovesDone()
+{
+	noInterrupts();
+	unsigned long n = _movesDone;
+	interrupts();
+	return n;
+}
+
+
+
+void ManyStepper::run(unsigned long tNow)
+{
+	// Advance motion by at most one step. Runs in the timer interrupt.
+
+	if (_isStopping)
+	{
+		// Drop queued moves and shorten the current one to a deceleration ramp
+		_queueHead = _queueTail;
+
+		if (_stepsLeft == 0)
+		{
+			// No move had started yet, so there is nothing to report as done
+			_isStopping = false;
+			_isBusy = false;
+			return;
+		}
+
+		unsigned long n = min(_stepCount, _moveRampSteps);
+		if (n == 0)
+		{
+			_stepsLeft = 0;
+			finishMove();
+			return;
+		}
+		_stepsLeft = min(_stepsLeft, n);
+		_moveRampSteps = n;
+	}
+
+	if (_stepsLeft == 0)
+	{
+		// Start the next queued move
+		if (_queueHead == _queueTail)
+			return;
+
+		long n = _queue[_queueHead];
+		_queueHead = (_queueHead + 1) % _queueSize;
+
+		_dir = n > 0 ? 1 : -1;
+		_stepsLeft = n > 0 ? n : -n;
+		_stepCount = 0;
+		_moveRampSteps = min(_rampSteps, _stepsLeft / 2);
+		_cFx = _moveRampSteps > 0 ? _c0Fx : _cMinFx;
+		_tDue = tNow;
+		_tFrac = 0;
+	}
+
+	if ((long)(tNow - _tDue) < 0)
+		return;
+
+	// Take a step
+	advancePhase(_dir);
+	writeCoils(phaseTable[_stepMode][_phase]);
+	_position += _dir;
+	_stepsLeft--;
+	_stepCount++;
+
+	if (_stepsLeft == 0)
+	{
+		finishMove();
+		return;
+	}
+
+	// Compute the next interval incrementally. A short move with an odd number of steps has
+	// a middle step between its ramps, which keeps the speed it reached.
+	if (_stepsLeft <= _moveRampSteps)
+		_cFx += 2 * _cFx / (4 * _stepsLeft - 1);
+	else if (_stepCount < _moveRampSteps)
+		_cFx -= 2 * _cFx / (4 * _stepCount + 1);
+	else if (_moveRampSteps == _rampSteps)
+		_cFx = _cMinFx;
+
+	if (_cFx < _cMinFx)
+		_cFx = _cMinFx;
+
+	// Schedule the next step, carrying the sub-microsecond remainder
+	_tFrac += _cFx & 0xFF;
+	_tDue += (_cFx >> 8) + (_tFrac >> 8);
+	_tFrac &= 0xFF;
+}
+
+void ManyStepper::finishMove()
+{
+	if (!_isHolding)
+		releaseCoils();
+
+	_movesDone++;
+
+	if (_queueHead == _queueTail)
+	{
+		_isStopping = false;
+		_isBusy = false;
+	}
+
+	if (_moveDoneFunc != NULL)
+		_moveDoneFunc();
+}
+
+
+
+bool StepperEngine::begin(unsigned long tickInUs)
+{
+	// Start a hardware timer calling tick. The tick period bounds the timing resolution of
+	// steps. On boards without IntervalTimer this returns false; call tick from your own
+	// timer interrupt instead, or from a Satellites::delayUntil condition.
+
+	return MotorEngine<ManyStepper>::begin(tickInUs);
+}
+
+bool StepperEngine::isBusy()
+{
+	return any(&ManyStepper::isBusy);
+}
@@ -8,17 +8,23 @@ Released into the public domain.
 #define ManyStepper_h
 
 #include "Arduino.h"
+#include "ManyTimer.h"
 
 class ManyStepper
 {
 public:
 	ManyStepper(byte pin0, byte pin1, byte pin2, byte pin3);
 
+	// Coil sequences
+	static const byte ONE_PHASE = 0;	// full step, one coil on (default)
+	static const byte TWO_PHASE = 1;	// full step, two coils on
+	static const byte HALF_STEP = 2;	// alternating one and two coils
+
 	void step(int numSteps);
 
 	void setPeriod(unsigned int periodInMs);
 	unsigned int getPeriod();
-	
+
 	void setActionTime(unsigned int actionTimeInMs);
 	unsigned int getActionTime();
 
@@ -26,15 +32,82 @@ public:
 	void disableHolding();
 	bool isHolding();
 
+	void setStepMode(byte mode);
+	byte getStepMode();
+
+	// Non-blocking motion (driven by StepperEngine)
+	void setStepInterval(unsigned long intervalInUs);
+	unsigned long getStepInterval();
+	void setAcceleration(unsigned long stepsPerSecSq);
+	unsigned long getAcceleration();
+
+	bool moveBy(long numSteps);
+	bool moveTo(long pos);
+	void stop();
+	void attachMoveDone(void(*f)(void));
+	void detachMoveDone();
+
+	// Status
+	long getPosition();
+	void setPosition(long pos);
+	long getTarget();
+	bool isBusy();
+	byte getQueueLength();
+	unsigned long getMovesDone();
+
+	// Called by StepperEngine::tick
+	void run(unsigned long tNow);
+
 private:
+	static const byte _queueSize = 4;
+
 	byte _pins[4];
-	byte _thisStep = 3;
+	byte _phase = 6;
+	byte _stepMode = ONE_PHASE;
 	unsigned int _actionTimeInMs = 50;
 	unsigned int _periodInMs = 50;
 	bool _isHolding = false;
 
+	// Motion profile. Intervals are in microseconds with 8 fractional bits.
+	uint32_t _cMinFx = 50000UL << 8;
+	uint32_t _c0Fx = 50000UL << 8;
+	unsigned long _accel = 0;
+	unsigned long _rampSteps = 0;
+
+	// Queued moves (relative steps), written by caller and read in the timer interrupt
+	volatile long _queue[_queueSize];
+	volatile byte _queueHead = 0;
+	volatile byte _queueTail = 0;
+	long _queuedTarget = 0;
+
+	// Current move
+	volatile long _position = 0;
+	volatile bool _isBusy = false;
+	volatile unsigned long _movesDone = 0;
+	volatile bool _isStopping = false;
+	unsigned long _stepsLeft = 0;
+	unsigned long _stepCount = 0;
+	unsigned long _moveRampSteps = 0;
+	uint32_t _cFx = 0;
+	unsigned long _tDue = 0;
+	unsigned int _tFrac = 0;
+	int8_t _dir = 1;
+	void (*_moveDoneFunc)(void) = NULL;
+
 	void unitStep();
+	void updateRamp();
+	void advancePhase(int8_t dir);
+	void writeCoils(byte mask);
+	void releaseCoils();
+	void finishMove();
 
 };
 
-#endif
\ No newline at end of file
+class StepperEngine : public MotorEngine<ManyStepper>
+{
+public:
+	static bool begin(unsigned long tickInUs = 50);
+	static bool isBusy();
+};
+
+#endif
@@ -0,0 +1,273 @@
+/*
+ManyTimer.h - Timer plumbing shared by the engines of ManyStepper, ManyVibMotor and ManyRig.
+Released into the public domain.
+
+Each engine claims one IntervalTimer from begin to end: StepperEngine, VibEngine, and
+StateMachine, SyncGenerator, SequencePlayer and ToneSynth of ManyRig, six in all. Teensy
+3.x and 4.x have four PIT channels behind IntervalTimer (Teensy LC has two), shared with
+anything else in the sketch that uses one, so at most four engines can run from timers at
+once. begin of the engine that finds none free returns false; call its tick from loop,
+or end an engine that is not needed before beginning another.
+*/
+
+#ifndef ManyTimer_h
+#define ManyTimer_h
+
+#include "Arduino.h"
+
+class TimerSlot
+{
+public:
+	// A hardware timer calling a function periodically. begin returns false on boards
+	// without IntervalTimer, or when no timer is free, and the caller then falls back to
+	// calling its tick from loop. Calling begin again restarts the period on the same timer.
+
+	bool begin(void (*f)(), double periodInUs)
+	{
+#if defined(TEENSYDUINO)
+		_isRunning = _timer.begin(f, periodInUs);
+#else
+		(void)f;
+		(void)periodInUs;
+		_isRunning = false;
+#endif
+		return _isRunning;
+	}
+
+	void update(unsigned long periodInUs)
+	{
+		// Takes effect when the current period ends
+#if defined(TEENSYDUINO)
+		if (_isRunning)
+			_timer.update(periodInUs);
+#else
+		(void)periodInUs;
+#endif
+	}
+
+	void end()
+	{
+#if defined(TEENSYDUINO)
+		_timer.end();
+#endif
+		_isRunning = false;
+	}
+
+	bool isRunning()
+	{
+		return _isRunning;
+	}
+
+private:
+#if defined(TEENSYDUINO)
+	IntervalTimer _timer;
+#endif
+	volatile bool _isRunning = false;
+};
+
+template <class M>
+class MotorEngine
+{
+public:
+	// Drives a list of motors from one timer by calling run(tNow) on each of them, as
+	// StepperEngine and VibEngine do
+
+	static const byte maxMotors = 4;
+
+	static bool attach(M& motor)
+	{
+		// Add a motor to be driven by tick. Returns false if no slot is left.
+
+		for (byte i = 0; i < _numMotors; i++)
+			if (_motors[i] == &motor)
+				return true;
+
+		if (_numMotors >= maxMotors)
+			return false;
+
+		_motors[_numMotors] = &motor;
+		_numMotors++;
+
+		return true;
+	}
+
+	static void detach(M& motor)
+	{
+		noInterrupts();
+		for (byte i = 0; i < _numMotors; i++)
+		{
+			if (_motors[i] == &motor)
+			{
+				for (byte j = i + 1; j < _numMotors; j++)
+					_motors[j - 1] = _motors[j];
+				_numMotors--;
+				break;
+			}
+		}
+		interrupts();
+	}
+
+	static bool begin(unsigned long tickInUs)
+	{
+		return _timer.begin(tick, tickInUs);
+	}
+
+	static void end()
+	{
+		_timer.end();
+	}
+
+	static void tick()
+	{
+		unsigned long tNow = micros();
+
+		for (byte i = 0; i < _numMotors; i++)
+			_motors[i]->run(tNow);
+	}
+
+	static bool any(bool (M::*isTrue)())
+	{
+		for (byte i = 0; i < _numMotors; i++)
+			if ((_motors[i]->*isTrue)())
+				return true;
+
+		return false;
+	}
+
+private:
+	static M* _motors[maxMotors];
+	static volatile byte _numMotors;
+	static TimerSlot _timer;
+};
+
+template <class M> M* MotorEngine<M>::_motors[MotorEngine<M>::maxMotors];
+template <class M> volatile byte MotorEngine<M>::_numMotors = 0;
+template <class M> TimerSlot MotorEngine<M>::_timer;
+
+template <class T, void (T::*F)()>
+class EngineTimer
+{
+public:
+	// A hardware timer calling F on one object of T at a time, since interrupt handlers take
+	// no arguments. Pin interrupt handlers of T reach the same object through active.
+
+	static T* active()
+	{
+		return _active;
+	}
+
+	static void attach(T& owner)
+	{
+		// Make owner the active object, ending the one before
+		if (_active != NULL && _active != &owner)
+			_active->end();
+		_active = &owner;
+	}
+
+	static void detach(T& owner)
+	{
+		// Stop the timer if owner has it
+		if (_active != &owner)
+			return;
+		_timer.end();
+		_active = NULL;
+	}
+
+	static bool begin(double periodInUs)
+	{
+		return _timer.begin(call, periodInUs);
+	}
+
+	static void update(unsigned long periodInUs)
+	{
+		_timer.update(periodInUs);
+	}
+
+	static void end()
+	{
+		_timer.end();
+	}
+
+	static bool isRunning()
+	{
+		return _timer.isRunning();
+	}
+
+private:
+	static T* volatile _active;
+	static TimerSlot _timer;
+
+	static void call()
+	{
+		T* owner = _active;
+		if (owner != NULL)
+			(owner->*F)();
+	}
+};
+
+template <class T, void (T::*F)()> T* volatile EngineTimer<T, F>::_active = NULL;
+template <class T, void (T::*F)()> TimerSlot EngineTimer<T, F>::_timer;
+
+template <class V, byte N>
+class EventRing
+{
+public:
+	// Events of a kind, a value and a time in us, written in interrupts and read in the main
+	// loop. New events are dropped and counted while the ring is full.
+
+	void push(byte kind, V value, unsigned long t)
+	{
+		// Called with interrupts off or from an interrupt handler
+
+		if (_count >= N)
+		{
+			_numDropped++;
+			return;
+		}
+
+		byte idx = (_head + _count) % N;
+		_kinds[idx] = kind;
+		_values[idx] = value;
+		_times[idx] = t;
+		_count++;
+	}
+
+	bool pop(byte& kind, V& value, unsigned long& t)
+	{
+		// Oldest event, false when there is none
+
+		noInterrupts();
+		bool isAvailable = _count > 0;
+		if (isAvailable)
+		{
+			kind = _kinds[_head];
+			value = _values[_head];
+			t = _times[_head];
+			_head = (_head + 1) % N;
+			_count--;
+		}
+		interrupts();
+		return isAvailable;
+	}
+
+	byte available()
+	{
+		return _count;
+	}
+
+	unsigned long getDropped()
+	{
+		return _numDropped;
+	}
+
+private:
+	// Struct of arrays
+	volatile byte _kinds[N];
+	volatile V _values[N];
+	volatile unsigned long _times[N];
+	volatile byte _head = 0;
+	volatile byte _count = 0;
+	volatile unsigned long _numDropped = 0;
+};
+
+#endif
@@ -17,7 +17,8 @@ ManyVibMotor::ManyVibMotor(byte pin)
 
 void ManyVibMotor::setResolution(byte res)
 {
-	_resolution = res;
+	_resolution = constrain(res, 1, 16);
+	_maxVal = (1UL << _resolution) - 1;
 }
 
 byte ManyVibMotor::getResolution()
@@ -25,6 +26,11 @@ byte ManyVibMotor::getResolution()
 	return _resolution;
 }
 
+unsigned int ManyVibMotor::getMaxValue()
+{
+	return _maxVal;
+}
+
 byte ManyVibMotor::getDutyCycle()
 {
 	return _dutyCycle;
@@ -33,35 +39,190 @@ byte ManyVibMotor::getDutyCycle()
 
 void ManyVibMotor::vibrate()
 {
+	_isPlaying = false;
 	analogWrite(_pin, dutyCycle2val(_dutyCycle));
 }
 
 void ManyVibMotor::vibrate(unsigned int val)
 {
-	val = min(val, pow(2, _resolution) - 1);
+	_isPlaying = false;
+	val = min(val, _maxVal);
 	analogWrite(_pin, val);
 	_dutyCycle = val2dutyCycle(val);
 }
 
 void ManyVibMotor::vibrateDutyCycle(byte prct)
 {
-	_dutyCycle = max(min(prct,  100),  0);
+	_isPlaying = false;
+	_dutyCycle = min(prct, 100);
 	analogWrite(_pin, dutyCycle2val(_dutyCycle));
 }
 
 void ManyVibMotor::stop()
 {
-	analogWrite(_pin, 0);
+	if (_isPlaying)
+		endPlay();
+	else
+		analogWrite(_pin, 0);
 }
 
 
 
 byte ManyVibMotor::val2dutyCycle(unsigned int val)
 {
-	return min(float(val) / float(pow(2, _resolution) - 1), 1) * 100;
+	return (unsigned long)min(val, _maxVal) * 100 / _maxVal;
 }
 
 unsigned int ManyVibMotor::dutyCycle2val(byte prct)
 {
-	return float(max(min(prct, 100), 0)) / 100 * (pow(2, _resolution) - 1);
-}
\ No newline at end of file
+	return (unsigned long)min(prct, 100) * _maxVal / 100;
+}
+
+
+
+void ManyVibMotor::play(const unsigned int* vals, unsigned int numVals, unsigned long stepInUs, unsigned int numRepeats)
+{
+	// Output each value of the sequence for stepInUs, repeating the sequence numRepeats times
+	// (0 repeats until stop). The array must stay valid during playback.
+
+	if (numVals == 0)
+		return;
+
+	noInterrupts();
+	_seq = vals;
+	_seqLen = numVals;
+	_seqIdx = 0;
+	_stepInUs = stepInUs;
+	_repeatsLeft = numRepeats;
+	_isLooping = numRepeats == 0;
+
+	analogWrite(_pin, min(_seq[0], _maxVal));
+	_tOnset = micros();
+	_tDue = _tOnset + _stepInUs;
+	_isPlaying = true;
+	interrupts();
+}
+
+bool ManyVibMotor::isPlaying()
+{
+	return _isPlaying;
+}
+
+unsigned long ManyVibMotor::getOnsetTime()
+{
+	// Time in micros() when the first value of the last pattern was written
+	noInterrupts();
+	unsigned long t = _tOnset;
+	interrupts();
+	return t;
+}
+
+unsigned long ManyVibMotor::getOffsetTime()
+{
+	// Time in micros() when the output of the last pattern was turned off
+	noInterrupts();
+	unsigned long t = _tOffset;
+	interrupts();
+	return t;
+}
+
+void ManyVibMotor::attachPlayDone(void(*f)(void))
+{
+	// The function is called from the timer interrupt when a pattern ends
+	_playDoneFunc = f;
+}
+
+void ManyVibMotor::detachPlayDone()
+{
+	_playDoneFunc = NULL;
+}
+
+void ManyVibMotor::run(unsigned long tNow)
+{
+	// Advance playback by one value when due. Runs in the timer interrupt.
+
+	if (!_isPlaying || (long)(tNow - _tDue) < 0)
+		return;
+
+	_seqIdx++;
+	if (_seqIdx >= _seqLen)
+	{
+		if (!_isLooping)
+			_repeatsLeft--;
+
+		if (!_isLooping && _repeatsLeft == 0)
+		{
+			endPlay();
+			return;
+		}
+		_seqIdx = 0;
+	}
+
+	analogWrite(_pin, min(_seq[_seqIdx], _maxVal));
+	_tDue += _stepInUs;
+}
+
+void ManyVibMotor::endPlay()
+{
+	analogWrite(_pin, 0);
+	_tOffset = micros();
+	_isPlaying = false;
+
+	if (_playDoneFunc != NULL)
+		_playDoneFunc();
+}
+
+
+
+void ManyVibMotor::fillRamp(unsigned int* vals, unsigned int numVals, unsigned int startVal, unsigned int endVal)
+{
+	// Linear ramp from startVal to endVal (inclusive)
+
+	for (unsigned int i = 0; i < numVals; i++)
+	{
+		if (numVals < 2)
+			vals[i] = startVal;
+		else
+			vals[i] = startVal + ((long)endVal - (long)startVal) * (long)i / (long)(numVals - 1);
+	}
+}
+
+void ManyVibMotor::fillPulseTrain(unsigned int* vals, unsigned int numVals, unsigned int onVal, unsigned int onSteps, unsigned int offSteps)
+{
+	// Pulses of onVal lasting onSteps, separated by offSteps of zero
+
+	unsigned int period = onSteps + offSteps;
+
+	for (unsigned int i = 0; i < numVals; i++)
+		vals[i] = period > 0 && i % period < onSteps ? onVal : 0;
+}
+
+void ManyVibMotor::applyEnvelope(unsigned int* vals, unsigned int numVals, const byte* envPrct, unsigned int numEnv)
+{
+	// Scale values by an envelope in percent, stretched over the whole sequence (e.g. for
+	// amplitude modulation of a pulse train)
+
+	if (numEnv == 0)
+		return;
+
+	for (unsigned int i = 0; i < numVals; i++)
+	{
+		unsigned int k = (unsigned long)i * numEnv / numVals;
+		vals[i] = (unsigned long)vals[i] * envPrct[k] / 100;
+	}
+}
+
+
+
+bool VibEngine::begin(unsigned long tickInUs)
+{
+	// Start a hardware timer calling tick. Returns false on boards without IntervalTimer,
+	// where tick should be called from a user timer interrupt instead.
+
+	return MotorEngine<ManyVibMotor>::begin(tickInUs);
+}
+
+bool VibEngine::isPlaying()
+{
+	return any(&ManyVibMotor::isPlaying);
+}
@@ -8,6 +8,7 @@ Released into the public domain.
 #define ManyVibMotor_h
 
 #include "Arduino.h"
+#include "ManyTimer.h"
 
 class ManyVibMotor
 {
@@ -22,15 +23,54 @@ public:
 	byte getDutyCycle();
 	void setResolution(byte res);
 	byte getResolution();
+	unsigned int getMaxValue();
+
+	// Pattern playback (driven by VibEngine)
+	void play(const unsigned int* vals, unsigned int numVals, unsigned long stepInUs, unsigned int numRepeats = 1);
+	bool isPlaying();
+	unsigned long getOnsetTime();
+	unsigned long getOffsetTime();
+	void attachPlayDone(void(*f)(void));
+	void detachPlayDone();
+
+	// Pattern building
+	static void fillRamp(unsigned int* vals, unsigned int numVals, unsigned int startVal, unsigned int endVal);
+	static void fillPulseTrain(unsigned int* vals, unsigned int numVals, unsigned int onVal, unsigned int onSteps, unsigned int offSteps);
+	static void applyEnvelope(unsigned int* vals, unsigned int numVals, const byte* envPrct, unsigned int numEnv);
+
+	// Called by VibEngine::tick
+	void run(unsigned long tNow);
 
 private:
 	byte _pin;
 	byte _dutyCycle = 100;
 	byte _resolution = 8;
+	unsigned int _maxVal = 255;
+
+	// Playback states
+	const unsigned int* _seq = NULL;
+	unsigned int _seqLen = 0;
+	volatile unsigned int _seqIdx = 0;
+	unsigned long _stepInUs = 0;
+	unsigned int _repeatsLeft = 0;
+	bool _isLooping = false;
+	unsigned long _tDue = 0;
+	volatile bool _isPlaying = false;
+	volatile unsigned long _tOnset = 0;
+	volatile unsigned long _tOffset = 0;
+	void (*_playDoneFunc)(void) = NULL;
 
 	unsigned int dutyCycle2val(byte prct);
 	byte val2dutyCycle(unsigned int val);
+	void endPlay();
 
 };
 
-#endif
\ No newline at end of file
+class VibEngine : public MotorEngine<ManyVibMotor>
+{
+public:
+	static bool begin(unsigned long tickInUs = 100);
+	static bool isPlaying();
+};
+
+#endif
@@ -1,25 +1,83 @@
+/*
+  SatelliteScopes
+  Streams analog channels, decimated on the board (SatelliteFilter) so that a high
+  acquisition rate does not need a fast link.
+
+  Channels are read at the sampling rate times the decimation factor. Each block of
+  decimation samples gives one "i,<time>,<values>" message, and with envelopes on, one
+  "e,<time>,<min>,<max>,<rms>,..." message with three values per channel.
+
+  Serial commands
+    s                   start or stop streaming
+    i                   read the channels once, without filtering
+    spr,<Hz>            output rate
+    flt,<mode>,<n>      decimate by n (1 to 32) by averaging (mode 0), a third order CIC
+                        filter (1) or a windowed sinc FIR filter (2)
+    dc,<shift>          subtract the running mean over about 2^shift samples, 0 to stop
+    env                 turn envelope messages on or off
+    pins,<p1>,...,<p4>  analog pins to read from
+
+  Check that the acquisition rate is feasible: analogRead alone takes about 110 us on an
+  AVR board, so 4 channels there top out near 2 kHz before any filtering. SatellitesBenchmark
+  reports the cost of the filters per sample.
+*/
+
 #include <Satellites.h>
 
-// Satellite object
+// Satellite object and the filters of the channels
 Satellites sat;
+SatelliteFilter filter;
 
 // Runtime variables
 unsigned long samplingRate = 60;
 const byte numChan = 4;
 byte pins[] = {0, 1, 2, 3};
-unsigned int vals[numChan];
+long vals[numChan];
+long envelopes[3 * numChan];
 bool isStream = false;
+bool isEnvelope = false;
+long filterMode = SatelliteFilter::averageMode;
+unsigned long samplePeriod;
+unsigned long nextSample;
 
 void setup() {
   // Communication
   Serial.begin(115200);
   sat.attachReader(myReader);
+  setPeriod();
 }
 
 void loop() {
-  sat.delay(1000. / samplingRate);
-  if (isStream)
-    readAndReport();
+  sat.serialReadCmd();
+  if (isStream && (long)(micros() - nextSample) >= 0) {
+    nextSample += samplePeriod;
+    acquire();
+  }
+}
+
+void setPeriod() {
+  // Time between reads of the channels in microseconds
+  samplePeriod = 1000000. / (samplingRate * filter.getDecimation(0));
+}
+
+void acquire() {
+  bool isReady = false;
+  for (int i = 0; i < numChan; i++)
+    isReady = filter.process(i, analogRead(pins[i]));
+  if (!isReady)
+    return;
+
+  for (int i = 0; i < numChan; i++) {
+    vals[i] = filter.getValue(i);
+    envelopes[3 * i] = filter.getMin(i);
+    envelopes[3 * i + 1] = filter.getMax(i);
+    envelopes[3 * i + 2] = filter.getRms(i);
+  }
+
+  unsigned long t = millis();
+  sat.sendData("i", t, vals, numChan);
+  if (isEnvelope)
+    sat.sendData("e", t, envelopes, 3 * numChan);
 }
 
 void readAndReport() {
@@ -47,9 +105,35 @@ void myReader()
   }
   else if (idx == 1 && cmdStr.equals("spr"))
   {
-    samplingRate = val;
+    samplingRate = max(val, 1L);
+    setPeriod();
     sat.sendData("sampling rate set", millis(), samplingRate);
   }
+  else if (idx == 1 && cmdStr.equals("flt"))
+  {
+    filterMode = val;
+  }
+  else if (idx == 2 && cmdStr.equals("flt"))
+  {
+    // Check the values before they are narrowed to bytes, e.g. 288 would become 32
+    bool isSet = filterMode >= 0 && filterMode <= SatelliteFilter::firMode && val >= 1
+      && val <= SatelliteFilter::maxDecimation;
+    for (int i = 0; isSet && i < numChan; i++)
+      isSet = filter.setChannel(i, filterMode, val);
+    setPeriod();
+
+    byte settings[] = {filter.getMode(0), filter.getDecimation(0)};
+    sat.sendData(isSet ? "filter set" : "filter rejected", millis(), settings, 2);
+  }
+  else if (idx == 1 && cmdStr.equals("dc") && val >= 0 && val <= 16)
+  {
+    for (int i = 0; i < numChan; i++)
+      filter.setOffsetTracking(i, val);
+  }
+  else if (idx == 0 && cmdStr.equals("env"))
+  {
+    isEnvelope = !isEnvelope;
+  }
   else if (idx == 0 && cmdStr.equals("i"))
   {
     readAndReport();
@@ -57,5 +141,6 @@ void myReader()
   else if (idx == 0 && cmdStr.equals("s"))
   {
     isStream = !isStream;
+    nextSample = micros();
   }
 }
@@ -0,0 +1,455 @@
+/*
+  SatellitesBenchmark
+  Measures the hot paths of the Satellites library: the time each sendData overload takes,
+  how fast serialRead parses commands, how the cost of a reader grows with the number of
+  commands it checks, how late the delay functions return, what SatelliteFilter costs
+  per sample, and what the Position conversions of ZaberMotor cost (so the ZaberMotor
+  library needs to be installed too).
+
+  Send "BEN,<iterations>" (1000 when 0) to run the suite, and "PNG,<n>" to get an "ack"
+  back right away for round-trip measurements (see SatellitesViewer/native/svbench.cpp,
+  which does both). Results are sent as one message per benchmark:
+
+    <name>,<time>,<iterations>,<mean>,<min>,<max>,<items>
+
+  Times are in clock ticks, CPU cycles where there is a cycle counter (Teensy, or the host
+  with HostArduino) and microseconds otherwise, except late_* results which are always in
+  microseconds. Items is the number of bytes, commands or positions per iteration, the delay
+  in ms, or the decimation factor. filter_* results are per sample of one channel, with block outputs
+  included, so the share of the CPU a channel takes is mean / ticks per us * rate / 1e6.
+  On the host, late_* results reflect the virtual clock of HostArduino rather than hardware.
+  The suite starts with "benchStart,<time>,<ticks per us>" (0 when unknown) and ends with
+  "benchEnd,<time>,<number of results>".
+
+  Messages timed on the serial port use the tag "x" so they are easy to filter out.
+*/
+
+
+#include <Satellites.h>
+#include <ZaberMotor.h>
+
+
+// Clock ticks for timing
+#if defined(ARM_DWT_CYCCNT)
+  #define TICKS() ARM_DWT_CYCCNT
+  #if defined(F_CPU)
+    const unsigned long ticksPerUs = F_CPU / 1000000;
+  #else
+    const unsigned long ticksPerUs = 0;
+  #endif
+#else
+  #define TICKS() micros()
+  const unsigned long ticksPerUs = 1;
+#endif
+
+
+// A stream that discards output, for timing message formatting alone
+class NullStream : public Stream
+{
+public:
+  int available() { return 0; }
+  int read() { return -1; }
+  int peek() { return -1; }
+  size_t write(uint8_t) { return 1; }
+  size_t write(const uint8_t*, size_t size) { return size; }
+};
+
+
+// A stream that plays the same command text over and over, for timing the parser
+class ReplayStream : public Stream
+{
+public:
+  void setText(const char* text) { _text = text; _len = strlen(text); _pos = 0; }
+  int available() { return _len; }
+  int read() { char c = _text[_pos]; if (++_pos == _len) _pos = 0; return c; }
+  int peek() { return _text[_pos]; }
+  size_t write(uint8_t) { return 1; }
+
+private:
+  const char* _text = "\n";
+  size_t _len = 1;
+  size_t _pos = 0;
+};
+
+
+// Satellites objects for the serial port and the test streams
+NullStream nullStream;
+ReplayStream replayStream;
+Satellites sat;
+Satellites nullSat(nullStream);
+Satellites replaySat(replayStream);
+SatelliteFilter benchFilter;
+
+
+// Timing statistics of one benchmark
+struct Stats
+{
+  unsigned long n;
+  long total;
+  long lo;
+  long hi;
+};
+
+unsigned long numIter = 1000;
+const unsigned long numDelayIter = 50;
+int numResults = 0;
+
+
+// Data for sendData
+volatile byte byteVal = 200;
+volatile int intVal = -12345;
+volatile unsigned int uintVal = 54321;
+volatile long longVal = -1234567890;
+volatile unsigned long ulongVal = 3456789012UL;
+volatile float floatVal = 3.14159;
+
+const byte numData = 8;
+volatile byte byteData[numData];
+volatile int intData[numData];
+volatile unsigned int uintData[numData];
+volatile long longData[numData];
+volatile unsigned long ulongData[numData];
+volatile float floatData[numData];
+
+
+// Commands for the reader dispatch benchmark
+const int maxCmds = 64;
+char cmdNames[maxCmds][4];
+int numCmds = 1;
+unsigned long numHits = 0;
+char replayText[16];
+
+
+// Targets for the Position benchmarks, in um and degrees
+const byte numPos = 16;
+long posX[numPos], posY[numPos];
+float posA[numPos], posR[numPos];
+long posXs[numPos], posYs[numPos];
+Position posBatch[numPos];
+volatile float posSinkF;
+volatile long posSinkL;
+
+
+// Parser workloads, typical of the example sketches
+const char* parseShort = "s\n";
+const char* parseMix = "LFW,0\nWAT,1,200\nITI,1,3000\nNLK,1,1000\nw,1,50\nIST,1,0\ni\nspr,1,60\n";
+const char* parseLong = "pins,1,14,15,16,17\nthresholds,1,-1200,1500,-1800,2100,-2400,2700\n";
+
+
+void setup()
+{
+  // Initialize serial (not necessary on Teensy)
+  Serial.begin(115200);
+
+  // Enable the cycle counter on Teensy 3
+  #if defined(ARM_DEMCR) && defined(ARM_DWT_CTRL)
+    ARM_DEMCR |= ARM_DEMCR_TRCENA;
+    ARM_DWT_CTRL |= ARM_DWT_CTRL_CYCCNTENA;
+  #endif
+
+  for (int i = 0; i < numData; i++)
+  {
+    byteData[i] = 30 * i;
+    intData[i] = -4000 * i;
+    uintData[i] = 7000 * i;
+    longData[i] = -300000L * i;
+    ulongData[i] = 500000UL * i;
+    floatData[i] = 1.25 * i;
+  }
+
+  for (int i = 0; i < numPos; i++)
+  {
+    posX[i] = -150000L + 20000L * i;
+    posY[i] = 90000L - 13000L * i;
+    posA[i] = -170 + 22.5 * i;
+    posR[i] = 1000 + 12000.0 * i;
+    posBatch[i] = Position(posA[i], posR[i]);
+  }
+
+  for (int i = 0; i < maxCmds; i++)
+  {
+    cmdNames[i][0] = 'C';
+    cmdNames[i][1] = '0' + i / 10;
+    cmdNames[i][2] = '0' + i % 10;
+    cmdNames[i][3] = '\0';
+  }
+
+  sat.attachReader(myReader);
+  replaySat.attachReader(tableReader);
+}
+
+
+void loop()
+{
+  sat.serialReadCmd();
+}
+
+
+void myReader()
+{
+  String cmdStr = sat.getCmdName();
+  int idx = sat.getIndex();
+  long val = sat.getValue();
+
+  if (idx == 1 && cmdStr.equals("PNG"))
+  {
+    // Answer right away for round-trip timing
+    sat.sendData("ack", millis(), val);
+  }
+  else if (idx == 1 && cmdStr.equals("BEN"))
+  {
+    numIter = val > 0 ? val : 1000;
+    runAll();
+  }
+}
+
+
+// A reader that checks commands one after another, like the example sketches do
+void tableReader()
+{
+  String cmdStr = replaySat.getCmdName();
+  int idx = replaySat.getIndex();
+  for (int i = 0; i < numCmds; i++)
+  {
+    if (idx == 1 && cmdStr.equals(cmdNames[i]))
+    {
+      numHits++;
+      break;
+    }
+  }
+}
+
+
+void clearStats(Stats& s)
+{
+  s.n = 0;
+  s.total = 0;
+  s.lo = 0x7FFFFFFF;
+  s.hi = -0x7FFFFFFF;
+}
+
+
+void addStats(Stats& s, long dt)
+{
+  s.n++;
+  s.total += dt;
+  if (dt < s.lo)
+    s.lo = dt;
+  if (dt > s.hi)
+    s.hi = dt;
+}
+
+
+void report(const char* name, Stats& s, long items)
+{
+  long vals[5] = {(long)s.n, s.n > 0 ? s.total / (long)s.n : 0, s.lo, s.hi, items};
+  sat.sendData(name, millis(), vals, 5);
+  numResults++;
+}
+
+
+// Times a statement over numIter iterations
+#define BENCH(name, items, statement) \
+  { \
+    Stats stats; \
+    clearStats(stats); \
+    for (unsigned long i = 0; i < numIter; i++) \
+    { \
+      uint32_t t0 = TICKS(); \
+      statement; \
+      addStats(stats, (long)(uint32_t)(TICKS() - t0)); \
+    } \
+    report(name, stats, items); \
+  }
+
+
+void runAll()
+{
+  numResults = 0;
+  sat.sendData("benchStart", millis(), ticksPerUs);
+
+  benchSend(nullSat, "fmt");
+  benchSendFlash();
+  benchSend(sat, "send");
+  benchParse();
+  benchDispatch();
+  benchDelay();
+  benchFilters();
+  benchPositions();
+
+  sat.sendData("benchEnd", millis(), numResults);
+}
+
+
+// Every sendData overload with a char* tag, on the given stream
+void benchSend(Satellites& s, const char* prefix)
+{
+  char name[32];
+  const char* tag = "x";
+
+  sprintf(name, "%s_tag", prefix);
+  BENCH(name, 1, s.sendData(tag, 123456));
+  sprintf(name, "%s_byte", prefix);
+  BENCH(name, 1, s.sendData(tag, 123456, byteVal));
+  sprintf(name, "%s_int", prefix);
+  BENCH(name, 1, s.sendData(tag, 123456, intVal));
+  sprintf(name, "%s_uint", prefix);
+  BENCH(name, 1, s.sendData(tag, 123456, uintVal));
+  sprintf(name, "%s_long", prefix);
+  BENCH(name, 1, s.sendData(tag, 123456, longVal));
+  sprintf(name, "%s_ulong", prefix);
+  BENCH(name, 1, s.sendData(tag, 123456, ulongVal));
+  sprintf(name, "%s_float", prefix);
+  BENCH(name, 1, s.sendData(tag, 123456, floatVal));
+
+  sprintf(name, "%s_bytes", prefix);
+  BENCH(name, numData, s.sendData(tag, 123456, byteData, numData));
+  sprintf(name, "%s_ints", prefix);
+  BENCH(name, numData, s.sendData(tag, 123456, intData, numData));
+  sprintf(name, "%s_uints", prefix);
+  BENCH(name, numData, s.sendData(tag, 123456, uintData, numData));
+  sprintf(name, "%s_longs", prefix);
+  BENCH(name, numData, s.sendData(tag, 123456, longData, numData));
+  sprintf(name, "%s_ulongs", prefix);
+  BENCH(name, numData, s.sendData(tag, 123456, ulongData, numData));
+  sprintf(name, "%s_floats", prefix);
+  BENCH(name, numData, s.sendData(tag, 123456, floatData, numData));
+}
+
+
+// Every sendData overload with a flash string tag, formatting only
+void benchSendFlash()
+{
+  BENCH("fmtF_tag", 1, nullSat.sendData(F("x"), 123456));
+  BENCH("fmtF_byte", 1, nullSat.sendData(F("x"), 123456, byteVal));
+  BENCH("fmtF_int", 1, nullSat.sendData(F("x"), 123456, intVal));
+  BENCH("fmtF_uint", 1, nullSat.sendData(F("x"), 123456, uintVal));
+  BENCH("fmtF_long", 1, nullSat.sendData(F("x"), 123456, longVal));
+  BENCH("fmtF_ulong", 1, nullSat.sendData(F("x"), 123456, ulongVal));
+  BENCH("fmtF_float", 1, nullSat.sendData(F("x"), 123456, floatVal));
+
+  BENCH("fmtF_bytes", numData, nullSat.sendData(F("x"), 123456, byteData, numData));
+  BENCH("fmtF_ints", numData, nullSat.sendData(F("x"), 123456, intData, numData));
+  BENCH("fmtF_uints", numData, nullSat.sendData(F("x"), 123456, uintData, numData));
+  BENCH("fmtF_longs", numData, nullSat.sendData(F("x"), 123456, longData, numData));
+  BENCH("fmtF_ulongs", numData, nullSat.sendData(F("x"), 123456, ulongData, numData));
+  BENCH("fmtF_floats", numData, nullSat.sendData(F("x"), 123456, floatData, numData));
+}
+
+
+// Parser throughput, one iteration per pass over a workload
+void benchParse()
+{
+  const char* names[] = {"parse_short", "parse_mix", "parse_long"};
+  const char* texts[] = {parseShort, parseMix, parseLong};
+
+  numCmds = 0;
+  for (int k = 0; k < 3; k++)
+  {
+    replayStream.setText(texts[k]);
+    int len = strlen(texts[k]);
+    BENCH(names[k], len, for (int j = 0; j < len; j++) replaySat.serialRead());
+  }
+}
+
+
+// Reader dispatch against the number of commands, matching the last one
+void benchDispatch()
+{
+  const int counts[] = {1, 4, 16, 64};
+  char name[32];
+
+  for (int k = 0; k < 4; k++)
+  {
+    numCmds = counts[k];
+    sprintf(replayText, "%s,100\n", cmdNames[numCmds - 1]);
+    replayStream.setText(replayText);
+    int len = strlen(replayText);
+
+    numHits = 0;
+    sprintf(name, "dispatch_%d", numCmds);
+    BENCH(name, numCmds, for (int j = 0; j < len; j++) replaySat.serialRead());
+    if (numHits != numIter)
+      sat.sendData("dispatchMissed", millis(), numIter - numHits);
+  }
+}
+
+
+bool never()
+{
+  return false;
+}
+
+
+// How late the delay functions return, in microseconds
+void benchDelay()
+{
+  const unsigned long durs[] = {1, 10};
+  char name[32];
+
+  for (int k = 0; k < 2; k++)
+  {
+    unsigned long dur = durs[k];
+    Stats s1, s2, s3;
+    clearStats(s1);
+    clearStats(s2);
+    clearStats(s3);
+
+    for (unsigned long i = 0; i < numDelayIter; i++)
+    {
+      unsigned long t0 = micros();
+      sat.delay(dur);
+      addStats(s1, (long)(micros() - t0) - (long)dur * 1000);
+
+      t0 = micros();
+      sat.delayUntil(never, dur);
+      addStats(s2, (long)(micros() - t0) - (long)dur * 1000);
+
+      t0 = micros();
+      sat.delayContinue(never, dur);
+      addStats(s3, (long)(micros() - t0) - (long)dur * 1000);
+    }
+
+    sprintf(name, "late_delay_%lu", dur);
+    report(name, s1, dur);
+    sprintf(name, "late_delayUntil_%lu", dur);
+    report(name, s2, dur);
+    sprintf(name, "late_delayContinue_%lu", dur);
+    report(name, s3, dur);
+  }
+}
+
+
+// SatelliteFilter per sample, for each mode at a low and a high decimation
+void benchFilters()
+{
+  const char* modes[] = {"average", "cic", "fir"};
+  const byte decimations[] = {4, 32};
+  char name[32];
+
+  for (byte mode = 0; mode < 3; mode++)
+  {
+    for (int k = 0; k < 2; k++)
+    {
+      byte n = decimations[k];
+      benchFilter.setChannel(0, mode, n);
+      benchFilter.setOffsetTracking(0, 8);
+      sprintf(name, "filter_%s_%d", modes[mode], n);
+      BENCH(name, n, benchFilter.process(0, (int)((i * 37) & 4095)));
+    }
+  }
+}
+
+
+// Position conversions, each single one from a fresh Position so that nothing is cached
+void benchPositions()
+{
+  BENCH("pos_getA", 1, { Position p(posX[i % numPos], posY[i % numPos]); posSinkF = p.getA(); });
+  BENCH("pos_getR", 1, { Position p(posX[i % numPos], posY[i % numPos]); posSinkF = p.getR(); });
+  BENCH("pos_getXY", 1, { Position p(posA[i % numPos], posR[i % numPos]); posSinkL = p.getX() + p.getY(); });
+
+  // toCartesian includes setting the angles again, which drops the cached cartesian forms
+  BENCH("pos_toCartesian", numPos,
+    { for (byte j = 0; j < numPos; j++) posBatch[j].setA(posA[j]); Position::toCartesian(posBatch, posXs, posYs, numPos); });
+  BENCH("pos_polarToCartesian", numPos, Position::polarToCartesian(posA, posR, posXs, posYs, numPos));
+}
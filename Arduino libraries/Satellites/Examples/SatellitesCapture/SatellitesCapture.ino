@@ -0,0 +1,130 @@
+/*
+  SatellitesCapture
+  Samples analog channels continuously but only sends the data around events, using
+  SatelliteCapture: a lick (rising edge of an input), a signal crossing a threshold, a
+  reward (any message tagged "reward") or a CAP command. Windows that overlap are merged.
+
+  Each window is sent in parts of up to 16 frames, so that other messages can go out between
+  them
+    capture,<trigger time>,<cause>,<triggers merged>,<frames before the trigger>,<frames>,
+      <channels>,<first frame of the part>,<samples, frame by frame>
+  where cause is 0 for CAP, 1 for a lick, 2 for the threshold and 3 for a reward. Frames are
+  1 ms apart. A window whose parts hold fewer frames than announced was cut short because
+  the link fell behind, and counts as dropped.
+
+  Serial commands
+    WIN,<pre>,<post>    ms kept before and after a trigger
+    THR,<level>         trigger when the first channel rises past level, 0 to disable
+    CAP                 trigger now
+    REW                 send a "reward" message, which triggers a window
+    DRP                 report windows pending and dropped
+*/
+
+
+#include <Satellites.h>
+
+
+// Satellites and the capture with its buffer
+Satellites sat;
+SatelliteCapture capture;
+
+const byte numChan = 2;
+const unsigned int numFrames = 1000;
+int16_t buffer[numChan * numFrames];
+
+// Pins and sampling
+byte pins[numChan] = {0, 1};
+const byte lickPin = 2;
+const unsigned long samplePeriod = 1000;
+unsigned long nextSample;
+unsigned int preFrames = 50;
+
+#if defined(TEENSYDUINO)
+  IntervalTimer sampleTimer;
+#endif
+
+
+void setup()
+{
+  // Initialize serial (not necessary on Teensy)
+  Serial.begin(115200);
+  sat.attachReader(myReader);
+  sat.attachCapture(capture);
+
+  pinMode(lickPin, INPUT);
+  capture.begin(buffer, numChan * numFrames, numChan);
+  capture.setWindow(50, 150);
+  capture.setEdge(lickPin);
+  capture.addTag("reward");
+
+  // Sample in a timer interrupt on Teensy, otherwise from loop
+  #if defined(TEENSYDUINO)
+    sampleTimer.begin(sample, samplePeriod);
+  #endif
+  nextSample = micros();
+}
+
+
+void loop()
+{
+  sat.serialReadCmd();
+
+  #if !defined(TEENSYDUINO)
+    if ((long)(micros() - nextSample) >= 0)
+    {
+      nextSample += samplePeriod;
+      sample();
+    }
+  #endif
+
+  // Send a part of the next complete window, if any
+  sat.sendCapture();
+}
+
+
+void sample()
+{
+  int vals[numChan];
+  for (int i = 0; i < numChan; i++)
+    vals[i] = analogRead(pins[i]);
+  capture.add(vals);
+}
+
+
+void myReader()
+{
+  String cmdStr = sat.getCmdName();
+  int idx = sat.getIndex();
+  long val = sat.getValue();
+
+  if (idx == 1 && cmdStr.equals("WIN"))
+  {
+    preFrames = val;
+  }
+  else if (idx == 2 && cmdStr.equals("WIN"))
+  {
+    unsigned int window[] = {preFrames, (unsigned int)val};
+    bool isSet = capture.setWindow(window[0], window[1]);
+    sat.sendData(isSet ? "window set" : "window rejected", millis(), window, 2);
+  }
+  else if (idx == 1 && cmdStr.equals("THR"))
+  {
+    if (val > 0)
+      capture.setThreshold(0, val);
+    else
+      capture.setThreshold(SatelliteCapture::maxChannels, 0);
+  }
+  else if (idx == 0 && cmdStr.equals("CAP"))
+  {
+    capture.trigger();
+  }
+  else if (idx == 0 && cmdStr.equals("REW"))
+  {
+    sat.sendData("reward");
+  }
+  else if (idx == 0 && cmdStr.equals("DRP"))
+  {
+    unsigned long counts[] = {capture.numPending(), capture.getDropped()};
+    sat.sendData("windows", millis(), counts, 2);
+  }
+}
@@ -26,6 +26,10 @@ int noLickDur = 1000;     // duration (ms) when the animal should not lick
 bool isTraining = false;  // whether or not the training should proceed
 
 
+// Registry of parameters that can be set by serial commands, e.g. "WAT,150"
+SatelliteParams params;
+
+
 void setup()
 {
   // Initialize serial (not necessary on Teensy)
@@ -38,6 +42,15 @@ void setup()
   // Attach the function you defined below to handle serial commands
   sr.attachReader(myReader);
 
+  // Register parameters with their command names and limits. New values are staged when
+  // commands arrive and take effect together when applyParams is called.
+  params.add("WAT", waterDur, 0, 5000);
+  params.add("ITI", itiDur, 0, 30000);
+  params.add("NLK", noLickDur, 0, 30000);
+  sr.attachParams(params);
+  sr.sendParamNames();
+  sr.sendParams();
+
   // Setup external interrupt and callback function
   attachInterrupt(digitalPinToInterrupt(lickPin), reportLick, RISING);
 }
@@ -47,6 +60,9 @@ void loop()
 {
   // Read any incoming serial command
   sr.serialReadCmd();
+
+  // Outside of training, new parameter values take effect right away
+  sr.applyParams();
 }
 
 
@@ -70,24 +86,6 @@ void myReader()
     isTraining = val;
     sr.sendData("isTraining set", millis(), isTraining);
   }
-  else if (idx == 1 && cmdStr.equals("WAT"))
-  {
-    // Change water valve opening duration
-    waterDur = val;
-    sr.sendData("waterDur set", millis(), waterDur);
-  }
-  else if (idx == 1 && cmdStr.equals("ITI"))
-  {
-    // Change the duration of inter-trial-interval
-    itiDur = val;
-    sr.sendData("itiDur set", millis(), itiDur);
-  }
-  else if (idx == 1 && cmdStr.equals("NLK"))
-  {
-    // Change the duration of no lick interval
-    noLickDur = val;
-    sr.sendData("noLickDur set", millis(), noLickDur);
-  }
   else if (idx == 1 && cmdStr.equals("w"))
   {
     // Manually give animal certain amount of water
@@ -118,6 +116,9 @@ void lickForWater()
     // Increment trial count
     numTrials++;
 
+    // Apply parameters changed during the last trial, which sends all values in one message
+    sr.applyParams();
+
     // Report current trial time and number
     sr.sendData("trial", millis(), numTrials);
     
@@ -0,0 +1,153 @@
+/*
+  SatellitesLog
+  Keeps a copy of every message on an SD card (SatelliteLog), so that a session survives a
+  dropped link or a crash on the host. Blocks are written from serialReadCmd while the
+  sketch is idle, and the host fetches the log in bulk with LOGF.
+
+  Licks are reported as "lick,<time>" and trials as "trial,<time>,<number>" every second.
+
+  Serial commands
+    LOGD,<0 or 1>   send messages to the link and the log (0), or to the log only (1)
+    LOGF,<block>    send the log from a block on, then "logEnd,<time>,<blocks>"
+    LOGS            send log statistics (see Satellites::sendLogStats)
+    LOGN            start a new log, overwriting the old one
+
+  The log file is created at full size before the session, since growing a file on the
+  card costs far more than writing a block. In HostArduino, the card is a file next to the
+  program that takes 3 ms per block write.
+*/
+
+
+#include <Satellites.h>
+
+#if defined(HOST_ARDUINO)
+  #include <HostBlockDevice.h>
+  HostBlockDevice card("SatellitesLog.bin", 2048, 3000);
+#else
+  #include <SD.h>
+
+  // Blocks of a preallocated file on the SD card
+  class SDBlockDevice : public SatelliteBlockDevice
+  {
+  public:
+    bool begin(const char* path, unsigned long numBlocks)
+    {
+      if (!SD.begin(BUILTIN_SDCARD))
+        return false;
+      file = SD.open(path, FILE_WRITE);
+      if (!file)
+        return false;
+      while (file.size() < numBlocks * blockSize)
+      {
+        byte zeros[blockSize] = {0};
+        file.seek(file.size());
+        file.write(zeros, blockSize);
+      }
+      file.flush();
+      n = numBlocks;
+      return true;
+    }
+
+    unsigned long numBlocks() { return n; }
+
+    bool readBlock(unsigned long index, byte* data)
+    {
+      return file.seek(index * blockSize) && file.read(data, blockSize) == (int)blockSize;
+    }
+
+    bool writeBlock(unsigned long index, const byte* data)
+    {
+      if (!file.seek(index * blockSize) || file.write(data, blockSize) != blockSize)
+        return false;
+      file.flush();
+      return true;
+    }
+
+  private:
+    File file;
+    unsigned long n = 0;
+  };
+
+  SDBlockDevice card;
+#endif
+
+
+Satellites sat;
+SatelliteLog logger;
+
+const byte lickPin = 2;
+const unsigned long trialDur = 1000;
+volatile bool isLick = false;
+unsigned long trialStart;
+long numTrials = 0;
+
+
+void setup()
+{
+  // Initialize serial (not necessary on Teensy)
+  Serial.begin(115200);
+  sat.attachReader(myReader);
+
+  pinMode(lickPin, INPUT);
+  attachInterrupt(digitalPinToInterrupt(lickPin), onLick, RISING);
+
+  // Continue the log on the card in a new session
+  #if !defined(HOST_ARDUINO)
+    card.begin("SESSION.LOG", 65536);
+  #endif
+  if (logger.begin(card))
+    sat.attachLog(logger);
+
+  trialStart = millis();
+}
+
+
+void loop()
+{
+  // Log blocks are written from here when one is ready
+  sat.serialReadCmd();
+
+  if (isLick)
+  {
+    isLick = false;
+    sat.sendData("lick", millis());
+  }
+
+  if (millis() - trialStart >= trialDur)
+  {
+    trialStart += trialDur;
+    sat.sendData("trial", millis(), ++numTrials);
+  }
+}
+
+
+void onLick()
+{
+  isLick = true;
+}
+
+
+void myReader()
+{
+  String cmdStr = sat.getCmdName();
+  int idx = sat.getIndex();
+  long val = sat.getValue();
+
+  if (idx == 1 && cmdStr.equals("LOGD"))
+  {
+    sat.attachLog(logger, val != 0);
+  }
+  else if (idx == 1 && cmdStr.equals("LOGF"))
+  {
+    sat.sendLog(val);
+  }
+  else if (idx == 0 && cmdStr.equals("LOGS"))
+  {
+    sat.sendLogStats();
+  }
+  else if (idx == 0 && cmdStr.equals("LOGN"))
+  {
+    if (logger.begin(card, false))
+      sat.attachLog(logger);
+  }
+}
@@ -0,0 +1,115 @@
+/*
+  SatellitesPriority
+  Streams analog samples faster than a slow link can carry them while running trials, to
+  show queueing by priority. With queueing on, samples ("i") are in the stream class and
+  drop the oldest when their queue is full, while trial events go out first and the trial
+  loop keeps its timing. With queueing off, every sendData waits for the link and trials
+  run late.
+
+  Each trial sends "trial,<time>,<number>" and 200 ms later opens the valve and sends
+  "water delivered,<time>,<ms late>", the delay of the valve against its schedule.
+
+  Serial commands
+    QUE,<0 or 1>    queueing off or on (on at start)
+    SPR,<Hz>        sampling rate of the stream
+    QST             send queue statistics (see Satellites::sendQueueStats)
+
+  In HostArduino, run with --baud 115200 to give Serial the speed of a UART.
+*/
+
+
+#include <Satellites.h>
+
+
+Satellites sat;
+SatelliteQueue queue;
+
+
+// Stream of samples
+const byte numChan = 4;
+byte pins[numChan] = {0, 1, 2, 3};
+int vals[numChan];
+unsigned long samplingRate = 1000;
+unsigned long nextSample;
+
+// Trials
+const byte valvePin = 13;
+const unsigned long trialDur = 1000;
+const unsigned long waterDelay = 200;
+const unsigned long waterDur = 50;
+unsigned long trialStart;
+int numTrials = 0;
+bool isWaterDue = false;
+
+
+void setup()
+{
+  // Initialize serial (not necessary on Teensy)
+  Serial.begin(115200);
+  sat.attachReader(myReader);
+  pinMode(valvePin, OUTPUT);
+
+  // Trial events are critical, samples are the first to go
+  sat.setTagClass("trial", Satellites::criticalClass);
+  sat.setTagClass("water delivered", Satellites::criticalClass);
+  sat.setTagClass("i", Satellites::streamClass);
+  sat.attachQueue(queue);
+
+  nextSample = micros();
+  trialStart = millis();
+}
+
+
+void loop()
+{
+  sat.serialReadCmd();
+
+  if ((long)(micros() - nextSample) >= 0)
+  {
+    nextSample += 1000000 / samplingRate;
+    for (int i = 0; i < numChan; i++)
+      vals[i] = analogRead(pins[i]);
+    sat.sendData("i", millis(), vals, numChan);
+  }
+
+  unsigned long t = millis();
+  if (t - trialStart >= trialDur)
+  {
+    trialStart += trialDur;
+    isWaterDue = true;
+    sat.sendData("trial", trialStart, ++numTrials);
+  }
+  else if (isWaterDue && t - trialStart >= waterDelay)
+  {
+    isWaterDue = false;
+    digitalWrite(valvePin, HIGH);
+    sat.sendData("water delivered", t, (long)(t - trialStart - waterDelay));
+    sat.delay(waterDur);
+    digitalWrite(valvePin, LOW);
+  }
+}
+
+
+void myReader()
+{
+  String cmdStr = sat.getCmdName();
+  int idx = sat.getIndex();
+  long val = sat.getValue();
+
+  if (idx == 1 && cmdStr.equals("QUE"))
+  {
+    if (val != 0)
+      sat.attachQueue(queue);
+    else
+      sat.detachQueue();
+  }
+  else if (idx == 1 && cmdStr.equals("SPR"))
+  {
+    samplingRate = constrain(val, 1, 10000);
+    nextSample = micros();
+  }
+  else if (idx == 0 && cmdStr.equals("QST"))
+  {
+    sat.sendQueueStats();
+  }
+}
@@ -0,0 +1,120 @@
+/*
+  SatellitesSequence
+  Plays a preloaded sequence of output changes (SequencePlayer in the ManyRig library) with
+  a hardware timer, e.g. an opto pulse train on wsPin with cues on audioPins. The sequence
+  is uploaded in one command, then started by a command or by the next lick.
+
+  Outputs are channels 0 (wsPin), 1 (audioPins[0]) and 2 (audioPins[1]). Each step is the
+  delay in us since the previous step and the levels of the channels as a bit mask. The
+  default is a 20 Hz train of 5 ms pulses on channel 0 for 1 s.
+
+  Serial commands
+    SEQ,<delay>,<levels>,...    replace the sequence, e.g. SEQ,2,1,5000,0
+    SQA,<delay>,<levels>,...    add steps to the sequence
+    SQI                         report the sequence loaded
+    LOP,<count>,<period>        play count times (0 for ever), one loop every period us
+    ARM                         start on the next lick
+    GO                          start now
+    STP                         stop and set all outputs low
+
+  Messages
+    seqLoaded,<time>,<steps>,<duration in us>
+    seqStart,<time in us>,<0 for GO, 1 for a lick>
+    seqDone,<time in us of the last step>,<loops>
+    seqStop,<time in us>,<steps played>
+
+  Without IntervalTimer (other than Teensy), or when other engines hold all the timers,
+  the player is ticked from loop and follows its timing instead.
+*/
+
+
+#include <Satellites.h>
+#include <ManyRig.h>
+
+
+Satellites sat;
+ManyRig rig;
+SequencePlayer player;
+unsigned long numLoops = 20;
+
+
+void setup()
+{
+  // Initialize serial (not necessary on Teensy)
+  Serial.begin(115200);
+  sat.attachReader(myReader);
+
+  player.setOutput(0, rig.wsPin);
+  player.setOutput(1, rig.audioPins[0]);
+  player.setOutput(2, rig.audioPins[1]);
+  player.setTrigger(rig.lickDetectorPin);
+
+  player.addStep(2, 1);
+  player.addStep(5000, 0);
+  player.setLoops(20, 50000);
+
+  player.begin();
+}
+
+
+void loop()
+{
+  sat.serialReadCmd();
+
+  // Does nothing while the player has a timer
+  player.tick();
+
+  // Report starts and ends logged by the interrupts
+  byte kind;
+  unsigned long value, t;
+  while (player.popEvent(kind, value, t))
+  {
+    if (kind == SequencePlayer::startEvent)
+      sat.sendData("seqStart", t, value);
+    else if (kind == SequencePlayer::doneEvent)
+      sat.sendData("seqDone", t, value);
+    else
+      sat.sendData("seqStop", t, value);
+  }
+}
+
+
+void myReader()
+{
+  String cmdStr = sat.getCmdName();
+  int idx = sat.getIndex();
+  long val = sat.getValue();
+
+  if (idx > 0 && (cmdStr.equals("SEQ") || cmdStr.equals("SQA")))
+  {
+    if (idx == 1 && cmdStr.equals("SEQ"))
+      player.clear();
+    if (!player.loadStep(idx, val))
+      sat.sendData("seqRejected", millis(), idx);
+  }
+  else if (idx == 0 && cmdStr.equals("SQI"))
+  {
+    unsigned long info[] = {player.numSteps(), player.getDuration()};
+    sat.sendData("seqLoaded", millis(), info, 2);
+  }
+  else if (idx == 1 && cmdStr.equals("LOP"))
+  {
+    numLoops = max(val, 0L);
+  }
+  else if (idx == 2 && cmdStr.equals("LOP"))
+  {
+    player.setLoops(numLoops, max(val, 0L));
+  }
+  else if (idx == 0 && cmdStr.equals("ARM"))
+  {
+    player.arm();
+  }
+  else if (idx == 0 && cmdStr.equals("GO"))
+  {
+    player.start();
+  }
+  else if (idx == 0 && cmdStr.equals("STP"))
+  {
+    player.stop();
+  }
+}
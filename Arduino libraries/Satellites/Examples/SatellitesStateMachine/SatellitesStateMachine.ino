@@ -0,0 +1,116 @@
+/*
+  SatellitesStateMachine
+  Runs a lick-for-water trial as a state machine (StateMachine in the ManyRig library)
+  instead of a sequence of blocking delays. Licks are handled in a pin-change interrupt,
+  so the valve opens within microseconds of the lick wherever the main loop is.
+
+  States of the default table
+    0  ITI      all outputs low, 2 s to the cue
+    1  Cue      100 ms tone and trial TTL high, a lick within 1.5 s is rewarded
+    2  Reward   50 ms valve pulse, 1 s to the next ITI
+    3  Miss     1 s to the next ITI
+
+  Serial commands
+    SMS,<state>       start at a state
+    SMX               stop
+    SMR,<state>,...   load a state (see StateMachine::loadRow), e.g. SMR,2,0,0,1,500000,0
+    LAT               report the longest lick-to-valve latency in microseconds
+
+  Every state entry is sent as "s,<time in us>,<state>,<cause>", where cause is the input
+  edge (0 for a lick onset, 1 for its end), 254 for a timer or 255 for a start.
+
+  Latency is measured from entering the lick interrupt to having written the outputs, and
+  the target is below 50 us. In the HostArduino emulator it is 2 us of virtual time. Check
+  the number on your board with LAT, since it depends on the speed of digitalWrite.
+*/
+
+
+#include <Satellites.h>
+#include <ManyRig.h>
+
+
+// Satellites, rig pin-out and the state machine
+Satellites sat;
+ManyRig rig;
+StateMachine sm;
+
+
+// Channels of the state machine
+const byte lickIn = 0;
+const byte valveOut = 0;
+const byte cueOut = 1;
+const byte trialOut = 2;
+
+// States
+const byte itiState = 0;
+const byte cueState = 1;
+const byte rewardState = 2;
+const byte missState = 3;
+
+
+void setup()
+{
+  // Initialize serial (not necessary on Teensy)
+  Serial.begin(115200);
+  sat.attachReader(myReader);
+
+  // Wiring and pulse widths
+  sm.setInput(lickIn, rig.lickDetectorPin);
+  sm.setOutput(valveOut, rig.waterValvePin);
+  sm.setOutput(cueOut, rig.audioPins[0]);
+  sm.setOutput(trialOut, rig.camPin);
+  sm.setPulse(valveOut, 50000);
+  sm.setPulse(cueOut, 100000);
+
+  // Default table: state, outputs set high, outputs set low, pulses, timer (us) and its target
+  byte all = bit(valveOut) | bit(cueOut) | bit(trialOut);
+  sm.setState(itiState, 0, all, 0, 2000000, cueState);
+  sm.setState(cueState, bit(trialOut), 0, bit(cueOut), 1500000, missState);
+  sm.setTransition(cueState, lickIn, true, rewardState);
+  sm.setState(rewardState, 0, bit(trialOut), bit(valveOut), 1000000, itiState);
+  sm.setState(missState, 0, bit(trialOut), 0, 1000000, itiState);
+
+  // Without a hardware timer (other than Teensy), tick is called from loop
+  sm.begin();
+}
+
+
+void loop()
+{
+  sat.serialReadCmd();
+
+  #if !defined(TEENSYDUINO)
+    sm.tick();
+  #endif
+
+  // Report state entries logged by the interrupts
+  byte event[2];
+  unsigned long t;
+  while (sm.popEvent(event[0], event[1], t))
+    sat.sendData("s", t, event, 2);
+}
+
+
+void myReader()
+{
+  String cmdStr = sat.getCmdName();
+  int idx = sat.getIndex();
+  long val = sat.getValue();
+
+  if (idx == 1 && cmdStr.equals("SMS"))
+  {
+    sm.start(val);
+  }
+  else if (idx == 0 && cmdStr.equals("SMX"))
+  {
+    sm.stop();
+  }
+  else if (idx > 0 && cmdStr.equals("SMR"))
+  {
+    sm.loadRow(idx, val);
+  }
+  else if (idx == 0 && cmdStr.equals("LAT"))
+  {
+    sat.sendData("latency", millis(), sm.getMaxLatency());
+  }
+}
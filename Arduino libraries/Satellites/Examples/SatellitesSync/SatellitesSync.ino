@@ -0,0 +1,124 @@
+/*
+  SatellitesSync
+  Sends the trial number as a barcode on numPin at the start of every trial and triggers a
+  camera on camPin (mirrored on framePin) at a fixed frame rate, both from a timer
+  interrupt (SyncGenerator in the ManyRig library). The trial loop below never waits for
+  them, so a recording system can align video and ephys to trials without slowing the task.
+
+  Messages
+    bc,<time in us>,<trial>     start of a barcode
+    fr,<time in us>,<index>     every 30th frame, and the first one
+    frEnd,<time in us>,<count>  last frame when frames stop
+
+  Serial commands
+    FRS,<count>     start frames, stopping after count frames (0 to run on)
+    FRX             stop frames
+    FPS,<Hz>        frame rate
+    LAT             report the longest time between loop iterations in microseconds
+
+  A barcode of 16 bits with 10 ms cells takes 190 ms. Decode it from the recording by
+  finding the 20 ms high mark, then reading each bit from the edge in the middle of its
+  cell: rising for a 0 and falling for a 1, least significant bit first.
+*/
+
+
+#include <Satellites.h>
+#include <ManyRig.h>
+
+
+Satellites sat;
+ManyRig rig;
+SyncGenerator sync;
+
+
+// Trials
+const unsigned long trialDur = 2000;
+unsigned long trialStart;
+unsigned long numTrials = 0;
+
+// Loop timing
+unsigned long lastLoop;
+unsigned long maxLoopGap = 0;
+
+
+void setup()
+{
+  // Initialize serial (not necessary on Teensy)
+  Serial.begin(115200);
+  sat.attachReader(myReader);
+
+  sync.setBarcodePin(rig.numPin);
+  sync.setBarcode(16, 10000);
+  sync.setFramePins(rig.camPin, rig.framePin);
+  sync.setFrameRate(30);
+  sync.setFrameWidth(1000);
+  sync.setFrameLogInterval(30);
+
+  // Without a hardware timer (other than Teensy), tick is called from loop
+  sync.begin();
+  sync.startFrames();
+
+  trialStart = millis();
+  lastLoop = micros();
+}
+
+
+void loop()
+{
+  unsigned long t = micros();
+  if (t - lastLoop > maxLoopGap)
+    maxLoopGap = t - lastLoop;
+  lastLoop = t;
+
+  sat.serialReadCmd();
+
+  #if !defined(TEENSYDUINO)
+    sync.tick();
+  #endif
+
+  // A new trial starts with its barcode
+  if (millis() - trialStart >= trialDur)
+  {
+    trialStart += trialDur;
+    sync.sendBarcode(++numTrials);
+  }
+
+  // Report barcodes and frames logged by the interrupts
+  byte kind;
+  unsigned long value;
+  while (sync.popEvent(kind, value, t))
+  {
+    if (kind == SyncGenerator::barcodeEvent)
+      sat.sendData("bc", t, value);
+    else if (kind == SyncGenerator::frameEvent)
+      sat.sendData("fr", t, value);
+    else
+      sat.sendData("frEnd", t, value);
+  }
+}
+
+
+void myReader()
+{
+  String cmdStr = sat.getCmdName();
+  int idx = sat.getIndex();
+  long val = sat.getValue();
+
+  if (idx == 1 && cmdStr.equals("FRS"))
+  {
+    sync.startFrames(max(val, 0L));
+  }
+  else if (idx == 0 && cmdStr.equals("FRX"))
+  {
+    sync.stopFrames();
+  }
+  else if (idx == 1 && cmdStr.equals("FPS"))
+  {
+    sync.setFrameRate(val);
+  }
+  else if (idx == 0 && cmdStr.equals("LAT"))
+  {
+    sat.sendData("latency", millis(), maxLoopGap);
+    maxLoopGap = 0;
+  }
+}
@@ -0,0 +1,126 @@
+/*
+  SatellitesTone
+  Plays audio cues synthesized on the board (ToneSynth in the ManyRig library) instead of
+  triggering an external sound card. Samples are computed in a timer interrupt, so play
+  returns at once and the onset follows the command by at most one sample period.
+
+  The output is the DAC pin A14 where there is one (Teensy 3.2, filtered and amplified for
+  a speaker), and a PWM pin otherwise (audioPins[0], which needs a low-pass filter).
+
+  Presets at start: 0 is 4 kHz, 1 is 8 kHz, 2 is 12 kHz, at full volume.
+
+  Serial commands
+    TON,<preset>,<ms>     play a preset for ms, or until TOF when 0
+    TOF                   fade out
+    TPR,<preset>,<Hz>     frequency of a preset, below half the sample rate
+    TVO,<preset>,<vol>    volume of a preset, 0 to 255
+    RMP,<us>              duration of the fades
+    SPR,<Hz>              sample rate, while no tone plays and over twice every preset
+    LOAD                  report the cost of the interrupt and start measuring again
+
+  Messages
+    toneOn,<time in us>,<preset>      first sample of a tone
+    toneOff,<time in us>,<preset>     last sample of the fade out
+    toneLoad,<time>,<sample rate>,<ticks per sample>,<max ticks>
+
+  Ticks are CPU cycles where there is a cycle counter (Teensy, or the host with HostArduino)
+  and the CPU share is ticks per sample * rate / (cycles per second).
+*/
+
+
+#include <Satellites.h>
+#include <ManyRig.h>
+
+
+Satellites sat;
+ManyRig rig;
+ToneSynth synth;
+
+// Presets and rates, as set by commands
+float freqs[ToneSynth::numPresets] = {4000, 8000, 12000};
+byte volumes[ToneSynth::numPresets] = {255, 255, 255};
+unsigned long sampleRate = 40000;
+byte preset = 0;
+
+
+void setup()
+{
+  // Initialize serial (not necessary on Teensy)
+  Serial.begin(115200);
+  sat.attachReader(myReader);
+
+  #if defined(A14)
+    synth.setOutput(A14, 12);
+  #else
+    synth.setOutput(rig.audioPins[0], 8);
+  #endif
+  synth.setSampleRate(sampleRate);
+  synth.setRamp(5000);
+  for (byte i = 0; i < ToneSynth::numPresets; i++)
+    synth.setPreset(i, freqs[i], volumes[i]);
+
+  // Without a hardware timer (other than Teensy), tick is called from loop
+  synth.begin();
+}
+
+
+void loop()
+{
+  sat.serialReadCmd();
+
+  #if !defined(TEENSYDUINO)
+    synth.tick();
+  #endif
+
+  // Report onsets and offsets logged by the interrupt
+  byte kind, p;
+  unsigned long t;
+  while (synth.popEvent(kind, p, t))
+    sat.sendData(kind == ToneSynth::onsetEvent ? "toneOn" : "toneOff", t, p);
+}
+
+
+void myReader()
+{
+  String cmdStr = sat.getCmdName();
+  int idx = sat.getIndex();
+  long val = sat.getValue();
+
+  if (idx == 1 && (cmdStr.equals("TON") || cmdStr.equals("TPR") || cmdStr.equals("TVO")))
+  {
+    preset = constrain(val, 0, ToneSynth::numPresets - 1);
+  }
+  else if (idx == 2 && cmdStr.equals("TON"))
+  {
+    synth.play(preset, max(val, 0L) * 1000);
+  }
+  else if (idx == 0 && cmdStr.equals("TOF"))
+  {
+    synth.stop();
+  }
+  else if (idx == 2 && cmdStr.equals("TPR"))
+  {
+    if (synth.setPreset(preset, max(val, 0L), volumes[preset]))
+      freqs[preset] = max(val, 0L);
+  }
+  else if (idx == 2 && cmdStr.equals("TVO"))
+  {
+    volumes[preset] = constrain(val, 0, 255);
+    synth.setPreset(preset, freqs[preset], volumes[preset]);
+  }
+  else if (idx == 1 && cmdStr.equals("RMP"))
+  {
+    synth.setRamp(max(val, 0L));
+  }
+  else if (idx == 1 && cmdStr.equals("SPR"))
+  {
+    if (synth.setSampleRate(max(val, 1L)))
+      sampleRate = max(val, 1L);
+  }
+  else if (idx == 0 && cmdStr.equals("LOAD"))
+  {
+    unsigned long vals[] = {sampleRate, synth.getTicksPerSample(), synth.getMaxTicks()};
+    sat.sendData("toneLoad", millis(), vals, 3);
+    synth.clearLoad();
+  }
+}
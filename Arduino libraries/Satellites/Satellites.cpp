@@ -1,5 +1,11 @@
 #include "Satellites.h"
 
+#if defined(__AVR__)
+extern int __heap_start, *__brkval;
+#elif defined(__arm__)
+extern "C" char* sbrk(int incr);
+#endif
+
 void Satellites::setDelimiter(char d) {
 	_delimiter = d;
 }
@@ -31,7 +37,19 @@ String Satellites::getCmdName() {
 void Satellites::serialRead() {
 	// Handle command identification and dispatching
 
-	if (_serial.available())
+	int numAvailable = _serial.available();
+
+	// Health telemetry costs a single test when disabled
+	if (_healthInterval > 0)
+		pollHealth(numAvailable);
+
+	// Queued messages and capture parts go out as the link frees up, and log blocks are written
+	if (_queue != NULL)
+		serialWrite();
+	if (_log != NULL)
+		_log->poll();
+
+	if (numAvailable > 0)
 	{
 		// Read byte as char
 		char ch = _serial.read();
@@ -48,8 +66,8 @@ void Satellites::serialRead() {
 		}
 		else if (ch == _delimiter || isControl(ch))
 		{
-			// Parse command and incoming value
-			if (_parserFunc != NULL && _cmdString.length() > 0)
+			// Parse command and incoming value, unless it sets a parameter
+			if (_cmdString.length() > 0 && !stageParam() && _parserFunc != NULL)
 				_parserFunc();
 
 			// Clear incoming value of the current input
@@ -61,6 +79,11 @@ void Satellites::serialRead() {
 			// Accumulate other characters to assemble the incoming string
 			_cmdString += ch;
 		}
+		else
+		{
+			// Other characters in values are ignored
+			_numIgnoredBytes++;
+		}
 
 		// Keep track of the number of delimiters for indexing inputs
 		if (ch == _delimiter)
@@ -69,6 +92,8 @@ void Satellites::serialRead() {
 		// Reset reader state for identification
 		if (isControl(ch))
 		{
+			if (_cmdString.length() > 0 || _numDelimiter > 0)
+				_numParseResets++;
 			_cmdString = "";
 			_numDelimiter = 0;
 		}
@@ -82,6 +107,10 @@ void Satellites::serialReadCmd() {
 	{
 		serialRead();
 	}
+
+	// Idle time for the log
+	if (_log != NULL)
+		_log->poll();
 }
 
 void Satellites::delay(unsigned long dur) {
@@ -137,8 +166,487 @@ bool Satellites::delayContinue(bool(*f)(void), unsigned long unitTime) {
 	return b;
 }
 
+void Satellites::attachParams(SatelliteParams& params) {
+	_params = &params;
+}
+
+void Satellites::detachParams() {
+	_params = NULL;
+}
+
+bool Satellites::stageParam() {
+	// Stage the value of a parameter command, returning false for other commands
+
+	if (_params == NULL)
+		return false;
+
+	int k = _params->find(_cmdString.c_str());
+	if (k < 0)
+		return false;
+
+	// The callback at the first delimiter has no value yet
+	if (_numDelimiter == 1)
+		_params->stage(k, (long)getValue());
+	return true;
+}
+
+bool Satellites::applyParams(const char* tag) {
+	// Apply staged parameters and send a snapshot when any was staged
+
+	if (_params == NULL || _params->apply() == 0)
+		return false;
+
+	sendParams(tag);
+	return true;
+}
+
+void Satellites::sendParams(const char* tag) {
+	// Send all parameter values in order of registration followed by the checksum
+
+	if (_params == NULL)
+		return;
+
+	long vals[SatelliteParams::maxParams + 1];
+	byte n = _params->size();
+	for (byte i = 0; i < n; i++)
+		vals[i] = _params->get(i);
+	vals[n] = _params->checksum();
+
+	sendData(tag, millis(), vals, n + 1);
+}
+
+void Satellites::sendParamNames(const char* tag) {
+	// Send parameter names in the order used by sendParams
+
+	if (_params == NULL)
+		return;
+
+	String msg = String();
+
+	msg += tag;
+	msg += _delimiter;
+	msg += millis();
+
+	for (byte i = 0; i < _params->size(); i++) {
+		msg += _delimiter;
+		msg += _params->getName(i);
+	}
+
+	serialSend(msg);
+}
+
+void Satellites::attachCapture(SatelliteCapture& capture) {
+	_capture = &capture;
+}
+
+void Satellites::detachCapture() {
+	_capture = NULL;
+}
+
+bool Satellites::sendCapture(const char* tag) {
+	// Send the next part of a complete window as a message, returning false when there is
+	// none or, with a queue, when the link is busy. With a queue, parts also go out from
+	// serialWrite, after the queued messages of their class.
+
+	if (_capture == NULL)
+		return false;
+
+	_captureTag = tag;
+	_captureClass = classOf(tag);
+	if (_queue == NULL)
+		return writeCapture(false);
+
+	for (byte c = 0; c <= _captureClass; c++) {
+		if (!writeClass(c))
+			return false;
+	}
+	return writeCapture(true);
+}
+
+bool Satellites::writeCapture(bool isPaced) {
+	// Write the next capture part like any message, to the log and then to the link. Paced
+	// parts wait for room in the transmit buffer rather than block.
+
+	bool isDiverted = _log != NULL && _isLogDiverted;
+	if (isPaced && !isDiverted && !hasRoom(_capture->maxPartLength(_captureTag)))
+		return false;
+
+	String msg;
+	if (!_capture->send(msg, _captureTag, _delimiter))
+		return false;
+
+	if (_log != NULL)
+		_log->append(msg.c_str(), msg.length());
+	if (!isDiverted)
+		writeMessage(msg);
+	if (_queue != NULL)
+		_numSent[_captureClass]++;
+	return true;
+}
+
+void Satellites::attachQueue(SatelliteQueue& queue) {
+	// Queue messages by priority class while the link is busy, instead of blocking on each.
+	// Classes come from message tags (setTagClass). A higher class always goes first, and a
+	// full queue drops its oldest or its newest message, or blocks until there is room or
+	// the timeout has passed (then dropping the newest). The defaults are
+	//   criticalClass	block for up to 100 ms
+	//   eventClass		block for up to 10 ms, the class of tags without one
+	//   streamClass	drop the oldest
+	// Queued messages are written from sendData, serialRead and serialWrite. Only call
+	// sendData outside of interrupts while queueing is on. The queue holds its messages
+	// without using the heap (see SatelliteQueue); a message longer than a class ring is
+	// written right away.
+
+	_queue = &queue;
+}
+
+void Satellites::detachQueue() {
+	// Write what is left and stop queueing
+
+	if (_queue == NULL)
+		return;
+
+	for (byte c = 0; c < numClasses; c++) {
+		while (_queue->numQueued(c) > 0) {
+			writeQueued(c);
+			_numSent[c]++;
+		}
+	}
+	_queue = NULL;
+}
+
+bool Satellites::setTagClass(const char* tag, byte cls) {
+	// Class of messages with this tag, replacing any earlier one
+
+	if (tag == NULL || cls >= numClasses)
+		return false;
+
+	for (byte i = 0; i < _numTagClasses; i++) {
+		if (strcmp(_classTags[i], tag) == 0) {
+			_tagClasses[i] = cls;
+			return true;
+		}
+	}
+
+	if (_numTagClasses >= maxTagClasses)
+		return false;
+	_classTags[_numTagClasses] = tag;
+	_tagClasses[_numTagClasses++] = cls;
+	return true;
+}
+
+void Satellites::setDefaultClass(byte cls) {
+	if (cls < numClasses)
+		_defaultClass = cls;
+}
+
+bool Satellites::setClassPolicy(byte cls, byte policy, unsigned long timeout) {
+	// What a full queue does, with the timeout in ms for blockPolicy
+
+	if (cls >= numClasses || policy > blockPolicy)
+		return false;
+
+	_policies[cls] = policy;
+	_timeouts[cls] = timeout;
+	return true;
+}
+
+byte Satellites::classOf(const char* msg) {
+	for (byte i = 0; i < _numTagClasses; i++) {
+		size_t len = strlen(_classTags[i]);
+		if (strncmp(msg, _classTags[i], len) == 0 && (msg[len] == _delimiter || msg[len] == '\0'))
+			return _tagClasses[i];
+	}
+	return _defaultClass;
+}
+
+bool Satellites::hasRoom(unsigned int length) {
+	// Whether a message and its line break fit in the transmit buffer. Messages longer than
+	// the buffer wait until it is empty, and ports that do not report room never wait.
+
+	int room = _serial.availableForWrite();
+	if (room > _txCapacity)
+		_txCapacity = room;
+	return room >= (int)length + 2 || room >= _txCapacity;
+}
+
+void Satellites::writeQueued(byte cls) {
+	// Write the oldest message of a class and remove it
+	unsigned int length = 0;
+	unsigned long t = 0;
+	const char* msg = _queue->peek(cls, length, t);
+	writeMessage(msg, length);
+	_queue->pop(cls);
+}
+
+bool Satellites::writeClass(byte cls) {
+	// Write the queued messages of a class while the link has room, returning whether none is
+	// left
+
+	unsigned int length = 0;
+	unsigned long t = 0;
+	while (_queue->peek(cls, length, t) != NULL) {
+		if (!hasRoom(length))
+			return false;
+
+		unsigned long latency = micros() - t;
+		if (latency > _maxLatency[cls])
+			_maxLatency[cls] = latency;
+
+		writeQueued(cls);
+		_numSent[cls]++;
+	}
+	return true;
+}
+
+void Satellites::serialWrite() {
+	// Write queued messages, highest class first, while the link has room, and a part of a
+	// capture window after the messages of its class
+
+	for (byte c = 0; c < numClasses; c++) {
+		if (_queue != NULL && !writeClass(c))
+			return;
+		if (c == _captureClass && _capture != NULL)
+			writeCapture(true);
+	}
+}
+
+void Satellites::sendQueueStats(const char* tag) {
+	// Send, for each class from the highest, messages sent and dropped in total, and the
+	// longest wait in the queue (us) and the deepest queue since the last stats
+
+	long vals[4 * numClasses];
+	for (byte c = 0; c < numClasses; c++) {
+		vals[4 * c] = _numSent[c];
+		vals[4 * c + 1] = _numDropped[c];
+		vals[4 * c + 2] = _maxLatency[c];
+		vals[4 * c + 3] = _maxDepth[c];
+		_maxLatency[c] = 0;
+		_maxDepth[c] = _queue != NULL ? _queue->numQueued(c) : 0;
+	}
+	sendData(tag, millis(), vals, 4 * numClasses);
+}
+
+void Satellites::attachLog(SatelliteLog& log, bool isDiverted) {
+	// Record every message in the log, and only there when diverted
+	_log = &log;
+	_isLogDiverted = isDiverted;
+}
+
+void Satellites::detachLog() {
+	_log = NULL;
+}
+
+void Satellites::sendLog(unsigned long fromBlock) {
+	// Send the log from a block on (see SatelliteLog::replay), then "logEnd,<time>,<blocks>".
+	// Lines go straight to the port, past the queue and the log itself.
+
+	if (_log == NULL)
+		return;
+
+	_log->flush();
+	unsigned long n = _log->size();
+	for (unsigned long b = fromBlock; b < n; b++)
+		_log->replay(b, _serial, _delimiter);
+
+	String msg = String("logEnd");
+	msg += _delimiter;
+	msg += millis();
+	msg += _delimiter;
+	msg += n;
+	writeMessage(msg);
+}
+
+void Satellites::sendLogStats(const char* tag) {
+	// Send the session, blocks used, records, records dropped, bytes logged, bytes written,
+	// write amplification in percent, stalls, longest stall of a message (us) and longest
+	// block write (us)
+
+	if (_log == NULL)
+		return;
+
+	unsigned long logged = _log->bytesLogged();
+	unsigned long written = _log->bytesWritten();
+	unsigned long vals[10];
+	vals[0] = _log->getSession();
+	vals[1] = _log->size();
+	vals[2] = _log->numRecords();
+	vals[3] = _log->numDropped();
+	vals[4] = logged;
+	vals[5] = written;
+	vals[6] = logged > 0 ? (unsigned long)((float)written * 100 / logged) : 0;
+	vals[7] = _log->numStalls();
+	vals[8] = _log->getMaxStall();
+	vals[9] = _log->getMaxWrite();
+	sendData(tag, millis(), vals, 10);
+}
+
+void Satellites::setHeartbeat(unsigned long interval) {
+	// Send a health message every interval ms from serialRead, or never when 0. The values are
+	//   polls per second		serialRead calls, e.g. in delay loops
+	//   max poll gap			longest time between serialRead calls (us)
+	//   RX high-water			most bytes waiting in the receive buffer
+	//   TX low-water			least space left in the transmit buffer (-1 before any send)
+	//   RX full				times the receive buffer filled up (input may have been lost)
+	//   TX short				messages not written in full
+	//   parse resets			command lines ended by a line break
+	//   ignored bytes			characters in values that the parser skipped
+	//   free RAM				between heap and stack now, in bytes (-1 when unknown)
+	//   min free RAM			lowest free RAM seen while polling
+	// Rates and buffer marks cover the last interval; counts and min free RAM are totals.
+
+	_healthInterval = interval;
+	_healthT0 = millis();
+	_isPolled = false;
+	_numPolls = 0;
+	_maxPollGap = 0;
+	_rxHighWater = 0;
+	_txLowWater = -1;
+}
+
+unsigned long Satellites::getHeartbeat() {
+	return _healthInterval;
+}
+
+void Satellites::pollHealth(int numAvailable) {
+	// Update health telemetry at every serialRead and send it when due
+
+	unsigned long t = micros();
+	if (_isPolled && t - _lastPollUs > _maxPollGap)
+		_maxPollGap = t - _lastPollUs;
+	_lastPollUs = t;
+	_isPolled = true;
+	_numPolls++;
+
+	if (numAvailable > _rxHighWater)
+		_rxHighWater = numAvailable;
+
+	// Count each time the buffer fills rather than every poll while it is full
+#if defined(SERIAL_RX_BUFFER_SIZE)
+	bool isFull = numAvailable >= SERIAL_RX_BUFFER_SIZE - 1;
+	if (isFull && !_isRxFull)
+		_numRxFull++;
+	_isRxFull = isFull;
+#endif
+
+	long ram = freeRam();
+	if (ram >= 0 && (_minFreeRam < 0 || ram < _minFreeRam))
+		_minFreeRam = ram;
+
+	if (millis() - _healthT0 >= _healthInterval)
+		sendHealth();
+}
+
+void Satellites::sendHealth() {
+	// Send a health message now and start a new interval
+
+	unsigned long t = millis();
+	unsigned long dt = t - _healthT0;
+
+	long vals[10];
+	vals[0] = dt > 0 ? (long)((float)_numPolls * 1000 / dt) : 0;
+	vals[1] = _maxPollGap;
+	vals[2] = _rxHighWater;
+	vals[3] = _txLowWater;
+	vals[4] = _numRxFull;
+	vals[5] = _numTxShort;
+	vals[6] = _numParseResets;
+	vals[7] = _numIgnoredBytes;
+	vals[8] = freeRam();
+	vals[9] = _minFreeRam;
+
+	_healthT0 = t;
+	_numPolls = 0;
+	_maxPollGap = 0;
+	_rxHighWater = 0;
+	_txLowWater = -1;
+
+	sendData("health", t, vals, 10);
+}
+
+long Satellites::freeRam() {
+	// Bytes between the top of the heap and the stack, or -1 when unknown
+
+	char top;
+#if defined(__AVR__)
+	return (long)&top - (__brkval ? (long)__brkval : (long)&__heap_start);
+#elif defined(__arm__)
+	return (long)(&top - sbrk(0));
+#else
+	(void)top;
+	return -1;
+#endif
+}
+
 void Satellites::serialSend(String msg) {
-	_serial.println(msg);
+	// Let messages with a trigger tag open a capture window. Capture parts are messages of
+	// their own, so this one can go out while a window is being sent.
+	if (_capture != NULL)
+		_capture->checkTag(msg.c_str(), _delimiter);
+
+	if (_log != NULL) {
+		_log->append(msg.c_str(), msg.length());
+		if (_isLogDiverted)
+			return;
+	}
+
+	if (_queue == NULL) {
+		writeMessage(msg);
+		return;
+	}
+
+	// Write right away when the link has room and nothing of the same or a higher class waits
+	byte c = classOf(msg.c_str());
+	serialWrite();
+	bool isWaiting = false;
+	for (byte k = 0; k <= c; k++)
+		isWaiting = isWaiting || _queue->numQueued(k) > 0;
+	if ((!isWaiting && hasRoom(msg.length())) || msg.length() > SatelliteQueue::queueBytes) {
+		writeMessage(msg);
+		_numSent[c]++;
+		return;
+	}
+
+	// Make room in a full queue by the policy of the class
+	bool isQueued = _queue->push(c, msg.c_str(), msg.length());
+	if (!isQueued && _policies[c] == blockPolicy) {
+		unsigned long t0 = millis();
+		while (!isQueued && millis() - t0 < _timeouts[c]) {
+			serialWrite();
+			isQueued = _queue->push(c, msg.c_str(), msg.length());
+		}
+	}
+	while (!isQueued && _policies[c] == dropOldest && _queue->numQueued(c) > 0) {
+		_queue->pop(c);
+		_numDropped[c]++;
+		isQueued = _queue->push(c, msg.c_str(), msg.length());
+	}
+	if (!isQueued) {
+		_numDropped[c]++;
+		return;
+	}
+
+	if (_queue->numQueued(c) > _maxDepth[c])
+		_maxDepth[c] = _queue->numQueued(c);
+}
+
+void Satellites::writeMessage(const String& msg) {
+	writeMessage(msg.c_str(), msg.length());
+}
+
+void Satellites::writeMessage(const char* msg, unsigned int length) {
+	size_t n = _serial.write((const uint8_t*)msg, length);
+	n += _serial.println();
+
+	if (_healthInterval > 0)
+	{
+		if (n < length + 2)
+			_numTxShort++;
+
+		int space = _serial.availableForWrite();
+		if (_txLowWater < 0 || space < _txLowWater)
+			_txLowWater = space;
+	}
 }
 
 unsigned long Satellites::sendData(const char* tag, unsigned long t) {
@@ -639,4 +1147,1056 @@ unsigned long Satellites::sendData(const __FlashStringHelper* tag, unsigned long
 	serialSend(msg);
 
 	return micros() - tStart;
+}
+
+
+
+// Parameter types
+enum {
+	boolParam,
+	byteParam,
+	intParam,
+	uintParam,
+	longParam,
+	ulongParam
+};
+
+static byte hashName(const char* name) {
+	// FNV-1a folded to a byte
+
+	uint32_t h = 2166136261UL;
+	while (*name)
+		h = (h ^ (byte)*name++) * 16777619UL;
+	return (byte)(h ^ (h >> 8) ^ (h >> 16) ^ (h >> 24));
+}
+
+bool SatelliteParams::add(const char* name, bool& var) {
+	return addVar(name, &var, boolParam, 0, 1);
+}
+
+bool SatelliteParams::add(const char* name, byte& var, long minVal, long maxVal) {
+	return addVar(name, &var, byteParam, max(minVal, 0L), min(maxVal, 255L));
+}
+
+bool SatelliteParams::add(const char* name, int& var, long minVal, long maxVal) {
+	return addVar(name, &var, intParam, minVal, maxVal);
+}
+
+bool SatelliteParams::add(const char* name, unsigned int& var, long minVal, long maxVal) {
+	return addVar(name, &var, uintParam, max(minVal, 0L), maxVal);
+}
+
+bool SatelliteParams::add(const char* name, long& var, long minVal, long maxVal) {
+	return addVar(name, &var, longParam, minVal, maxVal);
+}
+
+bool SatelliteParams::add(const char* name, unsigned long& var, long minVal, long maxVal) {
+	return addVar(name, &var, ulongParam, max(minVal, 0L), maxVal);
+}
+
+bool SatelliteParams::addVar(const char* name, void* var, byte type, long minVal, long maxVal) {
+	// Register a variable under a unique name
+
+	if (_numParams >= maxParams || name == NULL || *name == '\0' || minVal > maxVal || find(name) >= 0)
+		return false;
+
+	byte k = _numParams++;
+	_names[k] = name;
+	_vars[k] = var;
+	_types[k] = type;
+	_mins[k] = minVal;
+	_maxs[k] = maxVal;
+
+	byte i = hashName(name) & (_tableSize - 1);
+	while (_table[i])
+		i = (i + 1) & (_tableSize - 1);
+	_table[i] = k + 1;
+	return true;
+}
+
+byte SatelliteParams::size() {
+	return _numParams;
+}
+
+int SatelliteParams::find(const char* name) {
+	// Index of a parameter, or -1 when there is none by that name
+
+	byte i = hashName(name) & (_tableSize - 1);
+	while (_table[i]) {
+		byte k = _table[i] - 1;
+		if (strcmp(_names[k], name) == 0)
+			return k;
+		i = (i + 1) & (_tableSize - 1);
+	}
+	return -1;
+}
+
+const char* SatelliteParams::getName(byte index) {
+	return index < _numParams ? _names[index] : NULL;
+}
+
+long SatelliteParams::get(byte index) {
+	if (index >= _numParams)
+		return 0;
+
+	switch (_types[index]) {
+		case boolParam: return *(bool*)_vars[index];
+		case byteParam: return *(byte*)_vars[index];
+		case intParam: return *(int*)_vars[index];
+		case uintParam: return *(unsigned int*)_vars[index];
+		case longParam: return *(long*)_vars[index];
+		case ulongParam: return (long)*(unsigned long*)_vars[index];
+	}
+	return 0;
+}
+
+void SatelliteParams::set(byte index, long value) {
+	switch (_types[index]) {
+		case boolParam: *(bool*)_vars[index] = value != 0; break;
+		case byteParam: *(byte*)_vars[index] = value; break;
+		case intParam: *(int*)_vars[index] = value; break;
+		case uintParam: *(unsigned int*)_vars[index] = value; break;
+		case longParam: *(long*)_vars[index] = value; break;
+		case ulongParam: *(unsigned long*)_vars[index] = value; break;
+	}
+}
+
+bool SatelliteParams::stage(byte index, long value) {
+	// Hold a value, limited to the parameter's range, until apply is called
+
+	if (index >= _numParams)
+		return false;
+
+	_staged[index] = constrain(value, _mins[index], _maxs[index]);
+	_stagedMask |= 1UL << index;
+	return true;
+}
+
+bool SatelliteParams::stage(const char* name, long value) {
+	int k = find(name);
+	return k >= 0 && stage(k, value);
+}
+
+byte SatelliteParams::numStaged() {
+	byte n = 0;
+	for (unsigned long m = _stagedMask; m; m &= m - 1)
+		n++;
+	return n;
+}
+
+byte SatelliteParams::apply() {
+	// Write all staged values at once, so that interrupts never see a partial update
+
+	if (_stagedMask == 0)
+		return 0;
+
+	byte n = 0;
+	noInterrupts();
+	for (byte k = 0; k < _numParams; k++) {
+		if (_stagedMask & (1UL << k)) {
+			set(k, _staged[k]);
+			n++;
+		}
+	}
+	_stagedMask = 0;
+	interrupts();
+	return n;
+}
+
+void SatelliteParams::discard() {
+	_stagedMask = 0;
+}
+
+unsigned int SatelliteParams::checksum() {
+	// Fletcher-16 over names and values (as 4 bytes, least significant first)
+
+	unsigned int a = 0, b = 0;
+	for (byte k = 0; k < _numParams; k++) {
+		for (const char* p = _names[k]; *p; p++) {
+			a = (a + (byte)*p) % 255;
+			b = (b + a) % 255;
+		}
+		unsigned long v = (unsigned long)get(k);
+		for (byte i = 0; i < 4; i++) {
+			a = (a + ((v >> (8 * i)) & 0xFF)) % 255;
+			b = (b + a) % 255;
+		}
+	}
+	return (b << 8) | a;
+}
+
+
+
+SatelliteFilter::SatelliteFilter() {
+	for (byte ch = 0; ch < maxChannels; ch++) {
+		_offsetShifts[ch] = 0;
+		setChannel(ch, averageMode, 1);
+	}
+}
+
+bool SatelliteFilter::setChannel(byte ch, byte mode, byte decimation) {
+	// Select the decimation of a channel, 1 passes samples through
+
+	if (ch >= maxChannels || mode > firMode || decimation < 1 || decimation > maxDecimation)
+		return false;
+
+	_modes[ch] = mode;
+	_decimations[ch] = decimation;
+	if (mode == firMode)
+		designTaps(ch);
+	reset(ch);
+	return true;
+}
+
+bool SatelliteFilter::setOffsetTracking(byte ch, byte shift) {
+	// Subtract a running mean with a time constant of 2^shift samples, 0 to disable
+
+	if (ch >= maxChannels || shift > 16)
+		return false;
+
+	_offsetShifts[ch] = shift;
+	reset(ch);
+	return true;
+}
+
+byte SatelliteFilter::getMode(byte ch) {
+	return ch < maxChannels ? _modes[ch] : 0;
+}
+
+byte SatelliteFilter::getDecimation(byte ch) {
+	return ch < maxChannels ? _decimations[ch] : 0;
+}
+
+void SatelliteFilter::reset(byte ch) {
+	if (ch >= maxChannels)
+		return;
+
+	_phases[ch] = 0;
+	for (byte k = 0; k < _numStates; k++)
+		_states[ch][k] = 0;
+	_isOffsetSet[ch] = false;
+	_offsets[ch] = 0;
+	_values[ch] = 0;
+	_mins[ch] = 0;
+	_maxs[ch] = 0;
+	_rms[ch] = 0;
+}
+
+void SatelliteFilter::designTaps(byte ch) {
+	// Hamming windowed sinc in Q14 with the cutoff at the output Nyquist frequency,
+	// numPhaseTaps taps for each of the decimation phases
+
+	byte r = _decimations[ch];
+	byte k = r == 1 ? 1 : min((int)_maxPhaseTaps, maxTaps / r);
+	byte n = k * r;
+	_numPhaseTaps[ch] = k;
+
+	float h[maxTaps];
+	float sum = 0;
+	for (byte i = 0; i < n; i++) {
+		float m = i - (n - 1) / 2.0;
+		h[i] = m == 0 ? 1.0 / r : sin(PI * m / r) / (PI * m);
+		if (n > 1)
+			h[i] *= 0.54 - 0.46 * cos(2 * PI * i / (n - 1));
+		sum += h[i];
+	}
+
+	// Scale to a gain of exactly 1, putting the rounding error on the center tap
+	long total = 0;
+	for (byte i = 0; i < n; i++) {
+		_taps[ch][i] = round(h[i] / sum * 16384);
+		total += _taps[ch][i];
+	}
+	_taps[ch][n / 2] += 16384 - total;
+}
+
+static long divideRounded(long a, long b) {
+	return a >= 0 ? (a + b / 2) / b : -((-a + b / 2) / b);
+}
+
+static unsigned int squareRoot(uint32_t a) {
+	// Integer square root, rounded down
+
+	uint32_t root = 0;
+	uint32_t bit = 1UL << 30;
+	while (bit > a)
+		bit >>= 2;
+	while (bit) {
+		if (a >= root + bit) {
+			a -= root + bit;
+			root = (root >> 1) + bit;
+		}
+		else
+			root >>= 1;
+		bit >>= 2;
+	}
+	return root;
+}
+
+bool SatelliteFilter::process(byte ch, int x) {
+	// Feed one sample. Work per sample is bounded (at most 4 multiplies for FIR), and
+	// divisions only happen once per block.
+
+	if (ch >= maxChannels)
+		return false;
+
+	// Offset tracking in 1/256 of a count
+	long v = x;
+	byte shift = _offsetShifts[ch];
+	if (shift) {
+		if (!_isOffsetSet[ch]) {
+			_offsets[ch] = v * 256;
+			_isOffsetSet[ch] = true;
+		}
+		_offsets[ch] += (v * 256 - _offsets[ch]) >> shift;
+		v -= (_offsets[ch] + 128) >> 8;
+	}
+
+	// Envelope of the block
+	byte p = _phases[ch];
+	if (p == 0) {
+		_blockMins[ch] = v;
+		_blockMaxs[ch] = v;
+		_sumSquares[ch] = 0;
+	}
+	else if (v < _blockMins[ch])
+		_blockMins[ch] = v;
+	else if (v > _blockMaxs[ch])
+		_blockMaxs[ch] = v;
+	uint32_t a = v < 0 ? -v : v;
+	_sumSquares[ch] += a * a;
+
+	// Decimation
+	uint32_t* s = _states[ch];
+	byte r = _decimations[ch];
+	switch (_modes[ch]) {
+		case averageMode:
+			s[0] += v;
+			break;
+		case cicMode:
+			// Three integrators
+			s[0] += v;
+			s[1] += s[0];
+			s[2] += s[1];
+			break;
+		case firMode: {
+			// Polyphase: the sample adds to each of the outputs whose window it falls in
+			const int16_t* h = _taps[ch] + r - 1 - p;
+			for (byte j = 0; j < _numPhaseTaps[ch]; j++, h += r)
+				s[j] += *h * v;
+			break;
+		}
+	}
+
+	if (++p < r) {
+		_phases[ch] = p;
+		return false;
+	}
+	_phases[ch] = 0;
+
+	switch (_modes[ch]) {
+		case averageMode:
+			_values[ch] = divideRounded((int32_t)s[0], r);
+			s[0] = 0;
+			break;
+		case cicMode: {
+			// Three combs, then the gain of r^3 is divided out
+			uint32_t c = s[2];
+			for (byte k = 3; k < 6; k++) {
+				uint32_t d = c - s[k];
+				s[k] = c;
+				c = d;
+			}
+			_values[ch] = divideRounded((int32_t)c, (long)r * r * r);
+			break;
+		}
+		case firMode: {
+			_values[ch] = ((int32_t)s[0] + 8192) >> 14;
+			byte k = _numPhaseTaps[ch];
+			for (byte j = 0; j + 1 < k; j++)
+				s[j] = s[j + 1];
+			s[k - 1] = 0;
+			break;
+		}
+	}
+
+	_mins[ch] = _blockMins[ch];
+	_maxs[ch] = _blockMaxs[ch];
+	uint64_t sum = _sumSquares[ch];
+	_rms[ch] = squareRoot(sum >> 32 ? (uint32_t)(sum / r) : (uint32_t)sum / r);
+	return true;
+}
+
+long SatelliteFilter::getValue(byte ch) {
+	return ch < maxChannels ? _values[ch] : 0;
+}
+
+long SatelliteFilter::getMin(byte ch) {
+	return ch < maxChannels ? _mins[ch] : 0;
+}
+
+long SatelliteFilter::getMax(byte ch) {
+	return ch < maxChannels ? _maxs[ch] : 0;
+}
+
+unsigned int SatelliteFilter::getRms(byte ch) {
+	return ch < maxChannels ? _rms[ch] : 0;
+}
+
+long SatelliteFilter::getOffset(byte ch) {
+	return ch < maxChannels ? (_offsets[ch] + 128) >> 8 : 0;
+}
+
+
+
+bool SatelliteCapture::begin(int16_t* buffer, unsigned int size, byte numChannels) {
+	// Use size samples of buffer as a ring of frames and drop any pending windows
+
+	if (buffer == NULL || numChannels < 1 || numChannels > maxChannels || size / numChannels < 2)
+		return false;
+
+	noInterrupts();
+	_buffer = buffer;
+	_numChannels = numChannels;
+	_capacity = size / numChannels;
+	_numFrames = 0;
+	_firstWindow = 0;
+	_numWindows = 0;
+	_isSending = false;
+	_isOverrun = false;
+	_preFrames = min(_preFrames, _capacity / 4);
+	_postFrames = min(_postFrames, _capacity / 4);
+	interrupts();
+	return true;
+}
+
+bool SatelliteCapture::setWindow(unsigned int preFrames, unsigned int postFrames) {
+	// Frames kept before and after each trigger. A window takes at most half the ring, so
+	// that older windows can still be sent while new ones fill.
+
+	if ((unsigned long)preFrames + postFrames > _capacity / 2)
+		return false;
+
+	noInterrupts();
+	_preFrames = preFrames;
+	_postFrames = postFrames;
+	interrupts();
+	return true;
+}
+
+bool SatelliteCapture::addTag(const char* tag) {
+	// Trigger whenever a message with this tag is sent
+
+	if (_numTags >= maxTags || tag == NULL || *tag == '\0')
+		return false;
+	_tags[_numTags++] = tag;
+	return true;
+}
+
+void SatelliteCapture::setEdge(int pin, bool isRising) {
+	// Trigger on edges of a digital input, read with each frame (-1 to disable)
+
+	_edgePin = pin;
+	_isEdgeRising = isRising;
+	_lastLevel = -1;
+}
+
+void SatelliteCapture::setThreshold(byte ch, int level, bool isRising) {
+	// Trigger when a channel crosses level, or never when ch is past the last channel
+
+	_thresholdCh = ch < _numChannels ? ch : -1;
+	_thresholdLevel = level;
+	_isThresholdRising = isRising;
+	_lastValue = isRising ? level : level - 1;
+}
+
+void SatelliteCapture::clearTriggers() {
+	_numTags = 0;
+	_edgePin = -1;
+	_thresholdCh = -1;
+}
+
+void SatelliteCapture::add(const int* values) {
+	// Store a frame, after checking the triggers so that a crossing frame is the first one
+	// after the trigger
+
+	if (_buffer == NULL)
+		return;
+
+	if (_edgePin >= 0) {
+		int level = digitalRead(_edgePin);
+		if (_lastLevel >= 0 && level != _lastLevel && (level == HIGH) == _isEdgeRising)
+			trigger(edgeCause);
+		_lastLevel = level;
+	}
+
+	if (_thresholdCh >= 0) {
+		int v = values[_thresholdCh];
+		bool isCrossed = _isThresholdRising ?
+			_lastValue < _thresholdLevel && v >= _thresholdLevel :
+			_lastValue >= _thresholdLevel && v < _thresholdLevel;
+		if (isCrossed)
+			trigger(thresholdCause);
+		_lastValue = v;
+	}
+
+	// Windows still waiting for the frame about to be overwritten are dropped
+	unsigned long n = _numFrames;
+	if (n >= _capacity) {
+		unsigned long old = n - _capacity;
+		while (_numWindows > 0 && !_isOverrun) {
+			if (old < (_isSending ? _sendFrame : _winStarts[_firstWindow]))
+				break;
+			_numDropped++;
+			if (_isSending)
+				_isOverrun = true;
+			else
+				popWindow();
+		}
+	}
+
+	int16_t* frame = _buffer + (n % _capacity) * _numChannels;
+	for (byte i = 0; i < _numChannels; i++)
+		frame[i] = values[i];
+	_numFrames = n + 1;
+}
+
+void SatelliteCapture::trigger(byte cause) {
+	// Open a window around the next frame, or extend the last one when they overlap
+
+	if (_buffer == NULL)
+		return;
+
+	unsigned long t = millis();
+	noInterrupts();
+
+	unsigned long f = _numFrames;
+	unsigned long oldest = f > _capacity - 1 ? f - (_capacity - 1) : 0;
+	unsigned long start = f > _preFrames ? f - _preFrames : 0;
+	unsigned long end = f + _postFrames;
+	if (start < oldest)
+		start = oldest;
+
+	if (_numWindows > 0) {
+		byte last = (_firstWindow + _numWindows - 1) % maxWindows;
+		bool isLastSending = _isSending && _numWindows == 1;
+
+		// Merge unless the window is being sent or would take more than half the ring
+		if (!isLastSending && start <= _winEnds[last] && end - _winStarts[last] <= _capacity / 2) {
+			if (end > _winEnds[last])
+				_winEnds[last] = end;
+			if (_winCounts[last] < 255)
+				_winCounts[last]++;
+			interrupts();
+			return;
+		}
+
+		// Never send a frame twice
+		if (start < _winEnds[last])
+			start = _winEnds[last];
+	}
+
+	if (end <= start) {
+		interrupts();
+		return;
+	}
+
+	if (_numWindows >= maxWindows) {
+		_numDropped++;
+		interrupts();
+		return;
+	}
+
+	byte k = (_firstWindow + _numWindows) % maxWindows;
+	_winStarts[k] = start;
+	_winTriggers[k] = f;
+	_winEnds[k] = end;
+	_winTimes[k] = t;
+	_winCauses[k] = cause;
+	_winCounts[k] = 1;
+	_numWindows++;
+	interrupts();
+}
+
+bool SatelliteCapture::checkTag(const char* msg, char delimiter) {
+	// Trigger when the message starts with one of the tags
+
+	for (byte i = 0; i < _numTags; i++) {
+		size_t len = strlen(_tags[i]);
+		if (strncmp(msg, _tags[i], len) == 0 && (msg[len] == delimiter || msg[len] == '\0')) {
+			trigger(tagCause + i);
+			return true;
+		}
+	}
+	return false;
+}
+
+void SatelliteCapture::popWindow() {
+	_firstWindow = (_firstWindow + 1) % maxWindows;
+	_numWindows--;
+}
+
+bool SatelliteCapture::send(String& msg, const char* tag, char delimiter) {
+	// Put the next part of the oldest complete window in msg, up to framesPerSend frames:
+	//   <tag>,<trigger time>,<cause>,<triggers merged>,<frames before the trigger>,
+	//   <frames>,<channels>,<first frame of the part>,<samples, frame by frame>
+	// Each part is a message of its own, so that others can go out between them. A window
+	// overrun while being sent ends early, with fewer frames than announced. Returns false
+	// when no window is complete.
+
+	int16_t samples[framesPerSend * maxChannels];
+	unsigned int numSamples = 0;
+	long header[7];
+
+	noInterrupts();
+	byte k = _firstWindow;
+	if (_numWindows == 0 || (!_isSending && _numFrames < _winEnds[k])) {
+		interrupts();
+		return false;
+	}
+
+	if (!_isSending) {
+		_isSending = true;
+		_sendFrame = _winStarts[k];
+	}
+
+	header[0] = _winTimes[k];
+	header[1] = _winCauses[k];
+	header[2] = _winCounts[k];
+	header[3] = (long)_winTriggers[k] - (long)_winStarts[k];
+	header[4] = _winEnds[k] - _winStarts[k];
+	header[5] = _numChannels;
+	header[6] = _sendFrame - _winStarts[k];
+
+	bool isEnd = _isOverrun;
+	if (!isEnd) {
+		for (byte j = 0; j < framesPerSend && _sendFrame < _winEnds[k]; j++) {
+			int16_t* frame = _buffer + (_sendFrame % _capacity) * _numChannels;
+			for (byte i = 0; i < _numChannels; i++)
+				samples[numSamples++] = frame[i];
+			_sendFrame++;
+		}
+		isEnd = _sendFrame >= _winEnds[k];
+	}
+
+	if (isEnd) {
+		popWindow();
+		_isSending = false;
+		_isOverrun = false;
+	}
+	interrupts();
+
+	// Format outside of the critical section. An overrun part has no samples.
+	msg = tag;
+	msg.reserve(maxPartLength(tag));
+	for (byte i = 0; i < 7; i++) {
+		msg += delimiter;
+		msg += header[i];
+	}
+	for (unsigned int i = 0; i < numSamples; i++) {
+		msg += delimiter;
+		msg += samples[i];
+	}
+	return true;
+}
+
+unsigned int SatelliteCapture::maxPartLength(const char* tag) {
+	// Longest part, with 7 header values of up to 10 digits and samples of up to 6 characters
+	return strlen(tag) + 7 * 11 + framesPerSend * _numChannels * 7;
+}
+
+bool SatelliteCapture::isSending() {
+	return _isSending;
+}
+
+byte SatelliteCapture::numPending() {
+	return _numWindows;
+}
+
+unsigned long SatelliteCapture::getDropped() {
+	return _numDropped;
+}
+
+
+
+// Block layout: "SL", log id, session, block index, payload length, payload, checksum.
+// Records in the payload are a length byte (or 0xFE and 2 bytes) followed by the message,
+// or 0xFF followed by millis and the number of records so far (sync markers).
+static const byte longRecord = 0xFE;
+static const byte syncRecord = 0xFF;
+
+static void putLE(byte* p, unsigned long v, byte n) {
+	for (byte i = 0; i < n; i++)
+		p[i] = v >> (8 * i);
+}
+
+static unsigned long getLE(const byte* p, byte n) {
+	unsigned long v = 0;
+	for (byte i = 0; i < n; i++)
+		v |= (unsigned long)p[i] << (8 * i);
+	return v;
+}
+
+static unsigned int fletcher16(const byte* p, unsigned int n) {
+	unsigned int a = 0, b = 0;
+	for (unsigned int i = 0; i < n; i++) {
+		a = (a + p[i]) % 255;
+		b = (b + a) % 255;
+	}
+	return (b << 8) | a;
+}
+
+bool SatelliteLog::begin(SatelliteBlockDevice& device, bool isAppend) {
+	// Find the end of the log on the device and start a session after it. Blocks of an
+	// older log on the same device have another log id and are ignored.
+
+	unsigned long n = device.numBlocks();
+	if (n == 0)
+		return false;
+
+	_device = &device;
+	_active = 0;
+	_activeLength = 0;
+	_isPending = false;
+	_isFlushed = true;
+	_numRecords = 0;
+	_numDropped = 0;
+	_bytesLogged = 0;
+	_bytesWritten = 0;
+	_numStalls = 0;
+	_maxStall = 0;
+	_maxWrite = 0;
+
+	byte* data = _buffers[0];
+	_logId = 0;
+	bool hasLog = isValid(0, data);
+	unsigned int lastId = hasLog ? getLE(data + 2, 2) : 0;
+
+	if (hasLog && isAppend) {
+		// Valid blocks form a prefix of the device
+		_logId = lastId;
+		unsigned long lo = 0, hi = n;
+		while (hi - lo > 1) {
+			unsigned long mid = lo + (hi - lo) / 2;
+			if (isValid(mid, data))
+				lo = mid;
+			else
+				hi = mid;
+		}
+		isValid(lo, data);
+		_session = getLE(data + 4, 2) + 1;
+		_nextBlock = lo + 1;
+	}
+	else {
+		_logId = (lastId + 1) & 0xFFFF;
+		if (_logId == 0)
+			_logId = 1;
+		_session = 1;
+		_nextBlock = 0;
+	}
+
+	_lastFlush = millis();
+	addSync();
+	return true;
+}
+
+void SatelliteLog::setIntervals(unsigned long syncInterval, unsigned long flushInterval) {
+	// Time in ms between sync markers, and between writes of the partial block (which bound
+	// what a reset loses, at the cost of writing the block again when it fills)
+
+	_syncInterval = syncInterval;
+	_flushInterval = flushInterval;
+}
+
+bool SatelliteLog::isValid(unsigned long block, byte* data) {
+	// Read a block and check that it belongs to this log (any log when the id is 0)
+
+	if (!_device->readBlock(block, data))
+		return false;
+
+	const unsigned int n = SatelliteBlockDevice::blockSize;
+	return data[0] == 'S' && data[1] == 'L'
+		&& (_logId == 0 || getLE(data + 2, 2) == _logId)
+		&& getLE(data + 6, 4) == block
+		&& getLE(data + 10, 2) <= payloadSize
+		&& getLE(data + n - 2, 2) == fletcher16(data, n - 2);
+}
+
+bool SatelliteLog::writeBuffer(byte index, unsigned long block, unsigned int length) {
+	const unsigned int n = SatelliteBlockDevice::blockSize;
+	byte* data = _buffers[index];
+
+	data[0] = 'S';
+	data[1] = 'L';
+	putLE(data + 2, _logId, 2);
+	putLE(data + 4, _session, 2);
+	putLE(data + 6, block, 4);
+	putLE(data + 10, length, 2);
+	memset(data + headerSize + length, 0, payloadSize - length);
+	putLE(data + n - 2, fletcher16(data, n - 2), 2);
+
+	unsigned long t0 = micros();
+	bool isDone = _device->writeBlock(block, data);
+	unsigned long dt = micros() - t0;
+	if (dt > _maxWrite)
+		_maxWrite = dt;
+	_bytesWritten += n;
+	return isDone;
+}
+
+bool SatelliteLog::reserve(unsigned int length) {
+	// Make room for a record, handing a full block over to be written. When the other buffer
+	// has not been written yet, it is written now and the caller stalls.
+
+	if (_nextBlock >= _device->numBlocks())
+		return false;
+	if (_activeLength + length <= payloadSize)
+		return true;
+
+	if (_isPending) {
+		writeBuffer(_active ^ 1, _pendingBlock, _pendingLength);
+		_numStalls++;
+	}
+
+	_isPending = true;
+	_pendingBlock = _nextBlock++;
+	_pendingLength = _activeLength;
+	_active ^= 1;
+	_activeLength = 0;
+	return _nextBlock < _device->numBlocks();
+}
+
+void SatelliteLog::put(const byte* data, unsigned int length) {
+	memcpy(_buffers[_active] + headerSize + _activeLength, data, length);
+	_activeLength += length;
+	_bytesLogged += length;
+	_isFlushed = false;
+}
+
+bool SatelliteLog::append(const char* text, unsigned int length) {
+	// Add a message as a record, false when it was dropped because the device is full
+
+	if (_device == NULL)
+		return false;
+
+	unsigned long t0 = micros();
+	byte head[3];
+	byte headLength = 1;
+	head[0] = length;
+	if (length >= longRecord) {
+		head[0] = longRecord;
+		putLE(head + 1, length, 2);
+		headLength = 3;
+	}
+
+	if (headLength + length > payloadSize || !reserve(headLength + length)) {
+		_numDropped++;
+		return false;
+	}
+	put(head, headLength);
+	put((const byte*)text, length);
+	_numRecords++;
+
+	unsigned long dt = micros() - t0;
+	if (dt > _maxStall)
+		_maxStall = dt;
+	return true;
+}
+
+void SatelliteLog::addSync() {
+	// Mark the time, so that records between markers can be placed in time
+
+	if (_device == NULL || !reserve(9))
+		return;
+
+	byte marker[9];
+	marker[0] = syncRecord;
+	putLE(marker + 1, millis(), 4);
+	putLE(marker + 5, _numRecords, 4);
+	put(marker, 9);
+	_lastSync = millis();
+}
+
+void SatelliteLog::poll() {
+	// Write a waiting block, or add a sync marker or flush when due, one thing per call
+
+	if (_device == NULL)
+		return;
+
+	if (_isPending) {
+		writeBuffer(_active ^ 1, _pendingBlock, _pendingLength);
+		_isPending = false;
+		return;
+	}
+
+	unsigned long t = millis();
+	if (t - _lastSync >= _syncInterval)
+		addSync();
+	else if (!_isFlushed && t - _lastFlush >= _flushInterval)
+		flush();
+}
+
+bool SatelliteLog::flush() {
+	// Write everything logged so far, including the partial block
+
+	if (_device == NULL)
+		return false;
+
+	bool isDone = true;
+	if (_isPending) {
+		isDone = writeBuffer(_active ^ 1, _pendingBlock, _pendingLength);
+		_isPending = false;
+	}
+	if (_activeLength > 0 && !_isFlushed && _nextBlock < _device->numBlocks())
+		isDone = writeBuffer(_active, _nextBlock, _activeLength) && isDone;
+
+	_isFlushed = true;
+	_lastFlush = millis();
+	return isDone;
+}
+
+unsigned long SatelliteLog::size() {
+	// Blocks in use, including the partial one
+	return _nextBlock + (_activeLength > 0 ? 1 : 0);
+}
+
+unsigned int SatelliteLog::getSession() {
+	return _session;
+}
+
+bool SatelliteLog::replay(unsigned long block, Print& out, char delimiter) {
+	// Write the records of a block as lines: "logBlock,<block>,<session>", then each message
+	// as it was sent and each sync marker as "logSync,<ms>,<records before it>"
+
+	byte data[SatelliteBlockDevice::blockSize];
+	if (_device == NULL || !isValid(block, data))
+		return false;
+
+	out.print("logBlock");
+	out.print(delimiter);
+	out.print(block);
+	out.print(delimiter);
+	out.println(getLE(data + 4, 2));
+
+	unsigned int i = headerSize;
+	unsigned int end = headerSize + getLE(data + 10, 2);
+	while (i < end) {
+		byte head = data[i];
+		if (head == syncRecord) {
+			out.print("logSync");
+			out.print(delimiter);
+			out.print(getLE(data + i + 1, 4));
+			out.print(delimiter);
+			out.println(getLE(data + i + 5, 4));
+			i += 9;
+			continue;
+		}
+
+		unsigned int length = head;
+		i++;
+		if (head == longRecord) {
+			length = getLE(data + i, 2);
+			i += 2;
+		}
+		if (i + length > end)
+			return false;
+		out.write(data + i, length);
+		out.println();
+		i += length;
+	}
+	return true;
+}
+
+unsigned long SatelliteLog::numRecords() {
+	return _numRecords;
+}
+
+unsigned long SatelliteLog::numDropped() {
+	return _numDropped;
+}
+
+unsigned long SatelliteLog::bytesLogged() {
+	return _bytesLogged;
+}
+
+unsigned long SatelliteLog::bytesWritten() {
+	return _bytesWritten;
+}
+
+unsigned long SatelliteLog::numStalls() {
+	return _numStalls;
+}
+
+unsigned long SatelliteLog::getMaxStall() {
+	return _maxStall;
+}
+
+unsigned long SatelliteLog::getMaxWrite() {
+	return _maxWrite;
+}
+
+
+
+bool SatelliteQueue::push(byte cls, const char* msg, unsigned int length) {
+	// Copy a message to the end of the queue of its class, at the tail of the ring or back at
+	// its start when it does not fit before the end. Returns false when there is no room.
+
+	byte n = _counts[cls];
+	if (n >= queueSize || length > queueBytes)
+		return false;
+
+	unsigned int start = 0;
+	if (n > 0) {
+		unsigned int head = _starts[cls][_heads[cls]];
+		unsigned int tail = _tails[cls];
+		if (tail > head && queueBytes - tail >= length)
+			start = tail;
+		else if (tail > head && head >= length)
+			start = 0;
+		else if (tail < head && head - tail >= length)
+			start = tail;
+		else
+			return false;
+	}
+
+	byte k = (_heads[cls] + n) % queueSize;
+	memcpy(_data[cls] + start, msg, length);
+	_starts[cls][k] = start;
+	_lengths[cls][k] = length;
+	_times[cls][k] = micros();
+	_tails[cls] = start + length;
+	_counts[cls]++;
+	_numQueued++;
+	return true;
+}
+
+const char* SatelliteQueue::peek(byte cls, unsigned int& length, unsigned long& t) {
+	// Oldest message of a class, not terminated, and the time it was queued (us), or NULL
+
+	if (_counts[cls] == 0)
+		return NULL;
+
+	byte k = _heads[cls];
+	length = _lengths[cls][k];
+	t = _times[cls][k];
+	return _data[cls] + _starts[cls][k];
+}
+
+void SatelliteQueue::pop(byte cls) {
+	if (_counts[cls] == 0)
+		return;
+
+	_heads[cls] = (_heads[cls] + 1) % queueSize;
+	_counts[cls]--;
+	_numQueued--;
+	if (_counts[cls] == 0)
+		_tails[cls] = 0;
+}
+
+byte SatelliteQueue::numQueued(byte cls) {
+	return cls < numClasses ? _counts[cls] : 0;
+}
+
+byte SatelliteQueue::numQueued() {
+	return _numQueued;
 }
\ No newline at end of file
@@ -10,15 +10,318 @@ Released into the public domain.
 
 #include "Arduino.h"
 
+// Named integer and bool variables that commands update in two steps: stage, then apply
+class SatelliteParams
+{
+public:
+	static const byte maxParams = 32;
+
+	// Registration, with values limited to [minVal, maxVal]
+	bool add(const char* name, bool& var);
+	bool add(const char* name, byte& var, long minVal = 0, long maxVal = 255);
+	bool add(const char* name, int& var, long minVal, long maxVal);
+	bool add(const char* name, unsigned int& var, long minVal, long maxVal);
+	bool add(const char* name, long& var, long minVal, long maxVal);
+	bool add(const char* name, unsigned long& var, long minVal, long maxVal);
+	byte size();
+	int find(const char* name);
+	const char* getName(byte index);
+	long get(byte index);
+
+	// Staged values take effect together when applied
+	bool stage(byte index, long value);
+	bool stage(const char* name, long value);
+	byte numStaged();
+	byte apply();
+	void discard();
+
+	// Checksum of names and current values
+	unsigned int checksum();
+
+private:
+	static const byte _tableSize = 2 * maxParams;
+
+	// Parameters as struct of arrays, in order of registration
+	const char* _names[maxParams];
+	void* _vars[maxParams];
+	byte _types[maxParams];
+	long _mins[maxParams];
+	long _maxs[maxParams];
+	long _staged[maxParams];
+	unsigned long _stagedMask = 0;
+	byte _numParams = 0;
+
+	// Open addressing hash table of index + 1, 0 when empty
+	byte _table[_tableSize] = {0};
+
+	bool addVar(const char* name, void* var, byte type, long minVal, long maxVal);
+	void set(byte index, long value);
+};
+
+// Fixed-point decimation, block envelopes and offset tracking of sampled channels
+class SatelliteFilter
+{
+public:
+	static const byte maxChannels = 4;
+	static const byte maxDecimation = 32;
+	static const byte maxTaps = 32;
+
+	// Decimation modes
+	static const byte averageMode = 0;
+	static const byte cicMode = 1;
+	static const byte firMode = 2;
+
+	SatelliteFilter();
+
+	// Configuration, which restarts the channel
+	bool setChannel(byte ch, byte mode, byte decimation);
+	bool setOffsetTracking(byte ch, byte shift);
+	byte getMode(byte ch);
+	byte getDecimation(byte ch);
+	void reset(byte ch);
+
+	// Feeds one sample, true when a block of decimation samples is complete
+	bool process(byte ch, int x);
+
+	// Results of the last complete block
+	long getValue(byte ch);
+	long getMin(byte ch);
+	long getMax(byte ch);
+	unsigned int getRms(byte ch);
+	long getOffset(byte ch);
+
+private:
+	static const byte _maxPhaseTaps = 4;
+	static const byte _numStates = 6;
+
+	// Configuration
+	byte _modes[maxChannels];
+	byte _decimations[maxChannels];
+	byte _numPhaseTaps[maxChannels];
+	byte _offsetShifts[maxChannels];
+	int16_t _taps[maxChannels][maxTaps];
+
+	// Running state, unsigned so that sums wrap instead of overflowing
+	byte _phases[maxChannels];
+	uint32_t _states[maxChannels][_numStates];
+	bool _isOffsetSet[maxChannels];
+	long _offsets[maxChannels];
+	long _blockMins[maxChannels];
+	long _blockMaxs[maxChannels];
+	uint64_t _sumSquares[maxChannels];
+
+	// Results
+	long _values[maxChannels];
+	long _mins[maxChannels];
+	long _maxs[maxChannels];
+	unsigned int _rms[maxChannels];
+
+	void designTaps(byte ch);
+};
+
+// Continuous sampling into a ring buffer, keeping windows around triggers for sending
+class SatelliteCapture
+{
+public:
+	static const byte maxChannels = 8;
+	static const byte maxTags = 4;
+	static const byte maxWindows = 4;
+	static const byte framesPerSend = 16;
+
+	// Causes of a window
+	static const byte callCause = 0;
+	static const byte edgeCause = 1;
+	static const byte thresholdCause = 2;
+	static const byte tagCause = 3;
+
+	// Configuration, with the buffer provided by the sketch
+	bool begin(int16_t* buffer, unsigned int size, byte numChannels);
+	bool setWindow(unsigned int preFrames, unsigned int postFrames);
+	bool addTag(const char* tag);
+	void setEdge(int pin, bool isRising = true);
+	void setThreshold(byte ch, int level, bool isRising = true);
+	void clearTriggers();
+
+	// Sampling and triggering, also from interrupts
+	void add(const int* values);
+	void trigger(byte cause = callCause);
+	bool checkTag(const char* msg, char delimiter);
+
+	// Sending complete windows in parts, each a message of its own
+	bool send(String& msg, const char* tag, char delimiter);
+	unsigned int maxPartLength(const char* tag);
+	bool isSending();
+	byte numPending();
+	unsigned long getDropped();
+
+private:
+	// Ring buffer of frames, one sample per channel
+	int16_t* _buffer = NULL;
+	unsigned int _capacity = 0;
+	byte _numChannels = 0;
+	unsigned int _preFrames = 0;
+	unsigned int _postFrames = 0;
+	volatile unsigned long _numFrames = 0;
+
+	// Triggers
+	const char* _tags[maxTags];
+	byte _numTags = 0;
+	int _edgePin = -1;
+	bool _isEdgeRising = true;
+	int _lastLevel = -1;
+	int _thresholdCh = -1;
+	int _thresholdLevel = 0;
+	bool _isThresholdRising = true;
+	int _lastValue = 0;
+
+	// Queue of windows in frames, end excluded, as struct of arrays
+	volatile unsigned long _winStarts[maxWindows];
+	volatile unsigned long _winTriggers[maxWindows];
+	volatile unsigned long _winEnds[maxWindows];
+	volatile unsigned long _winTimes[maxWindows];
+	volatile byte _winCauses[maxWindows];
+	volatile byte _winCounts[maxWindows];
+	volatile byte _firstWindow = 0;
+	volatile byte _numWindows = 0;
+	volatile unsigned long _numDropped = 0;
+
+	// Window being sent
+	volatile bool _isSending = false;
+	volatile bool _isOverrun = false;
+	volatile unsigned long _sendFrame = 0;
+
+	void popWindow();
+};
+
+// Storage in blocks of 512 bytes, e.g. an SD card, flash or a file on the host
+class SatelliteBlockDevice
+{
+public:
+	static const unsigned int blockSize = 512;
+
+	virtual unsigned long numBlocks() = 0;
+	virtual bool readBlock(unsigned long index, byte* data) = 0;
+	virtual bool writeBlock(unsigned long index, const byte* data) = 0;
+};
+
+// Append-only log of messages on a block device, written in idle time
+class SatelliteLog
+{
+public:
+	static const byte headerSize = 12;
+	static const unsigned int payloadSize = SatelliteBlockDevice::blockSize - headerSize - 2;
+
+	// Continues the log on the device, or starts a new one
+	bool begin(SatelliteBlockDevice& device, bool isAppend = true);
+	void setIntervals(unsigned long syncInterval, unsigned long flushInterval);
+
+	// Recording, with the device written from poll while idle
+	bool append(const char* text, unsigned int length);
+	void addSync();
+	void poll();
+	bool flush();
+
+	// Reading back
+	unsigned long size();
+	unsigned int getSession();
+	bool replay(unsigned long block, Print& out, char delimiter);
+
+	// Statistics
+	unsigned long numRecords();
+	unsigned long numDropped();
+	unsigned long bytesLogged();
+	unsigned long bytesWritten();
+	unsigned long numStalls();
+	unsigned long getMaxStall();
+	unsigned long getMaxWrite();
+
+private:
+	SatelliteBlockDevice* _device = NULL;
+	unsigned int _logId = 0;
+	unsigned int _session = 0;
+
+	// Double buffer: one block fills while the other waits to be written
+	byte _buffers[2][SatelliteBlockDevice::blockSize];
+	byte _active = 0;
+	unsigned int _activeLength = 0;
+	bool _isPending = false;
+	unsigned long _pendingBlock = 0;
+	unsigned int _pendingLength = 0;
+	unsigned long _nextBlock = 0;
+
+	// Sync markers and flushes of the partial block
+	unsigned long _syncInterval = 1000;
+	unsigned long _flushInterval = 5000;
+	unsigned long _lastSync = 0;
+	unsigned long _lastFlush = 0;
+	bool _isFlushed = true;
+
+	// Statistics
+	unsigned long _numRecords = 0;
+	unsigned long _numDropped = 0;
+	unsigned long _bytesLogged = 0;
+	unsigned long _bytesWritten = 0;
+	unsigned long _numStalls = 0;
+	unsigned long _maxStall = 0;
+	unsigned long _maxWrite = 0;
+
+	bool isValid(unsigned long block, byte* data);
+	bool writeBuffer(byte index, unsigned long block, unsigned int length);
+	bool reserve(unsigned int length);
+	void put(const byte* data, unsigned int length);
+};
+
+// Outgoing messages waiting by priority class, for Satellites::attachQueue. Each class is a
+// ring of queueBytes holding the text of up to queueSize messages, each one in one piece.
+class SatelliteQueue
+{
+public:
+	static const byte numClasses = 3;
+	static const byte queueSize = 8;
+#if defined(__AVR__)
+	static const unsigned int queueBytes = 96;
+#else
+	static const unsigned int queueBytes = 512;
+#endif
+
+	bool push(byte cls, const char* msg, unsigned int length);
+	const char* peek(byte cls, unsigned int& length, unsigned long& t);
+	void pop(byte cls);
+	byte numQueued(byte cls);
+	byte numQueued();
+
+private:
+	char _data[numClasses][queueBytes];
+	unsigned int _starts[numClasses][queueSize];
+	unsigned int _lengths[numClasses][queueSize];
+	unsigned long _times[numClasses][queueSize];
+	byte _heads[numClasses] = {0};
+	byte _counts[numClasses] = {0};
+	unsigned int _tails[numClasses] = {0};
+	byte _numQueued = 0;
+};
+
 class Satellites
 {
 public:
+	// Priority classes of outgoing messages, from the highest, and what happens when the
+	// queue of a class is full
+	static const byte numClasses = SatelliteQueue::numClasses;
+	static const byte criticalClass = 0;
+	static const byte eventClass = 1;
+	static const byte streamClass = 2;
+	static const byte dropOldest = 0;
+	static const byte dropNewest = 1;
+	static const byte blockPolicy = 2;
+	static const byte maxTagClasses = 8;
+
 	// Constructors
 	Satellites():_serial(Serial) {};
 	Satellites(HardwareSerial& serial):_serial(serial) {};
 	#if defined(usb_serial_class)
 		Satellites(usb_serial_class& serial):_serial(serial) {};
 	#endif
+	Satellites(Stream& stream):_serial(stream) {};
 	
 	void setDelimiter(char d);
 	char getDelimiter();
@@ -37,6 +340,39 @@ public:
 	bool delayUntil(bool(*f)(void), unsigned long timeout);
 	bool delayContinue(bool(*f)(void), unsigned long unitTime);
 
+	// Parameters set by commands "<name>,<value>" and applied by the protocol
+	void attachParams(SatelliteParams& params);
+	void detachParams();
+	bool applyParams(const char* tag = "params");
+	void sendParams(const char* tag = "params");
+	void sendParamNames(const char* tag = "paramNames");
+
+	// Windows of a capture, triggered by sendData tags among others
+	void attachCapture(SatelliteCapture& capture);
+	void detachCapture();
+	bool sendCapture(const char* tag = "capture");
+
+	// Queueing of outgoing messages by priority when the link is busy (off by default)
+	void attachQueue(SatelliteQueue& queue);
+	void detachQueue();
+	bool setTagClass(const char* tag, byte cls);
+	void setDefaultClass(byte cls);
+	bool setClassPolicy(byte cls, byte policy, unsigned long timeout = 0);
+	void serialWrite();
+	void sendQueueStats(const char* tag = "queue");
+
+	// Local log of outgoing messages, as a copy or instead of sending them
+	void attachLog(SatelliteLog& log, bool isDiverted = false);
+	void detachLog();
+	void sendLog(unsigned long fromBlock = 0);
+	void sendLogStats(const char* tag = "logStats");
+
+	// Health telemetry (disabled when the interval is 0)
+	void setHeartbeat(unsigned long interval);
+	unsigned long getHeartbeat();
+	void sendHealth();
+	static long freeRam();
+
 	// Format and send data message
 	unsigned long sendData(const char* tag, unsigned long t = millis());
 	unsigned long sendData(const char* tag, unsigned long t, volatile byte num);
@@ -74,10 +410,55 @@ protected:
 	long _inputSign = 1;
 	String _cmdString = String();
 	void (*_parserFunc)(void) = NULL;
+	SatelliteParams* _params = NULL;
+	bool stageParam();
 
 	// Sending
 	Stream& _serial;
+	SatelliteCapture* _capture = NULL;
+	const char* _captureTag = "capture";
+	byte _captureClass = eventClass;
+	SatelliteLog* _log = NULL;
+	bool _isLogDiverted = false;
 	void serialSend(String);
+	bool writeCapture(bool isPaced);
+
+	// Queueing by priority class
+	SatelliteQueue* _queue = NULL;
+	byte _policies[numClasses] = {blockPolicy, blockPolicy, dropOldest};
+	unsigned long _timeouts[numClasses] = {100, 10, 0};
+	const char* _classTags[maxTagClasses];
+	byte _tagClasses[maxTagClasses];
+	byte _numTagClasses = 0;
+	byte _defaultClass = eventClass;
+	int _txCapacity = 0;
+	unsigned long _numSent[numClasses] = {0};
+	unsigned long _numDropped[numClasses] = {0};
+	unsigned long _maxLatency[numClasses] = {0};
+	byte _maxDepth[numClasses] = {0};
+	byte classOf(const char* msg);
+	bool hasRoom(unsigned int length);
+	void writeQueued(byte cls);
+	bool writeClass(byte cls);
+	void writeMessage(const String& msg);
+	void writeMessage(const char* msg, unsigned int length);
+
+	// Health telemetry
+	unsigned long _healthInterval = 0;
+	unsigned long _healthT0 = 0;
+	bool _isPolled = false;
+	bool _isRxFull = false;
+	unsigned long _lastPollUs = 0;
+	unsigned long _numPolls = 0;
+	unsigned long _maxPollGap = 0;
+	int _rxHighWater = 0;
+	int _txLowWater = -1;
+	unsigned long _numRxFull = 0;
+	unsigned long _numTxShort = 0;
+	unsigned long _numParseResets = 0;
+	unsigned long _numIgnoredBytes = 0;
+	long _minFreeRam = -1;
+	void pollHealth(int numAvailable);
 
 };
 
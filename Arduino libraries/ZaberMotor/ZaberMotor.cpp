@@ -1,19 +1,96 @@
 #include "ZaberMotor.h"
 
-ZaberMotor::ZaberMotor(Stream& serial):_serial(serial)
+ZaberMotor::ZaberMotor(Stream& serial, byte device, byte numAxes):_serial(serial)
 {
+	init(device, numAxes);
+	_isAttached = true;
+}
+
+ZaberMotor::ZaberMotor(ZaberBus& bus, byte device, byte numAxes):_serial(bus.getStream())
+{
+	// Share the port of a daisy chain with other devices. Replies are routed by the bus.
+	// When the bus is full, the motor stays off the port (see isAttached).
+	init(device, numAxes);
+	if (bus.attach(*this)) {
+		_bus = &bus;
+		_isAttached = true;
+	}
+}
+
+ZaberMotor::~ZaberMotor()
+{
+	// The bus must not route replies to a motor that is gone
+	if (_bus != NULL)
+		_bus->detach(*this);
+}
+
+bool ZaberMotor::isAttached()
+{
+	// False for a motor given a bus that had no slot left. It then sends nothing and parses
+	// nothing, since reading the shared port would take replies meant for the others.
+	return _isAttached;
+}
+
+void ZaberMotor::init(byte device, byte numAxes)
+{
+	_device = device;
+	_numAxes = constrain(numAxes, 1, maxAxes);
+
 	// Initialize array variables
 	maxPos[0] = 100000;
-	maxPos[1] = 50000;
-	for (int i = 0; i < 1; i++) {
+	for (int i = 1; i < maxAxes; i++)
+		maxPos[i] = 50000;
+	for (int i = 0; i < maxAxes; i++) {
 		isReverse[i] = false;
 		_refPos[i] = 0;
 	}
+	for (int i = 0; i <= maxAxes; i++) {
+		_isBusy[i] = false;
+		_posSteps[i] = 0;
+		strcpy(_warning[i], "--");
+	}
+}
+
+byte ZaberMotor::getDevice()
+{
+	return _device;
+}
+
+byte ZaberMotor::getNumAxes()
+{
+	return _numAxes;
+}
+
+void ZaberMotor::setProtocol(byte protocol)
+{
+	// Select how commands are encoded. The device itself must already be configured for the
+	// same protocol (e.g. with "tools setcomm").
+	if (protocol != ASCII && protocol != BINARY)
+		return;
+
+	_protocol = protocol;
+	if (_bus != NULL)
+		_bus->setProtocol(protocol);
+}
+
+byte ZaberMotor::getProtocol()
+{
+	return _protocol;
+}
+
+void ZaberMotor::setMicrostepSize(unsigned long num, unsigned long den)
+{
+	// Size of a microstep in um as the fraction num/den (default 381/2000, i.e. 0.1905 um)
+	if (num == 0 || den == 0)
+		return;
+
+	_stepNum = num;
+	_stepDen = den;
 }
 
 void ZaberMotor::setRef(long ref, byte axId)
 {
-	if (axId > 2)
+	if (axId > _numAxes)
 		return;
 
 	_refPos[axId-1] = ref;
@@ -21,7 +98,7 @@ void ZaberMotor::setRef(long ref, byte axId)
 
 long ZaberMotor::getRef(byte axId)
 {
-	if (axId > 2)
+	if (axId > _numAxes)
 		return -1;
 
 	return _refPos[axId - 1];
@@ -34,97 +111,164 @@ void ZaberMotor::setJitter(int n)
 
 void ZaberMotor::setMaxSpeed(long v)
 {
-	String str = "/01 0 set maxspeed ";
-	str.concat(v);
-	_serial.println(str);
+	if (_protocol == BINARY) {
+		for (byte i = 1; i <= _numAxes; i++)
+			binSend(i, BIN_SET_SPEED, v);
+		return;
+	}
+
+	cmdBegin(0);
+	cmdWord("set maxspeed");
+	cmdArg(v);
+	cmdSend();
 	streamDisable();
 }
 
 void ZaberMotor::setAcceleration(int a)
 {
-	String str = "/01 0 set accel ";
-	str.concat(a);
-	_serial.println(str);
+	if (_protocol == BINARY) {
+		for (byte i = 1; i <= _numAxes; i++)
+			binSend(i, BIN_SET_ACCEL, a);
+		return;
+	}
+
+	cmdBegin(0);
+	cmdWord("set accel");
+	cmdArg(a);
+	cmdSend();
 	streamDisable();
 }
 
 void ZaberMotor::home(byte axId)
 {
-    if (axId > 2)
-        return;
-    
-    String str = "/01 ";
-    str.concat(axId);
-    str.concat(" home");
-    _serial.println(str);
-    _isStream = false;
+	if (axId > _numAxes)
+		return;
+
+	if (_protocol == BINARY) {
+		for (byte i = 1; i <= _numAxes; i++)
+			if (axId == 0 || axId == i)
+				binSend(i, BIN_HOME, 0);
+		setBusy(axId, true);
+		return;
+	}
+
+	cmdBegin(axId);
+	cmdWord("home");
+	cmdSend();
+	setBusy(axId, true);
+	_isStream = false;
 }
 
 void ZaberMotor::move(long pos, byte axId)
 {
-	if (axId > 2)
+	if (axId > _numAxes || axId < 1)
 		return;
 
 	pos = convert(pos, axId);
-	String str = "/01 ";
-	str.concat(axId);
-	str.concat(" move abs ");
-	str.concat(pos);
-	_serial.println(str);
+
+	if (_protocol == BINARY) {
+		binSend(axId, BIN_MOVE_ABS, pos);
+		setBusy(axId, true);
+		return;
+	}
+
+	cmdBegin(axId);
+	cmdWord("move abs");
+	cmdArg(pos);
+	cmdSend();
+	setBusy(axId, true);
 	_isStream = false;
 }
 
 void ZaberMotor::moveMax(byte axId)
 {
-	if (axId > 2)
+	if (axId > _numAxes)
+		return;
+
+	if (_protocol == BINARY) {
+		// Binary protocol has no "move max"; move to the end of the travel range instead
+		for (byte i = 1; i <= _numAxes; i++)
+			if (axId == 0 || axId == i)
+				binSend(i, BIN_MOVE_ABS, maxPos[i - 1] * _stepDen / _stepNum);
+		setBusy(axId, true);
 		return;
+	}
 
-    String str = "/01 ";
-    str.concat(axId);
-    str.concat(" move max");
-    _serial.println(str);
+	cmdBegin(axId);
+	cmdWord("move max");
+	cmdSend();
+	setBusy(axId, true);
 	_isStream = false;
 }
 
 void ZaberMotor::streamLive()
 {
+	// Streams exist only in the ASCII protocol. Stream methods do nothing in binary mode.
+	if (_protocol != ASCII)
+		return;
+
 	if (!_isStream) {
-		_serial.println("/01 0 stream 1 setup live 1 2");
+		cmdBegin(0);
+		cmdWord("stream 1 setup live 1 2");
+		cmdSend();
 		_isStream = true;
 	}
 }
 
 void ZaberMotor::streamDisable()
 {
-	_serial.println("/01 0 stream 1 setup disable");
+	if (_protocol != ASCII)
+		return;
+
+	cmdBegin(0);
+	cmdWord("stream 1 setup disable");
+	cmdSend();
 	_isStream = false;
 }
 
 void ZaberMotor::streamCork()
 {
-	_serial.println("/01 0 stream 1 fifo cork");
+	if (_protocol != ASCII)
+		return;
+
+	cmdBegin(0);
+	cmdWord("stream 1 fifo cork");
+	cmdSend();
 }
 
 void ZaberMotor::streamUncork()
 {
-	_serial.println("/01 0 stream 1 fifo uncork");
+	if (_protocol != ASCII)
+		return;
+
+	cmdBegin(0);
+	cmdWord("stream 1 fifo uncork");
+	cmdSend();
 }
 
 void ZaberMotor::streamLine(long pos1, long pos2)
 {
+	if (_protocol != ASCII)
+		return;
+
 	pos1 = convert(pos1, 1);
 	pos2 = convert(pos2, 2);
 
 	streamLive();
 
-	String str = "/01 0 stream 1 line abs ";
-	str = str.concat(pos1) + " ";
-	str.concat(pos2);
-	_serial.println(str);
+	cmdBegin(0);
+	cmdWord("stream 1 line abs");
+	cmdArg(pos1);
+	cmdArg(pos2);
+	cmdSend();
+	setBusy(0, true);
 }
 
-void ZaberMotor::streamArc(long centerx, long centery, long endx, long endy)
+void ZaberMotor::streamArc(long centerx, long centery, long endx, long endy, bool isCw)
 {
+	if (_protocol != ASCII)
+		return;
+
     centerx = convert(centerx, 1);
     centery = convert(centery, 2);
     endx = convert(endx, 1);
@@ -132,16 +276,22 @@ void ZaberMotor::streamArc(long centerx, long centery, long endx, long endy)
 
     streamLive();
 
-	String str = "/01 0 stream 1 arc abs cw ";
-    str = str.concat(centerx) + " ";
-    str = str.concat(centery) + " ";
-	str = str.concat(endx) + " ";
-	str.concat(endy);
-	_serial.println(str);
+	cmdBegin(0);
+	cmdWord("stream 1 arc abs");
+	cmdWord(isCw ? "cw" : "ccw");
+	cmdArg(centerx);
+	cmdArg(centery);
+	cmdArg(endx);
+	cmdArg(endy);
+	cmdSend();
+	setBusy(0, true);
 }
 
 void ZaberMotor::streamArc2(long startx, long starty, long endx, long endy)
 {
+	if (_protocol != ASCII)
+		return;
+
     startx = convert(startx, 1);
     starty = convert(starty, 2);
     endx = convert(endx, 1);
@@ -149,42 +299,44 @@ void ZaberMotor::streamArc2(long startx, long starty, long endx, long endy)
 
     streamLive();
 
-	String str = "/01 0 stream 1 arc abs ";
-
-	if (endy > starty)
-		str.concat("cw ");
-	else
-		str.concat("ccw ");
-	
-	str = str.concat((startx+endx)/2) + " ";
-	str = str.concat((starty+endy)/2) + " ";
-	str = str.concat(endx) + " ";
-	str.concat(endy);
-	_serial.println(str);
+	cmdBegin(0);
+	cmdWord("stream 1 arc abs");
+	cmdWord(endy > starty ? "cw" : "ccw");
+	cmdArg((startx + endx) / 2);
+	cmdArg((starty + endy) / 2);
+	cmdArg(endx);
+	cmdArg(endy);
+	cmdSend();
+	setBusy(0, true);
 }
 
 void ZaberMotor::streamCirc(long centerx, long centery)
 {
+	if (_protocol != ASCII)
+		return;
+
     centerx = convert(centerx, 1);
     centery = convert(centery, 2);
 
 	streamLive();
 
-	String str = "/01 0 stream 1 circle abs cw ";
-	str = str.concat(centerx) + " ";
-	str.concat(centery);
-	_serial.println(str);
+	cmdBegin(0);
+	cmdWord("stream 1 circle abs cw");
+	cmdArg(centerx);
+	cmdArg(centery);
+	cmdSend();
+	setBusy(0, true);
 }
 
 long ZaberMotor::convert(long pos, byte axId)
 {
+	// Position in um to device microsteps
 	pos = pos + _refPos[axId-1] + genJitter();
 	if (isReverse[axId-1]) {
 		pos = maxPos[axId-1] - pos;
 	}
 	pos = constrain(pos, 0, maxPos[axId - 1]);
-	pos = pos / 0.1905;
-	return pos;
+	return pos * _stepDen / _stepNum;
 }
 
 int ZaberMotor::genJitter()
@@ -200,3 +352,1085 @@ void ZaberMotor::read()
 		Serial.print(ch);
 	}
 }
+
+
+
+void ZaberMotor::cmdBegin(byte axId, byte kind)
+{
+	// Start an ASCII command with device address, axis number and optional message ID,
+	// e.g. "/01 2" or "/01 2 07". Every command gets a reply, which is tracked as pending.
+	_cmdLen = 0;
+	_cmd[_cmdLen++] = '/';
+	_cmd[_cmdLen++] = '0' + _device / 10 % 10;
+	_cmd[_cmdLen++] = '0' + _device % 10;
+	_cmd[_cmdLen++] = ' ';
+	_cmd[_cmdLen++] = '0' + axId % 10;
+
+	byte id = 0;
+	if (_isMsgId) {
+		id = _nextMsgId;
+		_nextMsgId = (_nextMsgId + 1) % 100;
+		_cmd[_cmdLen++] = ' ';
+		_cmd[_cmdLen++] = '0' + id / 10;
+		_cmd[_cmdLen++] = '0' + id % 10;
+	}
+	pushPending(kind, id);
+}
+
+void ZaberMotor::cmdWord(const char* word)
+{
+	// Append a space and a word to the command
+	if (_cmdLen < cmdBufSize)
+		_cmd[_cmdLen++] = ' ';
+
+	while (*word != '\0' && _cmdLen < cmdBufSize)
+		_cmd[_cmdLen++] = *word++;
+}
+
+void ZaberMotor::cmdArg(long val)
+{
+	// Append a space and a decimal number to the command
+	char digits[11];
+	byte n = 0;
+	unsigned long u = val < 0 ? -(unsigned long)val : val;
+
+	do {
+		digits[n++] = '0' + u % 10;
+		u /= 10;
+	} while (u > 0);
+
+	if (_cmdLen + n + 2 > cmdBufSize)
+		return;
+
+	_cmd[_cmdLen++] = ' ';
+	if (val < 0)
+		_cmd[_cmdLen++] = '-';
+	while (n > 0)
+		_cmd[_cmdLen++] = digits[--n];
+}
+
+void ZaberMotor::cmdSend()
+{
+	// Terminate the command and write it in one call
+	_cmd[_cmdLen++] = '\r';
+	_cmd[_cmdLen++] = '\n';
+	writeOut((const uint8_t*)_cmd, _cmdLen);
+	_cmdLen = 0;
+	_tLastSend = millis();
+}
+
+void ZaberMotor::writeOut(const uint8_t* buf, byte len)
+{
+	if (!_isAttached)
+		return;
+
+	if (_bus != NULL)
+		_bus->write(buf, len);
+	else
+		_serial.write(buf, len);
+}
+
+void ZaberMotor::binSend(byte axId, byte command, long data)
+{
+	// Send a 6-byte binary frame. Each axis of a controller is addressed as its own device,
+	// numbered consecutively from the device number.
+	uint8_t frame[6];
+	frame[0] = _device + axId - 1;
+	frame[1] = command;
+	for (byte i = 0; i < 4; i++)
+		frame[2 + i] = ((unsigned long)data >> (8 * i)) & 0xFF;
+	writeOut(frame, 6);
+	_tLastSend = millis();
+}
+
+
+
+// Accumulate a reply byte. Returns true when rx holds a complete ASCII line (null-terminated)
+// or a 6-byte binary frame.
+static bool zaberAccumulate(char ch, byte protocol, char* rx, byte& rxLen, byte rxSize, unsigned long& tLastByte)
+{
+	if (protocol == ZaberMotor::BINARY) {
+		// Resynchronize frames after a gap in transmission
+		if (millis() - tLastByte > 50)
+			rxLen = 0;
+		tLastByte = millis();
+
+		rx[rxLen++] = ch;
+		if (rxLen == 6) {
+			rxLen = 0;
+			return true;
+		}
+		return false;
+	}
+
+	if (ch == '@' || ch == '!' || ch == '#') {
+		// Start of a reply, alert or info message
+		rxLen = 0;
+		rx[rxLen++] = ch;
+	}
+	else if (ch == '\n') {
+		rx[rxLen] = '\0';
+		rxLen = 0;
+		return true;
+	}
+	else if (ch != '\r' && rxLen < rxSize - 1) {
+		rx[rxLen++] = ch;
+	}
+
+	return false;
+}
+
+void ZaberMotor::update()
+{
+	// Parse all available reply bytes without blocking
+
+	if (!_isAttached)
+		return;
+
+	if (_bus != NULL) {
+		_bus->update();
+		return;
+	}
+
+	while (_serial.available()) {
+		if (!zaberAccumulate(_serial.read(), _protocol, _rx, _rxLen, rxBufSize, _tLastByte))
+			continue;
+
+		if (_protocol == BINARY)
+			handleBinaryReply(_rx);
+		else
+			handleAsciiReply(_rx);
+	}
+}
+
+void ZaberMotor::enableMessageIds(bool isEnabled)
+{
+	// Tag commands with IDs (00-99) so that replies can be matched when several commands are
+	// in flight. Otherwise replies are matched in the order commands were sent.
+	_isMsgId = isEnabled;
+	_pendingCount = 0;
+}
+
+void ZaberMotor::enableAlerts()
+{
+	// Ask the device to send an alert when an axis finishes moving
+	if (_protocol != ASCII)
+		return;
+
+	cmdBegin(0);
+	cmdWord("set comm.alert 1");
+	cmdSend();
+}
+
+void ZaberMotor::setPollInterval(unsigned int intervalInMs)
+{
+	_pollInterval = intervalInMs;
+}
+
+void ZaberMotor::requestStatus(byte axId)
+{
+	if (axId > _numAxes)
+		return;
+
+	if (_protocol == BINARY) {
+		for (byte i = 1; i <= _numAxes; i++)
+			if (axId == 0 || axId == i)
+				binSend(i, BIN_GET_STATUS, 0);
+		return;
+	}
+
+	// An empty command returns the status
+	cmdBegin(axId);
+	cmdSend();
+}
+
+void ZaberMotor::requestPosition(byte axId)
+{
+	if (axId > _numAxes)
+		return;
+
+	if (_protocol == BINARY) {
+		for (byte i = 1; i <= _numAxes; i++)
+			if (axId == 0 || axId == i)
+				binSend(i, BIN_GET_POS, 0);
+		return;
+	}
+
+	cmdBegin(axId, KIND_GET_POS);
+	cmdWord("get pos");
+	cmdSend();
+}
+
+bool ZaberMotor::checkIdle(byte axId)
+{
+	// Parse replies and poll the status of a busy axis. Returns true once the axis is idle.
+	// Suitable as the condition of Satellites::delayUntil through a wrapper function.
+
+	update();
+
+	if (isBusy(axId)) {
+		expireReplies(5UL * _pollInterval);
+
+		if (_pendingCount == 0 && millis() - _tLastSend >= _pollInterval)
+			requestStatus(axId);
+	}
+
+	return !isBusy(axId);
+}
+
+bool ZaberMotor::expireReplies(unsigned long timeoutInMs)
+{
+	// Give up waiting for replies when nothing was sent for timeoutInMs, as after a reply
+	// was lost. Returns true if any replies were given up.
+
+	if (_pendingCount == 0 || millis() - _tLastSend < timeoutInMs)
+		return false;
+
+	_pendingCount = 0;
+	return true;
+}
+
+bool ZaberMotor::isBusy(byte axId)
+{
+	if (axId > _numAxes)
+		return false;
+
+	return _isBusy[axId];
+}
+
+long ZaberMotor::getPosition(byte axId)
+{
+	// Last reported position in um, in the same coordinates as move()
+	if (axId < 1 || axId > _numAxes)
+		return 0;
+
+	long pos = _posSteps[axId] * _stepNum / _stepDen;
+	if (isReverse[axId - 1])
+		pos = maxPos[axId - 1] - pos;
+
+	return pos - _refPos[axId - 1];
+}
+
+long ZaberMotor::getPositionSteps(byte axId)
+{
+	// Last reported position in device microsteps
+	if (axId < 1 || axId > _numAxes)
+		return 0;
+
+	return _posSteps[axId];
+}
+
+const char* ZaberMotor::getWarning(byte axId)
+{
+	// Warning flag of the last reply, "--" if there is none
+	if (axId > _numAxes)
+		return "--";
+
+	return _warning[axId];
+}
+
+byte ZaberMotor::getLastReply()
+{
+	return _lastReply;
+}
+
+unsigned int ZaberMotor::getRejectCount()
+{
+	return _numRejected;
+}
+
+byte ZaberMotor::getPendingCount()
+{
+	return _pendingCount;
+}
+
+
+
+void ZaberMotor::pushPending(byte kind, byte id)
+{
+	// Drop the oldest entry when full
+	if (_pendingCount == maxPending) {
+		_pendingHead = (_pendingHead + 1) % maxPending;
+		_pendingCount--;
+	}
+
+	byte k = (_pendingHead + _pendingCount) % maxPending;
+	_pendingKind[k] = kind;
+	_pendingId[k] = id;
+	_pendingCount++;
+}
+
+bool ZaberMotor::isPending(byte id)
+{
+	for (byte i = 0; i < _pendingCount; i++)
+		if (_pendingId[(_pendingHead + i) % maxPending] == id)
+			return true;
+
+	return false;
+}
+
+bool ZaberMotor::popPending(bool isMatchId, byte id, byte& kind)
+{
+	for (byte i = 0; i < _pendingCount; i++) {
+		byte k = (_pendingHead + i) % maxPending;
+
+		if (isMatchId && _pendingId[k] != id)
+			continue;
+
+		kind = _pendingKind[k];
+
+		// Remove the entry while keeping the order of the rest
+		for (byte j = i; j > 0; j--) {
+			byte dst = (_pendingHead + j) % maxPending;
+			byte src = (_pendingHead + j - 1) % maxPending;
+			_pendingKind[dst] = _pendingKind[src];
+			_pendingId[dst] = _pendingId[src];
+		}
+		_pendingHead = (_pendingHead + 1) % maxPending;
+		_pendingCount--;
+		return true;
+	}
+
+	return false;
+}
+
+void ZaberMotor::setBusy(byte axId, bool isBusy)
+{
+	if (axId == 0) {
+		for (byte i = 0; i <= _numAxes; i++)
+			_isBusy[i] = isBusy;
+		return;
+	}
+
+	_isBusy[axId] = isBusy;
+	_isBusy[0] = false;
+	for (byte i = 1; i <= _numAxes; i++)
+		_isBusy[0] = _isBusy[0] || _isBusy[i];
+}
+
+void ZaberMotor::handleAsciiReply(char* line)
+{
+	// Reply:  @01 1 [id] OK IDLE -- data...
+	// Alert:  !01 1 IDLE --
+
+	// Split fields in place
+	char* tok[8];
+	byte n = 0;
+	char* p = line;
+	while (*p != '\0' && n < 8) {
+		while (*p == ' ')
+			p++;
+		if (*p == '\0')
+			break;
+		tok[n++] = p;
+		while (*p != '\0' && *p != ' ')
+			p++;
+		if (*p != '\0')
+			*p++ = '\0';
+	}
+
+	if (n < 2 || (tok[0][0] != '@' && tok[0][0] != '!'))
+		return;
+
+	if (atoi(tok[0] + 1) != _device)
+		return;
+
+	byte axId = atoi(tok[1]);
+	if (axId > _numAxes)
+		return;
+
+	byte k = 2;
+
+	if (tok[0][0] == '!') {
+		if (n >= k + 2) {
+			setBusy(axId, strcmp(tok[k], "BUSY") == 0);
+			strncpy(_warning[axId], tok[k + 1], 2);
+		}
+		return;
+	}
+
+	// Match the reply with its command. A broadcast may carry an ID for other devices on
+	// the bus, which is skipped when IDs are off here.
+	byte kind = KIND_CMD;
+	byte id = 0;
+	bool hasId = n > k && isDigit(tok[k][0]);
+	if (hasId)
+		id = atoi(tok[k++]);
+	popPending(hasId && _isMsgId, id, kind);
+
+	if (n < k + 3)
+		return;
+
+	bool isOk = strcmp(tok[k], "OK") == 0;
+	_lastReply = isOk ? REPLY_OK : REPLY_RJ;
+	if (!isOk)
+		_numRejected++;
+
+	setBusy(axId, strcmp(tok[k + 1], "BUSY") == 0);
+	strncpy(_warning[axId], tok[k + 2], 2);
+	k += 3;
+
+	// Device-level replies to "get pos" list the positions of all axes
+	if (isOk && kind == KIND_GET_POS) {
+		if (axId == 0) {
+			for (byte i = 1; i <= _numAxes && k + i - 1 < n; i++)
+				_posSteps[i] = atol(tok[k + i - 1]);
+		}
+		else if (k < n) {
+			_posSteps[axId] = atol(tok[k]);
+		}
+	}
+}
+
+void ZaberMotor::handleBinaryReply(const char* frame)
+{
+	// Frame: device, command, 4 bytes of little-endian data
+
+	int axId = (byte)frame[0] - _device + 1;
+	if (axId < 1 || axId > _numAxes)
+		return;
+
+	uint32_t u = 0;
+	for (byte i = 0; i < 4; i++)
+		u |= (uint32_t)(byte)frame[2 + i] << (8 * i);
+	long data = (int32_t)u;
+
+	switch ((byte)frame[1]) {
+	case BIN_ERROR:
+		_lastReply = REPLY_RJ;
+		_numRejected++;
+		return;
+	case BIN_HOME:
+	case BIN_MOVE_ABS:
+		// Motion commands reply on completion with the final position
+		_posSteps[axId] = data;
+		setBusy(axId, false);
+		break;
+	case BIN_GET_POS:
+		_posSteps[axId] = data;
+		break;
+	case BIN_GET_STATUS:
+		setBusy(axId, data != 0);
+		break;
+	}
+
+	_lastReply = REPLY_OK;
+}
+
+
+
+ZaberBus::ZaberBus(Stream& serial):_serial(serial)
+{
+}
+
+void ZaberBus::setProtocol(byte protocol)
+{
+	// All devices on a chain use the same protocol
+	_protocol = protocol;
+	_rxLen = 0;
+}
+
+bool ZaberBus::attach(ZaberMotor& motor)
+{
+	if (_numMotors >= maxDevices)
+		return false;
+
+	_motors[_numMotors++] = &motor;
+	_protocol = motor._protocol;
+	return true;
+}
+
+void ZaberBus::detach(ZaberMotor& motor)
+{
+	// Take the motor off the bus, which frees its slot. It then sends and parses nothing.
+
+	for (byte i = 0; i < _numMotors; i++) {
+		if (_motors[i] == &motor) {
+			for (byte j = i + 1; j < _numMotors; j++)
+				_motors[j - 1] = _motors[j];
+			_numMotors--;
+			break;
+		}
+	}
+
+	if (motor._bus == this) {
+		motor._bus = NULL;
+		motor._isAttached = false;
+	}
+}
+
+void ZaberBus::update()
+{
+	// Parse replies from the shared port and hand each one to the device it came from
+
+	while (_serial.available()) {
+		if (!zaberAccumulate(_serial.read(), _protocol, _rx, _rxLen, sizeof(_rx), _tLastByte))
+			continue;
+
+		if (_protocol == ZaberMotor::BINARY) {
+			// Binary frames carry the device number of an axis
+			byte dev = _rx[0];
+			for (byte i = 0; i < _numMotors; i++) {
+				ZaberMotor* m = _motors[i];
+				if (dev >= m->_device && dev < m->_device + m->_numAxes) {
+					m->handleBinaryReply(_rx);
+					break;
+				}
+			}
+		}
+		else {
+			byte dev = atoi(_rx + 1);
+			for (byte i = 0; i < _numMotors; i++) {
+				if (_motors[i]->_device == dev) {
+					_motors[i]->handleAsciiReply(_rx);
+					break;
+				}
+			}
+		}
+	}
+}
+
+void ZaberBus::beginBatch()
+{
+	// Commands are buffered until endBatch, so that moves of several devices leave in a
+	// single write
+	_isBatch = true;
+}
+
+void ZaberBus::endBatch()
+{
+	_isBatch = false;
+	flush();
+}
+
+void ZaberBus::broadcast(const char* cmd)
+{
+	// Send one command to every device (address 0). Each device replies, so every attached
+	// device expects a reply. When any device uses message IDs, the command carries an ID
+	// that none of them has pending, and all replies come back with it.
+
+	if (_protocol != ZaberMotor::ASCII)
+		return;
+
+	bool isMsgId = false;
+	byte id = 0;
+	for (byte i = 0; i < _numMotors; i++) {
+		if (_motors[i]->_isMsgId && !isMsgId) {
+			id = _motors[i]->_nextMsgId;
+			isMsgId = true;
+		}
+	}
+
+	if (isMsgId) {
+		for (byte tries = 0; tries < 100; tries++) {
+			bool isFree = true;
+			for (byte i = 0; i < _numMotors; i++)
+				if (_motors[i]->_isMsgId && _motors[i]->isPending(id))
+					isFree = false;
+			if (isFree)
+				break;
+			id = (id + 1) % 100;
+		}
+	}
+
+	write((const uint8_t*)"/00 0 ", 6);
+	if (isMsgId) {
+		uint8_t digits[3] = { (uint8_t)('0' + id / 10), (uint8_t)('0' + id % 10), ' ' };
+		write(digits, 3);
+	}
+	write((const uint8_t*)cmd, strlen(cmd));
+	write((const uint8_t*)"\r\n", 2);
+
+	bool isMotion = strncmp(cmd, "home", 4) == 0 || strncmp(cmd, "move", 4) == 0;
+	unsigned long tNow = millis();
+
+	for (byte i = 0; i < _numMotors; i++) {
+		ZaberMotor* m = _motors[i];
+		m->pushPending(ZaberMotor::KIND_CMD, id);
+		m->_tLastSend = tNow;
+		if (m->_isMsgId)
+			m->_nextMsgId = (id + 1) % 100;
+		if (isMotion)
+			m->setBusy(0, true);
+	}
+}
+
+Stream& ZaberBus::getStream()
+{
+	return _serial;
+}
+
+void ZaberBus::write(const uint8_t* buf, byte len)
+{
+	if (!_isBatch) {
+		_serial.write(buf, len);
+		return;
+	}
+
+	if (_txLen + len > txBufSize)
+		flush();
+
+	memcpy(_tx + _txLen, buf, len);
+	_txLen += len;
+}
+
+void ZaberBus::flush()
+{
+	if (_txLen > 0) {
+		_serial.write(_tx, _txLen);
+		_txLen = 0;
+	}
+}
+
+
+// CORDIC tables: atan(2^-i) as binary angles, and the inverse gain 1/1.64676 in Q30, which
+// keeps its error below 0.01 um at 1 m
+static const int32_t cordicAtan[24] PROGMEM = {
+	536870912, 316933406, 167458907, 85004756, 42667331, 21354465, 10679838, 5340245,
+	2670163, 1335087, 667544, 333772, 166886, 83443, 41722, 20861,
+	10430, 5215, 2608, 1304, 652, 326, 163, 81
+};
+static const int64_t cordicInvGainQ30 = 652032874;
+static const float degPerBam = 360.0 / 4294967296.0;
+
+static int32_t deg2bam(float a)
+{
+	// Wrap to one turn first, which fmodf does exactly, so that the float product does not
+	// lose bits on large angles. Then 2^22 units per degree, and 128/45 binary angles each.
+	int32_t q = lroundf(fmodf(a, 360) * 4194304.0f);
+	return (int32_t)(uint32_t)(((int64_t)q * 128) / 45);
+}
+
+Position::Position(float a, float r) : _isCartesian(false)
+{
+	_angle = deg2bam(a);
+	_rQ8 = r * 256;
+}
+
+float Position::getA()
+{
+	// Degrees in [-180, 180)
+	updatePolar();
+	return _angle * degPerBam;
+}
+
+float Position::getR()
+{
+	updatePolar();
+	return _rQ8 / 256.0;
+}
+
+void Position::setA(float a)
+{
+	updatePolar();
+	_angle = deg2bam(a);
+	_isCartesian = false;
+}
+
+void Position::setR(float r)
+{
+	updatePolar();
+	_rQ8 = r * 256;
+	_isCartesian = false;
+}
+
+Position Position::operator+(const Position& p) const
+{
+	updateCartesian();
+	p.updateCartesian();
+	return Position(_x + p._x, _y + p._y);
+}
+
+Position Position::operator-(const Position& p) const
+{
+	updateCartesian();
+	p.updateCartesian();
+	return Position(_x - p._x, _y - p._y);
+}
+
+void Position::updatePolar() const
+{
+	// CORDIC vectoring of (y, x), which yields atan2(x, y) and the magnitude
+
+	if (_isPolar)
+		return;
+
+	int32_t u = (int32_t)_y << 8;
+	int32_t v = (int32_t)_x << 8;
+	uint32_t a = 0;
+
+	// Bring the vector into the right half plane where CORDIC converges
+	if (u < 0) {
+		u = -u;
+		v = -v;
+		a = 0x80000000UL;
+	}
+
+	for (byte i = 0; i < 24; i++) {
+		int32_t du = v >> i;
+		int32_t dv = u >> i;
+		int32_t da = pgm_read_dword(&cordicAtan[i]);
+		if (v > 0) {
+			u += du;
+			v -= dv;
+			a += da;
+		}
+		else {
+			u -= du;
+			v += dv;
+			a -= da;
+		}
+	}
+
+	_angle = a;
+	_rQ8 = ((int64_t)u * cordicInvGainQ30 + (1L << 29)) >> 30;
+	_isPolar = true;
+}
+
+void Position::updateCartesian() const
+{
+	// CORDIC rotation of (r/K, 0) by the angle
+
+	if (_isCartesian)
+		return;
+
+	int32_t a = _angle;
+	int32_t u = ((int64_t)_rQ8 * cordicInvGainQ30 + (1L << 29)) >> 30;
+	int32_t v = 0;
+
+	// Fold angles beyond +/-90 degrees
+	if (a > 0x40000000L || a < -0x40000000L) {
+		a = (int32_t)((uint32_t)a + 0x80000000UL);
+		u = -u;
+	}
+
+	for (byte i = 0; i < 24; i++) {
+		int32_t du = v >> i;
+		int32_t dv = u >> i;
+		int32_t da = pgm_read_dword(&cordicAtan[i]);
+		if (a > 0) {
+			u -= du;
+			v += dv;
+			a -= da;
+		}
+		else {
+			u += du;
+			v -= dv;
+			a += da;
+		}
+	}
+
+	_y = (u + 128) >> 8;
+	_x = (v + 128) >> 8;
+	_isCartesian = true;
+}
+
+void Position::toCartesian(Position* ps, long* xs, long* ys, unsigned int n)
+{
+	for (unsigned int i = 0; i < n; i++) {
+		xs[i] = ps[i].getX();
+		ys[i] = ps[i].getY();
+	}
+}
+
+void Position::polarToCartesian(const float* as, const float* rs, long* xs, long* ys, unsigned int n)
+{
+	// Convert arrays of angles (degrees) and radii (um) without keeping Position objects
+	Position p;
+	for (unsigned int i = 0; i < n; i++) {
+		p._angle = deg2bam(as[i]);
+		p._rQ8 = rs[i] * 256;
+		p._isCartesian = false;
+		xs[i] = p.getX();
+		ys[i] = p.getY();
+	}
+}
+
+
+// Rounding allowance when testing points against the merge cone, in um
+static const float coneSlack = 0.05;
+
+ZaberPlanner::ZaberPlanner(ZaberMotor& zaber):_zaber(zaber)
+{
+}
+
+bool ZaberPlanner::addLine(long x, long y)
+{
+	// Extend the previous line instead when the new point continues it, as long as that line
+	// has not been sent yet. Each point merged into the line allows the directions from its
+	// start that pass within the tolerance of the point, and the line only turns within all
+	// of them, so that no merged point ends up further than the tolerance from it.
+
+	unsigned long k = (_numAdded - 1) % maxSegments;
+
+	if (_hasTail && _numAdded > _numSent && _kind[k] == LINE) {
+		float ax = _x[k] - _tailStartX, ay = _y[k] - _tailStartY;
+		float bx = x - _x[k], by = y - _y[k];
+		float cx = x - _tailStartX, cy = y - _tailStartY;
+
+		bool isStartKnown = ax != 0 || ay != 0;
+		bool isForward = ax * bx + ay * by >= 0 && cx * cx + cy * cy >= ax * ax + ay * ay;
+
+		// Distances of the new point from the bounds of the cone, in um
+		bool isInCone = _isConeOpen ||
+			(_coneRx * cy - _coneRy * cx >= -coneSlack && cx * _coneLy - cy * _coneLx >= -coneSlack);
+
+		if (isStartKnown && isForward && isInCone) {
+			narrowCone(x, y);
+			_x[k] = x;
+			_y[k] = y;
+			return true;
+		}
+	}
+
+	return addSegment(LINE, x, y, 0, 0);
+}
+
+bool ZaberPlanner::addLine(Position p)
+{
+	return addLine(p.getX(), p.getY());
+}
+
+bool ZaberPlanner::addArc(long centerx, long centery, long endx, long endy, bool isCw)
+{
+	return addSegment(isCw ? ARC_CW : ARC_CCW, endx, endy, centerx, centery);
+}
+
+void ZaberPlanner::endPath()
+{
+	// No more segments follow. Until then, the device running out of segments counts as an
+	// underrun and update keeps waiting for more.
+	_isPathEnded = true;
+}
+
+void ZaberPlanner::setMergeTolerance(long tol)
+{
+	// Largest deviation (um) from a straight line for points to be merged (0 merges only
+	// exactly collinear points)
+	_mergeTol = tol;
+}
+
+void ZaberPlanner::clear()
+{
+	_numAdded = 0;
+	_numSent = 0;
+	_hasTail = false;
+	_isPathEnded = false;
+	_isRunning = false;
+}
+
+bool ZaberPlanner::addSegment(byte kind, long x, long y, long cx, long cy)
+{
+	// Returns false when the ring is full of unsent segments
+
+	if (_numAdded - _numSent >= maxSegments)
+		return false;
+
+	unsigned long k = _numAdded % maxSegments;
+	if (_hasTail) {
+		unsigned long kPrev = (_numAdded - 1) % maxSegments;
+		_tailStartX = _x[kPrev];
+		_tailStartY = _y[kPrev];
+	}
+	else {
+		_tailStartX = x;
+		_tailStartY = y;
+	}
+
+	_kind[k] = kind;
+	_x[k] = x;
+	_y[k] = y;
+	_cx[k] = cx;
+	_cy[k] = cy;
+	_numAdded++;
+	_hasTail = true;
+
+	_isConeOpen = true;
+	if (kind == LINE)
+		narrowCone(x, y);
+
+	return true;
+}
+
+void ZaberPlanner::narrowCone(long x, long y)
+{
+	// Intersect the cone with the directions from the start of the tail that pass within the
+	// tolerance of (x, y), i.e. within asin(tol / d) of the direction to it
+
+	float ux = x - _tailStartX, uy = y - _tailStartY;
+	float d = sqrt(ux * ux + uy * uy);
+	if (d <= _mergeTol)
+		return;
+
+	float s = _mergeTol / d;
+	float c = sqrt(1 - s * s);
+	ux /= d;
+	uy /= d;
+	float rx = ux * c + uy * s, ry = uy * c - ux * s;
+	float lx = ux * c - uy * s, ly = uy * c + ux * s;
+
+	if (_isConeOpen) {
+		_coneRx = rx;
+		_coneRy = ry;
+		_coneLx = lx;
+		_coneLy = ly;
+		_isConeOpen = false;
+		return;
+	}
+
+	// Keep the tighter of each pair of bounds
+	if (_coneRx * ry - _coneRy * rx > 0) {
+		_coneRx = rx;
+		_coneRy = ry;
+	}
+	if (lx * _coneLy - ly * _coneLx > 0) {
+		_coneLx = lx;
+		_coneLy = ly;
+	}
+}
+
+
+
+void ZaberPlanner::setTargetDepth(byte n)
+{
+	// Number of segments to keep sent but not yet accepted by the controller. The controller
+	// delays its reply to a stream command while its queue is full, so unacknowledged
+	// segments are the ones waiting for room. At most ZaberMotor::maxPending, since replies
+	// beyond that are not tracked.
+	if (n < 1)
+		n = 1;
+	if (n > ZaberMotor::maxPending)
+		n = ZaberMotor::maxPending;
+	_targetDepth = n;
+}
+
+void ZaberPlanner::setPollInterval(unsigned int intervalInMs)
+{
+	_pollInterval = intervalInMs;
+}
+
+void ZaberPlanner::setReplyTimeout(unsigned long timeoutInMs)
+{
+	// Waiting for replies longer than this gives them up as lost (5 s by default). The device
+	// holds back the reply to a segment while its FIFO is full, until the segment running
+	// ends, so the timeout must be longer than the longest segment takes.
+	_replyTimeout = timeoutInMs;
+}
+
+void ZaberPlanner::start()
+{
+	// Send the first batch corked so that motion begins with a filled queue
+
+	_numUnderruns = 0;
+	_numExpired = 0;
+	_tStart = millis();
+	_tEnd = _tStart;
+	_tLastPoll = _tStart;
+	_wasIdle = false;
+	_isRunning = true;
+
+	_zaber.streamLive();
+	_zaber.streamCork();
+	for (byte i = 0; i < _targetDepth && canSend(); i++)
+		sendNext();
+	_zaber.streamUncork();
+}
+
+bool ZaberPlanner::update()
+{
+	// Parse replies and top up the controller queue. Segments may be added while running.
+	// Returns true when the path is ended, all segments are sent and the device is idle.
+
+	if (!_isRunning)
+		return true;
+
+	_zaber.update();
+
+	while (canSend() && _zaber.getPendingCount() < _targetDepth)
+		sendNext();
+
+	// A lost reply would otherwise stop the status polls for good
+	if (_zaber.getPendingCount() > 0) {
+		if (!_zaber.expireReplies(_replyTimeout))
+			return false;
+		_numExpired++;
+	}
+
+	// Poll device status to detect underruns and the end of motion
+	if (millis() - _tLastPoll >= _pollInterval) {
+		_zaber.requestStatus(0);
+		_tLastPoll = millis();
+		return false;
+	}
+
+	bool isIdle = !_zaber.isBusy(0);
+
+	// The device stopped while the path goes on, either because the caller has not added
+	// the next segment yet or because it has not been sent
+	bool isOpen = !_isPathEnded || _numSent < _numAdded;
+	if (isIdle && !_wasIdle && isOpen && _numSent > 0)
+		_numUnderruns++;
+	_wasIdle = isIdle;
+
+	if (isIdle && !isOpen) {
+		_isRunning = false;
+		return true;
+	}
+
+	return false;
+}
+
+bool ZaberPlanner::isDone()
+{
+	return !_isRunning;
+}
+
+bool ZaberPlanner::canSend()
+{
+	// The last line may still be extended by addLine, so it waits for the segment after it
+	// or for the end of the path
+
+	if (_numSent >= _numAdded)
+		return false;
+
+	bool isTail = _numSent + 1 == _numAdded;
+	return !isTail || _isPathEnded || _kind[_numSent % maxSegments] != LINE;
+}
+
+void ZaberPlanner::sendNext()
+{
+	unsigned long k = _numSent % maxSegments;
+
+	if (_kind[k] == LINE)
+		_zaber.streamLine(_x[k], _y[k]);
+	else
+		_zaber.streamArc(_cx[k], _cy[k], _x[k], _y[k], _kind[k] == ARC_CW);
+
+	_numSent++;
+	_tEnd = millis();
+}
+
+
+
+unsigned long ZaberPlanner::getSegmentsSent()
+{
+	return _numSent;
+}
+
+unsigned int ZaberPlanner::getUnderrunCount()
+{
+	return _numUnderruns;
+}
+
+unsigned int ZaberPlanner::getExpiredCount()
+{
+	// Times the planner gave up waiting for replies
+	return _numExpired;
+}
+
+float ZaberPlanner::getSegmentRate()
+{
+	// Segments per second from start to the last segment sent
+	unsigned long dt = _tEnd - _tStart;
+	return dt > 0 ? _numSent * 1000.0 / dt : 0;
+}
@@ -3,14 +3,39 @@
 
 #include "Arduino.h"
 
+class ZaberBus;
+
 class ZaberMotor
 {
+	friend class ZaberBus;
+
 public:
-	ZaberMotor(Stream& serial);
+	ZaberMotor(Stream& serial, byte device = 1, byte numAxes = 2);
+	ZaberMotor(ZaberBus& bus, byte device, byte numAxes = 2);
+	~ZaberMotor();
+
+	static const byte maxAxes = 4;
+	static const byte maxPending = 8;	// replies tracked at once
+
+	// Protocols
+	static const byte ASCII = 0;
+	static const byte BINARY = 1;
+
+	// Reply status
+	static const byte REPLY_NONE = 0;
+	static const byte REPLY_OK = 1;
+	static const byte REPLY_RJ = 2;
+
+	long maxPos[maxAxes];
+    bool isReverse[maxAxes];
+
+    bool isAttached();
+    byte getDevice();
+    byte getNumAxes();
+    void setProtocol(byte protocol);
+    byte getProtocol();
+    void setMicrostepSize(unsigned long num, unsigned long den);
 
-	long maxPos[2];
-    bool isReverse[2];
-    
     void setRef(long ref, byte axId = 1);
 	long getRef(byte axId = 1);
     void setJitter(int n);
@@ -25,65 +50,250 @@ public:
     void streamLive();
 	void streamDisable();
     void streamLine(long pos1, long pos2);
-    void streamArc(long centerx, long centery, long endx, long endy);
+    void streamArc(long centerx, long centery, long endx, long endy, bool isCw = true);
     void streamArc2(long startx, long starty, long endx, long endy);
     void streamCirc(long centrex, long centrey);
     void streamCork();
     void streamUncork();
 
 	void read();
+
+	// Reply parsing and device state
+	void update();
+	void enableMessageIds(bool isEnabled);
+	void enableAlerts();
+	void setPollInterval(unsigned int intervalInMs);
+	void requestStatus(byte axId = 0);
+	void requestPosition(byte axId = 0);
+	bool checkIdle(byte axId = 0);
+	bool expireReplies(unsigned long timeoutInMs);
+	bool isBusy(byte axId = 0);
+	long getPosition(byte axId = 1);
+	long getPositionSteps(byte axId = 1);
+	const char* getWarning(byte axId = 0);
+	byte getLastReply();
+	unsigned int getRejectCount();
+	byte getPendingCount();
     
 private:
+    // Binary protocol command numbers
+    static const byte BIN_HOME = 1;
+    static const byte BIN_MOVE_ABS = 20;
+    static const byte BIN_SET_SPEED = 42;
+    static const byte BIN_SET_ACCEL = 43;
+    static const byte BIN_GET_STATUS = 54;
+    static const byte BIN_GET_POS = 60;
+    static const byte BIN_ERROR = 255;
+
+    // Kinds of outstanding commands
+    static const byte KIND_CMD = 0;
+    static const byte KIND_GET_POS = 1;
+
+    static const byte cmdBufSize = 80;
+    static const byte rxBufSize = 64;
+
     Stream& _serial;
-	long _refPos[2];
+    ZaberBus* _bus = NULL;
+    bool _isAttached = false;
+	long _refPos[maxAxes];
     int _jitRange = 0;
     bool _isStream = false;
+    byte _protocol = ASCII;
+    byte _device = 1;
+    byte _numAxes = 2;
+    unsigned long _stepNum = 381;
+    unsigned long _stepDen = 2000;
+
+    // Command encoding
+    char _cmd[cmdBufSize + 2];
+    byte _cmdLen = 0;
+    void cmdBegin(byte axId, byte kind = KIND_CMD);
+    void cmdWord(const char* word);
+    void cmdArg(long val);
+    void cmdSend();
+    void binSend(byte axId, byte command, long data);
+
+    // Reply parsing. Index 0 of state arrays holds the device-level state.
+    char _rx[rxBufSize];
+    byte _rxLen = 0;
+    unsigned long _tLastByte = 0;
+    bool _isMsgId = false;
+    byte _nextMsgId = 0;
+    byte _pendingKind[maxPending];
+    byte _pendingId[maxPending];
+    byte _pendingHead = 0;
+    byte _pendingCount = 0;
+    unsigned int _pollInterval = 20;
+    unsigned long _tLastSend = 0;
+    bool _isBusy[maxAxes + 1];
+    long _posSteps[maxAxes + 1];
+    char _warning[maxAxes + 1][3];
+    byte _lastReply = REPLY_NONE;
+    unsigned int _numRejected = 0;
+    void pushPending(byte kind, byte id);
+    bool isPending(byte id);
+    bool popPending(bool isMatchId, byte id, byte& kind);
+    void setBusy(byte axId, bool isBusy);
+    void init(byte device, byte numAxes);
+    void handleAsciiReply(char* line);
+    void handleBinaryReply(const char* frame);
+    void writeOut(const uint8_t* buf, byte len);
 	
     int genJitter();
 	long convert(long pos, byte axId);
 };
 
+class ZaberBus
+{
+public:
+	ZaberBus(Stream& serial);
+
+	static const byte maxDevices = 8;
+	static const unsigned int txBufSize = 256;
+
+	void setProtocol(byte protocol);
+
+	// Devices are attached by the ZaberMotor constructor and detached by its destructor
+	void detach(ZaberMotor& motor);
+
+	// Reply parsing for all attached devices
+	void update();
+
+	// Coalesce commands of several devices into one write
+	void beginBatch();
+	void endBatch();
+
+	// Commands to all devices at once, e.g. "home" or "stop"
+	void broadcast(const char* cmd);
+
+	Stream& getStream();
+
+private:
+	friend class ZaberMotor;
+
+	Stream& _serial;
+	ZaberMotor* _motors[maxDevices];
+	byte _numMotors = 0;
+	byte _protocol = ZaberMotor::ASCII;
+
+	uint8_t _tx[txBufSize];
+	unsigned int _txLen = 0;
+	bool _isBatch = false;
+
+	char _rx[64];
+	byte _rxLen = 0;
+	unsigned long _tLastByte = 0;
+
+	bool attach(ZaberMotor& motor);
+	void write(const uint8_t* buf, byte len);
+	void flush();
+};
+
 class Position
 {
 protected:
-	long _x = 0, _y = 0;
-	float _a = 0, _r = 0;
-
-	void updatePolar() {
-		_a = atan(double(_x) / double(_y)) * 180 / PI;
-		_r = sqrt(pow(double(_x), 2) + pow(double(_y), 2));
-	}
-	void updateCartesian() {
-		_x = sin(_a / 180.0 * PI) * _r;
-		_y = cos(_a / 180.0 * PI) * _r;
-	}
+	// Cartesian (um) and polar forms are cached and converted only when requested. The angle
+	// is a binary angle (2^32 per turn) measured from +y toward +x; the radius is in 1/256 um.
+	mutable long _x = 0, _y = 0;
+	mutable int32_t _angle = 0;
+	mutable long _rQ8 = 0;
+	mutable bool _isCartesian = true;
+	mutable bool _isPolar = true;
+
+	void updatePolar() const;
+	void updateCartesian() const;
 
 public:
 	Position() {};
-	Position(long x, long y) : _x(x), _y(y) { updatePolar(); }
-	Position(float a, float r) : _a(a), _r(r) { updateCartesian(); }
-
-	long getX() { return _x; }
-	long getY() { return _y; }
-	long getA() { return _a; }
-	long getR() { return _r; }
-	void setX(long x) { _x = x; updatePolar(); }
-	void setY(long y) { _y = y; updatePolar(); }
-	void setA(long a) { _a = a; updateCartesian(); }
-	void setR(long r) { _r = r; updateCartesian(); }
-
-	Position operator+(const Position& p) {
-		Position pp(this->_x + p._x, this->_y + p._y);
-		return pp;
-	}
-	Position operator-(const Position& p) {
-		Position pp(this->_x - p._x, this->_y - p._y);
-		return pp;
-	}
-	Position operator=(const Position& p) {
-		Position pp(p._x, p._y);
-		return pp;
-	}
+	Position(long x, long y) : _x(x), _y(y), _isPolar(false) {}
+	Position(float a, float r);
+
+	long getX() { updateCartesian(); return _x; }
+	long getY() { updateCartesian(); return _y; }
+	float getA();
+	float getR();
+	void setX(long x) { updateCartesian(); _x = x; _isPolar = false; }
+	void setY(long y) { updateCartesian(); _y = y; _isPolar = false; }
+	void setA(float a);
+	void setR(float r);
+
+	Position operator+(const Position& p) const;
+	Position operator-(const Position& p) const;
+
+	// Batch conversion of targets for streaming
+	static void toCartesian(Position* ps, long* xs, long* ys, unsigned int n);
+	static void polarToCartesian(const float* as, const float* rs, long* xs, long* ys, unsigned int n);
+};
+
+class ZaberPlanner
+{
+public:
+	ZaberPlanner(ZaberMotor& zaber);
+
+	static const byte maxSegments = 16;
+
+	// Path building (coordinates in um, as in ZaberMotor::streamLine)
+	bool addLine(long x, long y);
+	bool addLine(Position p);
+	bool addArc(long centerx, long centery, long endx, long endy, bool isCw = true);
+	void endPath();
+	void setMergeTolerance(long tol);
+	void clear();
+
+	// Streaming
+	void setTargetDepth(byte n);
+	void setPollInterval(unsigned int intervalInMs);
+	void setReplyTimeout(unsigned long timeoutInMs);
+	void start();
+	bool update();
+	bool isDone();
+
+	// Statistics of the last run
+	unsigned long getSegmentsSent();
+	unsigned int getUnderrunCount();
+	unsigned int getExpiredCount();
+	float getSegmentRate();
+
+private:
+	static const byte LINE = 0;
+	static const byte ARC_CW = 1;
+	static const byte ARC_CCW = 2;
+
+	ZaberMotor& _zaber;
+
+	// Segment ring as struct of arrays
+	byte _kind[maxSegments];
+	long _x[maxSegments], _y[maxSegments];
+	long _cx[maxSegments], _cy[maxSegments];
+	unsigned long _numAdded = 0;
+	unsigned long _numSent = 0;
+
+	// Start of the last added segment for merging, and the directions from there that keep
+	// all points merged into it within the tolerance, clockwise and counterclockwise bounds
+	// as unit vectors (all directions while open)
+	bool _hasTail = false;
+	long _tailStartX = 0, _tailStartY = 0;
+	long _mergeTol = 1;
+	bool _isConeOpen = true;
+	float _coneRx = 0, _coneRy = 0;
+	float _coneLx = 0, _coneLy = 0;
+	bool _isPathEnded = false;
+
+	byte _targetDepth = 4;
+	unsigned int _pollInterval = 20;
+	unsigned long _replyTimeout = 5000;
+	bool _isRunning = false;
+	bool _wasIdle = false;
+	unsigned long _tStart = 0;
+	unsigned long _tEnd = 0;
+	unsigned long _tLastPoll = 0;
+	unsigned int _numUnderruns = 0;
+	unsigned int _numExpired = 0;
+
+	bool addSegment(byte kind, long x, long y, long cx, long cy);
+	void narrowCone(long x, long y);
+	bool canSend();
+	void sendNext();
 };
 
 #endif
\ No newline at end of file
@@ -14,6 +14,7 @@ classdef MSerial < handle
         handshakeRx = '';
         serialInBuffer = cell(0,2);
         verbose = true;
+        xbeeHandle = []; % native XBee decoder (see Satellites.BuildNative)
     end
     
     properties(Dependent)
@@ -106,6 +107,9 @@ classdef MSerial < handle
         
         function delete(this)
             this.Disconnect();
+            if ~isempty(this.xbeeHandle)
+                svxbee_mex('close', this.xbeeHandle);
+            end
         end
         
         
@@ -221,6 +225,20 @@ classdef MSerial < handle
                     % Read all available bytes
                     bb = fread(sObj, numBytesAvailable);
                     
+                    if ~strcmp(mSerialObj.serialMode, MSerial.supportedSerialModes{1}) && exist('svxbee_mex', 'file') == 3
+                        % Decode XBee API frames natively, which validates checksums and joins 
+                        % lines split across frames separately for each source radio
+                        if isempty(mSerialObj.xbeeHandle)
+                            mSerialObj.xbeeHandle = svxbee_mex('open', true);
+                        end
+                        rxLines = svxbee_mex('read', mSerialObj.xbeeHandle, uint8(bb));
+                        for k = 1 : numel(rxLines)
+                            mSerialObj.AddToSerialInBuffer(rxLines{k}, event.Data.AbsTime);
+                        end
+                        numBytesAvailable = sObj.BytesAvailable;
+                        continue;
+                    end
+                    
                     for i = 1 : numBytesAvailable
                         % Process one byte at a time
                         b = bb(i);
@@ -255,7 +273,7 @@ classdef MSerial < handle
                                 
                                 % Perform escaping if the preceeding byte was '7D'
                                 if isEscaping
-                                    b = xor(b, hex2dec('7D'));
+                                    b = bitxor(b, hex2dec('20'));
                                     isEscaping = false;
                                 end
                                 
@@ -352,6 +370,12 @@ classdef MSerial < handle
         
         function frame = PackFrameData(data)
             
+            if exist('svxbee_mex', 'file') == 3
+                % Escaped frame (API mode 2), as expected by the decoder in ReadSerial
+                frame = double(svxbee_mex('pack', uint8(data), '000000000000FFFF', true));
+                return;
+            end
+            
             % Change 16 hexadecimal numbers to 8 decimal numbers.
             decDestAdd = MSerial.Hex16ToDec8('000000000000FFFF');
             
@@ -379,6 +403,15 @@ classdef MSerial < handle
             % Include checksum in the frame
             checksum = hex2dec('FF') - mod(sum(frame(4:end)), 256);
             frame = [frame checksum];
+
+            % Escape 0x7E, 0x7D, 0x11 and 0x13 after the start byte as 0x7D followed by the
+            % byte XOR 0x20, like the MEX function (API mode 2)
+            body = double(frame(2:end));
+            isSpecial = body == 126 | body == 125 | body == 17 | body == 19;
+            body(isSpecial) = bitxor(body(isSpecial), 32);
+            escaped = [125 * ones(1, numel(body)); body];
+            escaped = escaped([isSpecial; true(1, numel(body))]);
+            frame = [frame(1) escaped(:)'];
         end
         
         function output = Hex16ToDec8(hex16Value)
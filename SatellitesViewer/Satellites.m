@@ -82,6 +82,16 @@ classdef Satellites
                 tagDelimiter = ',';
             end
             
+            % Use the native parser when available
+            if Satellites.IsNativeAvailable(tagDelimiter, msgDelimiter) && ~any(cellfun(@isempty, txtLines))
+                [ioType, sysTime, eventParts] = svlog_mex('text', strjoin(txtLines(:)', newline), ...
+                    tagDelimiter, msgDelimiter);
+                if numel(ioType) == numel(txtLines)
+                    sysTime = Satellites.TimeFromComponents(sysTime);
+                    return;
+                end
+            end
+            
             % Preallocation
             ioType = repmat('N', numel(txtLines), 1);
             sysTime = cell(numel(txtLines), 1);
@@ -121,6 +131,150 @@ classdef Satellites
                 'Format', 'yyyy-MM-dd HH:mm:ss.SSS');
         end
         
+        function [ioType, sysTime, eventParts, txtLines] = ReadLog(svPath, tagDelimiter, msgDelimiter)
+            % Read a SatellitesViewer log file and parse lines into parts
+            % 
+            %   [ioType, sysTime, eventParts, txtLines] = Satellites.ReadLog(svPath)
+            %   [ioType, sysTime, eventParts, txtLines] = Satellites.ReadLog(svPath, tagDelimiter, msgDelimiter)
+            % 
+            % This is equivalent to Satellites.ReadTxt followed by Satellites.LineParts but uses the 
+            % native parser (see Satellites.BuildNative) when it is available, which memory-maps the 
+            % file and parses it with multiple threads. Delimiters must be single characters for the 
+            % native parser. Inputs and outputs are described in ReadTxt and LineParts. 
+            % 
+            
+            if nargin < 3
+                msgDelimiter = ',';
+            end
+            
+            if nargin < 2
+                tagDelimiter = ',';
+            end
+            
+            if Satellites.IsNativeAvailable(tagDelimiter, msgDelimiter)
+                [ioType, sysTime, eventParts, txtLines] = svlog_mex('file', svPath, tagDelimiter, msgDelimiter);
+                sysTime = Satellites.TimeFromComponents(sysTime);
+            else
+                [~, txtLines] = Satellites.ReadTxt(svPath);
+                [ioType, sysTime, eventParts] = Satellites.LineParts(txtLines, tagDelimiter, msgDelimiter);
+            end
+        end
+        
+        function BuildNative()
+            % Compile the native log parser, event store, XBee codec and plot ring buffer (requires 
+            % a C++ compiler set up by "mex -setup C++")
+            % 
+            %   Satellites.BuildNative()
+            % 
+            
+            svDir = fileparts(mfilename('fullpath'));
+            srcDir = fullfile(svDir, 'native');
+            common = {fullfile(srcDir, 'svlog.cpp'), fullfile(srcDir, 'svmap.cpp')};
+            mex('-O', common{:}, fullfile(srcDir, 'svlog_mex.cpp'), '-outdir', svDir);
+            mex('-O', common{:}, fullfile(srcDir, 'svstore.cpp'), fullfile(srcDir, 'svstore_mex.cpp'), '-outdir', svDir);
+            mex('-O', fullfile(srcDir, 'svxbee.cpp'), fullfile(srcDir, 'svxbee_mex.cpp'), '-outdir', svDir);
+            mex('-O', fullfile(srcDir, 'svscope.cpp'), fullfile(srcDir, 'svscope_mex.cpp'), '-outdir', svDir);
+        end
+        
+        function WriteStore(svPath, storePath, delimiterEvents, tagDelimiter, msgDelimiter)
+            % Convert a SatellitesViewer log to an indexed event store for fast queries
+            % 
+            %   Satellites.WriteStore(svPath, storePath)
+            %   Satellites.WriteStore(svPath, storePath, delimiterEvents)
+            %   Satellites.WriteStore(svPath, storePath, delimiterEvents, tagDelimiter, msgDelimiter)
+            %   Satellites.WriteStore([], storePath, delimiterEvents)
+            % 
+            % Inputs
+            %   svPath              The path of a SatellitesViewer log file. If empty, only the index of an 
+            %                       existing store is rewritten. 
+            %   storePath           The path of the store file. The episode index is saved next to it with 
+            %                       an additional '.idx' extension. 
+            %   delimiterEvents     A string or cell array of event names that delimit episodes, such as 
+            %                       'trial'. Episodes are defined as in Satellites.GroupEventsByTime. 
+            %   tagDelimiter        See Satellites.LineParts. The default is ','.
+            %   msgDelimiter        See Satellites.LineParts. The default is ','.
+            % 
+            % The store keeps input events only. For each event type it holds device times (the 
+            % second part of messages), host system times and the remaining parts as numbers (NaN if 
+            % missing or not numeric). Requires the native library (see Satellites.BuildNative). 
+            % 
+            
+            if nargin < 5
+                msgDelimiter = ',';
+            end
+            if nargin < 4
+                tagDelimiter = ',';
+            end
+            if nargin < 3
+                delimiterEvents = {};
+            end
+            
+            assert(exist('svstore_mex', 'file') == 3, ...
+                'The native event store is not built. Please run Satellites.BuildNative first.');
+            
+            if ~isempty(svPath)
+                svstore_mex('convert', svPath, storePath, tagDelimiter, msgDelimiter);
+            end
+            if ~isempty(delimiterEvents)
+                svstore_mex('index', storePath, cellstr(delimiterEvents));
+            end
+        end
+        
+        function result = QueryStore(storePath, eventType, delimiterEvent, episodes)
+            % Read events of one type from an event store, optionally within a range of episodes
+            % 
+            %   result = Satellites.QueryStore(storePath)
+            %   result = Satellites.QueryStore(storePath, eventType)
+            %   result = Satellites.QueryStore(storePath, eventType, delimiterEvent, episodes)
+            % 
+            % Inputs
+            %   storePath           The path of a store written by Satellites.WriteStore. 
+            %   eventType           Name of the event type. If not specified, a summary of the store is 
+            %                       returned with fields eventTypes, numRows, numValues and numEpisodes. 
+            %   delimiterEvent      An event indexed when the store was written. 
+            %   episodes            The first and last episodes to read, e.g. [100 200]. Episode 1 begins 
+            %                       at the first delimiter event and episode 0 contains events before it. 
+            % Output
+            %   result              A struct with the following fields.
+            %     deviceTime          A [nEvent,1] array of event times from the device. 
+            %     sysTime             A [nEvent,1] array of datetime from the host (NaT if not logged). 
+            %     values              A [nEvent,nValue] array of event values. 
+            %     episode             A [nEvent,1] array of episode numbers (NaN if not queried by episode). 
+            % 
+            
+            assert(exist('svstore_mex', 'file') == 3, ...
+                'The native event store is not built. Please run Satellites.BuildNative first.');
+            
+            if nargin < 2
+                result = svstore_mex('info', storePath);
+                return;
+            end
+            
+            if nargin < 4
+                [t, hostTime, val, ep] = svstore_mex('query', storePath, eventType);
+            else
+                [t, hostTime, val, ep] = svstore_mex('query', storePath, eventType, ...
+                    delimiterEvent, episodes(1), episodes(end));
+            end
+            
+            result.deviceTime = t;
+            result.sysTime = datetime(1970, 1, 1, 0, 0, 0, hostTime, 'Format', 'yyyy-MM-dd HH:mm:ss.SSS');
+            result.values = val;
+            result.episode = ep;
+        end
+        
+        function b = IsNativeAvailable(tagDelimiter, msgDelimiter)
+            % Whether the native log parser is built and supports the delimiters
+            b = exist('svlog_mex', 'file') == 3 && ischar(tagDelimiter) && ischar(msgDelimiter) ...
+                && isscalar(tagDelimiter) && isscalar(msgDelimiter);
+        end
+        
+        function sysTime = TimeFromComponents(tc)
+            % Convert [n,7] date and time components from the native parser to datetime
+            sysTime = datetime(tc(:,1), tc(:,2), tc(:,3), tc(:,4), tc(:,5), tc(:,6), tc(:,7), ...
+                'Format', 'yyyy-MM-dd HH:mm:ss.SSS');
+        end
+        
         function eventStruct = GroupEventsByType(eventParts)
             % Categorize different event types into fields of a structure
             % 
@@ -266,18 +420,17 @@ classdef Satellites
                 end
                 txt = fullfile(svDir, svName);
             end
+            % Parse out IO and system time tags
             if ischar(txt) && exist(txt, 'file')
-                [~, txt] = Satellites.ReadTxt(txt);
-            end
-            if ~iscell(txt)
-                txt = Satellites.StringToLines(txt);
+                [ioType, sysTime, eventParts, txt] = Satellites.ReadLog(txt, tagDelimiter, msgDelimiter);
+            else
+                if ~iscell(txt)
+                    txt = Satellites.StringToLines(txt);
+                end
+                [ioType, sysTime, eventParts] = Satellites.LineParts(txt, tagDelimiter, msgDelimiter);
             end
             
 
-            % Parse out IO and system time tags
-            [ioType, sysTime, eventParts] = Satellites.LineParts(txt, tagDelimiter, msgDelimiter);
-            
-
             % Validate data integrity
             isValid = true(size(eventParts));
 %             valFunc = @(x) all(isstrprop(x,'digit') | x == '-');
@@ -11,6 +11,12 @@ classdef SerialViewerStream < handle
         lastBlockIdx = 0;
         lastElementIdx = 0;
         lastUpdateTime = 0;
+        
+        ringCapacity = 0;
+    end
+    
+    properties(Transient)
+        scopeHandle = []; % native ring buffer for envelopes (see Satellites.BuildNative)
     end
     
     properties(Dependent)
@@ -60,8 +66,10 @@ classdef SerialViewerStream < handle
             % Handles input parameters
             p = inputParser();
             p.addParameter('blockLength', 1e5, @isscalar);
+            p.addParameter('ringCapacity', 0, @isscalar); % number of latest samples kept natively
             p.parse(varargin{:});
             this.blockLength = p.Results.blockLength;
+            this.ringCapacity = p.Results.ringCapacity;
             
             % Initialize parameters
             this.Clear();
@@ -74,6 +82,16 @@ classdef SerialViewerStream < handle
             this.lastBlockIdx = 0;
             this.lastElementIdx = this.blockLength;
             this.lastUpdateTime = 0;
+            
+            if ~isempty(this.scopeHandle)
+                svscope_mex('clear', this.scopeHandle);
+            end
+        end
+        
+        function delete(this)
+            if ~isempty(this.scopeHandle)
+                svscope_mex('close', this.scopeHandle);
+            end
         end
         
         function Save(this)
@@ -99,6 +117,18 @@ classdef SerialViewerStream < handle
             
             this.lastElementIdx = this.lastElementIdx + 1;
             this.blocks{this.lastBlockIdx}(this.lastElementIdx,:) = val;
+            
+            % Also keep the sample in the native ring buffer
+            if isempty(this.scopeHandle) && this.ringCapacity > 0
+                if exist('svscope_mex', 'file') == 3
+                    this.scopeHandle = svscope_mex('open', this.ringCapacity, length(val)-1);
+                else
+                    this.ringCapacity = 0;
+                end
+            end
+            if ~isempty(this.scopeHandle)
+                svscope_mex('add', this.scopeHandle, val(:)');
+            end
         end
         
         
@@ -159,6 +189,54 @@ classdef SerialViewerStream < handle
             
         end
         
+        function [t, vMin, vMax] = GetEnvelopeByTime(this, dur, numBins)
+            % Retrieve the min and max of latest data points in a fixed number of bins
+            % 
+            %   [t, vMin, vMax] = GetEnvelopeByTime(dur, numBins)
+            % 
+            % Inputs
+            %   dur         The duration back from the latest sample.
+            %   numBins     The number of bins. Samples are divided evenly among bins.
+            % Output
+            %   t           The time of the first sample in each bin.
+            %   vMin        A [numBins,numValues] array of the minimum of each value in each bin.
+            %   vMax        Same as vMin but of the maximum. When there are fewer samples than 
+            %               bins, each sample is a bin.
+            % 
+            % The cost does not grow with dur when the native ring buffer is in use (see the 
+            % 'ringCapacity' parameter of the constructor). Otherwise GetLatestByTime is used. 
+            % 
+            
+            if ~isempty(this.scopeHandle)
+                [t, vMin, vMax] = svscope_mex('envelope', this.scopeHandle, dur, numBins);
+                return;
+            end
+            
+            if isempty(this.blocks)
+                val = zeros(0,1);
+            else
+                val = this.GetLatestByTime(dur);
+            end
+            numSamples = size(val,1);
+            
+            if numSamples <= numBins
+                t = val(:,1);
+                vMin = val(:,2:end);
+                vMax = vMin;
+                return;
+            end
+            
+            edges = floor((0:numBins) * numSamples / numBins);
+            t = val(edges(1:end-1)+1, 1);
+            vMin = zeros(numBins, size(val,2)-1);
+            vMax = vMin;
+            for i = 1 : numBins
+                binVal = val(edges(i)+1:edges(i+1), 2:end);
+                vMin(i,:) = min(binVal, [], 1);
+                vMax(i,:) = max(binVal, [], 1);
+            end
+        end
+        
         function val = GetAll(this)
             % Retrieve all data in an array
             
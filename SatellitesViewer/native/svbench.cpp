@@ -0,0 +1,276 @@
+/*
+svbench.cpp - Runs SatellitesBenchmark on a device and measures command round trips (Linux).
+Released into the public domain.
+
+Talks to a board running the SatellitesBenchmark example, or to the example built with
+HostArduino and started with --pty. Each round trip sends "PNG,<n>" and waits for the
+"ack" line carrying n. The on-board suite is then started with "BEN,<iterations>" and its
+result lines are printed as they arrive, up to benchEnd. Everything goes to stdout in the
+format of Satellites messages so that runs can be saved and compared between versions:
+
+	rtt,<count>,<mean>,<min>,<p50>,<p99>,<max>		round trip in microseconds
+	lost,<count>									pings without an ack within 1 s
+	<name>,<time>,<iterations>,<mean>,<min>,<max>,<items>	from the board
+	budget_<name>,<us>,<% at 1 kHz>,<% at 10 kHz>,<% at 50 kHz>	after each filter_* result
+
+Budget lines give the time SatelliteFilter takes per sample of one channel and the share
+of the CPU a channel takes at common acquisition rates. They need the cycle counter rate
+from benchStart, so they are missing when the board does not report it.
+
+Usage
+	svbench <device> [--baud 115200] [--pings 1000] [--iterations 1000]
+		--pings 0 or --iterations 0 skip that part.
+
+Build
+	g++ -O2 -std=c++11 svbench.cpp -o svbench
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+static double now()
+{
+	using namespace std::chrono;
+	return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+static speed_t baudToSpeed(int baud)
+{
+	switch (baud)
+	{
+		case 9600: return B9600;
+		case 19200: return B19200;
+		case 38400: return B38400;
+		case 57600: return B57600;
+		case 115200: return B115200;
+		case 230400: return B230400;
+		case 460800: return B460800;
+		case 921600: return B921600;
+	}
+	return 0;
+}
+
+class Port
+{
+public:
+	~Port()
+	{
+		if (_fd >= 0)
+			close(_fd);
+	}
+
+	bool open(const char* path, int baud)
+	{
+		_fd = ::open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+		if (_fd < 0)
+		{
+			fprintf(stderr, "cannot open %s: %s\n", path, strerror(errno));
+			return false;
+		}
+
+		// Raw 8N1 without flow control
+		termios tio;
+		if (tcgetattr(_fd, &tio) == 0)
+		{
+			cfmakeraw(&tio);
+			tio.c_cflag |= CLOCAL | CREAD;
+			tio.c_cflag &= ~CRTSCTS;
+			cfsetispeed(&tio, baudToSpeed(baud));
+			cfsetospeed(&tio, baudToSpeed(baud));
+			tcsetattr(_fd, TCSANOW, &tio);
+			tcflush(_fd, TCIOFLUSH);
+		}
+		return true;
+	}
+
+	bool send(const std::string& s)
+	{
+		size_t n = 0;
+		while (n < s.size())
+		{
+			ssize_t k = write(_fd, s.data() + n, s.size() - n);
+			if (k < 0 && errno != EAGAIN)
+				return false;
+			if (k > 0)
+				n += k;
+			else
+			{
+				pollfd p = { _fd, POLLOUT, 0 };
+				poll(&p, 1, 100);
+			}
+		}
+		return true;
+	}
+
+	// Next non-empty line, or false after the timeout
+	bool readLine(std::string& line, double timeout)
+	{
+		double deadline = now() + timeout;
+		while (true)
+		{
+			size_t e = _buf.find_first_of("\r\n");
+			while (e == 0)
+			{
+				_buf.erase(0, 1);
+				e = _buf.find_first_of("\r\n");
+			}
+			if (e != std::string::npos)
+			{
+				line = _buf.substr(0, e);
+				_buf.erase(0, e + 1);
+				return true;
+			}
+
+			double left = deadline - now();
+			if (left <= 0)
+				return false;
+			pollfd p = { _fd, POLLIN, 0 };
+			if (poll(&p, 1, (int)(left * 1000) + 1) > 0)
+			{
+				char chunk[4096];
+				ssize_t k = read(_fd, chunk, sizeof(chunk));
+				if (k > 0)
+					_buf.append(chunk, k);
+				else if (k == 0 || (errno != EAGAIN && errno != EINTR))
+					return false;
+			}
+		}
+	}
+
+private:
+	int _fd = -1;
+	std::string _buf;
+};
+
+static bool startsWith(const std::string& s, const char* prefix)
+{
+	return s.compare(0, strlen(prefix), prefix) == 0;
+}
+
+static void pingAll(Port& port, int numPings)
+{
+	std::vector<double> rtt;
+	int numLost = 0;
+	char cmd[32], ack[32];
+	std::string line;
+
+	for (int i = 1; i <= numPings; i++)
+	{
+		snprintf(cmd, sizeof(cmd), "PNG,%d\n", i);
+		snprintf(ack, sizeof(ack), ",%d", i);
+		double t0 = now();
+		if (!port.send(cmd))
+			break;
+
+		// The ack is "ack,<time>,<n>"
+		bool isAcked = false;
+		while (!isAcked && port.readLine(line, 1.0))
+		{
+			size_t n = strlen(ack);
+			isAcked = startsWith(line, "ack,") && line.size() > n && line.compare(line.size() - n, n, ack) == 0;
+		}
+		if (isAcked)
+			rtt.push_back((now() - t0) * 1e6);
+		else
+			numLost++;
+	}
+
+	if (!rtt.empty())
+	{
+		double sum = 0;
+		for (size_t i = 0; i < rtt.size(); i++)
+			sum += rtt[i];
+		std::sort(rtt.begin(), rtt.end());
+		size_t n = rtt.size();
+		printf("rtt,%zu,%.1f,%.1f,%.1f,%.1f,%.1f\n", n, sum / n, rtt[0], rtt[n / 2], rtt[std::min(n - 1, n * 99 / 100)], rtt[n - 1]);
+	}
+	printf("lost,%d\n", numLost);
+	fflush(stdout);
+}
+
+static bool runSuite(Port& port, int numIter)
+{
+	char cmd[32];
+	snprintf(cmd, sizeof(cmd), "BEN,%d\n", numIter);
+	if (!port.send(cmd))
+		return false;
+
+	// Timed messages are tagged x; give up when the board stays silent
+	std::string line;
+	double ticksPerUs = 0;
+	while (port.readLine(line, 30.0))
+	{
+		if (line == "x" || startsWith(line, "x,") || startsWith(line, "ack,"))
+			continue;
+		printf("%s\n", line.c_str());
+
+		// benchStart,<time>,<ticks per us> and filter_*,<time>,<iterations>,<mean>,...
+		double t, v, mean;
+		if (startsWith(line, "benchStart,") && sscanf(line.c_str(), "benchStart,%lf,%lf", &t, &v) == 2)
+			ticksPerUs = v;
+		size_t comma = line.find(',');
+		if (startsWith(line, "filter_") && ticksPerUs > 0 && comma != std::string::npos
+			&& sscanf(line.c_str() + comma, ",%lf,%lf,%lf", &t, &v, &mean) == 3)
+		{
+			double us = mean / ticksPerUs;
+			printf("budget_%s,%.3f,%.2f,%.2f,%.2f\n", line.substr(0, comma).c_str(), us, us * 0.1, us, us * 5);
+		}
+		fflush(stdout);
+		if (startsWith(line, "benchEnd"))
+			return true;
+	}
+	fprintf(stderr, "no benchEnd from the board\n");
+	return false;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2 || argv[1][0] == '-')
+	{
+		fprintf(stderr, "Usage: %s <device> [--baud 115200] [--pings 1000] [--iterations 1000]\n", argv[0]);
+		return 2;
+	}
+
+	int baud = 115200, numPings = 1000, numIter = 1000;
+	for (int i = 2; i + 1 < argc; i += 2)
+	{
+		std::string arg = argv[i];
+		if (arg == "--baud")
+			baud = atoi(argv[i + 1]);
+		else if (arg == "--pings")
+			numPings = atoi(argv[i + 1]);
+		else if (arg == "--iterations")
+			numIter = atoi(argv[i + 1]);
+		else
+		{
+			fprintf(stderr, "unknown option %s\n", argv[i]);
+			return 2;
+		}
+	}
+	if (baudToSpeed(baud) == 0)
+	{
+		fprintf(stderr, "unsupported baud rate\n");
+		return 2;
+	}
+
+	Port port;
+	if (!port.open(argv[1], baud))
+		return 1;
+
+	if (numPings > 0)
+		pingAll(port, numPings);
+	if (numIter > 0 && !runSuite(port, numIter))
+		return 1;
+	return 0;
+}
@@ -0,0 +1,397 @@
+/*
+svlog.cpp - Fast parser for SatellitesViewer log files.
+Released into the public domain.
+*/
+
+#include "svlog.h"
+#include "svmap.h"
+
+#include <string.h>
+#include <new>
+#include <thread>
+#include <vector>
+
+// Chunks smaller than this are not worth a thread
+static const size_t minChunkSize = 1 << 20;
+
+struct svlog_chunk
+{
+	std::vector<char> io;
+	std::vector<int64_t> sysTime;
+	std::vector<uint64_t> lineOffset;
+	std::vector<uint32_t> lineLength;
+	std::vector<uint64_t> partFirst;
+	std::vector<uint64_t> partOffset;
+	std::vector<uint32_t> partLength;
+};
+
+struct svlog_log
+{
+	const char* data;
+	size_t size;
+	bool isMapped;
+	svmap map;
+
+	svlog_chunk cols;
+};
+
+
+
+void svlog_default_options(svlog_options* opt)
+{
+	opt->tagDelimiter = ',';
+	opt->msgDelimiter = ',';
+	opt->numThreads = 0;
+}
+
+const char* svlog_error_string(int err)
+{
+	switch (err)
+	{
+		case SVLOG_OK: return "no error";
+		case SVLOG_ERR_OPEN: return "cannot open file";
+		case SVLOG_ERR_MAP: return "cannot map file into memory";
+		case SVLOG_ERR_MEMORY: return "out of memory";
+		case SVLOG_ERR_ARG: return "invalid argument";
+		case SVLOG_ERR_FORMAT: return "not a valid event store";
+		case SVLOG_ERR_TYPE: return "event type not found";
+	}
+	return "unknown error";
+}
+
+
+
+static const char* skipRun(const char* p, const char* e, char d)
+{
+	while (p < e && *p == d)
+		p++;
+	return p;
+}
+
+static const char* findChar(const char* p, const char* e, char d)
+{
+	const char* q = (const char*)memchr(p, d, e - p);
+	return q ? q : e;
+}
+
+static bool parseTime(const char* p, const char* e, int64_t* t)
+{
+	// Exactly 17 digits
+	if (e - p != 17)
+		return false;
+
+	int64_t v = 0;
+	for (; p < e; p++)
+	{
+		unsigned d = (unsigned char)*p - '0';
+		if (d > 9)
+			return false;
+		v = v * 10 + d;
+	}
+	*t = v;
+	return true;
+}
+
+static void parseLine(const char* base, const char* b, const char* e, const svlog_options& opt, svlog_chunk& c)
+{
+	c.lineOffset.push_back(b - base);
+	c.lineLength.push_back((uint32_t)(e - b));
+	c.partFirst.push_back(c.partOffset.size());
+
+	// I/O tag
+	const char* p = b;
+	const char* f = findChar(p, e, opt.tagDelimiter);
+	char io = 'N';
+	if (f - p == 1 && (*p == 'I' || *p == 'O'))
+	{
+		io = *p;
+		p = skipRun(f, e, opt.tagDelimiter);
+		f = findChar(p, e, opt.tagDelimiter);
+	}
+	c.io.push_back(io);
+
+	// System time tag
+	int64_t t;
+	if (parseTime(p, f, &t))
+		p = skipRun(f, e, opt.tagDelimiter);
+	else
+		t = SVLOG_NO_TIME;
+	c.sysTime.push_back(t);
+
+	// Event parts. Like strsplit, a leading or trailing delimiter gives an empty part.
+	for (;;)
+	{
+		f = findChar(p, e, opt.msgDelimiter);
+		c.partOffset.push_back(p - base);
+		c.partLength.push_back((uint32_t)(f - p));
+		if (f == e)
+			break;
+		p = skipRun(f, e, opt.msgDelimiter);
+	}
+}
+
+static void parseChunk(const char* base, const char* b, const char* e, const svlog_options& opt, svlog_chunk& c)
+{
+	// Reserve by a rough guess of 40 bytes per line
+	size_t n = (e - b) / 40 + 16;
+	c.io.reserve(n);
+	c.sysTime.reserve(n);
+	c.lineOffset.reserve(n);
+	c.lineLength.reserve(n);
+	c.partFirst.reserve(n);
+	c.partOffset.reserve(n * 4);
+	c.partLength.reserve(n * 4);
+
+	while (b < e)
+	{
+		const char* lf = findChar(b, e, '\n');
+
+		// A \r also ends a line; empty lines are dropped
+		while (b < lf)
+		{
+			const char* cr = findChar(b, lf, '\r');
+			if (cr > b)
+				parseLine(base, b, cr, opt, c);
+			b = cr + 1;
+		}
+		b = lf + 1;
+	}
+}
+
+template <typename T>
+static void append(std::vector<T>& dst, const std::vector<T>& src)
+{
+	dst.insert(dst.end(), src.begin(), src.end());
+}
+
+static int parse(svlog_log* log, const svlog_options* optIn)
+{
+	svlog_options opt;
+	if (optIn)
+		opt = *optIn;
+	else
+		svlog_default_options(&opt);
+
+	const char* data = log->data;
+	const char* end = data + log->size;
+
+	// Split the text into chunks at line boundaries
+	size_t numChunks = opt.numThreads > 0 ? opt.numThreads : std::thread::hardware_concurrency();
+	numChunks = numChunks < 1 ? 1 : numChunks;
+	if (log->size / numChunks < minChunkSize)
+		numChunks = log->size / minChunkSize + 1;
+
+	std::vector<const char*> bounds(numChunks + 1, end);
+	bounds[0] = data;
+	for (size_t i = 1; i < numChunks; i++)
+	{
+		const char* p = data + log->size / numChunks * i;
+		p = p < bounds[i-1] ? bounds[i-1] : p;
+		p = findChar(p, end, '\n');
+		bounds[i] = p < end ? p + 1 : end;
+	}
+
+	try
+	{
+		// Parse chunks in parallel
+		std::vector<svlog_chunk> chunks(numChunks);
+		std::vector<std::thread> workers;
+		for (size_t i = 1; i < numChunks; i++)
+			workers.push_back(std::thread(parseChunk, data, bounds[i], bounds[i+1], std::cref(opt), std::ref(chunks[i])));
+		parseChunk(data, bounds[0], bounds[1], opt, chunks[0]);
+		for (size_t i = 0; i < workers.size(); i++)
+			workers[i].join();
+
+		// Concatenate columns, shifting part indices by the parts of previous chunks
+		svlog_chunk& cols = log->cols;
+		if (numChunks == 1)
+		{
+			cols.io.swap(chunks[0].io);
+			cols.sysTime.swap(chunks[0].sysTime);
+			cols.lineOffset.swap(chunks[0].lineOffset);
+			cols.lineLength.swap(chunks[0].lineLength);
+			cols.partFirst.swap(chunks[0].partFirst);
+			cols.partOffset.swap(chunks[0].partOffset);
+			cols.partLength.swap(chunks[0].partLength);
+		}
+		else
+		{
+			size_t numLines = 0, numParts = 0;
+			for (size_t i = 0; i < numChunks; i++)
+			{
+				numLines += chunks[i].io.size();
+				numParts += chunks[i].partOffset.size();
+			}
+			cols.io.reserve(numLines);
+			cols.sysTime.reserve(numLines);
+			cols.lineOffset.reserve(numLines);
+			cols.lineLength.reserve(numLines);
+			cols.partFirst.reserve(numLines + 1);
+			cols.partOffset.reserve(numParts);
+			cols.partLength.reserve(numParts);
+
+			for (size_t i = 0; i < numChunks; i++)
+			{
+				svlog_chunk& c = chunks[i];
+				uint64_t shift = cols.partOffset.size();
+				for (size_t k = 0; k < c.partFirst.size(); k++)
+					cols.partFirst.push_back(c.partFirst[k] + shift);
+
+				append(cols.io, c.io);
+				append(cols.sysTime, c.sysTime);
+				append(cols.lineOffset, c.lineOffset);
+				append(cols.lineLength, c.lineLength);
+				append(cols.partOffset, c.partOffset);
+				append(cols.partLength, c.partLength);
+				c = svlog_chunk();
+			}
+		}
+		cols.partFirst.push_back(cols.partOffset.size());
+	}
+	catch (std::bad_alloc&)
+	{
+		return SVLOG_ERR_MEMORY;
+	}
+
+	return SVLOG_OK;
+}
+
+
+
+int svlog_parse_buffer(const char* buf, size_t len, const svlog_options* opt, svlog_log** out)
+{
+	if (out == NULL || (buf == NULL && len > 0))
+		return SVLOG_ERR_ARG;
+
+	svlog_log* log = new (std::nothrow) svlog_log();
+	if (log == NULL)
+		return SVLOG_ERR_MEMORY;
+
+	log->data = buf;
+	log->size = len;
+	log->isMapped = false;
+
+	int err = parse(log, opt);
+	if (err != SVLOG_OK)
+	{
+		svlog_close(log);
+		return err;
+	}
+
+	*out = log;
+	return SVLOG_OK;
+}
+
+int svlog_open_file(const char* path, const svlog_options* opt, svlog_log** out)
+{
+	if (out == NULL || path == NULL)
+		return SVLOG_ERR_ARG;
+
+	svlog_log* log = new (std::nothrow) svlog_log();
+	if (log == NULL)
+		return SVLOG_ERR_MEMORY;
+
+	log->data = NULL;
+	log->size = 0;
+	log->isMapped = false;
+
+	int err = svmap_open(path, &log->map);
+	if (err != SVLOG_OK)
+	{
+		delete log;
+		return err;
+	}
+	log->data = log->map.data;
+	log->size = log->map.size;
+	log->isMapped = true;
+
+	err = parse(log, opt);
+	if (err != SVLOG_OK)
+	{
+		svlog_close(log);
+		return err;
+	}
+
+	*out = log;
+	return SVLOG_OK;
+}
+
+void svlog_close(svlog_log* log)
+{
+	if (log == NULL)
+		return;
+
+	if (log->isMapped)
+		svmap_close(&log->map);
+
+	delete log;
+}
+
+
+
+size_t svlog_num_lines(const svlog_log* log)
+{
+	return log->cols.io.size();
+}
+
+size_t svlog_num_parts(const svlog_log* log)
+{
+	return log->cols.partOffset.size();
+}
+
+const char* svlog_data(const svlog_log* log)
+{
+	return log->data;
+}
+
+size_t svlog_data_size(const svlog_log* log)
+{
+	return log->size;
+}
+
+const char* svlog_io_types(const svlog_log* log)
+{
+	return log->cols.io.data();
+}
+
+const int64_t* svlog_sys_times(const svlog_log* log)
+{
+	return log->cols.sysTime.data();
+}
+
+const uint64_t* svlog_line_offsets(const svlog_log* log)
+{
+	return log->cols.lineOffset.data();
+}
+
+const uint32_t* svlog_line_lengths(const svlog_log* log)
+{
+	return log->cols.lineLength.data();
+}
+
+const uint64_t* svlog_part_first(const svlog_log* log)
+{
+	return log->cols.partFirst.data();
+}
+
+const uint64_t* svlog_part_offsets(const svlog_log* log)
+{
+	return log->cols.partOffset.data();
+}
+
+const uint32_t* svlog_part_lengths(const svlog_log* log)
+{
+	return log->cols.partLength.data();
+}
+
+void svlog_split_time(int64_t t, int* comps)
+{
+	// yyyyMMddHHmmssSSS -> {y, M, d, H, m, s, ms}
+	comps[6] = (int)(t % 1000); t /= 1000;
+	comps[5] = (int)(t % 100); t /= 100;
+	comps[4] = (int)(t % 100); t /= 100;
+	comps[3] = (int)(t % 100); t /= 100;
+	comps[2] = (int)(t % 100); t /= 100;
+	comps[1] = (int)(t % 100); t /= 100;
+	comps[0] = (int)t;
+}
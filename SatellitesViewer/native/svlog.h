@@ -0,0 +1,84 @@
+/*
+svlog.h - Fast parser for SatellitesViewer log files.
+Released into the public domain.
+
+A log is memory-mapped (or taken from a caller's buffer), split into chunks at line
+boundaries and parsed by several threads into typed columns. Parsing follows
+Satellites.StringToLines and Satellites.LineParts: lines are delimited by \n or \r
+with empty lines removed, an optional I/O tag and an optional 17-digit system time
+(yyyyMMddHHmmssSSS) are taken off the front, and the rest is split into event parts.
+Consecutive delimiters count as one, like strsplit.
+
+The interface is plain C so that it can be called from a MEX function or other
+languages. Part strings are not copied; offsets refer to svlog_data().
+
+Build the command line tool
+	g++ -O2 -std=c++11 -pthread svlog.cpp svmap.cpp svlog_cli.cpp -o svlog
+Build the MEX function (or call Satellites.BuildNative in MATLAB)
+	mex -O svlog.cpp svmap.cpp svlog_mex.cpp -outdir ..
+*/
+
+#ifndef svlog_h
+#define svlog_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Error codes
+#define SVLOG_OK			0
+#define SVLOG_ERR_OPEN		1
+#define SVLOG_ERR_MAP		2
+#define SVLOG_ERR_MEMORY	3
+#define SVLOG_ERR_ARG		4
+#define SVLOG_ERR_FORMAT	5
+#define SVLOG_ERR_TYPE		6
+
+// System time used for lines without a time tag (0001-01-01 00:00:00.000)
+#define SVLOG_NO_TIME		10101000000000LL
+
+typedef struct svlog_log svlog_log;
+
+typedef struct
+{
+	char tagDelimiter;		// delimiter of I/O and system time tags, default ','
+	char msgDelimiter;		// delimiter of event parts, default ','
+	int numThreads;			// 0 uses all hardware threads
+} svlog_options;
+
+void svlog_default_options(svlog_options* opt);
+
+// Parsing. opt can be NULL for defaults. A buffer passed to svlog_parse_buffer must
+// stay valid until the log is closed.
+int svlog_open_file(const char* path, const svlog_options* opt, svlog_log** out);
+int svlog_parse_buffer(const char* buf, size_t len, const svlog_options* opt, svlog_log** out);
+void svlog_close(svlog_log* log);
+const char* svlog_error_string(int err);
+
+// Columns. Each per-line array has svlog_num_lines elements.
+size_t svlog_num_lines(const svlog_log* log);
+size_t svlog_num_parts(const svlog_log* log);
+const char* svlog_data(const svlog_log* log);
+size_t svlog_data_size(const svlog_log* log);
+
+const char* svlog_io_types(const svlog_log* log);			// 'I', 'O' or 'N'
+const int64_t* svlog_sys_times(const svlog_log* log);		// yyyyMMddHHmmssSSS as an integer
+const uint64_t* svlog_line_offsets(const svlog_log* log);
+const uint32_t* svlog_line_lengths(const svlog_log* log);
+
+// Parts of line i are part_first[i] to part_first[i+1]-1 (part_first has numLines+1 elements)
+const uint64_t* svlog_part_first(const svlog_log* log);
+const uint64_t* svlog_part_offsets(const svlog_log* log);
+const uint32_t* svlog_part_lengths(const svlog_log* log);
+
+// Break a system time into year, month, day, hour, minute, second and millisecond
+void svlog_split_time(int64_t t, int* comps);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,224 @@
+/*
+svlog_cli.cpp - Command line tool for parsing and benchmarking SatellitesViewer logs.
+Released into the public domain.
+
+Usage
+	svlog <log.txt> [-j threads] [-t tagDelimiter] [-m msgDelimiter] [-o out.tsv]
+		Parse a log and print a summary. With -o, write one row per line with the
+		I/O tag, system time and event parts separated by tabs.
+	svlog --bench [numLines] [path]
+		Write a synthetic log (10,000,000 lines by default) and time parsing it with
+		one thread and with all threads against a plain read of the file.
+*/
+
+#include "svlog.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+static double now()
+{
+	using namespace std::chrono;
+	return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+static void printSummary(const svlog_log* log, double dt)
+{
+	size_t n = svlog_num_lines(log);
+	const char* io = svlog_io_types(log);
+	const int64_t* t = svlog_sys_times(log);
+
+	size_t numIn = 0, numOut = 0, numTimed = 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		numIn += io[i] == 'I';
+		numOut += io[i] == 'O';
+		numTimed += t[i] != SVLOG_NO_TIME;
+	}
+
+	double mb = svlog_data_size(log) / 1e6;
+	printf("%zu lines (%zu in, %zu out, %zu with system time), %zu parts\n",
+		n, numIn, numOut, numTimed, svlog_num_parts(log));
+	printf("%.1f MB in %.3f s (%.0f MB/s, %.1f M lines/s)\n", mb, dt, mb / dt, n / dt / 1e6);
+}
+
+static int writeColumns(const svlog_log* log, const char* path)
+{
+	FILE* f = fopen(path, "wb");
+	if (f == NULL)
+		return -1;
+
+	const char* data = svlog_data(log);
+	const char* io = svlog_io_types(log);
+	const int64_t* t = svlog_sys_times(log);
+	const uint64_t* first = svlog_part_first(log);
+	const uint64_t* off = svlog_part_offsets(log);
+	const uint32_t* len = svlog_part_lengths(log);
+
+	for (size_t i = 0; i < svlog_num_lines(log); i++)
+	{
+		fprintf(f, "%c\t%017lld", io[i], (long long)t[i]);
+		for (uint64_t k = first[i]; k < first[i+1]; k++)
+		{
+			fputc('\t', f);
+			fwrite(data + off[k], 1, len[k], f);
+		}
+		fputc('\n', f);
+	}
+
+	fclose(f);
+	return 0;
+}
+
+static int writeSynthetic(const char* path, size_t numLines)
+{
+	// Lines resemble a behavioral session: mostly input events with a timestamp and
+	// values, some output commands and a few lines without tags
+	static const char* events[] = { "lick", "water", "trialStart", "cue", "pos", "trialEnd" };
+
+	FILE* f = fopen(path, "wb");
+	if (f == NULL)
+		return -1;
+
+	std::vector<char> buf(1 << 20);
+	setvbuf(f, buf.data(), _IOFBF, buf.size());
+
+	unsigned long long ms = 0;
+	uint32_t rng = 2463534242u;
+	for (size_t i = 0; i < numLines; i++)
+	{
+		rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+		ms += 1 + rng % 50;
+
+		unsigned long long s = ms / 1000;
+		unsigned long long sysTime = 20170301000000000ULL
+			+ (s / 3600 % 24) * 10000000ULL + (s / 60 % 60) * 100000ULL + (s % 60) * 1000ULL + ms % 1000;
+
+		switch (rng % 16)
+		{
+			case 0:
+				fprintf(f, "O,%017llu,rw,%u\n", sysTime, rng % 100);
+				break;
+			case 1:
+				fprintf(f, "%s,%llu\n", events[rng % 6], ms);
+				break;
+			default:
+				fprintf(f, "I,%017llu,%s,%llu,%u,%d\n", sysTime, events[rng % 6], ms, rng % 1000, (int)(rng % 201) - 100);
+		}
+	}
+
+	fclose(f);
+	return 0;
+}
+
+static double timeRead(const char* path)
+{
+	// Plain sequential read of the file as a reference for disk speed
+	FILE* f = fopen(path, "rb");
+	if (f == NULL)
+		return 0;
+
+	std::vector<char> buf(1 << 22);
+	double t0 = now();
+	while (fread(buf.data(), 1, buf.size(), f) == buf.size());
+	double dt = now() - t0;
+	fclose(f);
+	return dt;
+}
+
+static int bench(size_t numLines, const char* path)
+{
+	printf("Writing %zu lines to %s\n", numLines, path);
+	if (writeSynthetic(path, numLines) != 0)
+	{
+		fprintf(stderr, "Cannot write %s\n", path);
+		return 1;
+	}
+
+	double dtRead = timeRead(path);
+
+	int numThreads[] = { 1, 0 };
+	for (int k = 0; k < 2; k++)
+	{
+		svlog_options opt;
+		svlog_default_options(&opt);
+		opt.numThreads = numThreads[k];
+
+		svlog_log* log = NULL;
+		double t0 = now();
+		int err = svlog_open_file(path, &opt, &log);
+		double dt = now() - t0;
+		if (err != SVLOG_OK)
+		{
+			fprintf(stderr, "%s\n", svlog_error_string(err));
+			return 1;
+		}
+
+		unsigned n = numThreads[k] ? numThreads[k] : std::thread::hardware_concurrency();
+		printf("\n%u thread(s)\n", n);
+		printSummary(log, dt);
+		svlog_close(log);
+	}
+
+	printf("\nPlain read: %.3f s\n", dtRead);
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		fprintf(stderr,
+			"Usage: svlog <log.txt> [-j threads] [-t tagDelimiter] [-m msgDelimiter] [-o out.tsv]\n"
+			"       svlog --bench [numLines] [path]\n");
+		return 2;
+	}
+
+	if (strcmp(argv[1], "--bench") == 0)
+	{
+		size_t numLines = argc > 2 ? strtoull(argv[2], NULL, 10) : 10000000;
+		return bench(numLines, argc > 3 ? argv[3] : "svlog_bench.txt");
+	}
+
+	svlog_options opt;
+	svlog_default_options(&opt);
+	const char* outPath = NULL;
+
+	for (int i = 2; i + 1 < argc; i += 2)
+	{
+		if (strcmp(argv[i], "-j") == 0)
+			opt.numThreads = atoi(argv[i+1]);
+		else if (strcmp(argv[i], "-t") == 0)
+			opt.tagDelimiter = argv[i+1][0];
+		else if (strcmp(argv[i], "-m") == 0)
+			opt.msgDelimiter = argv[i+1][0];
+		else if (strcmp(argv[i], "-o") == 0)
+			outPath = argv[i+1];
+	}
+
+	svlog_log* log = NULL;
+	double t0 = now();
+	int err = svlog_open_file(argv[1], &opt, &log);
+	double dt = now() - t0;
+	if (err != SVLOG_OK)
+	{
+		fprintf(stderr, "%s: %s\n", argv[1], svlog_error_string(err));
+		return 1;
+	}
+
+	printSummary(log, dt);
+
+	if (outPath && writeColumns(log, outPath) != 0)
+	{
+		fprintf(stderr, "Cannot write %s\n", outPath);
+		svlog_close(log);
+		return 1;
+	}
+
+	svlog_close(log);
+	return 0;
+}
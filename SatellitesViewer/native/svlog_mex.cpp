@@ -0,0 +1,125 @@
+/*
+svlog_mex.cpp - MEX gateway to the native SatellitesViewer log parser.
+Released into the public domain.
+
+	[ioType, sysTime, eventParts, txtLines] = svlog_mex('file', svPath, tagDelimiter, msgDelimiter)
+	[ioType, sysTime, eventParts, txtLines] = svlog_mex('text', txtStr, tagDelimiter, msgDelimiter)
+
+ioType is a [nLine,1] char array, sysTime a [nLine,7] array of date and time components
+(year, month, day, hour, minute, second, millisecond) for datetime, eventParts a [nLine,1]
+cell array of [1,nPart] cell arrays of strings and txtLines a [nLine,1] cell array of
+lines. Use Satellites.ReadLog or Satellites.LineParts rather than calling this directly.
+
+Build with Satellites.BuildNative, or
+	mex -O svlog.cpp svmap.cpp svlog_mex.cpp -outdir ..
+*/
+
+#include "mex.h"
+#include "svlog.h"
+
+#include <string.h>
+
+static mxArray* makeString(const char* s, size_t len)
+{
+	// Characters are copied byte by byte, which is exact for ASCII logs
+	mwSize dims[2] = { 1, (mwSize)len };
+	mxArray* a = mxCreateCharArray(2, dims);
+	mxChar* c = mxGetChars(a);
+	for (size_t i = 0; i < len; i++)
+		c[i] = (unsigned char)s[i];
+	return a;
+}
+
+static char getDelimiter(const mxArray* a)
+{
+	if (!mxIsChar(a) || mxGetNumberOfElements(a) != 1)
+		mexErrMsgIdAndTxt("svlog:delimiter", "Delimiters must be single characters.");
+	return (char)mxGetChars(a)[0];
+}
+
+void mexFunction(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[])
+{
+	if (nrhs < 2 || !mxIsChar(prhs[0]) || !mxIsChar(prhs[1]))
+		mexErrMsgIdAndTxt("svlog:input", "Usage: svlog_mex('file'|'text', src, tagDelimiter, msgDelimiter)");
+
+	svlog_options opt;
+	svlog_default_options(&opt);
+	if (nrhs > 2)
+		opt.tagDelimiter = getDelimiter(prhs[2]);
+	if (nrhs > 3)
+		opt.msgDelimiter = getDelimiter(prhs[3]);
+
+	char* mode = mxArrayToString(prhs[0]);
+	char* src = mxArrayToUTF8String(prhs[1]);
+	bool isFile = strcmp(mode, "file") == 0;
+	mxFree(mode);
+
+	// Text input is converted to UTF-8 and must outlive the parsed log
+	svlog_log* log = NULL;
+	int err;
+	if (isFile)
+		err = svlog_open_file(src, &opt, &log);
+	else
+		err = svlog_parse_buffer(src, strlen(src), &opt, &log);
+
+	if (err != SVLOG_OK)
+	{
+		mxFree(src);
+		mexErrMsgIdAndTxt("svlog:parse", "svlog: %s", svlog_error_string(err));
+	}
+
+	size_t n = svlog_num_lines(log);
+	const char* data = svlog_data(log);
+
+	// I/O tags
+	mwSize dims[2] = { (mwSize)n, 1 };
+	plhs[0] = mxCreateCharArray(2, dims);
+	mxChar* io = mxGetChars(plhs[0]);
+	const char* ioSrc = svlog_io_types(log);
+	for (size_t i = 0; i < n; i++)
+		io[i] = ioSrc[i];
+
+	// System time components in column-major order
+	if (nlhs > 1)
+	{
+		plhs[1] = mxCreateDoubleMatrix(n, 7, mxREAL);
+		double* tc = mxGetPr(plhs[1]);
+		const int64_t* t = svlog_sys_times(log);
+		int comps[7];
+		for (size_t i = 0; i < n; i++)
+		{
+			svlog_split_time(t[i], comps);
+			for (int k = 0; k < 7; k++)
+				tc[i + k * n] = comps[k];
+		}
+	}
+
+	// Event parts
+	if (nlhs > 2)
+	{
+		plhs[2] = mxCreateCellMatrix(n, 1);
+		const uint64_t* first = svlog_part_first(log);
+		const uint64_t* off = svlog_part_offsets(log);
+		const uint32_t* len = svlog_part_lengths(log);
+		for (size_t i = 0; i < n; i++)
+		{
+			mxArray* parts = mxCreateCellMatrix(1, first[i+1] - first[i]);
+			for (uint64_t k = first[i]; k < first[i+1]; k++)
+				mxSetCell(parts, k - first[i], makeString(data + off[k], len[k]));
+			mxSetCell(plhs[2], i, parts);
+		}
+	}
+
+	// Original lines
+	if (nlhs > 3)
+	{
+		plhs[3] = mxCreateCellMatrix(n, 1);
+		const uint64_t* off = svlog_line_offsets(log);
+		const uint32_t* len = svlog_line_lengths(log);
+		for (size_t i = 0; i < n; i++)
+			mxSetCell(plhs[3], i, makeString(data + off[i], len[i]));
+	}
+
+	svlog_close(log);
+	mxFree(src);
+}
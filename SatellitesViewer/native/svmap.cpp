@@ -0,0 +1,96 @@
+/*
+svmap.cpp - Read-only memory mapping of files for the native SatellitesViewer tools.
+Released into the public domain.
+*/
+
+#include "svmap.h"
+#include "svlog.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+int svmap_open(const char* path, svmap* m)
+{
+	m->data = NULL;
+	m->size = 0;
+
+#if defined(_WIN32)
+	m->hMap = NULL;
+	m->hFile = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+		OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (m->hFile == INVALID_HANDLE_VALUE)
+	{
+		m->hFile = NULL;
+		return SVLOG_ERR_OPEN;
+	}
+
+	LARGE_INTEGER size;
+	GetFileSizeEx(m->hFile, &size);
+	m->size = (size_t)size.QuadPart;
+
+	if (m->size > 0)
+	{
+		m->hMap = CreateFileMappingA(m->hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+		m->data = m->hMap ? (const char*)MapViewOfFile(m->hMap, FILE_MAP_READ, 0, 0, 0) : NULL;
+		if (m->data == NULL)
+		{
+			svmap_close(m);
+			return SVLOG_ERR_MAP;
+		}
+	}
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return SVLOG_ERR_OPEN;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		close(fd);
+		return SVLOG_ERR_OPEN;
+	}
+	m->size = st.st_size;
+
+	if (m->size > 0)
+	{
+		void* p = mmap(NULL, m->size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p == MAP_FAILED)
+		{
+			close(fd);
+			m->size = 0;
+			return SVLOG_ERR_MAP;
+		}
+		madvise(p, m->size, MADV_SEQUENTIAL);
+		m->data = (const char*)p;
+	}
+	close(fd);
+#endif
+
+	return SVLOG_OK;
+}
+
+void svmap_close(svmap* m)
+{
+#if defined(_WIN32)
+	if (m->data)
+		UnmapViewOfFile(m->data);
+	if (m->hMap)
+		CloseHandle(m->hMap);
+	if (m->hFile)
+		CloseHandle(m->hFile);
+	m->hMap = NULL;
+	m->hFile = NULL;
+#else
+	if (m->data)
+		munmap((void*)m->data, m->size);
+#endif
+
+	m->data = NULL;
+	m->size = 0;
+}
@@ -0,0 +1,25 @@
+/*
+svmap.h - Read-only memory mapping of files for the native SatellitesViewer tools.
+Released into the public domain.
+*/
+
+#ifndef svmap_h
+#define svmap_h
+
+#include <stddef.h>
+
+struct svmap
+{
+	const char* data;
+	size_t size;
+#if defined(_WIN32)
+	void* hFile;
+	void* hMap;
+#endif
+};
+
+// Returns an SVLOG_* error code. Empty files succeed with data set to NULL.
+int svmap_open(const char* path, svmap* m);
+void svmap_close(svmap* m);
+
+#endif
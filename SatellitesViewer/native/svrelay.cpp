@@ -0,0 +1,1094 @@
+/*
+svrelay.cpp - Serial/UDP relay for SatellitesViewer channels (Linux).
+Released into the public domain.
+
+Runs the Server or Client mode of a SatellitesViewer Channel without MATLAB in the loop.
+Lines are framed like MSerial in Transparent mode (\n or \r terminate a line, empty lines
+are dropped) and sent over UDP one line per datagram with a trailing \n, as MUdp does. In
+server mode, lines from the serial device are sent to every client (and an optional
+multicast group) with a single encode and one sendmmsg call; lines received on the local
+port are relayed to the device. In client mode, lines typed on stdin are sent to the
+server and lines from the server are printed on stdout.
+
+The log uses the format of SatellitesViewerChannel.SaveLog: an optional I/O tag and an
+optional system time (yyyyMMddHHmmssSSS, local time) before each message. Every queue is
+bounded and overflow is counted rather than blocking the relay; counters are printed on
+exit, on SIGUSR1 and every --stats seconds.
+
+Usage
+	svrelay server --serial <device> [--baud 115200] --listen <port> --client <host:port> [...]
+		[--multicast <group:port>] [--ttl 1] [common options]
+	svrelay client --server <host:port> --listen <port> [common options]
+	svrelay bench [numLines] [numClients]
+
+Common options
+	--log <file>			append messages to a log file
+	--log-outputs			also log outgoing messages
+	--no-io-tag, --no-time-tag	omit tags in the log
+	--tag-delimiter <c>		delimiter after tags, default ','
+	--prefix <str>			prefix added to outgoing messages (msgPrefix of a Channel)
+	--queue <n>				queue length in lines per destination, default 1000
+	--stats <sec>			print counters periodically
+
+The bench command runs a relay between a pseudo terminal pair and loopback UDP clients
+and reports latency and throughput in both directions.
+
+Build
+	g++ -O2 -std=c++11 -pthread svrelay.cpp -o svrelay
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+struct RelayConfig
+{
+	bool isServer = true;
+	std::string serialPath;
+	int baud = 115200;
+	int listenPort = 0;
+	std::vector<std::string> clients;
+	std::string multicast;
+	int ttl = 1;
+	std::string server;
+
+	std::string logPath;
+	bool isLogOutputs = false;
+	bool isTagIO = true;
+	bool isTagTime = true;
+	char tagDelimiter = ',';
+	std::string prefix;
+
+	size_t queueSize = 1000;
+	size_t maxLineLength = 4096;
+	int statsInterval = 0;
+	bool isHandleSignals = false;
+};
+
+struct RelayStats
+{
+	unsigned long long deviceRxLines = 0;
+	unsigned long long deviceTxLines = 0;
+	unsigned long long deviceTxDrops = 0;
+	unsigned long long netRxDatagrams = 0;
+	unsigned long long netTxDatagrams = 0;
+	unsigned long long netTxDrops = 0;
+	unsigned long long netTxErrors = 0;
+	unsigned long long truncatedLines = 0;
+	unsigned long long logDrops = 0;
+};
+
+class Relay
+{
+public:
+	Relay(const RelayConfig& cfg) : _cfg(cfg) {}
+	~Relay();
+
+	bool open(std::string& err);
+	void run();
+	void stop();
+	int getLocalPort();
+	void printStats(FILE* f);
+
+	RelayStats stats;
+
+private:
+	struct Dest
+	{
+		sockaddr_in addr;
+		std::deque<std::string> queue;
+	};
+
+	RelayConfig _cfg;
+	int _ep = -1;
+	int _devIn = -1;
+	int _devOut = -1;
+	int _udp = -1;
+	int _stopFd = -1;
+	int _timerFd = -1;
+	int _sigFd = -1;
+	int _logFd = -1;
+	bool _isRunning = false;
+	bool _isWaitingDev = false;
+	bool _isWaitingNet = false;
+
+	std::vector<Dest> _dests;
+	std::string _devRx;
+	std::deque<std::string> _devTx;
+	size_t _devTxOffset = 0;
+	std::string _log;
+
+	time_t _lastSec = -1;
+	char _timeTag[32];
+
+	bool openSerial(std::string& err);
+	bool addDest(const std::string& hostPort, std::string& err);
+	void watch(int fd, uint32_t events, bool isAdd);
+
+	void onDeviceReadable();
+	void onNetReadable();
+	void onDeviceLine(const char* s, size_t n);
+	void onNetLine(const char* s, size_t n);
+	void fanOut(const std::string& line);
+	void queueDevice(const std::string& line);
+	void flushDevice();
+	void flushNet();
+	void logLine(char io, const char* s, size_t n);
+	void flushLog();
+};
+
+static const size_t logBufferLimit = 8 << 20;
+
+
+
+// Setup
+
+static bool parseHostPort(const std::string& s, sockaddr_in& addr)
+{
+	size_t colon = s.rfind(':');
+	if (colon == std::string::npos)
+		return false;
+
+	addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;
+
+	addrinfo* res = NULL;
+	if (getaddrinfo(s.substr(0, colon).c_str(), s.substr(colon + 1).c_str(), &hints, &res) != 0)
+		return false;
+
+	memcpy(&addr, res->ai_addr, sizeof(addr));
+	freeaddrinfo(res);
+	return true;
+}
+
+static speed_t baudToSpeed(int baud)
+{
+	switch (baud)
+	{
+		case 9600: return B9600;
+		case 19200: return B19200;
+		case 38400: return B38400;
+		case 57600: return B57600;
+		case 115200: return B115200;
+		case 230400: return B230400;
+		case 460800: return B460800;
+		case 921600: return B921600;
+	}
+	return 0;
+}
+
+static void setNonBlocking(int fd)
+{
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+Relay::~Relay()
+{
+	flushLog();
+
+	int fds[] = { _ep, _udp, _stopFd, _timerFd, _sigFd, _logFd };
+	for (size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); i++)
+		if (fds[i] >= 0)
+			close(fds[i]);
+
+	if (_cfg.isServer && _devIn >= 0)
+		close(_devIn);
+}
+
+bool Relay::openSerial(std::string& err)
+{
+	_devIn = ::open(_cfg.serialPath.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+	if (_devIn < 0)
+	{
+		err = "cannot open " + _cfg.serialPath + ": " + strerror(errno);
+		return false;
+	}
+	_devOut = _devIn;
+
+	speed_t speed = baudToSpeed(_cfg.baud);
+	if (speed == 0)
+	{
+		err = "unsupported baud rate";
+		return false;
+	}
+
+	// Raw 8N1 without flow control
+	termios tio;
+	if (tcgetattr(_devIn, &tio) == 0)
+	{
+		cfmakeraw(&tio);
+		tio.c_cflag |= CLOCAL | CREAD;
+		tio.c_cflag &= ~CRTSCTS;
+		tio.c_cc[VMIN] = 1;
+		tio.c_cc[VTIME] = 0;
+		cfsetispeed(&tio, speed);
+		cfsetospeed(&tio, speed);
+		tcsetattr(_devIn, TCSANOW, &tio);
+		tcflush(_devIn, TCIFLUSH);
+	}
+
+	return true;
+}
+
+bool Relay::addDest(const std::string& hostPort, std::string& err)
+{
+	Dest d;
+	if (!parseHostPort(hostPort, d.addr))
+	{
+		err = "cannot resolve " + hostPort;
+		return false;
+	}
+	_dests.push_back(d);
+	return true;
+}
+
+bool Relay::open(std::string& err)
+{
+	_ep = epoll_create1(EPOLL_CLOEXEC);
+	_stopFd = eventfd(0, EFD_NONBLOCK);
+
+	// Device side: a serial port in server mode, stdin/stdout in client mode
+	if (_cfg.isServer)
+	{
+		if (!openSerial(err))
+			return false;
+	}
+	else
+	{
+		_devIn = STDIN_FILENO;
+		_devOut = STDOUT_FILENO;
+		setNonBlocking(_devOut);
+	}
+
+	// Network side
+	_udp = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+	int bufSize = 1 << 20;
+	setsockopt(_udp, SOL_SOCKET, SO_RCVBUF, &bufSize, sizeof(bufSize));
+	setsockopt(_udp, SOL_SOCKET, SO_SNDBUF, &bufSize, sizeof(bufSize));
+
+	sockaddr_in local;
+	memset(&local, 0, sizeof(local));
+	local.sin_family = AF_INET;
+	local.sin_addr.s_addr = htonl(INADDR_ANY);
+	local.sin_port = htons(_cfg.listenPort);
+	if (bind(_udp, (sockaddr*)&local, sizeof(local)) != 0)
+	{
+		err = std::string("cannot bind UDP port: ") + strerror(errno);
+		return false;
+	}
+
+	if (_cfg.isServer)
+	{
+		for (size_t i = 0; i < _cfg.clients.size(); i++)
+			if (!addDest(_cfg.clients[i], err))
+				return false;
+
+		if (!_cfg.multicast.empty())
+		{
+			if (!addDest(_cfg.multicast, err))
+				return false;
+			unsigned char ttl = _cfg.ttl;
+			setsockopt(_udp, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+		}
+	}
+	else if (!addDest(_cfg.server, err))
+		return false;
+
+	// Log
+	if (!_cfg.logPath.empty())
+	{
+		_logFd = ::open(_cfg.logPath.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+		if (_logFd < 0)
+		{
+			err = "cannot open " + _cfg.logPath + ": " + strerror(errno);
+			return false;
+		}
+	}
+
+	// Periodic flush of the log and optional counters
+	_timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+	itimerspec its;
+	memset(&its, 0, sizeof(its));
+	its.it_interval.tv_nsec = 200000000;
+	its.it_value.tv_nsec = 200000000;
+	timerfd_settime(_timerFd, 0, &its, NULL);
+
+	if (_cfg.isHandleSignals)
+	{
+		sigset_t mask;
+		sigemptyset(&mask);
+		sigaddset(&mask, SIGINT);
+		sigaddset(&mask, SIGTERM);
+		sigaddset(&mask, SIGUSR1);
+		sigprocmask(SIG_BLOCK, &mask, NULL);
+		_sigFd = signalfd(-1, &mask, SFD_NONBLOCK);
+		watch(_sigFd, EPOLLIN, true);
+	}
+
+	watch(_devIn, EPOLLIN, true);
+	watch(_udp, EPOLLIN, true);
+	watch(_stopFd, EPOLLIN, true);
+	watch(_timerFd, EPOLLIN, true);
+
+	// In client mode stdout is watched separately from stdin when it has a backlog
+	return true;
+}
+
+void Relay::watch(int fd, uint32_t events, bool isAdd)
+{
+	epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.fd = fd;
+	epoll_ctl(_ep, isAdd ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, fd, &ev);
+}
+
+int Relay::getLocalPort()
+{
+	sockaddr_in a;
+	socklen_t len = sizeof(a);
+	getsockname(_udp, (sockaddr*)&a, &len);
+	return ntohs(a.sin_port);
+}
+
+void Relay::stop()
+{
+	uint64_t one = 1;
+	if (write(_stopFd, &one, sizeof(one)) < 0)
+		perror("svrelay");
+}
+
+
+
+// Event loop
+
+void Relay::run()
+{
+	_isRunning = true;
+	unsigned long ticks = 0;
+	epoll_event events[16];
+
+	while (_isRunning)
+	{
+		int n = epoll_wait(_ep, events, 16, -1);
+		if (n < 0 && errno != EINTR)
+			break;
+
+		for (int i = 0; i < n; i++)
+		{
+			int fd = events[i].data.fd;
+			uint32_t ev = events[i].events;
+
+			if (fd == _udp)
+			{
+				if (ev & EPOLLIN)
+					onNetReadable();
+				if (ev & EPOLLOUT)
+					flushNet();
+			}
+			else if (fd == _devIn && (ev & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+			{
+				onDeviceReadable();
+				if (_cfg.isServer && (ev & EPOLLOUT))
+					flushDevice();
+			}
+			else if (fd == _devOut || (fd == _devIn && (ev & EPOLLOUT)))
+				flushDevice();
+			else if (fd == _timerFd)
+			{
+				uint64_t exp;
+				if (read(_timerFd, &exp, sizeof(exp)) > 0)
+					ticks += exp;
+				flushLog();
+				if (_cfg.statsInterval > 0 && ticks >= (unsigned long)_cfg.statsInterval * 5)
+				{
+					ticks = 0;
+					printStats(stderr);
+				}
+			}
+			else if (fd == _sigFd)
+			{
+				signalfd_siginfo si;
+				while (read(_sigFd, &si, sizeof(si)) == sizeof(si))
+				{
+					if (si.ssi_signo == SIGUSR1)
+						printStats(stderr);
+					else
+						_isRunning = false;
+				}
+			}
+			else if (fd == _stopFd)
+				_isRunning = false;
+		}
+	}
+
+	flushLog();
+}
+
+void Relay::onDeviceReadable()
+{
+	// Frame lines, emitting complete lines directly from the read buffer when possible
+	char buf[65536];
+
+	for (;;)
+	{
+		ssize_t n = read(_devIn, buf, sizeof(buf));
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+			return;
+
+		if (n <= 0)
+		{
+			// End of stdin keeps the relay running; a lost serial device stops it
+			epoll_ctl(_ep, EPOLL_CTL_DEL, _devIn, NULL);
+			if (_cfg.isServer)
+			{
+				fprintf(stderr, "svrelay: serial device closed\n");
+				_isRunning = false;
+			}
+			return;
+		}
+
+		const char* p = buf;
+		const char* end = buf + n;
+		while (p < end)
+		{
+			const char* q = p;
+			while (q < end && *q != '\n' && *q != '\r')
+				q++;
+
+			size_t len = q - p;
+			if (_devRx.size() + len > _cfg.maxLineLength)
+			{
+				if (_devRx.size() <= _cfg.maxLineLength)
+					stats.truncatedLines++;
+				len = _cfg.maxLineLength >= _devRx.size() ? _cfg.maxLineLength - _devRx.size() : 0;
+			}
+
+			if (q == end)
+			{
+				_devRx.append(p, len);
+				break;
+			}
+
+			if (_devRx.empty())
+			{
+				if (len > 0)
+					onDeviceLine(p, len);
+			}
+			else
+			{
+				_devRx.append(p, len);
+				onDeviceLine(_devRx.data(), _devRx.size());
+				_devRx.clear();
+			}
+			p = q + 1;
+		}
+	}
+}
+
+void Relay::onNetReadable()
+{
+	// Each datagram holds one or more lines; an unterminated tail is a complete line
+	char buf[65536];
+
+	for (;;)
+	{
+		ssize_t n = recv(_udp, buf, sizeof(buf), 0);
+		if (n < 0)
+			return;
+
+		stats.netRxDatagrams++;
+
+		const char* p = buf;
+		const char* end = buf + n;
+		while (p < end)
+		{
+			const char* q = p;
+			while (q < end && *q != '\n' && *q != '\r')
+				q++;
+			if (q > p)
+				onNetLine(p, std::min((size_t)(q - p), _cfg.maxLineLength));
+			p = q + 1;
+		}
+	}
+}
+
+void Relay::onDeviceLine(const char* s, size_t n)
+{
+	stats.deviceRxLines++;
+
+	if (_cfg.isServer)
+	{
+		// Serial input goes to all clients
+		logLine('I', s, n);
+		std::string line(s, n);
+		line += '\n';
+		fanOut(line);
+	}
+	else
+	{
+		// Commands typed by the user go to the server
+		std::string line = _cfg.prefix;
+		line.append(s, n);
+		logLine('O', line.data(), line.size());
+		line += '\n';
+		fanOut(line);
+	}
+}
+
+void Relay::onNetLine(const char* s, size_t n)
+{
+	std::string line;
+
+	if (_cfg.isServer)
+	{
+		// Commands from clients go to the device
+		line = _cfg.prefix;
+		line.append(s, n);
+		logLine('O', line.data(), line.size());
+	}
+	else
+	{
+		// Messages relayed by the server are printed
+		line.assign(s, n);
+		logLine('I', s, n);
+	}
+
+	line += '\n';
+	queueDevice(line);
+}
+
+void Relay::fanOut(const std::string& line)
+{
+	// Send one buffer to every destination without a backlog in a single call
+	mmsghdr msgs[64];
+	size_t idx[64];
+	iovec iov;
+	iov.iov_base = (void*)line.data();
+	iov.iov_len = line.size();
+
+	size_t numMsgs = 0;
+	for (size_t i = 0; i < _dests.size(); i++)
+	{
+		Dest& d = _dests[i];
+		if (!d.queue.empty() || numMsgs == 64)
+		{
+			if (d.queue.size() < _cfg.queueSize)
+				d.queue.push_back(line);
+			else
+				stats.netTxDrops++;
+			continue;
+		}
+
+		memset(&msgs[numMsgs], 0, sizeof(mmsghdr));
+		msgs[numMsgs].msg_hdr.msg_name = &d.addr;
+		msgs[numMsgs].msg_hdr.msg_namelen = sizeof(d.addr);
+		msgs[numMsgs].msg_hdr.msg_iov = &iov;
+		msgs[numMsgs].msg_hdr.msg_iovlen = 1;
+		idx[numMsgs] = i;
+		numMsgs++;
+	}
+
+	size_t sent = 0;
+	while (sent < numMsgs)
+	{
+		int r = sendmmsg(_udp, msgs + sent, numMsgs - sent, 0);
+		if (r > 0)
+		{
+			stats.netTxDatagrams += r;
+			sent += r;
+			continue;
+		}
+
+		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)
+		{
+			// Keep the rest for when the socket is writable
+			for (; sent < numMsgs; sent++)
+				_dests[idx[sent]].queue.push_back(line);
+		}
+		else
+		{
+			// e.g. ICMP port unreachable from a client that is not running yet
+			stats.netTxErrors++;
+			sent++;
+		}
+	}
+
+	bool isBacklog = false;
+	for (size_t i = 0; i < _dests.size(); i++)
+		isBacklog = isBacklog || !_dests[i].queue.empty();
+
+	if (isBacklog && !_isWaitingNet)
+	{
+		_isWaitingNet = true;
+		watch(_udp, EPOLLIN | EPOLLOUT, false);
+	}
+}
+
+void Relay::flushNet()
+{
+	bool isBacklog = false;
+
+	for (size_t i = 0; i < _dests.size(); i++)
+	{
+		Dest& d = _dests[i];
+		while (!d.queue.empty())
+		{
+			const std::string& s = d.queue.front();
+			ssize_t r = sendto(_udp, s.data(), s.size(), 0, (sockaddr*)&d.addr, sizeof(d.addr));
+			if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS))
+				break;
+
+			if (r < 0)
+				stats.netTxErrors++;
+			else
+				stats.netTxDatagrams++;
+			d.queue.pop_front();
+		}
+		isBacklog = isBacklog || !d.queue.empty();
+	}
+
+	if (!isBacklog && _isWaitingNet)
+	{
+		_isWaitingNet = false;
+		watch(_udp, EPOLLIN, false);
+	}
+}
+
+void Relay::queueDevice(const std::string& line)
+{
+	if (_devTx.size() >= _cfg.queueSize)
+	{
+		stats.deviceTxDrops++;
+		return;
+	}
+
+	_devTx.push_back(line);
+	flushDevice();
+}
+
+void Relay::flushDevice()
+{
+	while (!_devTx.empty())
+	{
+		const std::string& s = _devTx.front();
+		ssize_t r = write(_devOut, s.data() + _devTxOffset, s.size() - _devTxOffset);
+		if (r < 0)
+		{
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+			{
+				// Device gone; drop what is queued
+				stats.deviceTxDrops += _devTx.size();
+				_devTx.clear();
+				_devTxOffset = 0;
+			}
+			break;
+		}
+
+		_devTxOffset += r;
+		if (_devTxOffset == s.size())
+		{
+			_devTx.pop_front();
+			_devTxOffset = 0;
+			stats.deviceTxLines++;
+		}
+	}
+
+	// Wait for the device to become writable while there is a backlog
+	bool isBacklog = !_devTx.empty();
+	if (isBacklog != _isWaitingDev)
+	{
+		_isWaitingDev = isBacklog;
+		if (_devOut == _devIn)
+			watch(_devIn, EPOLLIN | (isBacklog ? (uint32_t)EPOLLOUT : 0), false);
+		else if (isBacklog)
+			watch(_devOut, EPOLLOUT, true);
+		else
+			epoll_ctl(_ep, EPOLL_CTL_DEL, _devOut, NULL);
+	}
+}
+
+
+
+// Logging
+
+void Relay::logLine(char io, const char* s, size_t n)
+{
+	if (_logFd < 0 || (io == 'O' && !_cfg.isLogOutputs))
+		return;
+
+	if (_log.size() + n > logBufferLimit)
+	{
+		stats.logDrops++;
+		return;
+	}
+
+	if (_cfg.isTagIO)
+	{
+		_log += io;
+		_log += _cfg.tagDelimiter;
+	}
+
+	if (_cfg.isTagTime)
+	{
+		// Format date and time once per second and only append milliseconds otherwise
+		timespec ts;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		if (ts.tv_sec != _lastSec)
+		{
+			tm t;
+			localtime_r(&ts.tv_sec, &t);
+			strftime(_timeTag, sizeof(_timeTag), "%Y%m%d%H%M%S", &t);
+			_lastSec = ts.tv_sec;
+		}
+
+		char ms[8];
+		snprintf(ms, sizeof(ms), "%03d", (int)(ts.tv_nsec / 1000000));
+		_log += _timeTag;
+		_log += ms;
+		_log += _cfg.tagDelimiter;
+	}
+
+	_log.append(s, n);
+	_log += '\n';
+
+	if (_log.size() >= 65536)
+		flushLog();
+}
+
+void Relay::flushLog()
+{
+	if (_logFd < 0 || _log.empty())
+		return;
+
+	if (write(_logFd, _log.data(), _log.size()) < 0)
+		stats.logDrops++;
+	_log.clear();
+}
+
+void Relay::printStats(FILE* f)
+{
+	fprintf(f, "device rx %llu, tx %llu, tx drops %llu | net rx %llu, tx %llu, tx drops %llu, tx errors %llu"
+		" | truncated %llu, log drops %llu\n",
+		stats.deviceRxLines, stats.deviceTxLines, stats.deviceTxDrops,
+		stats.netRxDatagrams, stats.netTxDatagrams, stats.netTxDrops, stats.netTxErrors,
+		stats.truncatedLines, stats.logDrops);
+}
+
+
+
+// Benchmark
+
+static int64_t nowNs()
+{
+	using namespace std::chrono;
+	return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+struct LatencyStats
+{
+	std::vector<double> us;
+	size_t received = 0;
+
+	void add(const char* line)
+	{
+		// Lines are "b,<seq>,<ns>"
+		const char* c = strrchr(line, ',');
+		if (c)
+			us.push_back((nowNs() - strtoll(c + 1, NULL, 10)) / 1e3);
+		received++;
+	}
+
+	void print(const char* name, size_t expected, double dt)
+	{
+		std::sort(us.begin(), us.end());
+		double p50 = us.empty() ? 0 : us[us.size() / 2];
+		double p99 = us.empty() ? 0 : us[us.size() * 99 / 100];
+		double pMax = us.empty() ? 0 : us.back();
+		printf("%-28s %8zu/%-8zu lines  %9.0f lines/s  latency p50 %7.1f us  p99 %7.1f us  max %8.1f us\n",
+			name, received, expected, received / dt, p50, p99, pMax);
+	}
+};
+
+static void readLines(int fd, size_t expected, LatencyStats& st)
+{
+	// Read lines until all arrived or nothing came for a second
+	std::string acc;
+	char buf[65536];
+	pollfd pfd = { fd, POLLIN, 0 };
+
+	while (st.received < expected && poll(&pfd, 1, 1000) > 0)
+	{
+		ssize_t n = read(fd, buf, sizeof(buf));
+		if (n <= 0)
+			break;
+
+		for (ssize_t i = 0; i < n; i++)
+		{
+			if (buf[i] == '\n' || buf[i] == '\r')
+			{
+				if (!acc.empty())
+					st.add(acc.c_str());
+				acc.clear();
+			}
+			else
+				acc += buf[i];
+		}
+	}
+}
+
+static void readDatagrams(const std::vector<int>& socks, size_t expected, std::vector<LatencyStats>& st)
+{
+	std::vector<pollfd> pfds;
+	for (size_t i = 0; i < socks.size(); i++)
+		pfds.push_back(pollfd{ socks[i], POLLIN, 0 });
+
+	char buf[65536];
+	for (;;)
+	{
+		bool isDone = true;
+		for (size_t i = 0; i < st.size(); i++)
+			isDone = isDone && st[i].received >= expected;
+		if (isDone || poll(pfds.data(), pfds.size(), 1000) <= 0)
+			break;
+
+		for (size_t i = 0; i < socks.size(); i++)
+		{
+			ssize_t n;
+			while ((n = recv(socks[i], buf, sizeof(buf) - 1, MSG_DONTWAIT)) > 0)
+			{
+				buf[n] = 0;
+				st[i].add(buf);
+			}
+		}
+	}
+}
+
+static void writeLines(int fd, size_t numLines, double rate, bool isUdp, const sockaddr_in* to)
+{
+	// Paced when rate > 0, otherwise as fast as the receiver takes them
+	int64_t t0 = nowNs();
+	char line[64];
+
+	for (size_t i = 0; i < numLines; i++)
+	{
+		if (rate > 0)
+		{
+			int64_t due = t0 + (int64_t)(i * 1e9 / rate);
+			while (nowNs() < due)
+				std::this_thread::yield();
+		}
+
+		int n = snprintf(line, sizeof(line), "b,%zu,%lld\n", i, (long long)nowNs());
+		if (isUdp)
+		{
+			while (sendto(fd, line, n, 0, (const sockaddr*)to, sizeof(*to)) < 0 && errno == ENOBUFS)
+				std::this_thread::yield();
+		}
+		else
+		{
+			for (int w = 0; w < n; )
+			{
+				ssize_t r = write(fd, line + w, n - w);
+				if (r > 0)
+					w += r;
+			}
+		}
+	}
+}
+
+static int bench(size_t numLines, size_t numClients)
+{
+	// Pseudo terminal pair standing in for the serial device
+	int master = posix_openpt(O_RDWR | O_NOCTTY);
+	if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0)
+	{
+		perror("svrelay: pty");
+		return 1;
+	}
+
+	// Loopback UDP clients
+	std::vector<int> socks;
+	RelayConfig cfg;
+	cfg.isServer = true;
+	cfg.serialPath = ptsname(master);
+	cfg.queueSize = numLines;
+	for (size_t i = 0; i < numClients; i++)
+	{
+		int s = socket(AF_INET, SOCK_DGRAM, 0);
+		int bufSize = 8 << 20;
+		setsockopt(s, SOL_SOCKET, SO_RCVBUF, &bufSize, sizeof(bufSize));
+		sockaddr_in a;
+		memset(&a, 0, sizeof(a));
+		a.sin_family = AF_INET;
+		a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		bind(s, (sockaddr*)&a, sizeof(a));
+		socklen_t len = sizeof(a);
+		getsockname(s, (sockaddr*)&a, &len);
+		socks.push_back(s);
+		cfg.clients.push_back("127.0.0.1:" + std::to_string(ntohs(a.sin_port)));
+	}
+
+	Relay relay(cfg);
+	std::string err;
+	if (!relay.open(err))
+	{
+		fprintf(stderr, "svrelay: %s\n", err.c_str());
+		return 1;
+	}
+	sockaddr_in relayAddr;
+	parseHostPort("127.0.0.1:" + std::to_string(relay.getLocalPort()), relayAddr);
+	std::thread relayThread(&Relay::run, &relay);
+
+	printf("Relay between %s and %zu UDP client(s)\n\n", cfg.serialPath.c_str(), numClients);
+
+	const double rates[] = { 2000, 0 };
+	for (int k = 0; k < 2; k++)
+	{
+		size_t n = rates[k] > 0 ? std::min(numLines, (size_t)rates[k]) : numLines;
+		char name[64];
+
+		// Serial to UDP clients
+		std::vector<LatencyStats> st(numClients);
+		int64_t t0 = nowNs();
+		std::thread reader(readDatagrams, std::cref(socks), n, std::ref(st));
+		writeLines(master, n, rates[k], false, NULL);
+		reader.join();
+		double dt = (nowNs() - t0) / 1e9;
+
+		for (size_t i = 0; i < numClients; i++)
+		{
+			snprintf(name, sizeof(name), "serial->udp[%zu] %s", i, rates[k] > 0 ? "paced" : "burst");
+			st[i].print(name, n, dt);
+		}
+
+		// UDP client to serial
+		LatencyStats sst;
+		t0 = nowNs();
+		std::thread serialReader(readLines, master, n, std::ref(sst));
+		writeLines(socks[0], n, rates[k], true, &relayAddr);
+		serialReader.join();
+		dt = (nowNs() - t0) / 1e9;
+
+		snprintf(name, sizeof(name), "udp->serial %s", rates[k] > 0 ? "paced" : "burst");
+		sst.print(name, n, dt);
+		printf("\n");
+	}
+
+	relay.stop();
+	relayThread.join();
+	relay.printStats(stdout);
+
+	for (size_t i = 0; i < socks.size(); i++)
+		close(socks[i]);
+	close(master);
+	return 0;
+}
+
+
+
+// Command line
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		fprintf(stderr,
+			"Usage: svrelay server --serial <device> [--baud 115200] --listen <port> --client <host:port> [...]\n"
+			"                      [--multicast <group:port>] [--ttl 1] [options]\n"
+			"       svrelay client --server <host:port> --listen <port> [options]\n"
+			"       svrelay bench [numLines] [numClients]\n"
+			"Options: --log <file> --log-outputs --no-io-tag --no-time-tag --tag-delimiter <c>\n"
+			"         --prefix <str> --queue <n> --stats <sec>\n");
+		return 2;
+	}
+
+	std::string mode = argv[1];
+	if (mode == "bench")
+		return bench(argc > 2 ? strtoul(argv[2], NULL, 10) : 100000, argc > 3 ? strtoul(argv[3], NULL, 10) : 2);
+
+	RelayConfig cfg;
+	cfg.isServer = mode == "server";
+	cfg.isHandleSignals = true;
+	if (!cfg.isServer && mode != "client")
+	{
+		fprintf(stderr, "svrelay: unknown mode '%s'\n", mode.c_str());
+		return 2;
+	}
+
+	for (int i = 2; i < argc; i++)
+	{
+		std::string opt = argv[i];
+		const char* val = i + 1 < argc ? argv[i+1] : "";
+
+		if (opt == "--log-outputs")
+			cfg.isLogOutputs = true;
+		else if (opt == "--no-io-tag")
+			cfg.isTagIO = false;
+		else if (opt == "--no-time-tag")
+			cfg.isTagTime = false;
+		else if (i + 1 >= argc)
+		{
+			fprintf(stderr, "svrelay: missing value for %s\n", opt.c_str());
+			return 2;
+		}
+		else
+		{
+			i++;
+			if (opt == "--serial") cfg.serialPath = val;
+			else if (opt == "--baud") cfg.baud = atoi(val);
+			else if (opt == "--listen") cfg.listenPort = atoi(val);
+			else if (opt == "--client") cfg.clients.push_back(val);
+			else if (opt == "--multicast") cfg.multicast = val;
+			else if (opt == "--ttl") cfg.ttl = atoi(val);
+			else if (opt == "--server") cfg.server = val;
+			else if (opt == "--log") cfg.logPath = val;
+			else if (opt == "--tag-delimiter") cfg.tagDelimiter = val[0];
+			else if (opt == "--prefix") cfg.prefix = val;
+			else if (opt == "--queue") cfg.queueSize = strtoul(val, NULL, 10);
+			else if (opt == "--stats") cfg.statsInterval = atoi(val);
+			else
+			{
+				fprintf(stderr, "svrelay: unknown option %s\n", opt.c_str());
+				return 2;
+			}
+		}
+	}
+
+	Relay relay(cfg);
+	std::string err;
+	if (!relay.open(err))
+	{
+		fprintf(stderr, "svrelay: %s\n", err.c_str());
+		return 1;
+	}
+
+	fprintf(stderr, "svrelay: %s mode, listening on UDP port %d\n", mode.c_str(), relay.getLocalPort());
+	relay.run();
+	relay.printStats(stderr);
+	return 0;
+}
@@ -0,0 +1,408 @@
+/*
+svscope.cpp - Time-indexed sample ring with min/max pyramid for live plots.
+Released into the public domain.
+*/
+
+#include "svscope.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <new>
+#include <vector>
+
+// Each level groups 4 buckets of the level below
+static const int levelShift = 2;
+
+struct svscope_level
+{
+	int shift;					// log2 of samples per bucket
+	uint64_t mask;				// bucket ring size - 1
+	std::vector<double> lo;		// [bucket][value]
+	std::vector<double> hi;
+};
+
+struct svscope_stream
+{
+	uint64_t mask;
+	int numValues;
+	uint64_t n;
+
+	std::vector<double> t;
+	std::vector<double> v;		// [sample][value]
+	std::vector<svscope_level> levels;
+};
+
+// Like fmin and fmax, ignoring NaN, but inlined
+static inline double minOf(double a, double b)
+{
+	return b < a || a != a ? b : a;
+}
+
+static inline double maxOf(double a, double b)
+{
+	return b > a || a != a ? b : a;
+}
+
+static size_t roundUpPow2(size_t n)
+{
+	size_t p = 1;
+	while (p < n)
+		p *= 2;
+	return p;
+}
+
+
+
+svscope_stream* svscope_create(size_t capacity, int numValues)
+{
+	if (capacity == 0 || numValues <= 0 || numValues > SVSCOPE_MAX_VALUES)
+		return NULL;
+
+	svscope_stream* s = new (std::nothrow) svscope_stream;
+	if (!s)
+		return NULL;
+
+	size_t cap = roundUpPow2(capacity < 16 ? 16 : capacity);
+	s->mask = cap - 1;
+	s->numValues = numValues;
+	s->n = 0;
+
+	try
+	{
+		s->t.assign(cap, NAN);
+		s->v.assign(cap * numValues, NAN);
+
+		// Levels down to 4 buckets per ring. A level ring holds twice the buckets spanned by
+		// the raw ring so that the oldest complete bucket is not overwritten by the newest.
+		for (int shift = levelShift; (cap >> shift) >= 4; shift += levelShift)
+		{
+			svscope_level l;
+			l.shift = shift;
+			l.mask = 2 * (cap >> shift) - 1;
+			l.lo.assign((l.mask + 1) * numValues, NAN);
+			l.hi.assign((l.mask + 1) * numValues, NAN);
+			s->levels.push_back(l);
+		}
+	}
+	catch (const std::bad_alloc&)
+	{
+		delete s;
+		return NULL;
+	}
+	return s;
+}
+
+void svscope_destroy(svscope_stream* s)
+{
+	delete s;
+}
+
+void svscope_clear(svscope_stream* s)
+{
+	s->n = 0;
+}
+
+int svscope_num_values(const svscope_stream* s)
+{
+	return s->numValues;
+}
+
+uint64_t svscope_num_added(const svscope_stream* s)
+{
+	return s->n;
+}
+
+size_t svscope_size(const svscope_stream* s)
+{
+	return s->n < s->mask + 1 ? (size_t)s->n : (size_t)(s->mask + 1);
+}
+
+double svscope_last_time(const svscope_stream* s)
+{
+	return s->n > 0 ? s->t[(s->n - 1) & s->mask] : NAN;
+}
+
+void svscope_add(svscope_stream* s, double t, const double* values, int n)
+{
+	const int nv = s->numValues;
+	uint64_t i = s->n & s->mask;
+	s->t[i] = t;
+
+	double* v = &s->v[i * nv];
+	int k = 0;
+	for (; k < n && k < nv; k++)
+		v[k] = values[k];
+	for (; k < nv; k++)
+		v[k] = NAN;
+
+	// Fold the sample into level 0 buckets, and each completed bucket into the level above
+	const double* lo = v;
+	const double* hi = v;
+	for (size_t j = 0; j < s->levels.size(); j++)
+	{
+		svscope_level& l = s->levels[j];
+		int childShift = j == 0 ? 0 : s->levels[j-1].shift;
+		uint64_t child = s->n >> childShift;
+		uint64_t b = (s->n >> l.shift) & l.mask;
+		double* bLo = &l.lo[b * nv];
+		double* bHi = &l.hi[b * nv];
+
+		if ((child & ((1 << levelShift) - 1)) == 0)
+		{
+			memcpy(bLo, lo, nv * sizeof(double));
+			memcpy(bHi, hi, nv * sizeof(double));
+		}
+		else
+		{
+			for (int c = 0; c < nv; c++)
+			{
+				bLo[c] = minOf(bLo[c], lo[c]);
+				bHi[c] = maxOf(bHi[c], hi[c]);
+			}
+		}
+
+		// Stop unless this sample completes the bucket
+		uint64_t size = (uint64_t)1 << l.shift;
+		if (((s->n + 1) & (size - 1)) != 0)
+			break;
+		lo = bLo;
+		hi = bHi;
+	}
+
+	s->n++;
+}
+
+
+
+// First retained sample number with time > t
+static uint64_t upperBound(const svscope_stream* s, double t)
+{
+	uint64_t lo = s->n > s->mask + 1 ? s->n - (s->mask + 1) : 0;
+	uint64_t hi = s->n;
+	while (lo < hi)
+	{
+		uint64_t mid = lo + (hi - lo) / 2;
+		if (s->t[mid & s->mask] > t)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	return lo;
+}
+
+void svscope_find(const svscope_stream* s, double tBegin, double tEnd, uint64_t* first, uint64_t* last)
+{
+	*first = upperBound(s, tBegin);
+	*last = upperBound(s, tEnd);
+	if (*last < *first)
+		*last = *first;
+}
+
+// Min and max over samples [x,y), taking the largest aligned buckets that fit
+static void rangeMinMax(const svscope_stream* s, uint64_t x, uint64_t y, double* lo, double* hi)
+{
+	const int nv = s->numValues;
+	const int numLevels = (int)s->levels.size();
+	for (int c = 0; c < nv; c++)
+	{
+		lo[c] = NAN;
+		hi[c] = NAN;
+	}
+
+	// Level 0 is the raw samples and level k > 0 is s->levels[k-1]
+	int k = 0;
+	while (x < y)
+	{
+		while (k < numLevels && (x & (((uint64_t)1 << s->levels[k].shift) - 1)) == 0
+			&& x + ((uint64_t)1 << s->levels[k].shift) <= y)
+			k++;
+		while (k > 0 && x + ((uint64_t)1 << s->levels[k-1].shift) > y)
+			k--;
+
+		const double *bLo, *bHi;
+		uint64_t size;
+		if (k == 0)
+		{
+			bLo = bHi = &s->v[(x & s->mask) * nv];
+			size = 1;
+		}
+		else
+		{
+			const svscope_level& l = s->levels[k-1];
+			uint64_t b = (x >> l.shift) & l.mask;
+			bLo = &l.lo[b * nv];
+			bHi = &l.hi[b * nv];
+			size = (uint64_t)1 << l.shift;
+		}
+
+		for (int c = 0; c < nv; c++)
+		{
+			lo[c] = minOf(lo[c], bLo[c]);
+			hi[c] = maxOf(hi[c], bHi[c]);
+		}
+		x += size;
+	}
+}
+
+size_t svscope_envelope(const svscope_stream* s, double tBegin, double tEnd, size_t numBins,
+	double* t, double* vMin, double* vMax)
+{
+	uint64_t first, last;
+	svscope_find(s, tBegin, tEnd, &first, &last);
+	uint64_t m = last - first;
+	if (m == 0 || numBins == 0)
+		return 0;
+
+	const int nv = s->numValues;
+	size_t numOut = m < numBins ? (size_t)m : numBins;
+	double lo[SVSCOPE_MAX_VALUES], hi[SVSCOPE_MAX_VALUES];
+
+	for (size_t j = 0; j < numOut; j++)
+	{
+		uint64_t x = first + m * j / numOut;
+		uint64_t y = first + m * (j + 1) / numOut;
+		rangeMinMax(s, x, y, lo, hi);
+
+		t[j] = s->t[x & s->mask];
+		for (int c = 0; c < nv; c++)
+		{
+			vMin[j + c * numBins] = lo[c];
+			vMax[j + c * numBins] = hi[c];
+		}
+	}
+	return numOut;
+}
+
+
+
+int svscope_parse(const char* line, size_t len, char delimiter, double* t, double* values, int maxValues)
+{
+	const char* p = line;
+	const char* e = line + len;
+	char buf[64];
+	int numParts = 0;
+
+	// Consecutive delimiters count as one, like strsplit
+	while (p < e)
+	{
+		while (p < e && *p == delimiter)
+			p++;
+		const char* q = p;
+		while (q < e && *q != delimiter && *q != '\r' && *q != '\n')
+			q++;
+		if (q == p)
+			break;
+
+		// The first part is the tag
+		if (numParts > 0)
+		{
+			size_t n = q - p < (ptrdiff_t)sizeof(buf) ? q - p : sizeof(buf) - 1;
+			memcpy(buf, p, n);
+			buf[n] = '\0';
+			char* end;
+			double x = strtod(buf, &end);
+			if (end == buf)
+				x = NAN;
+
+			if (numParts == 1)
+				*t = x;
+			else if (numParts - 2 < maxValues)
+				values[numParts - 2] = x;
+		}
+		numParts++;
+		p = q;
+		if (p < e && *p != delimiter)
+			break;
+	}
+
+	if (numParts < 2)
+		return -1;
+	return numParts - 2 < maxValues ? numParts - 2 : maxValues;
+}
+
+
+
+struct svscope_queue
+{
+	// Producer and consumer positions on separate cache lines
+	alignas(64) std::atomic<uint64_t> head;
+	alignas(64) std::atomic<uint64_t> tail;
+	alignas(64) uint64_t mask;
+	int stride;
+	std::atomic<uint64_t> dropped;
+	std::vector<double> slots;		// [slot][t, n, values]
+};
+
+svscope_queue* svscope_queue_create(size_t capacity, int maxValues)
+{
+	if (capacity == 0 || maxValues <= 0 || maxValues > SVSCOPE_MAX_VALUES)
+		return NULL;
+
+	svscope_queue* q = new (std::nothrow) svscope_queue;
+	if (!q)
+		return NULL;
+
+	size_t cap = roundUpPow2(capacity);
+	q->head = 0;
+	q->tail = 0;
+	q->mask = cap - 1;
+	q->stride = maxValues + 2;
+	q->dropped = 0;
+	try
+	{
+		q->slots.assign(cap * q->stride, 0);
+	}
+	catch (const std::bad_alloc&)
+	{
+		delete q;
+		return NULL;
+	}
+	return q;
+}
+
+void svscope_queue_destroy(svscope_queue* q)
+{
+	delete q;
+}
+
+int svscope_queue_push(svscope_queue* q, double t, const double* values, int n)
+{
+	uint64_t head = q->head.load(std::memory_order_relaxed);
+	if (head - q->tail.load(std::memory_order_acquire) > q->mask)
+	{
+		q->dropped.fetch_add(1, std::memory_order_relaxed);
+		return 0;
+	}
+
+	if (n > q->stride - 2)
+		n = q->stride - 2;
+	double* slot = &q->slots[(head & q->mask) * q->stride];
+	slot[0] = t;
+	slot[1] = n;
+	memcpy(slot + 2, values, n * sizeof(double));
+
+	q->head.store(head + 1, std::memory_order_release);
+	return 1;
+}
+
+size_t svscope_queue_drain(svscope_queue* q, svscope_stream* s)
+{
+	uint64_t tail = q->tail.load(std::memory_order_relaxed);
+	uint64_t head = q->head.load(std::memory_order_acquire);
+
+	for (uint64_t i = tail; i < head; i++)
+	{
+		const double* slot = &q->slots[(i & q->mask) * q->stride];
+		svscope_add(s, slot[0], slot + 2, (int)slot[1]);
+	}
+
+	q->tail.store(head, std::memory_order_release);
+	return (size_t)(head - tail);
+}
+
+uint64_t svscope_queue_dropped(const svscope_queue* q)
+{
+	return q->dropped.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,73 @@
+/*
+svscope.h - Time-indexed sample ring with min/max pyramid for live plots.
+Released into the public domain.
+
+A stream keeps the latest samples of a Satellites array message (tag,t,v1..vN) in a
+fixed-size ring. Times must not decrease, so a time range is found by binary search.
+Alongside the raw ring, levels of min/max buckets of 4, 16, 64... samples are updated as
+samples arrive. An envelope query splits a time range into a fixed number of bins and
+takes the min and max of each bin from the coarsest aligned buckets, so plotting a window
+of any span costs about the same.
+
+A queue passes parsed samples from an I/O thread to the thread that owns the stream
+without locks. It has exactly one producer and one consumer.
+
+Build the benchmark
+	g++ -O2 -std=c++11 -pthread svscope.cpp svscope_cli.cpp -o svscope
+Build the MEX function (or call Satellites.BuildNative in MATLAB)
+	mex -O svscope.cpp svscope_mex.cpp -outdir ..
+*/
+
+#ifndef svscope_h
+#define svscope_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Largest number of values in a sample
+#define SVSCOPE_MAX_VALUES		64
+
+typedef struct svscope_stream svscope_stream;
+typedef struct svscope_queue svscope_queue;
+
+// Streams. The capacity is rounded up to a power of 2. Missing values are NaN and extra
+// values are ignored.
+svscope_stream* svscope_create(size_t capacity, int numValues);
+void svscope_destroy(svscope_stream* s);
+void svscope_clear(svscope_stream* s);
+void svscope_add(svscope_stream* s, double t, const double* values, int n);
+
+int svscope_num_values(const svscope_stream* s);
+uint64_t svscope_num_added(const svscope_stream* s);
+size_t svscope_size(const svscope_stream* s);
+double svscope_last_time(const svscope_stream* s);
+
+// Range of retained sample numbers with tBegin < t <= tEnd
+void svscope_find(const svscope_stream* s, double tBegin, double tEnd, uint64_t* first, uint64_t* last);
+
+// Min and max of each of numBins bins over tBegin < t <= tEnd. Outputs are [numBins,numValues]
+// column-major; t holds the time of the first sample of each bin. Returns the number of bins
+// filled, which is the number of samples when there are fewer than numBins.
+size_t svscope_envelope(const svscope_stream* s, double tBegin, double tEnd, size_t numBins,
+	double* t, double* vMin, double* vMax);
+
+// Parses "tag,t,v1,...,vN" (the tag is skipped). Returns the number of values or -1.
+int svscope_parse(const char* line, size_t len, char delimiter, double* t, double* values, int maxValues);
+
+// Single-producer single-consumer queue of samples with up to maxValues values. push
+// returns 0 and counts a drop when the queue is full.
+svscope_queue* svscope_queue_create(size_t capacity, int maxValues);
+void svscope_queue_destroy(svscope_queue* q);
+int svscope_queue_push(svscope_queue* q, double t, const double* values, int n);
+size_t svscope_queue_drain(svscope_queue* q, svscope_stream* s);
+uint64_t svscope_queue_dropped(const svscope_queue* q);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,205 @@
+/*
+svscope_cli.cpp - Benchmark of the live plot stream.
+Released into the public domain.
+
+Usage
+	svscope [numSamples] [numValues] [capacity]
+		An I/O thread parses "i,t,v1,...,vN" messages and queues them while a plot thread
+		drains the queue and asks for 500-bin envelopes of the last 3 s and of the whole
+		ring, as SatelliteScopes does. Envelopes are then checked against a plain scan
+		and timed against copying the raw samples of the same windows.
+
+Build
+	g++ -O2 -std=c++11 -pthread svscope.cpp svscope_cli.cpp -o svscope
+*/
+
+#include "svscope.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+static const size_t numBins = 500;
+static const double sampleInterval = 1e-3;
+
+static double now()
+{
+	using namespace std::chrono;
+	return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+static uint32_t rnd(uint32_t* s)
+{
+	*s ^= *s << 13;
+	*s ^= *s >> 17;
+	*s ^= *s << 5;
+	return *s;
+}
+
+// Compares an envelope with a scan of the retained samples
+static bool check(const svscope_stream* s, const std::vector<double>& tAll, const std::vector<double>& vAll,
+	double tBegin, double tEnd)
+{
+	int nv = svscope_num_values(s);
+	std::vector<double> t(numBins), lo(numBins * nv), hi(numBins * nv);
+	size_t n = svscope_envelope(s, tBegin, tEnd, numBins, t.data(), lo.data(), hi.data());
+
+	uint64_t first, last;
+	svscope_find(s, tBegin, tEnd, &first, &last);
+	uint64_t m = last - first;
+	if (n != (m < numBins ? m : numBins))
+		return false;
+
+	for (size_t j = 0; j < n; j++)
+	{
+		uint64_t x = first + m * j / n, y = first + m * (j + 1) / n;
+		if (t[j] != tAll[x])
+			return false;
+		for (int c = 0; c < nv; c++)
+		{
+			double a = INFINITY, b = -INFINITY;
+			for (uint64_t i = x; i < y; i++)
+			{
+				a = fmin(a, vAll[i * nv + c]);
+				b = fmax(b, vAll[i * nv + c]);
+			}
+			if (a != lo[j + c * numBins] || b != hi[j + c * numBins])
+				return false;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	size_t numSamples = argc > 1 ? strtoull(argv[1], NULL, 10) : 20000000;
+	int numValues = argc > 2 ? atoi(argv[2]) : 4;
+	size_t capacity = argc > 3 ? strtoull(argv[3], NULL, 10) : 1 << 22;
+	if (numSamples == 0 || numValues <= 0 || numValues > SVSCOPE_MAX_VALUES)
+	{
+		fprintf(stderr, "Usage: svscope [numSamples] [numValues] [capacity]\n");
+		return 2;
+	}
+
+	svscope_stream* s = svscope_create(capacity, numValues);
+	svscope_queue* q = svscope_queue_create(1 << 16, numValues);
+	if (!s || !q)
+	{
+		fprintf(stderr, "Out of memory\n");
+		return 1;
+	}
+
+	// Messages as they come from the serial port, with millisecond times
+	std::vector<char> text;
+	std::vector<size_t> lineEnd;
+	std::vector<double> tAll(numSamples), vAll(numSamples * numValues);
+	uint32_t seed = 1;
+	char line[32 + 16 * SVSCOPE_MAX_VALUES];
+	for (size_t i = 0; i < numSamples; i++)
+	{
+		tAll[i] = i * sampleInterval;
+		int len = snprintf(line, sizeof(line), "i,%zu", i);
+		for (int c = 0; c < numValues; c++)
+		{
+			double v = (double)(rnd(&seed) % 1024);
+			vAll[i * numValues + c] = v;
+			len += snprintf(line + len, sizeof(line) - len, ",%d", (int)v);
+		}
+		text.insert(text.end(), line, line + len);
+		lineEnd.push_back(text.size());
+	}
+
+	std::atomic<bool> isDone(false);
+	double t0 = now();
+
+	std::thread io([&]()
+	{
+		double t, v[SVSCOPE_MAX_VALUES];
+		size_t b = 0;
+		for (size_t i = 0; i < numSamples; i++)
+		{
+			int n = svscope_parse(&text[b], lineEnd[i] - b, ',', &t, v, SVSCOPE_MAX_VALUES);
+			b = lineEnd[i];
+			while (n >= 0 && !svscope_queue_push(q, t * 1e-3, v, n))
+				std::this_thread::yield();
+		}
+		isDone = true;
+	});
+
+	// Plot thread
+	std::vector<double> t(numBins), lo(numBins * numValues), hi(numBins * numValues);
+	size_t numQueries = 0;
+	double dtQuery = 0;
+	while (true)
+	{
+		bool isLast = isDone;
+		svscope_queue_drain(q, s);
+		if (svscope_num_added(s) > 0)
+		{
+			double tLast = svscope_last_time(s);
+			double tq = now();
+			svscope_envelope(s, tLast - 3, tLast, numBins, t.data(), lo.data(), hi.data());
+			svscope_envelope(s, -INFINITY, tLast, numBins, t.data(), lo.data(), hi.data());
+			dtQuery += now() - tq;
+			numQueries += 2;
+		}
+		if (isLast)
+			break;
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	io.join();
+	double dt = now() - t0;
+
+	printf("%zu samples of %d values, ring of %zu\n", numSamples, numValues, svscope_size(s));
+	printf("Parse, queue and add: %.2f M samples/s, dropped %llu\n",
+		numSamples / dt / 1e6, (unsigned long long)svscope_queue_dropped(q));
+	printf("Envelope while streaming: %zu queries, %.1f us each\n", numQueries, dtQuery / numQueries * 1e6);
+
+	// Windows of growing span against copying their raw samples
+	double tLast = svscope_last_time(s);
+	bool isOk = true;
+	double spans[] = { 0.1, 3, 60, 600, 1e9 };
+	for (size_t k = 0; k < sizeof(spans) / sizeof(spans[0]); k++)
+	{
+		double tBegin = tLast - spans[k];
+		int reps = 200;
+		double tq = now();
+		for (int r = 0; r < reps; r++)
+			svscope_envelope(s, tBegin, tLast, numBins, t.data(), lo.data(), hi.data());
+		double dtEnv = (now() - tq) / reps;
+
+		uint64_t first, last;
+		svscope_find(s, tBegin, tLast, &first, &last);
+		std::vector<double> raw((last - first) * numValues);
+		tq = now();
+		for (int r = 0; r < reps; r++)
+			for (uint64_t i = first; i < last; i++)
+				memcpy(&raw[(i - first) * numValues], &vAll[i * numValues], numValues * sizeof(double));
+		double dtRaw = (now() - tq) / reps;
+
+		bool isSame = check(s, tAll, vAll, tBegin, tLast);
+		isOk = isOk && isSame;
+		printf("  span %10.1f s: %8llu samples, envelope %8.1f us, raw copy %9.1f us, %s\n", spans[k],
+			(unsigned long long)(last - first), dtEnv * 1e6, dtRaw * 1e6, isSame ? "match" : "MISMATCH");
+	}
+
+	// Random windows
+	uint32_t rs = 99;
+	size_t numBad = 0;
+	for (int k = 0; k < 200; k++)
+	{
+		double a = tLast - (rnd(&rs) % 100000) * 0.0137;
+		double b = a + (rnd(&rs) % 50000) * 0.0071;
+		numBad += !check(s, tAll, vAll, a, b);
+	}
+	printf("Random windows: %zu mismatches\n", numBad);
+
+	svscope_queue_destroy(q);
+	svscope_destroy(s);
+	return isOk && numBad == 0 ? 0 : 1;
+}
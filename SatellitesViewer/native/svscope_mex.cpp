@@ -0,0 +1,129 @@
+/*
+svscope_mex.cpp - MEX gateway to the live plot stream.
+Released into the public domain.
+
+	h = svscope_mex('open', capacity, numValues)
+	svscope_mex('add', h, samples)
+	[t, vMin, vMax] = svscope_mex('envelope', h, dur, numBins)
+	[t, vMin, vMax] = svscope_mex('envelope', h, tBegin, tEnd, numBins)
+	svscope_mex('clear', h)
+	svscope_mex('close', h)
+
+samples is a [n,1+numValues] matrix of [t, v1, ..., vN] rows. The first form of envelope
+covers the latest dur of samples. Outputs have one row per bin (or per sample when there are
+fewer samples than bins). SerialViewerStream uses this when it is built.
+
+Build with Satellites.BuildNative, or
+	mex -O svscope.cpp svscope_mex.cpp -outdir ..
+*/
+
+#include "mex.h"
+#include "svscope.h"
+
+#include <math.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+static std::vector<svscope_stream*> streams;
+
+static void closeAll()
+{
+	for (size_t i = 0; i < streams.size(); i++)
+		svscope_destroy(streams[i]);
+	streams.clear();
+}
+
+static svscope_stream* getStream(const mxArray* a)
+{
+	double h = mxIsNumeric(a) && mxGetNumberOfElements(a) == 1 ? mxGetScalar(a) : 0;
+	if (h < 1 || h > streams.size() || !streams[(size_t)h - 1])
+		mexErrMsgIdAndTxt("svscope:input", "Invalid handle.");
+	return streams[(size_t)h - 1];
+}
+
+static void add(svscope_stream* s, const mxArray* a)
+{
+	if (!mxIsDouble(a))
+		mexErrMsgIdAndTxt("svscope:input", "Samples must be a double matrix.");
+
+	size_t m = mxGetM(a), n = mxGetN(a);
+	const double* p = mxGetPr(a);
+	double row[SVSCOPE_MAX_VALUES];
+	int numValues = n - 1 < SVSCOPE_MAX_VALUES ? (int)n - 1 : SVSCOPE_MAX_VALUES;
+	for (size_t i = 0; n > 0 && i < m; i++)
+	{
+		for (int k = 0; k < numValues; k++)
+			row[k] = p[i + (k + 1) * m];
+		svscope_add(s, p[i], row, numValues);
+	}
+}
+
+static void envelope(svscope_stream* s, int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[])
+{
+	double tEnd = svscope_last_time(s);
+	double tBegin = tEnd - mxGetScalar(prhs[2]);
+	double numBins = mxGetScalar(prhs[3]);
+	if (nrhs > 4)
+	{
+		tBegin = mxGetScalar(prhs[2]);
+		tEnd = mxGetScalar(prhs[3]);
+		numBins = mxGetScalar(prhs[4]);
+	}
+	size_t nb = numBins > 0 ? (size_t)numBins : 0;
+	int nv = svscope_num_values(s);
+
+	std::vector<double> t(nb), lo(nb * nv), hi(nb * nv);
+	size_t n = svscope_envelope(s, tBegin, tEnd, nb, t.data(), lo.data(), hi.data());
+
+	plhs[0] = mxCreateDoubleMatrix(n, 1, mxREAL);
+	memcpy(mxGetPr(plhs[0]), t.data(), n * sizeof(double));
+
+	// Columns are numBins apart in the buffers
+	for (int k = 1; k < nlhs && k < 3; k++)
+	{
+		const std::vector<double>& src = k == 1 ? lo : hi;
+		plhs[k] = mxCreateDoubleMatrix(n, nv, mxREAL);
+		double* dst = mxGetPr(plhs[k]);
+		for (int c = 0; c < nv; c++)
+			memcpy(dst + c * n, src.data() + c * nb, n * sizeof(double));
+	}
+}
+
+void mexFunction(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[])
+{
+	mexAtExit(closeAll);
+
+	if (nrhs < 2 || !mxIsChar(prhs[0]))
+		mexErrMsgIdAndTxt("svscope:input", "Usage: svscope_mex(command, ...)");
+
+	char* str = mxArrayToString(prhs[0]);
+	std::string cmd(str);
+	mxFree(str);
+
+	if (cmd == "open" && nrhs > 2)
+	{
+		double capacity = mxGetScalar(prhs[1]);
+		svscope_stream* s = svscope_create(capacity > 0 ? (size_t)capacity : 0, (int)mxGetScalar(prhs[2]));
+		if (!s)
+			mexErrMsgIdAndTxt("svscope:input", "Cannot create a stream of this size.");
+		streams.push_back(s);
+		plhs[0] = mxCreateDoubleScalar((double)streams.size());
+		return;
+	}
+
+	svscope_stream* s = getStream(prhs[1]);
+	if (cmd == "add" && nrhs > 2)
+		add(s, prhs[2]);
+	else if (cmd == "envelope" && nrhs > 3)
+		envelope(s, nlhs, plhs, nrhs, prhs);
+	else if (cmd == "clear")
+		svscope_clear(s);
+	else if (cmd == "close")
+	{
+		svscope_destroy(s);
+		streams[(size_t)mxGetScalar(prhs[1]) - 1] = NULL;
+	}
+	else
+		mexErrMsgIdAndTxt("svscope:input", "Unknown command '%s'.", cmd.c_str());
+}
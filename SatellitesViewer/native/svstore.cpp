@@ -0,0 +1,609 @@
+/*
+svstore.cpp - Indexed columnar store of SatellitesViewer events.
+Released into the public domain.
+*/
+
+#include "svstore.h"
+#include "svmap.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+static const char storeMagic[8] = { 'S', 'V', 'S', 'T', 'O', 'R', 'E', '1' };
+static const char indexMagic[8] = { 'S', 'V', 'I', 'N', 'D', 'E', 'X', '1' };
+static const uint32_t formatVersion = 1;
+
+struct StoreHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t numTypes;
+	uint64_t numEvents;
+	uint64_t typesOffset;
+};
+
+struct TypeEntry
+{
+	uint64_t numRows;
+	uint32_t numValues;
+	uint32_t nameLen;
+	uint64_t nameOffset;
+	uint64_t seqOffset;
+	uint64_t deviceTimeOffset;
+	uint64_t hostTimeOffset;
+	uint64_t valuesOffset;
+};
+
+struct IndexHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t numIndexes;
+	uint64_t numEvents;
+	uint64_t storeSize;
+};
+
+struct IndexEntry
+{
+	uint32_t delimiterType;
+	uint32_t numEpisodes;
+	uint64_t rowsOffset;	// [numTypes][numEpisodes+1] first rows
+};
+
+struct svstore
+{
+	svmap map;
+	svmap idxMap;
+	const StoreHeader* header;
+	const TypeEntry* types;
+	const IndexHeader* idxHeader;
+	const IndexEntry* indexes;
+};
+
+
+
+// Writing
+
+class Writer
+{
+public:
+	Writer(FILE* f) : _f(f), _pos(0), _isOk(f != NULL) {}
+
+	uint64_t put(const void* p, size_t n)
+	{
+		// Write at the next 8-byte boundary and return the offset
+		static const char zeros[8] = { 0 };
+		size_t pad = (8 - _pos % 8) % 8;
+		if (pad)
+			write(zeros, pad);
+
+		uint64_t at = _pos;
+		write(p, n);
+		return at;
+	}
+
+	void rewrite(uint64_t at, const void* p, size_t n)
+	{
+		fseek(_f, (long)at, SEEK_SET);
+		_isOk = _isOk && fwrite(p, 1, n, _f) == n;
+	}
+
+	bool isOk() { return _isOk; }
+
+private:
+	FILE* _f;
+	uint64_t _pos;
+	bool _isOk;
+
+	void write(const void* p, size_t n)
+	{
+		_isOk = _isOk && (n == 0 || fwrite(p, 1, n, _f) == n);
+		_pos += n;
+	}
+};
+
+static int64_t daysFromCivil(int y, int m, int d)
+{
+	// Days since 1970-01-01 in the proleptic Gregorian calendar
+	y -= m <= 2;
+	int64_t era = (y >= 0 ? y : y - 399) / 400;
+	int64_t yoe = y - era * 400;
+	int64_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+	int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + doe - 719468;
+}
+
+static int64_t hostTimeMs(int64_t sysTime)
+{
+	if (sysTime == SVLOG_NO_TIME)
+		return INT64_MIN;
+
+	int c[7];
+	svlog_split_time(sysTime, c);
+	int64_t days = daysFromCivil(c[0], c[1], c[2]);
+	return (((days * 24 + c[3]) * 60 + c[4]) * 60 + c[5]) * 1000 + c[6];
+}
+
+static bool parseNumber(const char* p, uint32_t len, double* v)
+{
+	// Numbers are short, so copy to a terminated buffer for strtod
+	char buf[64];
+	if (len == 0 || len >= sizeof(buf))
+		return false;
+
+	memcpy(buf, p, len);
+	buf[len] = 0;
+	char* end;
+	*v = strtod(buf, &end);
+	return end == buf + len;
+}
+
+int svstore_write(const svlog_log* log, const char* path)
+{
+	const char* data = svlog_data(log);
+	const char* io = svlog_io_types(log);
+	const int64_t* sysTime = svlog_sys_times(log);
+	const uint64_t* first = svlog_part_first(log);
+	const uint64_t* off = svlog_part_offsets(log);
+	const uint32_t* len = svlog_part_lengths(log);
+	size_t numLines = svlog_num_lines(log);
+
+	struct Column
+	{
+		std::string name;
+		uint32_t numValues;
+		std::vector<uint64_t> seq;
+		std::vector<double> deviceTime;
+		std::vector<int64_t> hostTime;
+		std::vector<double> values;
+	};
+
+	try
+	{
+		// Intern event types in order of appearance
+		std::unordered_map<std::string, uint32_t> typeIds;
+		std::vector<Column> cols;
+		std::vector<uint32_t> lineType(numLines, UINT32_MAX);
+		uint64_t numEvents = 0;
+
+		for (size_t i = 0; i < numLines; i++)
+		{
+			if (io[i] == 'O')
+				continue;
+
+			std::string name(data + off[first[i]], len[first[i]]);
+			auto it = typeIds.find(name);
+			uint32_t k;
+			if (it == typeIds.end())
+			{
+				k = (uint32_t)cols.size();
+				typeIds[name] = k;
+				cols.push_back(Column());
+				cols[k].name = name;
+				cols[k].numValues = 0;
+			}
+			else
+				k = it->second;
+
+			uint32_t numParts = (uint32_t)(first[i+1] - first[i]);
+			cols[k].numValues = std::max(cols[k].numValues, numParts > 2 ? numParts - 2 : 0);
+			cols[k].seq.push_back(numEvents++);
+			lineType[i] = k;
+		}
+
+		// Fill columns
+		for (size_t k = 0; k < cols.size(); k++)
+		{
+			cols[k].deviceTime.reserve(cols[k].seq.size());
+			cols[k].hostTime.reserve(cols[k].seq.size());
+			cols[k].values.assign(cols[k].seq.size() * cols[k].numValues, NAN);
+		}
+
+		for (size_t i = 0; i < numLines; i++)
+		{
+			if (lineType[i] == UINT32_MAX)
+				continue;
+
+			Column& c = cols[lineType[i]];
+			size_t row = c.deviceTime.size();
+
+			double t = NAN;
+			if (first[i+1] - first[i] > 1)
+				parseNumber(data + off[first[i] + 1], len[first[i] + 1], &t);
+			c.deviceTime.push_back(t);
+			c.hostTime.push_back(hostTimeMs(sysTime[i]));
+
+			double* v = &c.values[row * c.numValues];
+			for (uint64_t p = first[i] + 2; p < first[i+1]; p++, v++)
+				if (!parseNumber(data + off[p], len[p], v))
+					*v = NAN;
+		}
+
+		// Sort types by name so that they match Satellites.GroupEventsByType
+		std::vector<uint32_t> order(cols.size());
+		for (size_t k = 0; k < order.size(); k++)
+			order[k] = (uint32_t)k;
+		std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return cols[a].name < cols[b].name; });
+
+		// Write header and arrays, then the type table
+		FILE* f = fopen(path, "wb");
+		if (f == NULL)
+			return SVLOG_ERR_OPEN;
+		Writer w(f);
+
+		StoreHeader h;
+		memset(&h, 0, sizeof(h));
+		memcpy(h.magic, storeMagic, sizeof(h.magic));
+		h.version = formatVersion;
+		h.numTypes = (uint32_t)cols.size();
+		h.numEvents = numEvents;
+		w.put(&h, sizeof(h));
+
+		std::vector<TypeEntry> types(cols.size());
+		for (size_t k = 0; k < order.size(); k++)
+		{
+			Column& c = cols[order[k]];
+			TypeEntry& e = types[k];
+			e.numRows = c.seq.size();
+			e.numValues = c.numValues;
+			e.nameLen = (uint32_t)c.name.size();
+			e.nameOffset = w.put(c.name.data(), c.name.size());
+			e.seqOffset = w.put(c.seq.data(), c.seq.size() * sizeof(uint64_t));
+			e.deviceTimeOffset = w.put(c.deviceTime.data(), c.deviceTime.size() * sizeof(double));
+			e.hostTimeOffset = w.put(c.hostTime.data(), c.hostTime.size() * sizeof(int64_t));
+			e.valuesOffset = w.put(c.values.data(), c.values.size() * sizeof(double));
+			c = Column();
+		}
+		h.typesOffset = w.put(types.data(), types.size() * sizeof(TypeEntry));
+		w.rewrite(0, &h, sizeof(h));
+
+		bool isOk = w.isOk();
+		isOk = fclose(f) == 0 && isOk;
+		if (!isOk)
+			return SVLOG_ERR_OPEN;
+	}
+	catch (std::bad_alloc&)
+	{
+		return SVLOG_ERR_MEMORY;
+	}
+
+	// An old sidecar no longer matches the store
+	remove((std::string(path) + ".idx").c_str());
+
+	return SVLOG_OK;
+}
+
+int svstore_write_index(const char* path, const char* const* delimiterTypes, int numDelimiters)
+{
+	svstore* s = NULL;
+	int err = svstore_open(path, &s);
+	if (err != SVLOG_OK)
+		return err;
+
+	uint32_t numTypes = svstore_num_types(s);
+	std::vector<uint32_t> delimiters;
+	for (int d = 0; d < numDelimiters; d++)
+	{
+		int k = svstore_find_type(s, delimiterTypes[d]);
+		if (k < 0)
+		{
+			svstore_close(s);
+			return SVLOG_ERR_TYPE;
+		}
+		delimiters.push_back((uint32_t)k);
+	}
+
+	std::string idxPath = std::string(path) + ".idx";
+	FILE* f = fopen(idxPath.c_str(), "wb");
+	if (f == NULL)
+	{
+		svstore_close(s);
+		return SVLOG_ERR_OPEN;
+	}
+	Writer w(f);
+
+	IndexHeader h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, indexMagic, sizeof(h.magic));
+	h.version = formatVersion;
+	h.numIndexes = (uint32_t)delimiters.size();
+	h.numEvents = svstore_num_events(s);
+	h.storeSize = s->map.size;
+	w.put(&h, sizeof(h));
+
+	std::vector<IndexEntry> entries(delimiters.size());
+	std::vector<uint64_t> rows;
+
+	try
+	{
+		for (size_t d = 0; d < delimiters.size(); d++)
+		{
+			// Episode i starts at the sequence number of the i-th delimiter event
+			const uint64_t* bounds = svstore_sequence(s, delimiters[d]);
+			uint32_t numEpisodes = (uint32_t)svstore_num_rows(s, delimiters[d]) + 1;
+
+			// For each type, walk its rows and the boundaries together to find the first row of
+			// every episode
+			rows.resize((size_t)numTypes * (numEpisodes + 1));
+			for (uint32_t k = 0; k < numTypes; k++)
+			{
+				const uint64_t* seq = svstore_sequence(s, k);
+				uint64_t n = svstore_num_rows(s, k);
+				uint64_t* r = &rows[(size_t)k * (numEpisodes + 1)];
+				uint64_t row = 0;
+
+				r[0] = 0;
+				for (uint32_t e = 1; e < numEpisodes; e++)
+				{
+					while (row < n && seq[row] < bounds[e-1])
+						row++;
+					r[e] = row;
+				}
+				r[numEpisodes] = n;
+			}
+
+			entries[d].delimiterType = delimiters[d];
+			entries[d].numEpisodes = numEpisodes;
+			entries[d].rowsOffset = w.put(rows.data(), rows.size() * sizeof(uint64_t));
+		}
+	}
+	catch (std::bad_alloc&)
+	{
+		svstore_close(s);
+		fclose(f);
+		remove(idxPath.c_str());
+		return SVLOG_ERR_MEMORY;
+	}
+	w.put(entries.data(), entries.size() * sizeof(IndexEntry));
+
+	svstore_close(s);
+
+	bool isOk = w.isOk();
+	isOk = fclose(f) == 0 && isOk;
+	return isOk ? SVLOG_OK : SVLOG_ERR_OPEN;
+}
+
+
+
+// Reading
+
+static bool inBounds(const svmap& m, uint64_t offset, uint64_t bytes)
+{
+	return offset % 8 == 0 && offset <= m.size && bytes <= m.size - offset;
+}
+
+static bool checkStore(const svstore* s)
+{
+	const svmap& m = s->map;
+	if (m.size < sizeof(StoreHeader))
+		return false;
+
+	const StoreHeader* h = (const StoreHeader*)m.data;
+	if (memcmp(h->magic, storeMagic, sizeof(h->magic)) != 0 || h->version != formatVersion)
+		return false;
+	if (!inBounds(m, h->typesOffset, (uint64_t)h->numTypes * sizeof(TypeEntry)))
+		return false;
+
+	const TypeEntry* types = (const TypeEntry*)(m.data + h->typesOffset);
+	for (uint32_t k = 0; k < h->numTypes; k++)
+	{
+		const TypeEntry& e = types[k];
+		uint64_t n = e.numRows;
+		if (e.nameOffset > m.size || e.nameLen > m.size - e.nameOffset
+			|| !inBounds(m, e.seqOffset, n * 8) || !inBounds(m, e.deviceTimeOffset, n * 8)
+			|| !inBounds(m, e.hostTimeOffset, n * 8) || !inBounds(m, e.valuesOffset, n * e.numValues * 8))
+			return false;
+	}
+
+	return true;
+}
+
+static void openIndex(svstore* s, const char* path)
+{
+	// A missing, corrupt or stale sidecar is ignored
+	std::string idxPath = std::string(path) + ".idx";
+	if (svmap_open(idxPath.c_str(), &s->idxMap) != SVLOG_OK)
+		return;
+
+	const svmap& m = s->idxMap;
+	const IndexHeader* h = (const IndexHeader*)m.data;
+	uint64_t entriesSize = 0;
+	bool isOk = m.size >= sizeof(IndexHeader)
+		&& memcmp(h->magic, indexMagic, sizeof(h->magic)) == 0 && h->version == formatVersion
+		&& h->numEvents == s->header->numEvents && h->storeSize == s->map.size;
+
+	if (isOk)
+	{
+		// Entries are at the end of the file
+		entriesSize = (uint64_t)h->numIndexes * sizeof(IndexEntry);
+		isOk = entriesSize <= m.size - sizeof(IndexHeader);
+	}
+
+	const IndexEntry* entries = isOk ? (const IndexEntry*)(m.data + m.size - entriesSize) : NULL;
+	for (uint32_t d = 0; isOk && d < h->numIndexes; d++)
+		isOk = entries[d].delimiterType < s->header->numTypes
+			&& inBounds(m, entries[d].rowsOffset, (uint64_t)s->header->numTypes * (entries[d].numEpisodes + 1ULL) * 8);
+
+	if (!isOk)
+	{
+		svmap_close(&s->idxMap);
+		return;
+	}
+
+	s->idxHeader = h;
+	s->indexes = entries;
+}
+
+int svstore_open(const char* path, svstore** out)
+{
+	if (path == NULL || out == NULL)
+		return SVLOG_ERR_ARG;
+
+	svstore* s = new (std::nothrow) svstore();
+	if (s == NULL)
+		return SVLOG_ERR_MEMORY;
+
+	int err = svmap_open(path, &s->map);
+	if (err != SVLOG_OK)
+	{
+		delete s;
+		return err;
+	}
+
+	if (!checkStore(s))
+	{
+		svstore_close(s);
+		return SVLOG_ERR_FORMAT;
+	}
+
+	s->header = (const StoreHeader*)s->map.data;
+	s->types = (const TypeEntry*)(s->map.data + s->header->typesOffset);
+	s->idxHeader = NULL;
+	s->indexes = NULL;
+	openIndex(s, path);
+
+	*out = s;
+	return SVLOG_OK;
+}
+
+void svstore_close(svstore* s)
+{
+	if (s == NULL)
+		return;
+
+	svmap_close(&s->idxMap);
+	svmap_close(&s->map);
+	delete s;
+}
+
+
+
+uint64_t svstore_num_events(const svstore* s)
+{
+	return s->header->numEvents;
+}
+
+uint32_t svstore_num_types(const svstore* s)
+{
+	return s->header->numTypes;
+}
+
+const char* svstore_type_name(const svstore* s, uint32_t type, uint32_t* len)
+{
+	*len = s->types[type].nameLen;
+	return s->map.data + s->types[type].nameOffset;
+}
+
+int svstore_find_type(const svstore* s, const char* name)
+{
+	// Binary search over sorted names
+	size_t nameLen = strlen(name);
+	int lo = 0, hi = (int)s->header->numTypes - 1;
+
+	while (lo <= hi)
+	{
+		int mid = (lo + hi) / 2;
+		uint32_t len;
+		const char* str = svstore_type_name(s, mid, &len);
+
+		int c = memcmp(str, name, std::min((size_t)len, nameLen));
+		if (c == 0)
+			c = len < nameLen ? -1 : (len > nameLen ? 1 : 0);
+
+		if (c == 0)
+			return mid;
+		if (c < 0)
+			lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
+
+	return -1;
+}
+
+uint64_t svstore_num_rows(const svstore* s, uint32_t type)
+{
+	return s->types[type].numRows;
+}
+
+uint32_t svstore_num_values(const svstore* s, uint32_t type)
+{
+	return s->types[type].numValues;
+}
+
+const uint64_t* svstore_sequence(const svstore* s, uint32_t type)
+{
+	return (const uint64_t*)(s->map.data + s->types[type].seqOffset);
+}
+
+const double* svstore_device_times(const svstore* s, uint32_t type)
+{
+	return (const double*)(s->map.data + s->types[type].deviceTimeOffset);
+}
+
+const int64_t* svstore_host_times(const svstore* s, uint32_t type)
+{
+	return (const int64_t*)(s->map.data + s->types[type].hostTimeOffset);
+}
+
+const double* svstore_values(const svstore* s, uint32_t type)
+{
+	return (const double*)(s->map.data + s->types[type].valuesOffset);
+}
+
+
+
+uint32_t svstore_num_indexes(const svstore* s)
+{
+	return s->idxHeader ? s->idxHeader->numIndexes : 0;
+}
+
+int svstore_find_index(const svstore* s, const char* delimiterType)
+{
+	int k = svstore_find_type(s, delimiterType);
+	for (uint32_t d = 0; d < svstore_num_indexes(s); d++)
+		if ((int)s->indexes[d].delimiterType == k)
+			return (int)d;
+
+	return -1;
+}
+
+uint32_t svstore_index_type(const svstore* s, uint32_t index)
+{
+	return s->indexes[index].delimiterType;
+}
+
+uint32_t svstore_num_episodes(const svstore* s, uint32_t index)
+{
+	return s->indexes[index].numEpisodes;
+}
+
+const uint64_t* svstore_episode_rows(const svstore* s, uint32_t index, uint32_t type)
+{
+	const IndexEntry& e = s->indexes[index];
+	return (const uint64_t*)(s->idxMap.data + e.rowsOffset) + (size_t)type * (e.numEpisodes + 1);
+}
+
+int svstore_query(const svstore* s, uint32_t index, uint32_t type, uint32_t firstEpisode, uint32_t lastEpisode,
+	uint64_t* rowBegin, uint64_t* rowEnd)
+{
+	// Rows of type in episodes firstEpisode to lastEpisode (inclusive), clipped to existing episodes
+	if (index >= svstore_num_indexes(s) || type >= svstore_num_types(s))
+		return SVLOG_ERR_ARG;
+
+	uint32_t n = svstore_num_episodes(s, index);
+	const uint64_t* rows = svstore_episode_rows(s, index, type);
+	firstEpisode = std::min(firstEpisode, n);
+	lastEpisode = std::min(lastEpisode, n - 1);
+
+	*rowBegin = rows[firstEpisode];
+	*rowEnd = lastEpisode >= firstEpisode ? rows[lastEpisode + 1] : *rowBegin;
+	return SVLOG_OK;
+}
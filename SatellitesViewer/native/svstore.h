@@ -0,0 +1,65 @@
+/*
+svstore.h - Indexed columnar store of SatellitesViewer events.
+Released into the public domain.
+
+A store is a binary file converted from a parsed log (see svlog.h). Event types are
+interned and each type has its own columns: the event sequence number in the log, the
+device time (second part of the message), the host system time in milliseconds since
+1970 (INT64_MIN when the line has none) and a row-major [numRows,numValues] matrix of the
+remaining parts as numbers (NaN when missing or not numeric). Output lines ('O') are
+skipped, as in Satellites.Import.
+
+A sidecar index (<store>.idx) holds episode boundaries for chosen delimiter events (e.g.
+"trial"). Episode 0 contains events before the first delimiter and episode i starts at the
+i-th delimiter event, like Satellites.GroupEventsByTime. For each delimiter and type the
+index stores the first row of every episode, so the rows of a type in a range of episodes
+are found in constant time and read in place from the mapped file.
+
+All arrays are 8-byte aligned and stored in native (little-endian) byte order.
+*/
+
+#ifndef svstore_h
+#define svstore_h
+
+#include "svlog.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct svstore svstore;
+
+// Conversion
+int svstore_write(const svlog_log* log, const char* path);
+int svstore_write_index(const char* path, const char* const* delimiterTypes, int numDelimiters);
+
+// Reading. Returned pointers refer to the mapped file and stay valid until the store is closed.
+int svstore_open(const char* path, svstore** out);
+void svstore_close(svstore* s);
+
+uint64_t svstore_num_events(const svstore* s);
+uint32_t svstore_num_types(const svstore* s);
+const char* svstore_type_name(const svstore* s, uint32_t type, uint32_t* len);
+int svstore_find_type(const svstore* s, const char* name);
+
+uint64_t svstore_num_rows(const svstore* s, uint32_t type);
+uint32_t svstore_num_values(const svstore* s, uint32_t type);
+const uint64_t* svstore_sequence(const svstore* s, uint32_t type);
+const double* svstore_device_times(const svstore* s, uint32_t type);
+const int64_t* svstore_host_times(const svstore* s, uint32_t type);
+const double* svstore_values(const svstore* s, uint32_t type);
+
+// Episode queries. index is the position of a delimiter in the sidecar (see svstore_find_index).
+uint32_t svstore_num_indexes(const svstore* s);
+int svstore_find_index(const svstore* s, const char* delimiterType);
+uint32_t svstore_index_type(const svstore* s, uint32_t index);
+uint32_t svstore_num_episodes(const svstore* s, uint32_t index);
+const uint64_t* svstore_episode_rows(const svstore* s, uint32_t index, uint32_t type);
+int svstore_query(const svstore* s, uint32_t index, uint32_t type, uint32_t firstEpisode, uint32_t lastEpisode,
+	uint64_t* rowBegin, uint64_t* rowEnd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,163 @@
+/*
+svstore_cli.cpp - Command line tool for SatellitesViewer event stores.
+Released into the public domain.
+
+Usage
+	svstore convert <log.txt> <store.svs> [-t tagDelimiter] [-m msgDelimiter] [-i delimiterEvent ...]
+		Convert a log to a store, optionally indexing episodes by delimiter events.
+	svstore index <store.svs> <delimiterEvent> [...]
+		(Re)write the sidecar index for the given delimiter events.
+	svstore info <store.svs>
+		List event types and indexes.
+	svstore query <store.svs> <eventType> [<delimiterEvent> <firstEpisode> <lastEpisode>]
+		Print rows of a type as tab-separated episode, device time, host time and values.
+
+Build
+	g++ -O2 -std=c++11 -pthread svlog.cpp svmap.cpp svstore.cpp svstore_cli.cpp -o svstore
+*/
+
+#include "svstore.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+static int fail(const char* what, int err)
+{
+	fprintf(stderr, "%s: %s\n", what, svlog_error_string(err));
+	return 1;
+}
+
+static int convert(int argc, char** argv)
+{
+	svlog_options opt;
+	svlog_default_options(&opt);
+	std::vector<const char*> delimiters;
+
+	for (int i = 4; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+			opt.tagDelimiter = argv[++i][0];
+		else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc)
+			opt.msgDelimiter = argv[++i][0];
+		else if (strcmp(argv[i], "-i") == 0)
+			for (; i + 1 < argc && argv[i+1][0] != '-'; i++)
+				delimiters.push_back(argv[i+1]);
+	}
+
+	svlog_log* log = NULL;
+	int err = svlog_open_file(argv[2], &opt, &log);
+	if (err != SVLOG_OK)
+		return fail(argv[2], err);
+
+	err = svstore_write(log, argv[3]);
+	svlog_close(log);
+	if (err != SVLOG_OK)
+		return fail(argv[3], err);
+
+	if (!delimiters.empty())
+	{
+		err = svstore_write_index(argv[3], delimiters.data(), (int)delimiters.size());
+		if (err != SVLOG_OK)
+			return fail(argv[3], err);
+	}
+
+	return 0;
+}
+
+static int info(svstore* s)
+{
+	printf("%llu events, %u types\n", (unsigned long long)svstore_num_events(s), svstore_num_types(s));
+	for (uint32_t k = 0; k < svstore_num_types(s); k++)
+	{
+		uint32_t len;
+		const char* name = svstore_type_name(s, k, &len);
+		printf("  %.*s\t%llu rows\t%u values\n", (int)len, name,
+			(unsigned long long)svstore_num_rows(s, k), svstore_num_values(s, k));
+	}
+
+	for (uint32_t d = 0; d < svstore_num_indexes(s); d++)
+	{
+		printf("Index %u: %u episodes\n", d, svstore_num_episodes(s, d));
+	}
+
+	return 0;
+}
+
+static int query(svstore* s, int argc, char** argv)
+{
+	int type = svstore_find_type(s, argv[3]);
+	if (type < 0)
+		return fail(argv[3], SVLOG_ERR_TYPE);
+
+	uint64_t rowBegin = 0, rowEnd = svstore_num_rows(s, type);
+	int index = -1;
+	uint32_t firstEpisode = 0;
+
+	if (argc > 6)
+	{
+		index = svstore_find_index(s, argv[4]);
+		if (index < 0)
+			return fail(argv[4], SVLOG_ERR_TYPE);
+
+		firstEpisode = (uint32_t)strtoul(argv[5], NULL, 10);
+		svstore_query(s, index, type, firstEpisode, (uint32_t)strtoul(argv[6], NULL, 10), &rowBegin, &rowEnd);
+	}
+
+	const double* dt = svstore_device_times(s, type);
+	const int64_t* ht = svstore_host_times(s, type);
+	const double* v = svstore_values(s, type);
+	uint32_t numValues = svstore_num_values(s, type);
+	const uint64_t* epRows = index >= 0 ? svstore_episode_rows(s, index, type) : NULL;
+	uint32_t ep = firstEpisode;
+
+	for (uint64_t r = rowBegin; r < rowEnd; r++)
+	{
+		while (epRows && epRows[ep + 1] <= r)
+			ep++;
+
+		printf("%u\t%.15g\t%lld", epRows ? ep : 0, dt[r], (long long)ht[r]);
+		for (uint32_t k = 0; k < numValues; k++)
+			printf("\t%.15g", v[r * numValues + k]);
+		printf("\n");
+	}
+
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 3)
+	{
+		fprintf(stderr,
+			"Usage: svstore convert <log.txt> <store.svs> [-t d] [-m d] [-i delimiterEvent ...]\n"
+			"       svstore index <store.svs> <delimiterEvent> [...]\n"
+			"       svstore info <store.svs>\n"
+			"       svstore query <store.svs> <eventType> [<delimiterEvent> <firstEpisode> <lastEpisode>]\n");
+		return 2;
+	}
+
+	if (strcmp(argv[1], "convert") == 0 && argc > 3)
+		return convert(argc, argv);
+
+	if (strcmp(argv[1], "index") == 0 && argc > 3)
+	{
+		int err = svstore_write_index(argv[2], (const char* const*)(argv + 3), argc - 3);
+		return err == SVLOG_OK ? 0 : fail(argv[2], err);
+	}
+
+	svstore* s = NULL;
+	int err = svstore_open(argv[2], &s);
+	if (err != SVLOG_OK)
+		return fail(argv[2], err);
+
+	int r = 2;
+	if (strcmp(argv[1], "info") == 0)
+		r = info(s);
+	else if (strcmp(argv[1], "query") == 0 && argc > 3)
+		r = query(s, argc, argv);
+
+	svstore_close(s);
+	return r;
+}
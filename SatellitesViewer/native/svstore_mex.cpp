@@ -0,0 +1,232 @@
+/*
+svstore_mex.cpp - MEX gateway to SatellitesViewer event stores.
+Released into the public domain.
+
+	svstore_mex('convert', svPath, storePath, tagDelimiter, msgDelimiter)
+	svstore_mex('index', storePath, delimiterEvents)
+	info = svstore_mex('info', storePath)
+	[deviceTime, hostTime, values, episode] = svstore_mex('query', storePath, eventType)
+	[deviceTime, hostTime, values, episode] = svstore_mex('query', storePath, eventType, delimiterEvent, firstEpisode, lastEpisode)
+
+hostTime is in milliseconds since 1970 (NaN when missing). Episodes are numbered from 0 for
+events before the first delimiter. Use Satellites.WriteStore and Satellites.QueryStore
+rather than calling this directly.
+
+Build with Satellites.BuildNative, or
+	mex -O svlog.cpp svmap.cpp svstore.cpp svstore_mex.cpp -outdir ..
+*/
+
+#include "mex.h"
+#include "svstore.h"
+
+#include <math.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+static std::string getString(const mxArray* a, const char* what)
+{
+	if (!mxIsChar(a))
+		mexErrMsgIdAndTxt("svstore:input", "%s must be a string.", what);
+
+	char* s = mxArrayToUTF8String(a);
+	std::string str(s);
+	mxFree(s);
+	return str;
+}
+
+static void check(int err, const std::string& what)
+{
+	if (err != SVLOG_OK)
+		mexErrMsgIdAndTxt("svstore:error", "%s: %s", what.c_str(), svlog_error_string(err));
+}
+
+static void convert(int nrhs, const mxArray* prhs[])
+{
+	if (nrhs < 3)
+		mexErrMsgIdAndTxt("svstore:input", "Usage: svstore_mex('convert', svPath, storePath, tagDelimiter, msgDelimiter)");
+
+	std::string svPath = getString(prhs[1], "svPath");
+	std::string storePath = getString(prhs[2], "storePath");
+
+	svlog_options opt;
+	svlog_default_options(&opt);
+	if (nrhs > 3)
+		opt.tagDelimiter = getString(prhs[3], "tagDelimiter")[0];
+	if (nrhs > 4)
+		opt.msgDelimiter = getString(prhs[4], "msgDelimiter")[0];
+
+	svlog_log* log = NULL;
+	check(svlog_open_file(svPath.c_str(), &opt, &log), svPath);
+	int err = svstore_write(log, storePath.c_str());
+	svlog_close(log);
+	check(err, storePath);
+}
+
+static void index(int nrhs, const mxArray* prhs[])
+{
+	if (nrhs < 3 || !(mxIsCell(prhs[2]) || mxIsChar(prhs[2])))
+		mexErrMsgIdAndTxt("svstore:input", "Usage: svstore_mex('index', storePath, delimiterEvents)");
+
+	std::string storePath = getString(prhs[1], "storePath");
+
+	std::vector<std::string> names;
+	if (mxIsChar(prhs[2]))
+		names.push_back(getString(prhs[2], "delimiterEvents"));
+	else
+		for (size_t i = 0; i < mxGetNumberOfElements(prhs[2]); i++)
+			names.push_back(getString(mxGetCell(prhs[2], i), "delimiterEvents"));
+
+	std::vector<const char*> ptrs;
+	for (size_t i = 0; i < names.size(); i++)
+		ptrs.push_back(names[i].c_str());
+
+	check(svstore_write_index(storePath.c_str(), ptrs.data(), (int)ptrs.size()), storePath);
+}
+
+static mxArray* info(const svstore* s)
+{
+	const char* fields[] = { "eventTypes", "numRows", "numValues", "numEpisodes" };
+	mxArray* info = mxCreateStructMatrix(1, 1, 4, fields);
+
+	uint32_t numTypes = svstore_num_types(s);
+	mxArray* types = mxCreateCellMatrix(numTypes, 1);
+	mxArray* rows = mxCreateDoubleMatrix(numTypes, 1, mxREAL);
+	mxArray* vals = mxCreateDoubleMatrix(numTypes, 1, mxREAL);
+	for (uint32_t k = 0; k < numTypes; k++)
+	{
+		uint32_t len;
+		const char* name = svstore_type_name(s, k, &len);
+		mxSetCell(types, k, mxCreateString(std::string(name, len).c_str()));
+		mxGetPr(rows)[k] = (double)svstore_num_rows(s, k);
+		mxGetPr(vals)[k] = svstore_num_values(s, k);
+	}
+
+	// Number of episodes of each indexed delimiter, in a struct with the delimiter names as fields
+	mxArray* eps = mxCreateStructMatrix(1, 1, 0, NULL);
+	for (uint32_t d = 0; d < svstore_num_indexes(s); d++)
+	{
+		uint32_t len;
+		const char* p = svstore_type_name(s, svstore_index_type(s, d), &len);
+		std::string name(p, len);
+		if (mxAddField(eps, name.c_str()) >= 0)
+			mxSetField(eps, 0, name.c_str(), mxCreateDoubleScalar(svstore_num_episodes(s, d)));
+	}
+
+	mxSetField(info, 0, "eventTypes", types);
+	mxSetField(info, 0, "numRows", rows);
+	mxSetField(info, 0, "numValues", vals);
+	mxSetField(info, 0, "numEpisodes", eps);
+	return info;
+}
+
+static bool query(const svstore* s, int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[])
+{
+	std::string eventType = getString(prhs[2], "eventType");
+	int type = svstore_find_type(s, eventType.c_str());
+
+	// A type that never occurred gives empty results
+	uint64_t rowBegin = 0, rowEnd = type >= 0 ? svstore_num_rows(s, type) : 0;
+	const uint64_t* epRows = NULL;
+	uint32_t ep = 0;
+
+	if (nrhs > 5)
+	{
+		std::string delimiter = getString(prhs[3], "delimiterEvent");
+		int index = svstore_find_index(s, delimiter.c_str());
+		if (index < 0)
+			return false;
+
+		double first = mxGetScalar(prhs[4]), last = mxGetScalar(prhs[5]);
+		ep = first > 0 ? (uint32_t)first : 0;
+		uint32_t lastEp = last > 0 ? (uint32_t)fmin(last, 4294967295.0) : 0;
+		if (type >= 0 && last >= 0)
+		{
+			svstore_query(s, index, type, ep, lastEp, &rowBegin, &rowEnd);
+			epRows = svstore_episode_rows(s, index, type);
+		}
+		else
+			rowEnd = rowBegin;
+	}
+
+	size_t n = rowEnd - rowBegin;
+	uint32_t numValues = type >= 0 ? svstore_num_values(s, type) : 0;
+
+	plhs[0] = mxCreateDoubleMatrix(n, 1, mxREAL);
+	if (n > 0)
+		memcpy(mxGetPr(plhs[0]), svstore_device_times(s, type) + rowBegin, n * sizeof(double));
+
+	if (nlhs > 1)
+	{
+		plhs[1] = mxCreateDoubleMatrix(n, 1, mxREAL);
+		double* ht = mxGetPr(plhs[1]);
+		const int64_t* src = n > 0 ? svstore_host_times(s, type) + rowBegin : NULL;
+		for (size_t i = 0; i < n; i++)
+			ht[i] = src[i] == INT64_MIN ? NAN : (double)src[i];
+	}
+
+	if (nlhs > 2)
+	{
+		// Stored row-major, returned as a [n,numValues] matrix
+		plhs[2] = mxCreateDoubleMatrix(n, numValues, mxREAL);
+		double* v = mxGetPr(plhs[2]);
+		const double* src = n > 0 ? svstore_values(s, type) + rowBegin * numValues : NULL;
+		for (size_t i = 0; i < n; i++)
+			for (uint32_t k = 0; k < numValues; k++)
+				v[i + k * n] = src[i * numValues + k];
+	}
+
+	if (nlhs > 3)
+	{
+		plhs[3] = mxCreateDoubleMatrix(n, 1, mxREAL);
+		double* e = mxGetPr(plhs[3]);
+		for (size_t i = 0; i < n; i++)
+		{
+			while (epRows && epRows[ep + 1] <= rowBegin + i)
+				ep++;
+			e[i] = epRows ? ep : NAN;
+		}
+	}
+
+	return true;
+}
+
+void mexFunction(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[])
+{
+	if (nrhs < 2)
+		mexErrMsgIdAndTxt("svstore:input", "Usage: svstore_mex(command, storePath, ...)");
+
+	std::string cmd = getString(prhs[0], "command");
+
+	if (cmd == "convert")
+	{
+		convert(nrhs, prhs);
+		return;
+	}
+	if (cmd == "index")
+	{
+		index(nrhs, prhs);
+		return;
+	}
+
+	std::string storePath = getString(prhs[1], "storePath");
+	svstore* s = NULL;
+	check(svstore_open(storePath.c_str(), &s), storePath);
+
+	// Close the store before raising errors
+	bool isOk = true;
+	if (cmd == "info")
+		plhs[0] = info(s);
+	else if (cmd == "query" && nrhs > 2)
+		isOk = query(s, nlhs, plhs, nrhs, prhs);
+	else
+	{
+		svstore_close(s);
+		mexErrMsgIdAndTxt("svstore:input", "Unknown command '%s'.", cmd.c_str());
+	}
+
+	svstore_close(s);
+
+	if (!isOk)
+		mexErrMsgIdAndTxt("svstore:index", "The delimiter event is not indexed. Use Satellites.WriteStore to index it.");
+}
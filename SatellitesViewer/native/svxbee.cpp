@@ -0,0 +1,400 @@
+/*
+svxbee.cpp - XBee API frame codec and per-node line router.
+Released into the public domain.
+*/
+
+#include "svxbee.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include <vector>
+
+enum
+{
+	waitStart,
+	waitLengthMsb,
+	waitLengthLsb,
+	waitData
+};
+
+static const uint8_t escapeXor = 0x20;
+
+
+
+void svxbee_decoder_init(svxbee_decoder* d, int isEscapedMode)
+{
+	memset(d, 0, sizeof(*d));
+	d->state = waitStart;
+	d->isEscapedMode = isEscapedMode ? 1 : 0;
+}
+
+static uint64_t readBigEndian(const uint8_t* p, int n)
+{
+	uint64_t v = 0;
+	for (int i = 0; i < n; i++)
+		v = (v << 8) | p[i];
+	return v;
+}
+
+static void emitFrame(svxbee_decoder* d, svxbee_frame_fn fn, void* user)
+{
+	svxbee_frame f;
+	memset(&f, 0, sizeof(f));
+	f.type = d->buf[0];
+	f.data = d->buf + 1;
+	f.length = d->length - 1;
+
+	// Type, 64-bit and 16-bit source address, options, payload
+	if (f.type == SVXBEE_RX_PACKET && d->length >= 12)
+	{
+		f.src64 = readBigEndian(d->buf + 1, 8);
+		f.src16 = (uint16_t)readBigEndian(d->buf + 9, 2);
+		f.options = d->buf[11];
+		f.payload = d->buf + 12;
+		f.payloadLength = d->length - 12;
+	}
+
+	d->frames++;
+	if (fn)
+		fn(&f, user);
+}
+
+// In unescaped mode a start delimiter can occur inside a frame, so after a bad frame the
+// bytes following its start are scanned again for the next one
+static size_t rescan(svxbee_decoder* d, svxbee_frame_fn fn, void* user)
+{
+	d->state = waitStart;
+	if (d->isEscapedMode)
+		return 0;
+
+	uint8_t raw[SVXBEE_MAX_FRAME + 3];
+	size_t n = 0;
+	raw[n++] = (uint8_t)(d->length >> 8);
+	raw[n++] = (uint8_t)(d->length & 0xFF);
+	if (d->pos > 0)
+	{
+		memcpy(raw + n, d->buf, d->pos);
+		n += d->pos;
+	}
+
+	// Bytes before the next start are counted as discarded again by the scan
+	d->discardedBytes -= n;
+	return svxbee_decode(d, raw, n, fn, user);
+}
+
+size_t svxbee_decode(svxbee_decoder* d, const uint8_t* bytes, size_t n, svxbee_frame_fn fn, void* user)
+{
+	size_t numFrames = 0;
+
+	for (size_t i = 0; i < n; i++)
+	{
+		uint8_t b = bytes[i];
+
+		if (d->state == waitStart)
+		{
+			// Skip garbage quickly
+			const uint8_t* p = (const uint8_t*)memchr(bytes + i, SVXBEE_START, n - i);
+			if (!p)
+			{
+				d->discardedBytes += n - i;
+				break;
+			}
+			d->discardedBytes += p - (bytes + i);
+			i = p - bytes;
+			d->state = waitLengthMsb;
+			d->isEscaping = 0;
+			continue;
+		}
+
+		if (d->isEscapedMode)
+		{
+			// A start delimiter is never escaped, so it always begins a new frame
+			if (b == SVXBEE_START)
+			{
+				d->discardedBytes += 1 + (d->state > waitLengthMsb) + (d->state > waitLengthLsb) + d->pos;
+				d->lengthErrors += d->state == waitData;
+				d->state = waitLengthMsb;
+				d->isEscaping = 0;
+				continue;
+			}
+			if (b == SVXBEE_ESCAPE)
+			{
+				d->isEscaping = 1;
+				continue;
+			}
+			if (d->isEscaping)
+			{
+				b ^= escapeXor;
+				d->isEscaping = 0;
+			}
+		}
+
+		switch (d->state)
+		{
+			case waitLengthMsb:
+				d->length = (uint16_t)(b << 8);
+				d->state = waitLengthLsb;
+				break;
+
+			case waitLengthLsb:
+				d->length |= b;
+				d->pos = 0;
+				d->sum = 0;
+				if (d->length == 0 || d->length > SVXBEE_MAX_FRAME)
+				{
+					d->lengthErrors++;
+					d->discardedBytes += 3;
+					numFrames += rescan(d, fn, user);
+				}
+				else
+					d->state = waitData;
+				break;
+
+			case waitData:
+				d->buf[d->pos++] = b;
+				d->sum += b;
+				if (d->pos <= d->length)
+					break;
+
+				// Frame data and checksum add up to 0xFF
+				if (d->sum == 0xFF)
+				{
+					d->state = waitStart;
+					emitFrame(d, fn, user);
+					numFrames++;
+				}
+				else
+				{
+					d->checksumErrors++;
+					d->discardedBytes += 3 + d->pos;
+					numFrames += rescan(d, fn, user);
+				}
+				break;
+		}
+	}
+
+	return numFrames;
+}
+
+
+
+static bool needsEscape(uint8_t b)
+{
+	return b == SVXBEE_START || b == SVXBEE_ESCAPE || b == SVXBEE_XON || b == SVXBEE_XOFF;
+}
+
+// Appends a byte, escaped if needed. Returns false when out is full.
+static inline bool put(uint8_t b, int isEscapedMode, uint8_t* out, size_t cap, size_t* pos)
+{
+	if (isEscapedMode && needsEscape(b))
+	{
+		if (*pos + 2 > cap)
+			return false;
+		out[(*pos)++] = SVXBEE_ESCAPE;
+		out[(*pos)++] = b ^ escapeXor;
+		return true;
+	}
+	if (*pos + 1 > cap)
+		return false;
+	out[(*pos)++] = b;
+	return true;
+}
+
+// Writes a frame whose data is a header followed by a payload
+static size_t encode(const uint8_t* head, size_t numHead, const uint8_t* data, size_t n, int isEscapedMode,
+	uint8_t* out, size_t cap)
+{
+	size_t length = numHead + n;
+	if (length == 0 || length > 0xFFFF || cap == 0)
+		return 0;
+
+	size_t pos = 0;
+	out[pos++] = SVXBEE_START;
+	bool isOk = put((uint8_t)(length >> 8), isEscapedMode, out, cap, &pos)
+		&& put((uint8_t)(length & 0xFF), isEscapedMode, out, cap, &pos);
+
+	uint8_t sum = 0;
+	for (size_t i = 0; isOk && i < numHead; i++)
+	{
+		sum += head[i];
+		isOk = put(head[i], isEscapedMode, out, cap, &pos);
+	}
+	for (size_t i = 0; isOk && i < n; i++)
+	{
+		sum += data[i];
+		isOk = put(data[i], isEscapedMode, out, cap, &pos);
+	}
+	isOk = isOk && put(0xFF - sum, isEscapedMode, out, cap, &pos);
+
+	return isOk ? pos : 0;
+}
+
+size_t svxbee_encode(uint8_t type, const uint8_t* data, size_t n, int isEscapedMode, uint8_t* out, size_t cap)
+{
+	return encode(&type, 1, data, n, isEscapedMode, out, cap);
+}
+
+size_t svxbee_encode_tx(uint64_t dest64, uint16_t dest16, uint8_t frameId, const uint8_t* payload, size_t n,
+	int isEscapedMode, uint8_t* out, size_t cap)
+{
+	// Type, frame ID, 64-bit and 16-bit destination, broadcast radius, options
+	uint8_t head[14];
+	head[0] = SVXBEE_TX_REQUEST;
+	head[1] = frameId;
+	for (int i = 0; i < 8; i++)
+		head[2 + i] = (uint8_t)(dest64 >> (56 - 8 * i));
+	head[10] = (uint8_t)(dest16 >> 8);
+	head[11] = (uint8_t)(dest16 & 0xFF);
+	head[12] = 0;
+	head[13] = 0;
+	return encode(head, sizeof(head), payload, n, isEscapedMode, out, cap);
+}
+
+
+
+struct svxbee_node
+{
+	uint64_t src64;
+	std::vector<char> line;
+	bool isDropping;
+};
+
+struct svxbee_router
+{
+	std::vector<svxbee_node> nodes;
+	size_t maxNodes;
+	size_t maxLineLength;
+	unsigned long dropped;
+
+	// Open addressing table of node indices by address, -1 when empty
+	std::vector<int> slots;
+	uint64_t mask;
+};
+
+static uint64_t hashAddress(uint64_t a)
+{
+	a ^= a >> 33;
+	a *= 0xFF51AFD7ED558CCDULL;
+	a ^= a >> 33;
+	return a;
+}
+
+svxbee_router* svxbee_router_create(int maxNodes, size_t maxLineLength)
+{
+	if (maxNodes <= 0 || maxLineLength == 0)
+		return NULL;
+
+	svxbee_router* r = new (std::nothrow) svxbee_router;
+	if (!r)
+		return NULL;
+
+	size_t numSlots = 16;
+	while (numSlots < 2 * (size_t)maxNodes)
+		numSlots *= 2;
+
+	r->maxNodes = maxNodes;
+	r->maxLineLength = maxLineLength;
+	r->dropped = 0;
+	r->mask = numSlots - 1;
+	try
+	{
+		r->slots.assign(numSlots, -1);
+		r->nodes.reserve(maxNodes);
+	}
+	catch (const std::bad_alloc&)
+	{
+		delete r;
+		return NULL;
+	}
+	return r;
+}
+
+void svxbee_router_destroy(svxbee_router* r)
+{
+	delete r;
+}
+
+static int findSlot(const svxbee_router* r, uint64_t src64)
+{
+	uint64_t k = hashAddress(src64) & r->mask;
+	while (r->slots[k] >= 0 && r->nodes[r->slots[k]].src64 != src64)
+		k = (k + 1) & r->mask;
+	return (int)k;
+}
+
+int svxbee_router_find(const svxbee_router* r, uint64_t src64)
+{
+	return r->slots[findSlot(r, src64)];
+}
+
+int svxbee_router_num_nodes(const svxbee_router* r)
+{
+	return (int)r->nodes.size();
+}
+
+uint64_t svxbee_router_address(const svxbee_router* r, int node)
+{
+	return node >= 0 && node < (int)r->nodes.size() ? r->nodes[node].src64 : 0;
+}
+
+unsigned long svxbee_router_dropped(const svxbee_router* r)
+{
+	return r->dropped;
+}
+
+int svxbee_router_route(svxbee_router* r, const svxbee_frame* frame, svxbee_line_fn fn, void* user)
+{
+	if (frame->type != SVXBEE_RX_PACKET || !frame->payload)
+		return -1;
+
+	// Nodes are added on their first packet
+	int slot = findSlot(r, frame->src64);
+	int node = r->slots[slot];
+	if (node < 0)
+	{
+		if (r->nodes.size() >= r->maxNodes)
+		{
+			r->dropped++;
+			return -1;
+		}
+		node = (int)r->nodes.size();
+		r->nodes.push_back(svxbee_node());
+		r->nodes[node].src64 = frame->src64;
+		r->nodes[node].isDropping = false;
+		r->nodes[node].line.reserve(r->maxLineLength);
+		r->slots[slot] = node;
+	}
+
+	// Lines end with '\r', '\n' or both and empty lines are skipped, as in MSerial
+	svxbee_node& n = r->nodes[node];
+	const char* p = (const char*)frame->payload;
+	const char* e = p + frame->payloadLength;
+	while (p < e)
+	{
+		const char* q = p;
+		while (q < e && *q != '\r' && *q != '\n')
+			q++;
+
+		// An overlong line is dropped up to its end
+		if (!n.isDropping && n.line.size() + (q - p) > r->maxLineLength)
+		{
+			r->dropped++;
+			n.isDropping = true;
+			n.line.clear();
+		}
+		if (!n.isDropping)
+			n.line.insert(n.line.end(), p, q);
+
+		if (q == e)
+			break;
+
+		if (!n.line.empty() && fn)
+			fn(node, frame->src64, n.line.data(), n.line.size(), user);
+		n.line.clear();
+		n.isDropping = false;
+		p = q + 1;
+	}
+
+	return node;
+}
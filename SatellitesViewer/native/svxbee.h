@@ -0,0 +1,101 @@
+/*
+svxbee.h - XBee API frame codec and per-node line router.
+Released into the public domain.
+
+The decoder takes a serial byte stream in API mode 1 (unescaped) or 2 (escaped), checks
+lengths and checksums and resynchronizes on the next start delimiter after garbage or a
+corrupt frame. Receive Packet frames (0x90) are split into source address, options and
+payload. The router keeps one line stream per 64-bit source address so that messages
+from several radio-linked rigs are framed independently, like separate serial ports.
+
+Build the benchmark
+	g++ -O2 -std=c++11 svxbee.cpp svxbee_cli.cpp -o svxbee
+Build the MEX function (or call Satellites.BuildNative in MATLAB)
+	mex -O svxbee.cpp svxbee_mex.cpp -outdir ..
+The round trip and resynchronization test is XBeeFrameTest in Arduino libraries/HostArduino/Tests.
+*/
+
+#ifndef svxbee_h
+#define svxbee_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SVXBEE_START			0x7E
+#define SVXBEE_ESCAPE			0x7D
+#define SVXBEE_XON				0x11
+#define SVXBEE_XOFF				0x13
+#define SVXBEE_TX_REQUEST		0x10
+#define SVXBEE_RX_PACKET		0x90
+
+// Largest frame data (frame type to end of payload) accepted by the decoder
+#define SVXBEE_MAX_FRAME		512
+
+// Broadcast destination of Transmit Request frames
+#define SVXBEE_BROADCAST64		0x000000000000FFFFULL
+#define SVXBEE_UNKNOWN16		0xFFFE
+
+typedef struct
+{
+	uint8_t type;
+	const uint8_t* data;		// frame data after the type byte
+	uint16_t length;
+
+	// Receive Packet fields, zero for other frame types
+	uint64_t src64;
+	uint16_t src16;
+	uint8_t options;
+	const uint8_t* payload;
+	uint16_t payloadLength;
+} svxbee_frame;
+
+typedef void (*svxbee_frame_fn)(const svxbee_frame* frame, void* user);
+
+typedef struct
+{
+	uint8_t buf[SVXBEE_MAX_FRAME + 1];	// frame data and checksum
+	uint16_t length;
+	uint16_t pos;
+	uint8_t state;
+	uint8_t isEscapedMode;
+	uint8_t isEscaping;
+	uint8_t sum;
+
+	// Counters
+	unsigned long frames;
+	unsigned long checksumErrors;
+	unsigned long lengthErrors;
+	unsigned long discardedBytes;
+} svxbee_decoder;
+
+// Decoding. Returns the number of valid frames passed to fn.
+void svxbee_decoder_init(svxbee_decoder* d, int isEscapedMode);
+size_t svxbee_decode(svxbee_decoder* d, const uint8_t* bytes, size_t n, svxbee_frame_fn fn, void* user);
+
+// Encoding. Returns the number of bytes written, or 0 if out is too small or the data too long.
+// An escaped frame needs at most 2 * (n + 18) + 1 bytes.
+size_t svxbee_encode(uint8_t type, const uint8_t* data, size_t n, int isEscapedMode, uint8_t* out, size_t cap);
+size_t svxbee_encode_tx(uint64_t dest64, uint16_t dest16, uint8_t frameId, const uint8_t* payload, size_t n,
+	int isEscapedMode, uint8_t* out, size_t cap);
+
+// Routing of Receive Packet payloads into lines per source address
+typedef struct svxbee_router svxbee_router;
+typedef void (*svxbee_line_fn)(int node, uint64_t src64, const char* line, size_t len, void* user);
+
+svxbee_router* svxbee_router_create(int maxNodes, size_t maxLineLength);
+void svxbee_router_destroy(svxbee_router* r);
+int svxbee_router_route(svxbee_router* r, const svxbee_frame* frame, svxbee_line_fn fn, void* user);
+int svxbee_router_find(const svxbee_router* r, uint64_t src64);
+int svxbee_router_num_nodes(const svxbee_router* r);
+uint64_t svxbee_router_address(const svxbee_router* r, int node);
+unsigned long svxbee_router_dropped(const svxbee_router* r);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
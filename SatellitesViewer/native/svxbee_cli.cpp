@@ -0,0 +1,310 @@
+/*
+svxbee_cli.cpp - Benchmark of the XBee API frame codec and router.
+Released into the public domain.
+
+Usage
+	svxbee [numFrames] [numNodes] [-u]
+		Encode Receive Packet frames carrying event lines from numNodes radios (16 by
+		default), decode and route them in serial-sized reads and check that every line
+		arrives at the right node. The stream is then corrupted with garbage and bad
+		bytes to measure how the decoder recovers. -u uses unescaped frames (API mode 1).
+
+Build
+	g++ -O2 -std=c++11 svxbee.cpp svxbee_cli.cpp -o svxbee
+*/
+
+#include "svxbee.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+// RF payload per frame and bytes per serial read
+static const size_t maxPayload = 72;
+static const size_t readSize = 4096;
+
+static double now()
+{
+	using namespace std::chrono;
+	return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+static uint64_t fnv(uint64_t h, const char* p, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+		h = (h ^ (uint8_t)p[i]) * 0x100000001B3ULL;
+	return h;
+}
+
+static uint32_t rnd(uint32_t* s)
+{
+	*s ^= *s << 13;
+	*s ^= *s >> 17;
+	*s ^= *s << 5;
+	return *s;
+}
+
+struct Stream
+{
+	std::vector<uint8_t> bytes;
+	std::vector<size_t> frameStart;
+	size_t numFrames;
+};
+
+struct Node
+{
+	uint64_t src64;
+	std::string pending;
+	size_t numLines;
+	uint64_t hash;
+};
+
+struct Received
+{
+	std::vector<Node>* nodes;
+	svxbee_router* router;
+	size_t numLines;
+	size_t numMisrouted;
+	std::vector<uint64_t> hash;
+	std::vector<size_t> count;
+};
+
+static void onLine(int node, uint64_t src64, const char* line, size_t len, void* user)
+{
+	Received* rx = (Received*)user;
+	if ((size_t)node >= rx->hash.size() || (*rx->nodes)[node].src64 != src64)
+	{
+		rx->numMisrouted++;
+		return;
+	}
+	rx->hash[node] = fnv(fnv(rx->hash[node], line, len), "\n", 1);
+	rx->count[node]++;
+	rx->numLines++;
+}
+
+static void onFrame(const svxbee_frame* f, void* user)
+{
+	Received* rx = (Received*)user;
+	svxbee_router_route(rx->router, f, onLine, rx);
+}
+
+// Sends the next len bytes of a node's lines in a Receive Packet frame
+static void appendFrame(Stream& s, Node& n, size_t len, bool isEscaped)
+{
+	uint8_t head[11 + maxPayload];
+	uint8_t out[2 * (maxPayload + 32)];
+
+	// Source address, 16-bit address, options and payload
+	for (int k = 0; k < 8; k++)
+		head[k] = (uint8_t)(n.src64 >> (56 - 8 * k));
+	head[8] = 0x7D;
+	head[9] = 0x33;
+	head[10] = 0x01;
+	memcpy(head + 11, n.pending.data(), len);
+	n.pending.erase(0, len);
+
+	size_t m = svxbee_encode(SVXBEE_RX_PACKET, head, 11 + len, isEscaped, out, sizeof(out));
+	s.frameStart.push_back(s.bytes.size());
+	s.bytes.insert(s.bytes.end(), out, out + m);
+}
+
+// Frames from nodes in random order, each carrying the next part of the node's lines
+static Stream makeStream(std::vector<Node>& nodes, size_t numFrames, bool isEscaped)
+{
+	Stream s;
+	s.bytes.reserve(numFrames * (maxPayload + 20) * (isEscaped ? 11 : 10) / 10);
+
+	uint32_t seed = 12345;
+	char line[64];
+
+	for (size_t i = 0; i < numFrames; i++)
+	{
+		Node& n = nodes[rnd(&seed) % nodes.size()];
+		while (n.pending.size() < maxPayload)
+		{
+			int len = snprintf(line, sizeof(line), "position,%u,%d,%d",
+				(unsigned)(n.numLines * 10), (int)(rnd(&seed) % 2000) - 1000, (int)(rnd(&seed) % 2000) - 1000);
+			n.hash = fnv(fnv(n.hash, line, len), "\n", 1);
+			n.numLines++;
+			n.pending.append(line, len);
+			n.pending.append("\r\n");
+		}
+		appendFrame(s, n, 1 + rnd(&seed) % maxPayload, isEscaped);
+	}
+
+	// Flush the lines left at each node
+	for (size_t k = 0; k < nodes.size(); k++)
+		while (!nodes[k].pending.empty())
+			appendFrame(s, nodes[k], std::min(nodes[k].pending.size(), maxPayload), isEscaped);
+
+	s.numFrames = s.frameStart.size();
+	return s;
+}
+
+static Received decode(std::vector<Node>& nodes, const std::vector<uint8_t>& bytes, bool isEscaped,
+	svxbee_decoder* d, double* dt)
+{
+	Received rx;
+	rx.nodes = &nodes;
+	rx.router = svxbee_router_create((int)nodes.size(), 256);
+	rx.numLines = 0;
+	rx.numMisrouted = 0;
+	rx.hash.assign(nodes.size(), 0xCBF29CE484222325ULL);
+	rx.count.assign(nodes.size(), 0);
+
+	// Register nodes in order so that node indices match
+	static const uint8_t empty = 0;
+	for (size_t k = 0; k < nodes.size(); k++)
+	{
+		svxbee_frame f;
+		memset(&f, 0, sizeof(f));
+		f.type = SVXBEE_RX_PACKET;
+		f.src64 = nodes[k].src64;
+		f.payload = &empty;
+		svxbee_router_route(rx.router, &f, NULL, NULL);
+	}
+
+	svxbee_decoder_init(d, isEscaped);
+	double t0 = now();
+	for (size_t i = 0; i < bytes.size(); i += readSize)
+	{
+		size_t n = bytes.size() - i < readSize ? bytes.size() - i : readSize;
+		svxbee_decode(d, bytes.data() + i, n, onFrame, &rx);
+	}
+	*dt = now() - t0;
+
+	svxbee_router_destroy(rx.router);
+	return rx;
+}
+
+// Flips a low bit of a payload byte in some frames and inserts garbage between others
+static std::vector<uint8_t> corrupt(const Stream& s, bool isEscaped, size_t* numBad, size_t* numGarbage)
+{
+	std::vector<uint8_t> out;
+	out.reserve(s.bytes.size() * 11 / 10);
+	uint32_t seed = 777;
+	*numBad = 0;
+	*numGarbage = 0;
+
+	for (size_t i = 0; i < s.numFrames; i++)
+	{
+		size_t b = s.frameStart[i];
+		size_t e = i + 1 < s.numFrames ? s.frameStart[i + 1] : s.bytes.size();
+
+		if (rnd(&seed) % 50 == 0)
+		{
+			size_t n = 1 + rnd(&seed) % 16;
+			for (size_t k = 0; k < n; k++)
+			{
+				// Garbage may contain start delimiters but no escapes
+				uint8_t g = (uint8_t)rnd(&seed);
+				out.push_back(g == SVXBEE_ESCAPE ? 0 : g);
+			}
+			*numGarbage += n;
+		}
+
+		size_t first = out.size();
+		out.insert(out.end(), s.bytes.begin() + b, s.bytes.begin() + e);
+
+		if (rnd(&seed) % 100 == 0 && e - b > 17)
+		{
+			// A change of one unescaped byte always breaks the checksum
+			size_t k = first + 16 + rnd(&seed) % (e - b - 17);
+			uint8_t c = out[k] ^ 1;
+			bool isSpecial = out[k-1] == SVXBEE_ESCAPE || out[k] == SVXBEE_ESCAPE || out[k] == SVXBEE_START
+				|| c == SVXBEE_ESCAPE || c == SVXBEE_START || c == SVXBEE_XON || c == SVXBEE_XOFF;
+			if (!isSpecial || !isEscaped)
+			{
+				out[k] = c;
+				(*numBad)++;
+			}
+		}
+	}
+	return out;
+}
+
+int main(int argc, char** argv)
+{
+	size_t numFrames = 2000000;
+	size_t numNodes = 16;
+	bool isEscaped = true;
+
+	int numArgs = 0;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-u") == 0)
+			isEscaped = false;
+		else if (numArgs++ == 0)
+			numFrames = strtoull(argv[i], NULL, 10);
+		else
+			numNodes = strtoull(argv[i], NULL, 10);
+	}
+	if (numFrames == 0 || numNodes == 0)
+	{
+		fprintf(stderr, "Usage: svxbee [numFrames] [numNodes] [-u]\n");
+		return 2;
+	}
+
+	std::vector<Node> nodes(numNodes);
+	for (size_t k = 0; k < numNodes; k++)
+	{
+		nodes[k].src64 = 0x0013A20040000000ULL + k * 0x1F7E;
+		nodes[k].numLines = 0;
+		nodes[k].hash = 0xCBF29CE484222325ULL;
+	}
+
+	printf("%zu frames from %zu nodes, %s\n", numFrames, numNodes, isEscaped ? "escaped (API 2)" : "unescaped (API 1)");
+
+	double t0 = now();
+	Stream s = makeStream(nodes, numFrames, isEscaped);
+	double dtEncode = now() - t0;
+	printf("Encode: %.1f MB in %.3f s, %.2f M frames/s\n", s.bytes.size() / 1e6, dtEncode, s.numFrames / dtEncode / 1e6);
+
+	// Transmit Request encoding alone
+	{
+		uint8_t payload[maxPayload], out[2 * (maxPayload + 32)];
+		memset(payload, 'x', sizeof(payload));
+		size_t total = 0;
+		t0 = now();
+		for (size_t i = 0; i < numFrames; i++)
+		{
+			payload[i % maxPayload] = (uint8_t)i;
+			total += svxbee_encode_tx(SVXBEE_BROADCAST64, SVXBEE_UNKNOWN16, 1, payload, sizeof(payload), isEscaped, out, sizeof(out));
+		}
+		double dt = now() - t0;
+		printf("Encode Transmit Request: %.2f M frames/s (%zu bytes)\n", numFrames / dt / 1e6, total);
+	}
+
+	svxbee_decoder d;
+	double dt;
+	Received rx = decode(nodes, s.bytes, isEscaped, &d, &dt);
+
+	size_t numSent = 0, numMismatched = 0;
+	for (size_t k = 0; k < numNodes; k++)
+	{
+		numSent += nodes[k].numLines;
+		numMismatched += rx.count[k] != nodes[k].numLines || rx.hash[k] != nodes[k].hash;
+	}
+
+	printf("Decode and route: %.2f M frames/s, %.0f MB/s\n", d.frames / dt / 1e6, s.bytes.size() / dt / 1e6);
+	printf("  frames %lu of %zu, lines %zu of %zu sent, misrouted %zu, mismatched nodes %zu\n",
+		d.frames, s.numFrames, rx.numLines, numSent, rx.numMisrouted, numMismatched);
+	printf("  checksum errors %lu, length errors %lu, discarded bytes %lu\n",
+		d.checksumErrors, d.lengthErrors, d.discardedBytes);
+
+	size_t numBad, numGarbage;
+	std::vector<uint8_t> noisy = corrupt(s, isEscaped, &numBad, &numGarbage);
+	rx = decode(nodes, noisy, isEscaped, &d, &dt);
+	printf("Corrupted stream: %zu bad frames, %zu garbage bytes\n", numBad, numGarbage);
+	printf("  %.2f M frames/s, recovered %lu of %zu intact frames, misrouted lines %zu\n",
+		d.frames / dt / 1e6, d.frames, s.numFrames - numBad, rx.numMisrouted);
+	printf("  checksum errors %lu, length errors %lu, discarded bytes %lu\n",
+		d.checksumErrors, d.lengthErrors, d.discardedBytes);
+
+	bool isOk = numMismatched == 0 && d.frames + numBad >= s.numFrames && rx.numMisrouted == 0;
+	return isOk ? 0 : 1;
+}
@@ -0,0 +1,188 @@
+/*
+svxbee_mex.cpp - MEX gateway to the XBee API frame codec.
+Released into the public domain.
+
+	h = svxbee_mex('open', isEscapedMode)
+	[lines, srcAddress64] = svxbee_mex('read', h, bytes)
+	frame = svxbee_mex('pack', data, destAddress64, isEscapedMode)
+	svxbee_mex('close', h)
+
+A handle keeps the decoder state and the partial line of every source between reads, so
+bytes can be passed as they arrive. lines are the complete lines received, without line
+breaks, and srcAddress64 the 16-digit hexadecimal addresses of their senders. MSerial uses
+this in XBeeAPI mode when it is built.
+
+Build with Satellites.BuildNative, or
+	mex -O svxbee.cpp svxbee_mex.cpp -outdir ..
+*/
+
+#include "mex.h"
+#include "svxbee.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+static const int maxNodes = 256;
+static const size_t maxLineLength = 4096;
+
+struct Link
+{
+	svxbee_decoder decoder;
+	svxbee_router* router;
+};
+
+static std::vector<Link*> links;
+
+struct Lines
+{
+	std::vector<std::string> text;
+	std::vector<uint64_t> src64;
+	svxbee_router* router;
+};
+
+static void closeAll()
+{
+	for (size_t i = 0; i < links.size(); i++)
+	{
+		if (links[i])
+			svxbee_router_destroy(links[i]->router);
+		delete links[i];
+	}
+	links.clear();
+}
+
+static Link* getLink(const mxArray* a)
+{
+	double h = mxIsNumeric(a) && mxGetNumberOfElements(a) == 1 ? mxGetScalar(a) : 0;
+	if (h < 1 || h > links.size() || !links[(size_t)h - 1])
+		mexErrMsgIdAndTxt("svxbee:input", "Invalid handle.");
+	return links[(size_t)h - 1];
+}
+
+static std::vector<uint8_t> getBytes(const mxArray* a)
+{
+	size_t n = mxGetNumberOfElements(a);
+	std::vector<uint8_t> bytes(n);
+	if (mxIsUint8(a) || mxIsInt8(a))
+	{
+		const uint8_t* p = (const uint8_t*)mxGetData(a);
+		bytes.assign(p, p + n);
+	}
+	else if (mxIsChar(a))
+	{
+		const mxChar* p = mxGetChars(a);
+		for (size_t i = 0; i < n; i++)
+			bytes[i] = (uint8_t)p[i];
+	}
+	else if (mxIsDouble(a))
+	{
+		const double* p = mxGetPr(a);
+		for (size_t i = 0; i < n; i++)
+			bytes[i] = (uint8_t)p[i];
+	}
+	else
+		mexErrMsgIdAndTxt("svxbee:input", "Bytes must be uint8, double or char.");
+	return bytes;
+}
+
+static void onLine(int, uint64_t src64, const char* line, size_t len, void* user)
+{
+	Lines* lines = (Lines*)user;
+	lines->text.push_back(std::string(line, len));
+	lines->src64.push_back(src64);
+}
+
+static void onFrame(const svxbee_frame* f, void* user)
+{
+	Lines* lines = (Lines*)user;
+	svxbee_router_route(lines->router, f, onLine, lines);
+}
+
+static void readLines(Link* link, int nlhs, mxArray* plhs[], const mxArray* bytesArray)
+{
+	std::vector<uint8_t> bytes = getBytes(bytesArray);
+
+	Lines lines;
+	lines.router = link->router;
+	svxbee_decode(&link->decoder, bytes.data(), bytes.size(), onFrame, &lines);
+
+	size_t n = lines.text.size();
+	plhs[0] = mxCreateCellMatrix(n, 1);
+	for (size_t i = 0; i < n; i++)
+		mxSetCell(plhs[0], i, mxCreateString(lines.text[i].c_str()));
+
+	if (nlhs > 1)
+	{
+		plhs[1] = mxCreateCellMatrix(n, 1);
+		char hex[17];
+		for (size_t i = 0; i < n; i++)
+		{
+			snprintf(hex, sizeof(hex), "%016llX", (unsigned long long)lines.src64[i]);
+			mxSetCell(plhs[1], i, mxCreateString(hex));
+		}
+	}
+}
+
+static mxArray* pack(int nrhs, const mxArray* prhs[])
+{
+	std::vector<uint8_t> data = getBytes(prhs[1]);
+
+	uint64_t dest64 = SVXBEE_BROADCAST64;
+	if (nrhs > 2 && mxIsChar(prhs[2]))
+	{
+		char* s = mxArrayToString(prhs[2]);
+		char* e;
+		dest64 = strtoull(s, &e, 16);
+		bool isValid = e - s == 16;
+		mxFree(s);
+		if (!isValid)
+			mexErrMsgIdAndTxt("svxbee:input", "The destination must be a 64-bit hexadecimal address, e.g. '0013A200408BAE30'.");
+	}
+	int isEscapedMode = nrhs > 3 ? mxGetScalar(prhs[3]) != 0 : 1;
+
+	std::vector<uint8_t> out(2 * (data.size() + 18) + 1);
+	size_t n = svxbee_encode_tx(dest64, SVXBEE_UNKNOWN16, 1, data.data(), data.size(), isEscapedMode, out.data(), out.size());
+	if (n == 0)
+		mexErrMsgIdAndTxt("svxbee:input", "The data is too long for a frame.");
+
+	mxArray* frame = mxCreateNumericMatrix(1, n, mxUINT8_CLASS, mxREAL);
+	memcpy(mxGetData(frame), out.data(), n);
+	return frame;
+}
+
+void mexFunction(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[])
+{
+	mexAtExit(closeAll);
+
+	if (nrhs < 1 || !mxIsChar(prhs[0]))
+		mexErrMsgIdAndTxt("svxbee:input", "Usage: svxbee_mex(command, ...)");
+
+	char* s = mxArrayToString(prhs[0]);
+	std::string cmd(s);
+	mxFree(s);
+
+	if (cmd == "open")
+	{
+		Link* link = new Link;
+		svxbee_decoder_init(&link->decoder, nrhs > 1 ? mxGetScalar(prhs[1]) != 0 : 1);
+		link->router = svxbee_router_create(maxNodes, maxLineLength);
+		links.push_back(link);
+		plhs[0] = mxCreateDoubleScalar((double)links.size());
+	}
+	else if (cmd == "read" && nrhs > 2)
+		readLines(getLink(prhs[1]), nlhs, plhs, prhs[2]);
+	else if (cmd == "pack" && nrhs > 1)
+		plhs[0] = pack(nrhs, prhs);
+	else if (cmd == "close" && nrhs > 1)
+	{
+		Link* link = getLink(prhs[1]);
+		svxbee_router_destroy(link->router);
+		delete link;
+		links[(size_t)mxGetScalar(prhs[1]) - 1] = NULL;
+	}
+	else
+		mexErrMsgIdAndTxt("svxbee:input", "Unknown command '%s'.", cmd.c_str());
+}
@@ -5,11 +5,12 @@ function SatelliteScopes(obj)
 % Declare runtime variables
 numChan = 4;
 dur = 3;
+numBins = 500;
 
 % Initialize figure and plots if absent
 if any(~isfield(obj.userData, {'svStream', 'figHandle', 'axesHandles', 'plotHandles'})) || ~ishandle(obj.userData.figHandle)
     % Create SerialViewerStream object to facilitate streaming
-    obj.userData.svStream = SerialViewerStream();
+    obj.userData.svStream = SerialViewerStream('ringCapacity', 2^20);
     
     % Create GUI
     obj.userData.figHandle = figure;
@@ -32,13 +33,14 @@ if obj.BeginWith('i')
     
     if mod(obj.userData.svStream.lastElementIdx, 10) == 0
         
-        val = obj.userData.svStream.GetLatestByTime(3);
+        % Plot the min and max of each bin so that the number of points stays fixed
+        [t, vMin, vMax] = obj.userData.svStream.GetEnvelopeByTime(dur, numBins);
         
-        if ~isempty(val)
-            t = val(:,1);
-            val = val(:,2:end);
+        if ~isempty(t)
+            tt = [t t]';
             for i = numChan : -1 : 1
-                set(obj.userData.plotHandles(i), 'XData', t, 'YData', val(:,i));
+                yy = [vMin(:,i) vMax(:,i)]';
+                set(obj.userData.plotHandles(i), 'XData', tt(:), 'YData', yy(:));
                 set(obj.userData.axesHandles(i), 'XLim', [t(end) - dur, t(end)]);
             end
         end